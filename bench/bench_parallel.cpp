@@ -0,0 +1,81 @@
+#include "jitome/jit.hpp"
+#include "jitome/parallel.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+// throughput of parallel_evaluate and parallel_reduce from 1 to N threads.
+//
+//   ./bench_parallel [rows] [max threads] [pin (0 or 1)]
+
+namespace
+{
+
+template<typename F>
+double best_seconds(F&& f, const int repeat = 5)
+{
+    double best = 1e300;
+    for(int i=0; i<repeat; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        const auto stop  = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(stop - start).count());
+    }
+    return best;
+}
+
+} // anonymous
+
+int main(int argc, char** argv)
+{
+    const std::size_t n   = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 50'000'000;
+    const std::size_t max = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) :
+                            std::max(1u, std::thread::hardware_concurrency());
+    const bool        pin = (argc > 3) && std::string(argv[3]) == "1";
+
+    const std::string code = "(a, b) {sqrt(a * a + b * b) * exp(0 - b)}";
+    jitome::JitBatchCompiler  f(code);
+    jitome::JitReduceCompiler g(code, jitome::Reduction::Sum);
+
+    // not initialized, so that first_touch places the pages
+    std::unique_ptr<double[]> a(new double[n]), b(new double[n]), out(new double[n]);
+
+    std::cout << "rows: " << n << ", lanes: " << f.lanes() << ", pin: " << pin << '\n';
+    std::cout << "threads\tevaluate[Mrows/s]\treduce[Mrows/s]\n";
+    for(std::size_t threads=1; threads<=max; threads = (threads < 4) ? threads + 1 : threads * 2)
+    {
+        jitome::ThreadPool pool(threads, pin);
+        if(threads == 1)
+        {
+            jitome::first_touch(pool, a.get(),   n);
+            jitome::first_touch(pool, b.get(),   n);
+            jitome::first_touch(pool, out.get(), n);
+            pool.run(jitome::chunk_count(n, jitome::default_chunk_rows), [&](const std::size_t i) {
+                const auto begin = i * jitome::default_chunk_rows;
+                const auto end   = std::min(n, begin + jitome::default_chunk_rows);
+                for(std::size_t j=begin; j<end; ++j)
+                {
+                    a[j] = 0.5 + 1e-6 * j;
+                    b[j] = 1.0 / (1.0 + j);
+                }
+            });
+        }
+        const double* columns[] = {a.get(), b.get()};
+
+        const double t_eval = best_seconds([&] {
+                jitome::parallel_evaluate(pool, f, columns, out.get(), n);
+            });
+        double sink = 0.0;
+        const double t_reduce = best_seconds([&] {
+                sink += jitome::parallel_reduce(pool, g, columns, n);
+            });
+        std::cout << threads << '\t' << n / t_eval * 1e-6 << '\t' << n / t_reduce * 1e-6
+                  << (sink == 0.0 ? "\t(zero)" : "") << '\n';
+    }
+    return 0;
+}
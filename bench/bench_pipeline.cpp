@@ -0,0 +1,430 @@
+#include "jitome/eval.hpp"
+#include "jitome/interpreter.hpp"
+#include "jitome/jit.hpp"
+#include "jitome/optimize.hpp"
+#include "jitome/parser.hpp"
+#include "jitome/static.hpp"
+#include "jitome/tokenizer.hpp"
+#include "perf_counters.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// cost of each stage of the pipeline and of a call, for a corpus of
+// generated functions and a few formulas with a hand-written C++ baseline.
+// The result is printed as JSON to track regressions.
+//
+//   ./bench_pipeline [seconds per measurement (0.05)] [rows (4096)]
+//
+// A stage is measured in ns per compilation. A call is measured in ns per
+// row, either by calling the scalar function row by row or by one batch call
+// over all the rows. The hardware counters are per compilation or per row,
+// and null if perf_event_open is not available.
+
+namespace
+{
+
+double budget_seconds = 0.05;
+volatile double sink  = 0.0; // keeps the results alive
+
+PerfCounters& counters()
+{
+    static PerfCounters pc;
+    return pc;
+}
+
+struct Measure
+{
+    double ns = 0.0;
+    std::array<std::optional<double>, PerfCounters::NumEvents> counters;
+};
+
+// calls f() until the budget passes (at least twice) after a warm-up call.
+// f() processes `units` compilations or rows.
+template<typename F>
+Measure measure(F&& f, const double units)
+{
+    using clock = std::chrono::steady_clock;
+    f();
+
+    std::size_t reps = 0;
+    double elapsed = 0.0;
+    counters().start();
+    const auto start = clock::now();
+    do
+    {
+        f();
+        reps += 1;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    }
+    while(elapsed < budget_seconds || reps < 2);
+    const auto values = counters().stop();
+
+    const double total = units * static_cast<double>(reps);
+    Measure m;
+    m.ns = elapsed * 1e9 / total;
+    for(std::size_t i=0; i<values.size(); ++i)
+    {
+        if(values[i]) {m.counters[i] = static_cast<double>(*values[i]) / total;}
+    }
+    return m;
+}
+
+std::string json(const std::optional<double>& v)
+{
+    if(!v)
+    {
+        return "null";
+    }
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.4g", *v);
+    return buf;
+}
+std::string json(const std::string& s)
+{
+    std::string retval("\"");
+    for(const char c : s)
+    {
+        if(c == '"' || c == '\\') {retval += '\\';}
+        retval += c;
+    }
+    return retval + "\"";
+}
+std::string json(const Measure& m, const bool rows)
+{
+    std::string retval = "{\"ns\": " + json(std::optional<double>(m.ns));
+    if(rows)
+    {
+        retval += ", \"rows_per_s\": " + json(std::optional<double>(1e9 / m.ns));
+    }
+    retval += ", \"cycles\": "       + json(m.counters[PerfCounters::Cycles]);
+    retval += ", \"instructions\": " + json(m.counters[PerfCounters::Instructions]);
+    retval += ", \"cache_misses\": " + json(m.counters[PerfCounters::CacheMisses]);
+    return retval + "}";
+}
+
+// ---------------------------------------------------------------------------
+// corpus
+
+struct Shape
+{
+    std::size_t nodes    = 0;
+    std::size_t depth    = 0;
+    std::size_t literals = 0;
+};
+
+Shape shape_of(const jitome::Node& node)
+{
+    return std::visit([](const auto& n) {
+        Shape s;
+        if constexpr (jitome::is_typeof<decltype(n), jitome::NodeImmediate>)
+        {
+            s.nodes = s.depth = s.literals = 1;
+        }
+        else if constexpr (jitome::is_typeof<decltype(n), jitome::NodeVariable>)
+        {
+            s.nodes = s.depth = 1;
+        }
+        else if constexpr (jitome::is_typeof<decltype(n), jitome::NodeExpression>)
+        {
+            s.nodes = 1;
+            for(const auto& operand : n.operands)
+            {
+                const auto c = shape_of(operand);
+                s.nodes    += c.nodes;
+                s.literals += c.literals;
+                s.depth     = std::max(s.depth, c.depth);
+            }
+            s.depth += 1;
+        }
+        else // the locals and the body of a function
+        {
+            std::vector<const jitome::Node*> children;
+            for(const auto& local : n.locals) {children.push_back(&local.value.get());}
+            children.push_back(&n.body.get());
+            for(const auto* child : children)
+            {
+                const auto c = shape_of(*child);
+                s.nodes    += c.nodes;
+                s.literals += c.literals;
+                s.depth     = std::max(s.depth, c.depth);
+            }
+        }
+        return s;
+    }, node.node);
+}
+
+// random expressions over x0, x1, ... with a fixed seed, so the corpus is
+// the same in every run. A subtree stops early with probability 1/4, so
+// that the trees of the same depth have different shapes.
+class Generator
+{
+  public:
+
+    Generator(const std::size_t arity, const double literals, const std::uint64_t seed)
+        : arity_(arity), literals_(literals), rng_(seed)
+    {}
+
+    std::string function(const std::size_t depth)
+    {
+        std::string code = "(";
+        for(std::size_t i=0; i<arity_; ++i)
+        {
+            code += (i == 0 ? "x" : ", x") + std::to_string(i);
+        }
+        return code + ") {" + expr(depth, true) + "}";
+    }
+
+  private:
+
+    std::string leaf()
+    {
+        if(uniform_(rng_) < literals_)
+        {
+            char buf[16];
+            std::snprintf(buf, sizeof(buf), "%.3f", 0.5 + 1.5 * uniform_(rng_));
+            return buf;
+        }
+        return "x" + std::to_string(rng_() % arity_);
+    }
+
+    std::string expr(const std::size_t depth, const bool root = false)
+    {
+        if(depth == 0 || (!root && rng_() % 4 == 0))
+        {
+            return leaf();
+        }
+        const auto lhs = expr(depth - 1);
+        switch(rng_() % 10)
+        {
+            case 0: case 1: case 2: {return "(" + lhs + " + " + expr(depth - 1) + ")";}
+            case 3:                 {return "(" + lhs + " - " + expr(depth - 1) + ")";}
+            case 4: case 5:         {return lhs + " * " + expr(depth - 1);}
+            case 6:                 {return lhs + " / (" + expr(depth - 1) + ")";}
+            case 7:                 {return "min(" + lhs + ", " + expr(depth - 1) + ")";}
+            case 8:                 {return "sqrt(abs(" + lhs + "))";}
+            default:                {return "(" + lhs + ")^2";}
+        }
+    }
+
+  private:
+
+    std::size_t                            arity_;
+    double                                 literals_;
+    std::mt19937_64                        rng_;
+    std::uniform_real_distribution<double> uniform_{0.0, 1.0};
+};
+
+// ---------------------------------------------------------------------------
+// benchmark of a function
+
+template<std::size_t I>
+using arg_type = double;
+
+// the scalar function types of N arguments
+template<typename Seq>
+struct Signature;
+template<std::size_t ... Is>
+struct Signature<std::index_sequence<Is...>>
+{
+    using jit         = jitome::JitCompiler<double(arg_type<Is>...)>;
+    using interpreter = jitome::Interpreter<double, arg_type<Is>...>;
+};
+
+struct Columns
+{
+    explicit Columns(const std::size_t n): rows(n), out(n)
+    {
+        for(std::size_t j=0; j<data.size(); ++j)
+        {
+            data[j].resize(n);
+            for(std::size_t i=0; i<n; ++i)
+            {
+                data[j][i] = 1.0 + 0.001 * static_cast<double>((i * (j + 3)) % 1000);
+            }
+            ptrs[j] = data[j].data();
+        }
+    }
+    std::size_t                           rows;
+    std::array<std::vector<double>, 4>    data;
+    std::array<const double*, 4>          ptrs;
+    std::vector<double>                   out;
+};
+
+// a loop that a user would write. The columns are copied to a local array
+// so that the compiler knows that `out` does not overwrite them.
+template<std::size_t ... Is, typename F>
+void apply_rows(std::index_sequence<Is...>, F&& f, const Columns& cols, double* out)
+{
+    const std::array<const double*, sizeof...(Is)> c = {{cols.ptrs[Is]...}};
+    for(std::size_t i=0; i<cols.rows; ++i)
+    {
+        out[i] = f(c[Is][i]...);
+    }
+}
+
+struct NoBaseline {};
+
+template<std::size_t N, typename Static = NoBaseline, typename Cpp = NoBaseline>
+void bench_function(const std::string& name, const std::string& code, const Columns& cols,
+                    const bool last, const Static& static_f = {}, const Cpp& cpp = {})
+{
+    using seq         = std::make_index_sequence<N>;
+    using jit         = typename Signature<seq>::jit;
+    using interpreter = typename Signature<seq>::interpreter;
+    const double rows = static_cast<double>(cols.rows);
+    double* out = const_cast<double*>(cols.out.data());
+
+    const auto root  = jitome::parse(jitome::tokenize(code).as_val()).as_val();
+    const auto func  = std::get<jitome::NodeFunction>(jitome::simplify(root).node);
+    const auto shape = shape_of(root);
+
+    std::cout << "    {\"name\": " << json(name) << ", \"code\": " << json(code)
+              << ", \"arity\": " << N << ", \"nodes\": " << shape.nodes
+              << ", \"depth\": " << shape.depth << ", \"literals\": " << shape.literals << ",\n";
+
+    // ns per compilation
+    std::vector<std::pair<std::string, Measure>> stages;
+    stages.emplace_back("tokenize", measure([&] {sink = jitome::tokenize(code).as_val().size();}, 1));
+    const auto tokens = jitome::tokenize(code).as_val();
+    stages.emplace_back("parse", measure([&] {sink = jitome::parse(tokens).is_ok();}, 1));
+    stages.emplace_back("simplify", measure([&] {sink = jitome::simplify(root).node.index();}, 1));
+    stages.emplace_back("lower", measure([&] {sink = jitome::lower(func).code.size();}, 1));
+    stages.emplace_back("interpreter", measure([&] {
+            interpreter f(root);
+            sink = f.merged();
+        }, 1));
+    stages.emplace_back("jit", measure([&] {
+            jit f(code);
+            sink = f.getSize();
+        }, 1));
+    stages.emplace_back("jit_batch", measure([&] {
+            jitome::JitBatchCompiler f(code);
+            sink = f.getSize();
+        }, 1));
+
+    // ns per row
+    std::vector<std::pair<std::string, Measure>> calls;
+    {
+        std::map<std::string, double> env;
+        std::array<double*, N> slots{};
+        const auto& args = std::get<jitome::NodeFunction>(root.node).args;
+        for(std::size_t j=0; j<N; ++j)
+        {
+            slots[j] = &env[args.at(j)];
+        }
+        calls.emplace_back("evaluate", measure([&] {
+                double s = 0.0;
+                for(std::size_t i=0; i<cols.rows; ++i)
+                {
+                    for(std::size_t j=0; j<N; ++j) {*slots[j] = cols.ptrs[j][i];}
+                    s += jitome::evaluate(env, root);
+                }
+                sink = s;
+            }, rows));
+    }
+    {
+        interpreter f(root);
+        calls.emplace_back("interpreter", measure([&] {apply_rows(seq{}, f, cols, out);}, rows));
+    }
+    {
+        const jit f(code);
+        const auto fp = f.get_func_ptr();
+        calls.emplace_back("jit", measure([&] {apply_rows(seq{}, fp, cols, out);}, rows));
+
+        const jitome::JitBatchCompiler batch(code);
+        calls.emplace_back("jit_batch", measure([&] {batch(cols.ptrs.data(), out, cols.rows);}, rows));
+    }
+    if constexpr (!std::is_same_v<Static, NoBaseline>)
+    {
+        calls.emplace_back("static", measure([&] {apply_rows(seq{}, static_f, cols, out);}, rows));
+    }
+    if constexpr (!std::is_same_v<Cpp, NoBaseline>)
+    {
+        calls.emplace_back("cpp", measure([&] {apply_rows(seq{}, cpp, cols, out);}, rows));
+    }
+    sink = out[cols.rows / 2];
+
+    const auto print = [](const auto& ms, const bool per_row) {
+        for(std::size_t i=0; i<ms.size(); ++i)
+        {
+            std::cout << "        " << json(ms[i].first) << ": " << json(ms[i].second, per_row)
+                      << (i + 1 < ms.size() ? ",\n" : "\n");
+        }
+    };
+    std::cout << "      \"compile\": {\n";
+    print(stages, false);
+    std::cout << "      },\n      \"call\": {\n";
+    print(calls, true);
+    std::cout << "      }}" << (last ? "\n" : ",\n");
+}
+
+} // anonymous
+
+// a formula that is also written in C++ and compiled by StaticFunction
+#define JITOME_BENCH_BASELINE(name, arity, code, last, ...)                        \
+    bench_function<arity>(name, code, cols, last, JITOME_STATIC_FUNCTION(code), \
+                          __VA_ARGS__)
+
+int main(int argc, char** argv)
+{
+    budget_seconds = (argc > 1) ? std::strtod(argv[1], nullptr) : 0.05;
+    const std::size_t rows = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 4096;
+    const Columns cols(std::max<std::size_t>(rows, 1));
+
+    std::cout << "{\n  \"isa\": " << json(std::string(jitome::to_string(jitome::host_isa())))
+              << ",\n  \"rows\": " << cols.rows << ",\n  \"seconds\": " << budget_seconds
+              << ",\n  \"counters\": {\"cycles\": "
+              << std::boolalpha << counters().available(PerfCounters::Cycles)
+              << ", \"instructions\": " << counters().available(PerfCounters::Instructions)
+              << ", \"cache_misses\": " << counters().available(PerfCounters::CacheMisses)
+              << "},\n  \"functions\": [\n";
+
+    JITOME_BENCH_BASELINE("polynomial", 1, "(x) {((2.5 * x - 1.5) * x + 0.5) * x - 3}", false,
+        [](double x) {return ((2.5 * x - 1.5) * x + 0.5) * x - 3;});
+    JITOME_BENCH_BASELINE("norm", 2, "(a, b) {sqrt(a * a + b * b) * exp(0 - b)}", false,
+        [](double a, double b) {return std::sqrt(a * a + b * b) * std::exp(0 - b);});
+    JITOME_BENCH_BASELINE("piecewise", 2, "(x, k) {x < k ? x * x : k * (2 * x - k)}", false,
+        [](double x, double k) {return x < k ? x * x : k * (2 * x - k);});
+    JITOME_BENCH_BASELINE("locals", 3, "(a, b, c) { t = a * b + c; return t * t - t / c; }", false,
+        [](double a, double b, double c) {const double t = a * b + c; return t * t - t / c;});
+
+    const std::array<std::size_t, 3> arities  = {{1, 2, 4}};
+    const std::array<std::size_t, 4> depths   = {{2, 4, 6, 8}};
+    const std::array<double, 2>      literals = {{0.1, 0.5}};
+    std::size_t count = 0;
+    const std::size_t total = arities.size() * depths.size() * literals.size();
+    for(const auto arity : arities)
+    {
+        for(const auto literal : literals)
+        {
+            Generator gen(arity, literal, 42 + count);
+            for(const auto depth : depths)
+            {
+                char name[64];
+                std::snprintf(name, sizeof(name), "a%zu-d%zu-l%.1f", arity, depth, literal);
+                const auto code = gen.function(depth);
+                const bool last = (++count == total);
+                switch(arity)
+                {
+                    case 1:  {bench_function<1>(name, code, cols, last); break;}
+                    case 2:  {bench_function<2>(name, code, cols, last); break;}
+                    default: {bench_function<4>(name, code, cols, last); break;}
+                }
+            }
+        }
+    }
+    std::cout << "  ]\n}\n";
+    return 0;
+}
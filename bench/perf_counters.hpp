@@ -0,0 +1,91 @@
+#ifndef JITOME_BENCH_PERF_COUNTERS_HPP
+#define JITOME_BENCH_PERF_COUNTERS_HPP
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+// hardware counters of the calling thread by perf_event_open(2), in user
+// space only. Each event is opened on its own, so a CPU or a virtual machine
+// that lacks one of them still reports the others. If the kernel does not
+// allow them at all (perf_event_paranoid, seccomp in a container), every
+// event is unavailable and stop() returns std::nullopt for it.
+class PerfCounters
+{
+  public:
+
+    enum Event : std::size_t {Cycles, Instructions, CacheMisses, NumEvents};
+
+    using values_type = std::array<std::optional<std::uint64_t>, NumEvents>;
+
+    PerfCounters()
+    {
+        const std::array<std::uint64_t, NumEvents> configs = {{
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+        }};
+        for(std::size_t i=0; i<NumEvents; ++i)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type           = PERF_TYPE_HARDWARE;
+            attr.size           = sizeof(attr);
+            attr.config         = configs[i];
+            attr.disabled       = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv     = 1;
+            fds_[i] = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+    }
+    ~PerfCounters()
+    {
+        for(const int fd : fds_)
+        {
+            if(fd >= 0) {::close(fd);}
+        }
+    }
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available(const Event e) const noexcept {return fds_[e] >= 0;}
+
+    void start() const noexcept
+    {
+        for(const int fd : fds_)
+        {
+            if(fd >= 0)
+            {
+                ::ioctl(fd, PERF_EVENT_IOC_RESET,  0);
+                ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+    values_type stop() const noexcept
+    {
+        values_type values;
+        for(std::size_t i=0; i<NumEvents; ++i)
+        {
+            if(fds_[i] < 0)
+            {
+                continue;
+            }
+            ::ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+            std::uint64_t count = 0;
+            if(::read(fds_[i], &count, sizeof(count)) == static_cast<ssize_t>(sizeof(count)))
+            {
+                values[i] = count;
+            }
+        }
+        return values;
+    }
+
+  private:
+
+    std::array<int, NumEvents> fds_ = {{-1, -1, -1}};
+};
+
+#endif// JITOME_BENCH_PERF_COUNTERS_HPP
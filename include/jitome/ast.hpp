@@ -88,17 +88,43 @@ inline std::string dump(const NodeExpression& node)
     return retval;
 }
 
+// `name = value;` in a function body. A local can be assigned again, and
+// later statements see the last value.
+struct NodeLocal
+{
+    std::string                    name;
+    copyable_dynamic_storage<Node> value;
+
+    bool operator==(const NodeLocal& other) const noexcept
+    {
+        return this->name == other.name && this->value == other.value;
+    }
+    bool operator!=(const NodeLocal& other) const noexcept
+    {
+        return !(*this == other);
+    }
+};
+
+inline std::string dump(const NodeLocal& node)
+{
+    return std::string("Local{") + node.name + ", " + dump(node.value) + "}";
+}
+
+// `(a, b) {t = a * b; return t * t;}` has a local `t` that is assigned
+// before the body, the returned expression.
 struct NodeFunction
 {
     std::string                    name;
     std::vector<std::string>       args;
     copyable_dynamic_storage<Node> body;
+    std::vector<NodeLocal>         locals = {};
 
     bool operator==(const NodeFunction& other) const noexcept
     {
-        return this->name == other.name &&
-               this->args == other.args &&
-               this->body == other.body ;
+        return this->name   == other.name &&
+               this->args   == other.args &&
+               this->body   == other.body &&
+               this->locals == other.locals;
     }
     bool operator!=(const NodeFunction& other) const noexcept
     {
@@ -119,6 +145,11 @@ inline std::string dump(const NodeFunction& node)
         front = false;
     }
     retval += ") {";
+    for(const auto& local : node.locals)
+    {
+        retval += dump(local);
+        retval += "; ";
+    }
     retval += dump(node.body);
     retval += "}";
     return retval;
@@ -0,0 +1,123 @@
+#ifndef JITOME_BUILTIN_HPP
+#define JITOME_BUILTIN_HPP
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace jitome
+{
+
+// Builtin functions that can be called in an expression, e.g. `sqrt(x*x + 1)`.
+//
+// The JIT emits sqrt, abs, min and max as single instructions, sign as two
+// comparisons, and select and clamp without branches. exp, log, sin
+// and cos are expanded inline into polynomial approximations that work in
+// packed code as well (see Lowering in ir.hpp). Compared to the C library,
+//
+// - exp: at most 1 ulp. Overflows to inf and underflows to 0 correctly.
+// - log: at most 1 ulp, including subnormal arguments. log(0) is -inf and
+//        log(x) for x < 0 is NaN.
+// - sin, cos: at most 2 ulp. The argument is reduced by Cody-Waite for
+//        |x| < 1e6 and by Payne-Hanek beyond that (see payne_hanek.hpp),
+//        which takes a scalar path for the lanes out of range.
+//
+// In single precision, exp is within 2 ulp, log 1 ulp and sin and cos 3 ulp
+// (Payne-Hanek beyond |x| = 4096).
+//
+// evaluate() and Interpreter use the C library, so they are the reference of
+// the JIT.
+
+struct Builtin
+{
+    std::string_view name;
+    std::size_t      arity;
+};
+
+inline constexpr std::array<Builtin, 11> builtins = {{
+    {"sqrt", 1}, {"abs", 1}, {"min", 2}, {"max", 2},
+    {"exp",  1}, {"log", 1}, {"sin", 1}, {"cos", 1},
+    {"sign", 1}, {"select", 3}, {"clamp", 3},
+}};
+
+// the largest arity in the table
+inline constexpr std::size_t max_builtin_arity = 3;
+
+// The name of a NodeExpression refers to the name in the table, so that it
+// outlives the source code.
+constexpr const Builtin* find_builtin(const std::string_view name) noexcept
+{
+    for(const auto& builtin : builtins)
+    {
+        if(builtin.name == name)
+        {
+            return &builtin;
+        }
+    }
+    return nullptr;
+}
+
+// min and max follow minsd and maxsd: if one of them is NaN, the second one
+// is returned. sign(x) is 1 or -1, and x itself if it is 0, -0 or NaN.
+// select(c, a, b) is a if c is not 0 (NaN is true), otherwise b.
+// clamp(x, lo, hi) is min(max(x, lo), hi), so it is lo if x is NaN.
+inline double call_builtin(const std::string_view name, const double* args)
+{
+    using namespace std::literals::string_view_literals;
+    if(name == "sqrt"sv) {return std::sqrt(args[0]);}
+    if(name == "abs"sv ) {return std::fabs(args[0]);}
+    if(name == "min"sv ) {return args[0] < args[1] ? args[0] : args[1];}
+    if(name == "max"sv ) {return args[0] > args[1] ? args[0] : args[1];}
+    if(name == "exp"sv ) {return std::exp(args[0]);}
+    if(name == "log"sv ) {return std::log(args[0]);}
+    if(name == "sin"sv ) {return std::sin(args[0]);}
+    if(name == "cos"sv ) {return std::cos(args[0]);}
+    if(name == "sign"sv) {return 0.0 < args[0] ? 1.0 : args[0] < 0.0 ? -1.0 : args[0];}
+    if(name == "select"sv) {return args[0] != 0.0 ? args[1] : args[2];}
+    if(name == "clamp"sv)
+    {
+        const double m = args[0] > args[1] ? args[0] : args[1];
+        return m < args[2] ? m : args[2];
+    }
+    throw std::runtime_error("jitome: unknown function: " + std::string(name));
+}
+
+// Comparison and logical operators. They return 1 or 0, and any value other
+// than 0 is true. Comparisons with NaN are false, except for `!=`, as in C.
+//
+// The JIT keeps a condition as a mask of all-one bits while it is used by
+// `&&`, `||` and select(), and converts it to 1 or 0 only if it is used as
+// a number.
+inline bool is_comparison(const std::string_view f) noexcept
+{
+    using namespace std::literals::string_view_literals;
+    return f == "<"sv || f == "<="sv || f == ">"sv || f == ">="sv || f == "=="sv || f == "!="sv;
+}
+inline bool is_logical(const std::string_view f) noexcept
+{
+    using namespace std::literals::string_view_literals;
+    return f == "&&"sv || f == "||"sv;
+}
+
+inline double call_operator(const std::string_view f, const double lhs, const double rhs)
+{
+    using namespace std::literals::string_view_literals;
+    bool retval = false;
+    if     (f == "<"sv ) {retval = lhs <  rhs;}
+    else if(f == "<="sv) {retval = lhs <= rhs;}
+    else if(f == ">"sv ) {retval = lhs >  rhs;}
+    else if(f == ">="sv) {retval = lhs >= rhs;}
+    else if(f == "=="sv) {retval = lhs == rhs;}
+    else if(f == "!="sv) {retval = lhs != rhs;}
+    else if(f == "&&"sv) {retval = lhs != 0.0 && rhs != 0.0;}
+    else if(f == "||"sv) {retval = lhs != 0.0 || rhs != 0.0;}
+    else
+    {
+        throw std::runtime_error("jitome: unknown operator: " + std::string(f));
+    }
+    return retval ? 1.0 : 0.0;
+}
+
+} // jitome
+#endif// JITOME_BUILTIN_HPP
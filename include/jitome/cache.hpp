@@ -0,0 +1,280 @@
+#ifndef JITOME_CACHE_HPP
+#define JITOME_CACHE_HPP
+#include "ast.hpp"
+#include "jit.hpp"
+#include "optimize.hpp"
+#include "parser.hpp"
+#include "tokenizer.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace jitome
+{
+
+// ---------------------------------------------------------------------------
+// canonical form
+//
+// A string that identifies a function up to the names of the function and
+// its arguments, and the order of the operands of `+` and `*`.
+//
+//   (a, b) {b + a * 2} -> ($0,$1){+($1,*($0,#4000000000000000))}
+//   (x, y) {y + 2 * x} -> the same
+//
+// Locals are numbered by the order of the assignments.
+//
+// Immediates are written by their bit pattern so that 0.0 and -0.0 differ.
+
+struct Canonicalizer
+{
+    std::map<std::string, std::size_t> args;
+    std::map<std::string, std::size_t> locals; // name -> index of the last assignment
+
+    std::string operator()(const Node& node) const
+    {
+        return std::visit([this](const auto& n) {return (*this)(n);}, node.node);
+    }
+    std::string operator()(const NodeVariable& node) const
+    {
+        if(const auto local = locals.find(node.name); local != locals.end())
+        {
+            return "%" + std::to_string(local->second);
+        }
+        const auto found = args.find(node.name);
+        if(found == args.end())
+        {
+            return "?" + node.name; // unknown variable. it will fail later
+        }
+        return "$" + std::to_string(found->second);
+    }
+    std::string operator()(const NodeImmediate& node) const
+    {
+        constexpr char digits[] = "0123456789abcdef";
+        const auto bits = bit_cast<std::uint64_t>(node.value);
+
+        std::string retval("#");
+        for(int shift = 60; 0 <= shift; shift -= 4)
+        {
+            retval += digits[(bits >> shift) & 0xF];
+        }
+        return retval;
+    }
+    std::string operator()(const NodeExpression& node) const
+    {
+        using namespace std::literals::string_view_literals;
+
+        std::vector<std::string> operands;
+        for(const auto& operand : node.operands)
+        {
+            operands.push_back((*this)(operand));
+        }
+        if(node.function == "+"sv || node.function == "*"sv)
+        {
+            std::sort(operands.begin(), operands.end());
+        }
+
+        std::string retval(node.function);
+        retval += "(";
+        for(std::size_t i=0; i<operands.size(); ++i)
+        {
+            if(i != 0) {retval += ",";}
+            retval += operands.at(i);
+        }
+        retval += ")";
+        return retval;
+    }
+    std::string operator()(const NodeFunction& node) const
+    {
+        Canonicalizer inner;
+        std::string retval("(");
+        for(std::size_t i=0; i<node.args.size(); ++i)
+        {
+            inner.args[node.args.at(i)] = i;
+            if(i != 0) {retval += ",";}
+            retval += "$" + std::to_string(i);
+        }
+        retval += "){";
+        for(std::size_t i=0; i<node.locals.size(); ++i)
+        {
+            const auto& local = node.locals.at(i);
+            retval += "%" + std::to_string(i) + "=" + inner(local.value.get()) + ";";
+            inner.locals[local.name] = i;
+        }
+        retval += inner(node.body.get());
+        retval += "}";
+        return retval;
+    }
+};
+
+inline std::string canonicalize(const Node& node)
+{
+    return Canonicalizer{}(node);
+}
+
+// ---------------------------------------------------------------------------
+// JitCache
+//
+// Compiled functions keyed by the canonical form of the simplified AST, the
+// type of the compiler and the options. Identical functions share one
+// JitCompiler.
+//
+// The cache keeps at most `capacity` functions and evicts the least recently
+// used one. An evicted function is still alive while someone has it.
+//
+// All the member functions are thread-safe. The compilation is done outside
+// of the lock, so a function might be compiled twice when two threads ask
+// for it at the same time. In that case, the first one is kept.
+
+struct CacheStats
+{
+    std::size_t hits      = 0;
+    std::size_t misses    = 0;
+    std::size_t evictions = 0;
+    std::size_t size      = 0;
+    std::size_t capacity  = 0;
+};
+
+class JitCache
+{
+  public:
+
+    explicit JitCache(std::size_t capacity = 4096)
+        : capacity_(capacity)
+    {
+        if(capacity_ == 0)
+        {
+            throw std::invalid_argument("jitome::JitCache: capacity must be positive");
+        }
+    }
+
+    template<typename F>
+    std::shared_ptr<const JitCompiler<F>>
+    compile(const std::string& code, const CompileOptions& options = CompileOptions{})
+    {
+        return this->compile<F>(parse_code(code), options);
+    }
+    template<typename F>
+    std::shared_ptr<const JitCompiler<F>>
+    compile(Node root, const CompileOptions& options = CompileOptions{})
+    {
+        return this->get_or_compile<JitCompiler<F>>(std::move(root), options);
+    }
+
+    std::shared_ptr<const JitBatchCompiler>
+    compile_batch(const std::string& code, const CompileOptions& options = CompileOptions{})
+    {
+        return this->compile_batch(parse_code(code), options);
+    }
+    std::shared_ptr<const JitBatchCompiler>
+    compile_batch(Node root, const CompileOptions& options = CompileOptions{})
+    {
+        return this->get_or_compile<JitBatchCompiler>(std::move(root), options);
+    }
+
+    CacheStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        CacheStats s = stats_;
+        s.size     = entries_.size();
+        s.capacity = capacity_;
+        return s;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        entries_.clear();
+        index_.clear();
+    }
+
+  private:
+
+    struct Entry
+    {
+        std::string                           key;
+        std::shared_ptr<Xbyak::CodeGenerator> compiled;
+    };
+
+    static Node parse_code(const std::string& code)
+    {
+        auto tks = tokenize(code);
+        if(tks.is_err())
+        {
+            throw std::runtime_error(tks.as_err().msg);
+        }
+        auto prs = parse(tks.as_val());
+        if(prs.is_err())
+        {
+            throw std::runtime_error(prs.as_err().msg);
+        }
+        return std::move(prs.as_val());
+    }
+
+    template<typename Compiler>
+    std::shared_ptr<const Compiler> get_or_compile(Node root, const CompileOptions& options)
+    {
+        root = simplify(std::move(root));
+        const auto key = std::string(typeid(Compiler).name()) + ":" + dump(options) + ":" +
+                         canonicalize(root);
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            const auto found = index_.find(key);
+            if(found != index_.end())
+            {
+                stats_.hits += 1;
+                entries_.splice(entries_.begin(), entries_, found->second);
+                return std::static_pointer_cast<const Compiler>(found->second->compiled);
+            }
+            stats_.misses += 1;
+        }
+
+        std::shared_ptr<Xbyak::CodeGenerator> compiled =
+            std::make_shared<Compiler>(std::move(root), options);
+
+        std::lock_guard<std::mutex> lock(mtx_);
+        const auto found = index_.find(key);
+        if(found != index_.end()) // another thread compiled it first
+        {
+            entries_.splice(entries_.begin(), entries_, found->second);
+            return std::static_pointer_cast<const Compiler>(found->second->compiled);
+        }
+        entries_.push_front(Entry{key, std::move(compiled)});
+        index_.emplace(key, entries_.begin());
+        while(capacity_ < entries_.size())
+        {
+            index_.erase(entries_.back().key);
+            entries_.pop_back();
+            stats_.evictions += 1;
+        }
+        return std::static_pointer_cast<const Compiler>(entries_.front().compiled);
+    }
+
+  private:
+
+    mutable std::mutex mtx_;
+    std::size_t        capacity_;
+    CacheStats         stats_;
+    std::list<Entry>   entries_; // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+};
+
+// the process-wide cache
+inline JitCache& global_jit_cache()
+{
+    static JitCache cache;
+    return cache;
+}
+
+} // jitome
+#endif// JITOME_CACHE_HPP
@@ -0,0 +1,1026 @@
+#ifndef JITOME_CODEGEN_HPP
+#define JITOME_CODEGEN_HPP
+#include "ir.hpp"
+#include "isa.hpp"
+#include "payne_hanek.hpp"
+#include "regalloc.hpp"
+#include "util.hpp"
+#include "xbyak.h"
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace jitome
+{
+
+// Constants used in the generated code. They are deduplicated by their bit
+// pattern and placed after the code so that instructions can refer them with
+// rip-relative addressing, e.g. `mulsd xmm0, [rip + c]`.
+//
+// Each entry is filled with copies of the value and aligned to its size, so
+// it can be used as a memory operand of a packed instruction. Entries are 16
+// bytes for SSE (xorpd requires 16 byte aligned memory) and 32 bytes for
+// ymm. AVX-512 code reads them with an embedded broadcast. Entries are keyed
+// by the bit pattern of the value (Instruction::bits). In single precision,
+// the lower 32 bits are written.
+//
+// The table of 2/pi for Reduce is placed after the entries if it is used.
+struct ConstantPool
+{
+    explicit ConstantPool(std::size_t entry = 16, Precision precision = Precision::Double)
+        : entry_(entry), precision_(precision)
+    {}
+
+    Xbyak::Label& label(const std::uint64_t bits)
+    {
+        return labels_[bits];
+    }
+
+    // two_over_pi in payne_hanek.hpp
+    Xbyak::Label& two_over_pi()
+    {
+        table_used_ = true;
+        return table_;
+    }
+
+    std::size_t size()  const noexcept {return labels_.size() + (table_used_ ? 1 : 0);}
+    std::size_t entry() const noexcept {return entry_;}
+
+    void emit(Xbyak::CodeGenerator& gen)
+    {
+        if(this->size() == 0)
+        {
+            return;
+        }
+        gen.align(entry_);
+        for(auto& [bits, label] : labels_)
+        {
+            gen.L(label);
+            if(precision_ == Precision::Single)
+            {
+                const auto v = static_cast<std::uint32_t>(bits);
+                for(std::size_t i=0; i < entry_ / sizeof(std::uint32_t); ++i)
+                {
+                    gen.dd(v);
+                }
+                continue;
+            }
+            for(std::size_t i=0; i < entry_ / sizeof(std::uint64_t); ++i)
+            {
+                gen.dq(bits);
+            }
+        }
+        if(table_used_)
+        {
+            gen.L(table_);
+            for(const auto word : jitome::two_over_pi)
+            {
+                gen.dq(word);
+            }
+        }
+    }
+
+  private:
+
+    std::size_t                           entry_;
+    Precision                             precision_;
+    std::map<std::uint64_t, Xbyak::Label> labels_;
+    Xbyak::Label                          table_;
+    bool                                  table_used_ = false;
+};
+
+// types of the arguments and the result in registers or memory. If they
+// differ from the precision of the Program, they are converted when loaded
+// and stored. Only a double precision Program can have float data.
+struct DataTypes
+{
+    Precision arguments = Precision::Double;
+    Precision result    = Precision::Double;
+
+    // a Program computes in single precision only if all the data is float
+    constexpr Precision compute() const noexcept
+    {
+        return (arguments == Precision::Single && result == Precision::Single) ?
+            Precision::Single : Precision::Double;
+    }
+    // arguments should be loaded into a register to be converted
+    constexpr bool converts_arguments() const noexcept {return arguments != this->compute();}
+    constexpr bool converts_result()    const noexcept {return result    != this->compute();}
+};
+
+// Layout of an array of structs: the k-th argument of the i-th row is the
+// double at `base + i * stride + offsets[k]` in bytes.
+struct RowLayout
+{
+    std::size_t              stride = sizeof(double);
+    std::vector<std::size_t> offsets;
+
+    // the rows are doubles next to each other, so packed loads can be used
+    bool contiguous() const noexcept {return stride == sizeof(double);}
+};
+
+// Translates an allocated Program into x86-64 instructions.
+//
+// The same Allocation can be emitted with different vector widths. The batch
+// kernel uses it for both the packed loop and the scalar loop for the rest.
+struct Emitter
+{
+    enum class Arguments : std::uint8_t
+    {
+        Registers, // System V ABI. 9th and later arguments are on the stack.
+        Columns,   // rdi points an array of columns, rcx is the row index.
+        Rows,      // r9 points the current row in a RowLayout.
+    };
+    // Output instructions write into the array pointed by rdi (Registers) or
+    // into the columns pointed by the array at rsi (Columns and Rows).
+
+    // lanes: 1 (scalar) or the number of values in a ymm or zmm register
+    // isa:   resolved instruction set. AVX and AVX512 use VEX/EVEX encoded
+    //        three-operand instructions, and AVX512 uses rcp14 and rsqrt14
+    //        for scalar values as well, so they match the packed lanes.
+    // slot:  size of a spill slot in bytes. Slots are placed at [rsp].
+    // pool:  constants used in the code. It should be emitted after the code.
+    // rows:  layout of the rows for Arguments::Rows.
+    //
+    // A packed Emitter with strided rows gathers the arguments. With AVX-512,
+    // zmm31 should hold the offsets of the rows, {0, stride, 2 * stride, ...}.
+    // With AVX, xmm15 is used as a temporary and should not be allocated.
+    Emitter(Xbyak::CodeGenerator& gen, const Program& prog, ConstantPool& pool,
+            Arguments args, std::size_t lanes, Isa isa, std::size_t slot,
+            DataTypes types = DataTypes{}, const RowLayout* rows = nullptr)
+        : gen_(gen), prog_(prog), pool_(pool), args_(args), lanes_(lanes),
+          vex_(isa == Isa::AVX || isa == Isa::AVX512), evex_(isa == Isa::AVX512),
+          slot_(slot), types_(types), rows_(rows),
+          single_(prog.precision == Precision::Single)
+    {
+        if(isa == Isa::Auto)
+        {
+            throw std::runtime_error("jitome::Emitter: Isa::Auto should be resolved");
+        }
+        if(args_ == Arguments::Rows && (!rows_ || rows_->offsets.size() != prog.arity ||
+                                        types_.arguments != Precision::Double))
+        {
+            throw std::runtime_error("jitome::Emitter: invalid layout of rows");
+        }
+        if(lanes_ != 1 && !vex_)
+        {
+            throw std::runtime_error("jitome::Emitter: packed code requires AVX");
+        }
+        if(this->bytes() == 32 && pool_.entry() < 32)
+        {
+            throw std::runtime_error("jitome::Emitter: constant pool entry is too small");
+        }
+        if(prog.precision != types.compute())
+        {
+            throw std::runtime_error("jitome::Emitter: precision of the program does not match");
+        }
+    }
+
+    void emit(const Allocation& alloc)
+    {
+        for(const auto& op : alloc.ops)
+        {
+            switch(op.kind)
+            {
+                case MachineOp::Kind::Load   : {this->load   (op); break;}
+                case MachineOp::Kind::Store  : {this->store  (op); break;}
+                case MachineOp::Kind::Move   : {this->move   (op); break;}
+                case MachineOp::Kind::Compute: {this->compute(op); break;}
+            }
+        }
+    }
+
+    // vector register with the width of this emitter
+    Xbyak::Xmm vreg(const std::size_t idx) const
+    {
+        const int i = static_cast<int>(idx);
+        switch(this->bytes())
+        {
+            case 64: {return Xbyak::Zmm(i);}
+            case 32: {return Xbyak::Ymm(i);}
+            default: {return Xbyak::Xmm(i);}
+        }
+    }
+    // size of the values in a register in bytes
+    std::size_t bytes() const noexcept {return lanes_ * size_of(prog_.precision);}
+
+    // copy a register. Scalar values are also copied by movapd to avoid the
+    // dependency on the upper half of the destination.
+    void copy(const Xbyak::Xmm& dst, const Xbyak::Xmm& src)
+    {
+        if(dst.getIdx() == src.getIdx())
+        {
+            return;
+        }
+        if(vex_) {gen_.vmovapd(dst, src);} else {gen_.movapd(dst, src);}
+    }
+
+  private:
+
+    void load(const MachineOp& op)
+    {
+        const auto dst = this->vreg(op.dst.index);
+        const auto& src = op.src.at(0);
+        if(src.kind == Location::Kind::Argument && args_ == Arguments::Rows &&
+           lanes_ != 1 && !rows_->contiguous())
+        {
+            this->gather(dst, src.index);
+            return;
+        }
+        const auto addr = this->address(src);
+        if(src.kind == Location::Kind::Argument && types_.converts_arguments())
+        {
+            // float -> double
+            if(lanes_ != 1) {gen_.vcvtps2pd(dst, addr);}
+            else if(vex_)   {gen_.vcvtss2sd(dst, dst, addr);}
+            else            {gen_.cvtss2sd (dst, addr);}
+        }
+        else if(src.kind == Location::Kind::Constant && this->bytes() == 64)
+        {
+            if(single_) {gen_.vbroadcastss(dst, addr);} else {gen_.vbroadcastsd(dst, addr);}
+        }
+        else if(lanes_ != 1) {if(single_) {gen_.vmovups(dst, addr);} else {gen_.vmovupd(dst, addr);}}
+        else if(vex_)        {if(single_) {gen_.vmovss (dst, addr);} else {gen_.vmovsd (dst, addr);}}
+        else                 {if(single_) {gen_.movss  (dst, addr);} else {gen_.movsd  (dst, addr);}}
+    }
+
+    // loads an argument of `lanes_` rows at a stride
+    // - AVX-512: vgatherqpd with the offsets of the rows in zmm31
+    // - AVX:     two rows into each 128-bit half by vmovsd and vmovhpd
+    void gather(const Xbyak::Xmm& dst, const std::size_t arg)
+    {
+        using namespace Xbyak::util;
+        const int offset = static_cast<int>(rows_->offsets.at(arg));
+        const int stride = static_cast<int>(rows_->stride);
+        if(this->bytes() == 64)
+        {
+            gen_.kxnorw(k1, k1, k1); // the mask is cleared by the gather
+            gen_.vgatherqpd(dst | k1, ptr[r9 + Xbyak::Zmm(31) + offset]);
+            return;
+        }
+        const Xbyak::Xmm lower(dst.getIdx()), upper(15);
+        gen_.vmovsd (lower, ptr[r9 + offset]);
+        gen_.vmovhpd(lower, lower, ptr[r9 + offset + stride]);
+        gen_.vmovsd (upper, ptr[r9 + offset + stride * 2]);
+        gen_.vmovhpd(upper, upper, ptr[r9 + offset + stride * 3]);
+        gen_.vinsertf128(Xbyak::Ymm(dst.getIdx()), Xbyak::Ymm(dst.getIdx()), upper, 1);
+    }
+
+    void store(const MachineOp& op)
+    {
+        const auto src  = this->vreg(op.src.at(0).index);
+        const auto addr = this->address(op.dst);
+        if(lanes_ != 1)      {gen_.vmovapd(addr, src);}
+        else if(vex_)        {if(single_) {gen_.vmovss(addr, src);} else {gen_.vmovsd(addr, src);}}
+        else                 {if(single_) {gen_.movss (addr, src);} else {gen_.movsd (addr, src);}}
+    }
+
+    void move(const MachineOp& op)
+    {
+        this->copy(this->vreg(op.dst.index), this->vreg(op.src.at(0).index));
+    }
+
+    void compute(const MachineOp& op)
+    {
+        const auto& inst = prog_.code.at(op.inst);
+        const auto  dst  = this->vreg(op.dst.index);
+        switch(inst.op)
+        {
+            case Opcode::Add:
+            case Opcode::Sub:
+            case Opcode::Mul:
+            case Opcode::Div:
+            case Opcode::Min:
+            case Opcode::Max:
+            {
+                const auto lhs = this->vreg(op.src.at(0).index);
+                this->with_operand(op.src.at(1), [&](const Xbyak::Operand& rhs) {
+                        this->arithmetic(inst.op, dst, lhs, rhs);
+                    });
+                break;
+            }
+            case Opcode::Neg:
+            {
+                // flip the sign bit by xor-ing -0.0
+                const auto lhs = this->vreg(op.src.at(0).index);
+                this->with_operand(op.src.at(1), [&](const Xbyak::Operand& rhs) {
+                        // vxorpd on zmm requires AVX512DQ
+                        if(this->bytes() == 64) {if(single_) {gen_.vpxord(dst, lhs, rhs);} else {gen_.vpxorq(dst, lhs, rhs);}}
+                        else if(vex_)           {if(single_) {gen_.vxorps(dst, lhs, rhs);} else {gen_.vxorpd(dst, lhs, rhs);}}
+                        else                    {if(single_) {gen_.xorps (dst,      rhs);} else {gen_.xorpd (dst,      rhs);}}
+                    });
+                break;
+            }
+            case Opcode::MulAdd:
+            case Opcode::MulSub:
+            case Opcode::NegMulAdd:
+            {
+                this->fma(inst.op, op);
+                break;
+            }
+            case Opcode::Sqrt:
+            {
+                const auto src = this->vreg(op.src.at(0).index);
+                if(lanes_ != 1) {if(single_) {gen_.vsqrtps(dst, src);}      else {gen_.vsqrtpd(dst, src);}}
+                else if(vex_)   {if(single_) {gen_.vsqrtss(dst, src, src);} else {gen_.vsqrtsd(dst, src, src);}}
+                else            {if(single_) {gen_.sqrtss (dst, src);}      else {gen_.sqrtsd (dst, src);}}
+                break;
+            }
+            case Opcode::Recip:
+            case Opcode::RecipSqrt:
+            {
+                this->approximate(inst.op, dst, this->vreg(op.src.at(0).index));
+                break;
+            }
+            case Opcode::Less:
+            case Opcode::LessEqual:
+            case Opcode::Equal:
+            case Opcode::NotEqual:
+            {
+                const auto lhs = this->vreg(op.src.at(0).index);
+                this->with_operand(op.src.at(1), [&](const Xbyak::Operand& rhs) {
+                        this->compare(inst.op, dst, lhs, rhs);
+                    });
+                break;
+            }
+            case Opcode::And:
+            case Opcode::AndNot:
+            case Opcode::Or:
+            {
+                const auto lhs = this->vreg(op.src.at(0).index);
+                this->with_operand(op.src.at(1), [&](const Xbyak::Operand& rhs) {
+                        this->bitwise(inst.op, dst, lhs, rhs);
+                    });
+                break;
+            }
+            case Opcode::ShiftLeft:
+            case Opcode::ShiftRight:
+            {
+                // 256-bit shifts require AVX2. The caller checks it.
+                const auto src   = this->vreg(op.src.at(0).index);
+                const auto count = static_cast<std::uint8_t>(inst.index);
+                const bool left  = (inst.op == Opcode::ShiftLeft);
+                if(single_)
+                {
+                    if(vex_) {if(left) {gen_.vpslld(dst, src, count);} else {gen_.vpsrld(dst, src, count);}}
+                    else     {if(left) {gen_.pslld (dst,      count);} else {gen_.psrld (dst,      count);}}
+                }
+                else
+                {
+                    if(vex_) {if(left) {gen_.vpsllq(dst, src, count);} else {gen_.vpsrlq(dst, src, count);}}
+                    else     {if(left) {gen_.psllq (dst,      count);} else {gen_.psrlq (dst,      count);}}
+                }
+                break;
+            }
+            case Opcode::Reduce:
+            {
+                this->reduce(inst.index, op);
+                break;
+            }
+            case Opcode::Output:
+            {
+                this->output(inst.index, this->vreg(op.src.at(0).index));
+                break;
+            }
+            default:
+            {
+                throw std::runtime_error("jitome::Emitter: unsupported instruction: " +
+                                         std::string(to_string(inst.op)));
+            }
+        }
+    }
+
+    // note: for Arguments::Columns, this clobbers rax.
+    void output(const std::size_t idx, const Xbyak::Xmm& src)
+    {
+        using namespace Xbyak::util;
+        if(types_.converts_result())
+        {
+            throw std::runtime_error("jitome::Emitter: outputs cannot be converted");
+        }
+        const auto size = size_of(types_.result);
+        if(args_ != Arguments::Registers)
+        {
+            gen_.mov(rax, ptr[rsi + idx * 8]);
+        }
+        const auto addr = (args_ != Arguments::Registers) ? ptr[rax + rcx * static_cast<int>(size)] :
+                                                            ptr[rdi + idx * size];
+        this->write(addr, src);
+    }
+
+  public:
+
+    // writes a register into the result type in memory. If it should be
+    // converted, the register is overwritten.
+    void write(const Xbyak::Address& addr, const Xbyak::Xmm& src)
+    {
+        if(types_.converts_result())
+        {
+            // double -> float. The lower half of the register is used.
+            const auto half = (this->bytes() == 64) ? Xbyak::Xmm(Xbyak::Ymm(src.getIdx())) :
+                                                      Xbyak::Xmm(src.getIdx());
+            if(lanes_ != 1) {gen_.vcvtpd2ps(half, src); gen_.vmovups(addr, half);}
+            else if(vex_)   {gen_.vcvtsd2ss(src, src, src); gen_.vmovss(addr, src);}
+            else            {gen_.cvtsd2ss (src, src);      gen_.movss (addr, src);}
+        }
+        else if(lanes_ != 1) {if(single_) {gen_.vmovups(addr, src);} else {gen_.vmovupd(addr, src);}}
+        else if(vex_)        {if(single_) {gen_.vmovss (addr, src);} else {gen_.vmovsd (addr, src);}}
+        else                 {if(single_) {gen_.movss  (addr, src);} else {gen_.movsd  (addr, src);}}
+    }
+
+  private:
+
+    // dst = lhs (op) rhs. In legacy SSE, dst is the same as lhs.
+    void arithmetic(const Opcode code, const Xbyak::Xmm& dst, const Xbyak::Xmm& lhs,
+                    const Xbyak::Operand& rhs)
+    {
+        if(lanes_ != 1 && single_)
+        {
+            switch(code)
+            {
+                case Opcode::Add: {gen_.vaddps(dst, lhs, rhs); return;}
+                case Opcode::Sub: {gen_.vsubps(dst, lhs, rhs); return;}
+                case Opcode::Mul: {gen_.vmulps(dst, lhs, rhs); return;}
+                case Opcode::Div: {gen_.vdivps(dst, lhs, rhs); return;}
+                case Opcode::Min: {gen_.vminps(dst, lhs, rhs); return;}
+                case Opcode::Max: {gen_.vmaxps(dst, lhs, rhs); return;}
+                default: {break;}
+            }
+        }
+        else if(lanes_ != 1)
+        {
+            switch(code)
+            {
+                case Opcode::Add: {gen_.vaddpd(dst, lhs, rhs); return;}
+                case Opcode::Sub: {gen_.vsubpd(dst, lhs, rhs); return;}
+                case Opcode::Mul: {gen_.vmulpd(dst, lhs, rhs); return;}
+                case Opcode::Div: {gen_.vdivpd(dst, lhs, rhs); return;}
+                case Opcode::Min: {gen_.vminpd(dst, lhs, rhs); return;}
+                case Opcode::Max: {gen_.vmaxpd(dst, lhs, rhs); return;}
+                default: {break;}
+            }
+        }
+        else if(vex_ && single_)
+        {
+            switch(code)
+            {
+                case Opcode::Add: {gen_.vaddss(dst, lhs, rhs); return;}
+                case Opcode::Sub: {gen_.vsubss(dst, lhs, rhs); return;}
+                case Opcode::Mul: {gen_.vmulss(dst, lhs, rhs); return;}
+                case Opcode::Div: {gen_.vdivss(dst, lhs, rhs); return;}
+                case Opcode::Min: {gen_.vminss(dst, lhs, rhs); return;}
+                case Opcode::Max: {gen_.vmaxss(dst, lhs, rhs); return;}
+                default: {break;}
+            }
+        }
+        else if(vex_)
+        {
+            switch(code)
+            {
+                case Opcode::Add: {gen_.vaddsd(dst, lhs, rhs); return;}
+                case Opcode::Sub: {gen_.vsubsd(dst, lhs, rhs); return;}
+                case Opcode::Mul: {gen_.vmulsd(dst, lhs, rhs); return;}
+                case Opcode::Div: {gen_.vdivsd(dst, lhs, rhs); return;}
+                case Opcode::Min: {gen_.vminsd(dst, lhs, rhs); return;}
+                case Opcode::Max: {gen_.vmaxsd(dst, lhs, rhs); return;}
+                default: {break;}
+            }
+        }
+        else if(single_)
+        {
+            switch(code)
+            {
+                case Opcode::Add: {gen_.addss(dst, rhs); return;}
+                case Opcode::Sub: {gen_.subss(dst, rhs); return;}
+                case Opcode::Mul: {gen_.mulss(dst, rhs); return;}
+                case Opcode::Div: {gen_.divss(dst, rhs); return;}
+                case Opcode::Min: {gen_.minss(dst, rhs); return;}
+                case Opcode::Max: {gen_.maxss(dst, rhs); return;}
+                default: {break;}
+            }
+        }
+        else
+        {
+            switch(code)
+            {
+                case Opcode::Add: {gen_.addsd(dst, rhs); return;}
+                case Opcode::Sub: {gen_.subsd(dst, rhs); return;}
+                case Opcode::Mul: {gen_.mulsd(dst, rhs); return;}
+                case Opcode::Div: {gen_.divsd(dst, rhs); return;}
+                case Opcode::Min: {gen_.minsd(dst, rhs); return;}
+                case Opcode::Max: {gen_.maxsd(dst, rhs); return;}
+                default: {break;}
+            }
+        }
+        throw std::runtime_error("jitome::Emitter: not an arithmetic operation: " +
+                                 std::string(to_string(code)));
+    }
+
+    // dst = lhs < rhs ? all-one bits : 0, and so on. AVX-512 compares into an
+    // opmask, so the mask is broadcast from the constant pool with
+    // zero-masking. The predicates are the ones that the legacy SSE encoding
+    // supports as well.
+    void compare(const Opcode code, const Xbyak::Xmm& dst, const Xbyak::Xmm& lhs,
+                 const Xbyak::Operand& rhs)
+    {
+        using namespace Xbyak::util;
+        std::uint8_t pred = 0;
+        switch(code)
+        {
+            case Opcode::Less     : {pred = 1; break;} // _CMP_LT_OS
+            case Opcode::LessEqual: {pred = 2; break;} // _CMP_LE_OS
+            case Opcode::Equal    : {pred = 0; break;} // _CMP_EQ_OQ
+            case Opcode::NotEqual : {pred = 4; break;} // _CMP_NEQ_UQ
+            default: {throw std::runtime_error("jitome::Emitter: not a comparison");}
+        }
+        const auto& ones = pool_.label(~std::uint64_t(0));
+        if(this->bytes() == 64)
+        {
+            if(single_)
+            {
+                gen_.vcmpps(k1, lhs, rhs, pred);
+                gen_.vpbroadcastd(dst | k1 | Xbyak::T_z, dword[rip + ones]);
+            }
+            else
+            {
+                gen_.vcmppd(k1, lhs, rhs, pred);
+                gen_.vpbroadcastq(dst | k1 | Xbyak::T_z, qword[rip + ones]);
+            }
+        }
+        else if(lanes_ != 1) {if(single_) {gen_.vcmpps(dst, lhs, rhs, pred);} else {gen_.vcmppd(dst, lhs, rhs, pred);}}
+        else if(vex_)        {if(single_) {gen_.vcmpss(dst, lhs, rhs, pred);} else {gen_.vcmpsd(dst, lhs, rhs, pred);}}
+        else                 {if(single_) {gen_.cmpss (dst,      rhs, pred);} else {gen_.cmpsd (dst,      rhs, pred);}}
+    }
+
+    // rcp and rsqrt. There are no such instructions for double before
+    // AVX-512, so approximate_division() is applied to double only with it.
+    // With AVX-512, the scalar code uses the 14-bit instructions as well, so
+    // the rows in the scalar loop get the same result as the packed ones.
+    void approximate(const Opcode code, const Xbyak::Xmm& dst, const Xbyak::Xmm& src)
+    {
+        const bool rsqrt = (code == Opcode::RecipSqrt);
+        if(evex_ && lanes_ != 1) // zmm, or ymm with AVX-512VL
+        {
+            if(single_) {if(rsqrt) {gen_.vrsqrt14ps(dst, src);} else {gen_.vrcp14ps(dst, src);}}
+            else        {if(rsqrt) {gen_.vrsqrt14pd(dst, src);} else {gen_.vrcp14pd(dst, src);}}
+        }
+        else if(evex_)
+        {
+            if(single_) {if(rsqrt) {gen_.vrsqrt14ss(dst, src, src);} else {gen_.vrcp14ss(dst, src, src);}}
+            else        {if(rsqrt) {gen_.vrsqrt14sd(dst, src, src);} else {gen_.vrcp14sd(dst, src, src);}}
+        }
+        else if(!single_)
+        {
+            throw std::runtime_error("jitome::Emitter: rcp and rsqrt of double require AVX-512");
+        }
+        else if(lanes_ != 1) {if(rsqrt) {gen_.vrsqrtps(dst, src);}        else {gen_.vrcpps(dst, src);}}
+        else if(vex_)        {if(rsqrt) {gen_.vrsqrtss(dst, src, src);}   else {gen_.vrcpss(dst, src, src);}}
+        else                 {if(rsqrt) {gen_.rsqrtss(dst, src);}         else {gen_.rcpss(dst, src);}}
+    }
+
+    // and, andnot and or on the bit patterns. The instructions for double
+    // work on float as well, except that the broadcast of AVX-512 depends on
+    // the size of the elements.
+    void bitwise(const Opcode code, const Xbyak::Xmm& dst, const Xbyak::Xmm& lhs,
+                 const Xbyak::Operand& rhs)
+    {
+        if(this->bytes() == 64 && single_)
+        {
+            switch(code)
+            {
+                case Opcode::And   : {gen_.vpandd (dst, lhs, rhs); return;}
+                case Opcode::AndNot: {gen_.vpandnd(dst, lhs, rhs); return;}
+                case Opcode::Or    : {gen_.vpord  (dst, lhs, rhs); return;}
+                default: {break;}
+            }
+        }
+        else if(this->bytes() == 64) // vandpd on zmm requires AVX512DQ
+        {
+            switch(code)
+            {
+                case Opcode::And   : {gen_.vpandq (dst, lhs, rhs); return;}
+                case Opcode::AndNot: {gen_.vpandnq(dst, lhs, rhs); return;}
+                case Opcode::Or    : {gen_.vporq  (dst, lhs, rhs); return;}
+                default: {break;}
+            }
+        }
+        else if(vex_)
+        {
+            switch(code)
+            {
+                case Opcode::And   : {gen_.vandpd (dst, lhs, rhs); return;}
+                case Opcode::AndNot: {gen_.vandnpd(dst, lhs, rhs); return;}
+                case Opcode::Or    : {gen_.vorpd  (dst, lhs, rhs); return;}
+                default: {break;}
+            }
+        }
+        else
+        {
+            switch(code)
+            {
+                case Opcode::And   : {gen_.andpd (dst, rhs); return;}
+                case Opcode::AndNot: {gen_.andnpd(dst, rhs); return;}
+                case Opcode::Or    : {gen_.orpd  (dst, rhs); return;}
+                default: {break;}
+            }
+        }
+        throw std::runtime_error("jitome::Emitter: not a bitwise operation: " +
+                                 std::string(to_string(code)));
+    }
+
+    // The register allocator overwrites one of the operands of FMA. The form
+    // is chosen by which one is overwritten.
+    //   231: dst = src0 * src1 + dst  (dst is the addend)
+    //   213: dst = src  * dst  + src2 (dst is one of the factors)
+    void fma(const Opcode code, const MachineOp& op)
+    {
+        if(!vex_)
+        {
+            throw std::runtime_error("jitome::Emitter: FMA requires VEX encoding");
+        }
+        const auto  dst = this->vreg(op.dst.index);
+        const auto& a   = op.src.at(0);
+        const auto& b   = op.src.at(1);
+        const auto& c   = op.src.at(2);
+        if(c == op.dst)
+        {
+            // only the second one can be a memory operand
+            const auto& x = a.is_register() ? a : b;
+            const auto& y = a.is_register() ? b : a;
+            this->with_operand(y, [&](const Xbyak::Operand& rhs) {
+                    this->fma_form(code, 231, dst, this->vreg(x.index), rhs);
+                });
+        }
+        else
+        {
+            const auto& x = (a == op.dst) ? b : a;
+            this->with_operand(c, [&](const Xbyak::Operand& rhs) {
+                    this->fma_form(code, 213, dst, this->vreg(x.index), rhs);
+                });
+        }
+    }
+
+    void fma_form(const Opcode code, const int form, const Xbyak::Xmm& dst,
+                  const Xbyak::Xmm& x, const Xbyak::Operand& y)
+    {
+        const bool packed = (lanes_ != 1);
+        if(single_)
+        {
+            this->fma_form_single(code, form, dst, x, y);
+            return;
+        }
+        switch(code)
+        {
+            case Opcode::MulAdd:
+            {
+                if(form == 231) {if(packed) {gen_.vfmadd231pd(dst, x, y);} else {gen_.vfmadd231sd(dst, x, y);}}
+                else            {if(packed) {gen_.vfmadd213pd(dst, x, y);} else {gen_.vfmadd213sd(dst, x, y);}}
+                return;
+            }
+            case Opcode::MulSub:
+            {
+                if(form == 231) {if(packed) {gen_.vfmsub231pd(dst, x, y);} else {gen_.vfmsub231sd(dst, x, y);}}
+                else            {if(packed) {gen_.vfmsub213pd(dst, x, y);} else {gen_.vfmsub213sd(dst, x, y);}}
+                return;
+            }
+            case Opcode::NegMulAdd:
+            {
+                if(form == 231) {if(packed) {gen_.vfnmadd231pd(dst, x, y);} else {gen_.vfnmadd231sd(dst, x, y);}}
+                else            {if(packed) {gen_.vfnmadd213pd(dst, x, y);} else {gen_.vfnmadd213sd(dst, x, y);}}
+                return;
+            }
+            default:
+            {
+                throw std::runtime_error("jitome::Emitter: not an FMA operation: " +
+                                         std::string(to_string(code)));
+            }
+        }
+    }
+
+    void fma_form_single(const Opcode code, const int form, const Xbyak::Xmm& dst,
+                         const Xbyak::Xmm& x, const Xbyak::Operand& y)
+    {
+        const bool packed = (lanes_ != 1);
+        switch(code)
+        {
+            case Opcode::MulAdd:
+            {
+                if(form == 231) {if(packed) {gen_.vfmadd231ps(dst, x, y);} else {gen_.vfmadd231ss(dst, x, y);}}
+                else            {if(packed) {gen_.vfmadd213ps(dst, x, y);} else {gen_.vfmadd213ss(dst, x, y);}}
+                return;
+            }
+            case Opcode::MulSub:
+            {
+                if(form == 231) {if(packed) {gen_.vfmsub231ps(dst, x, y);} else {gen_.vfmsub231ss(dst, x, y);}}
+                else            {if(packed) {gen_.vfmsub213ps(dst, x, y);} else {gen_.vfmsub213ss(dst, x, y);}}
+                return;
+            }
+            case Opcode::NegMulAdd:
+            {
+                if(form == 231) {if(packed) {gen_.vfnmadd231ps(dst, x, y);} else {gen_.vfnmadd231ss(dst, x, y);}}
+                else            {if(packed) {gen_.vfnmadd213ps(dst, x, y);} else {gen_.vfnmadd213ss(dst, x, y);}}
+                return;
+            }
+            default:
+            {
+                throw std::runtime_error("jitome::Emitter: not an FMA operation: " +
+                                         std::string(to_string(code)));
+            }
+        }
+    }
+
+    // Reduce. Usually all the lanes are in range and it is a test and a
+    // branch. Otherwise, the lanes are stored below the stack and the ones
+    // out of range are reduced one by one, in the same way as payne_hanek().
+    // The registers that it uses are saved and restored.
+    void reduce(const std::size_t idx, const MachineOp& op)
+    {
+        using namespace Xbyak::util;
+        using Xbyak::CodeGenerator;
+        const auto dst  = this->vreg(op.dst.index);
+        const auto x    = this->vreg(op.src.at(0).index);
+        const auto fast = this->vreg(op.src.at(1).index);
+        const auto mask = this->vreg(op.src.at(2).index);
+
+        Xbyak::Label slow, lane, positive, nonfinite, next, done;
+        if(this->bytes() == 64)
+        {
+            if(single_) {gen_.vptestnmd(k1, mask, mask);} else {gen_.vptestnmq(k1, mask, mask);}
+            gen_.kortestw(k1, k1);
+        }
+        else
+        {
+            const auto all = static_cast<std::uint32_t>((1u << lanes_) - 1u);
+            gen_.push(rax);
+            if(vex_) {if(single_) {gen_.vmovmskps(eax, mask);} else {gen_.vmovmskpd(eax, mask);}}
+            else     {if(single_) {gen_.movmskps (eax, mask);} else {gen_.movmskpd (eax, mask);}}
+            gen_.and_(eax, all);
+            gen_.cmp (eax, all);
+            gen_.pop (rax);
+        }
+        gen_.jne(slow, CodeGenerator::T_NEAR);
+        this->copy(dst, fast);
+        gen_.jmp(done, CodeGenerator::T_NEAR);
+
+        // [rsp]: x, fast (and the results), mask, xmm15, rax...r11, a temporary
+        gen_.L(slow);
+        const int width = static_cast<int>(std::max<std::size_t>(this->bytes(), 16));
+        const int xs = 0, ys = width, ms = 2 * width, saved = 3 * width;
+        const int gprs = 4 * width, tmp = gprs + 72, frame = gprs + 80;
+        const std::array<Xbyak::Reg64, 9> regs{{rax, rcx, rdx, rsi, rdi, r8, r9, r10, r11}};
+        const Xbyak::Xmm t(15);
+
+        const auto vstore = [this](const Xbyak::Address& addr, const Xbyak::Xmm& v) {
+            if(vex_) {gen_.vmovups(addr, v);} else {gen_.movups(addr, v);}
+        };
+        const auto vload = [this](const Xbyak::Xmm& v, const Xbyak::Address& addr) {
+            if(vex_) {gen_.vmovups(v, addr);} else {gen_.movups(v, addr);}
+        };
+        // the r11-th lane
+        const auto element = [this](const int base) {
+            return single_ ? dword[rsp + r11 * 4 + base] : qword[rsp + r11 * 8 + base];
+        };
+
+        gen_.sub(rsp, frame);
+        vstore(ptr[rsp + xs], x);
+        vstore(ptr[rsp + ys], fast);
+        vstore(ptr[rsp + ms], mask);
+        vstore(ptr[rsp + saved], this->vreg(t.getIdx()));
+        for(std::size_t i=0; i<regs.size(); ++i)
+        {
+            gen_.mov(qword[rsp + gprs + static_cast<int>(i) * 8], regs.at(i));
+        }
+
+        gen_.xor_(r11d, r11d);
+        gen_.L(lane);
+        if(single_) {gen_.mov(eax, element(ms)); gen_.test(eax, eax);}
+        else        {gen_.mov(rax, element(ms)); gen_.test(rax, rax);}
+        gen_.jnz(next, CodeGenerator::T_NEAR);
+
+        // the bits of x as a double
+        if(single_)
+        {
+            if(vex_) {gen_.vcvtss2sd(t, t, element(xs)); gen_.vmovsd(qword[rsp + tmp], t);}
+            else     {gen_.cvtss2sd (t,    element(xs)); gen_.movsd (qword[rsp + tmp], t);}
+            gen_.mov(rax, qword[rsp + tmp]);
+        }
+        else
+        {
+            gen_.mov(rax, element(xs));
+        }
+        gen_.mov(rdi, rax);
+        gen_.shr(rdi, 52);
+        gen_.and_(edi, 0x7FF);
+        gen_.cmp(edi, 0x7FF);
+        gen_.je(nonfinite, CodeGenerator::T_NEAR);
+        gen_.mov(r8, 0x000FFFFFFFFFFFFFull); // m
+        gen_.and_(r8, rax);
+        gen_.bts(r8, 52);
+
+        // the window starts at the cl-th bit of the (rdi/64)-th word
+        gen_.sub(edi, 1013);
+        gen_.mov(ecx, edi);
+        gen_.and_(ecx, 63);
+        gen_.shr(edi, 6);
+        gen_.lea(r9, ptr[rip + pool_.two_over_pi()]);
+        gen_.lea(r9, ptr[r9 + rdi * 8]);
+
+        // lo (r10) = high(m w2) + low(m w1), hi (rsi) = high(m w1) + low(m w0) + carry
+        const auto window = [&](const int i) {
+            gen_.mov(rax, qword[r9 + i * 8]);
+            gen_.mov(rdx, qword[r9 + i * 8 + 8]);
+            gen_.shld(rax, rdx, cl);
+        };
+        window(2);
+        gen_.mul(r8);
+        gen_.mov(r10, rdx);
+        window(1);
+        gen_.mul(r8);
+        gen_.add(r10, rax);
+        gen_.adc(rdx, 0);
+        gen_.mov(rsi, rdx);
+        window(0);
+        gen_.imul(rax, r8);
+        gen_.add(rsi, rax);
+
+        // n (rdi) = (hi + 2^61) >> 62, f (rsi) = hi - (n << 62)
+        gen_.mov(rdi, 1ull << 61);
+        gen_.add(rdi, rsi);
+        gen_.shr(rdi, 62);
+        gen_.mov(rax, rdi);
+        gen_.shl(rax, 62);
+        gen_.sub(rsi, rax);
+
+        // the sign bit of x in rdx
+        if(single_) {gen_.mov(edx, element(xs)); gen_.shr(edx, 31);}
+        else        {gen_.mov(rdx, element(xs)); gen_.shr(rdx, 63);}
+        if(idx == 1)
+        {
+            // the quadrant, (4 - n) & 3 for negative x
+            gen_.test(edx, edx);
+            gen_.jz(positive);
+            gen_.neg(rdi);
+            gen_.and_(edi, 3);
+            gen_.L(positive);
+            if(single_)
+            {
+                if(vex_) {gen_.vcvtsi2ss(t, t, rdi); gen_.vmovss(element(ys), t);}
+                else     {gen_.cvtsi2ss (t,    rdi); gen_.movss (element(ys), t);}
+            }
+            else
+            {
+                if(vex_) {gen_.vcvtsi2sd(t, t, rdi); gen_.vmovsd(element(ys), t);}
+                else     {gen_.cvtsi2sd (t,    rdi); gen_.movsd (element(ys), t);}
+            }
+        }
+        else
+        {
+            // |(f, lo)| in (rsi, r10). r9 is 1 if the remainder is negative.
+            gen_.mov(r9, rsi);
+            gen_.shr(r9, 63);
+            gen_.xor_(r9d, edx);
+            gen_.test(rsi, rsi);
+            gen_.jns(positive);
+            gen_.neg(r10);
+            gen_.adc(rsi, 0);
+            gen_.neg(rsi);
+            gen_.L(positive);
+
+            // u (rsi) = (a << z) | (b >> (64 - z)) for z = clz(a | 1) in cl
+            gen_.mov(rax, rsi);
+            gen_.or_(rax, 1);
+            gen_.bsr(rax, rax);
+            gen_.mov(ecx, 63);
+            gen_.sub(ecx, eax);
+            gen_.shld(rsi, r10, cl);
+
+            // r = (high(u pi/2) >> 1) 2^(-60-z)
+            gen_.mov(rax, pi_over_2);
+            gen_.mul(rsi);
+            gen_.shr(rdx, 1);
+            gen_.mov(eax, 963);
+            gen_.sub(eax, ecx);
+            gen_.shl(rax, 52);
+            gen_.mov(qword[rsp + tmp], rax);
+            if(vex_) {gen_.vcvtsi2sd(t, t, rdx); gen_.vmulsd(t, t, qword[rsp + tmp]);}
+            else     {gen_.cvtsi2sd (t,    rdx); gen_.mulsd (t,    qword[rsp + tmp]);}
+            if(single_)
+            {
+                if(vex_) {gen_.vcvtsd2ss(t, t, t); gen_.vmovss(element(ys), t);}
+                else     {gen_.cvtsd2ss (t,    t); gen_.movss (element(ys), t);}
+            }
+            else
+            {
+                if(vex_) {gen_.vmovsd(element(ys), t);} else {gen_.movsd(element(ys), t);}
+            }
+            gen_.test(r9d, r9d);
+            gen_.jz(next, CodeGenerator::T_NEAR);
+            gen_.btc(element(ys), single_ ? 31 : 63);
+        }
+        gen_.jmp(next, CodeGenerator::T_NEAR);
+
+        // NaN and 0 for inf and NaN
+        gen_.L(nonfinite);
+        if(idx == 1)
+        {
+            gen_.mov(element(ys), 0);
+        }
+        else if(single_)
+        {
+            gen_.mov(element(ys), 0x7FC00000);
+        }
+        else
+        {
+            gen_.mov(rax, 0x7FF8000000000000ull);
+            gen_.mov(element(ys), rax);
+        }
+
+        gen_.L(next);
+        gen_.inc(r11);
+        gen_.cmp(r11, static_cast<std::uint32_t>(lanes_));
+        gen_.jb(lane, CodeGenerator::T_NEAR);
+
+        vload(this->vreg(t.getIdx()), ptr[rsp + saved]);
+        for(std::size_t i=0; i<regs.size(); ++i)
+        {
+            gen_.mov(regs.at(i), qword[rsp + gprs + static_cast<int>(i) * 8]);
+        }
+        vload(dst, ptr[rsp + ys]);
+        gen_.add(rsp, frame);
+        gen_.L(done);
+    }
+
+    template<typename F>
+    void with_operand(const Location& loc, F&& f)
+    {
+        if(loc.is_register())
+        {
+            f(this->vreg(loc.index));
+        }
+        else if(loc.kind == Location::Kind::Constant && this->bytes() == 64)
+        {
+            using namespace Xbyak::util;
+            f(ptr_b[rip + pool_.label(prog_.code.at(loc.index).bits)]);
+        }
+        else
+        {
+            f(this->address(loc));
+        }
+    }
+
+    // note: for Arguments::Columns, this clobbers rax.
+    Xbyak::Address address(const Location& loc)
+    {
+        using namespace Xbyak::util;
+        switch(loc.kind)
+        {
+            case Location::Kind::Spill:
+            {
+                return ptr[rsp + loc.index * slot_];
+            }
+            case Location::Kind::Argument:
+            {
+                if(args_ == Arguments::Columns)
+                {
+                    gen_.mov(rax, ptr[rdi + loc.index * 8]);
+                    return ptr[rax + rcx * static_cast<int>(size_of(types_.arguments))];
+                }
+                if(args_ == Arguments::Rows)
+                {
+                    return ptr[r9 + static_cast<int>(rows_->offsets.at(loc.index))];
+                }
+                // return address and rbp are on top of the stack arguments
+                return ptr[rbp + 16 + (loc.index - 8) * 8];
+            }
+            case Location::Kind::Constant:
+            {
+                return ptr[rip + pool_.label(prog_.code.at(loc.index).bits)];
+            }
+            default:
+            {
+                throw std::runtime_error("jitome::Emitter: no memory location");
+            }
+        }
+    }
+
+  private:
+
+    Xbyak::CodeGenerator& gen_;
+    const Program&        prog_;
+    ConstantPool&         pool_;
+    Arguments             args_;
+    std::size_t           lanes_;
+    bool                  vex_;
+    bool                  evex_;
+    std::size_t           slot_;
+    DataTypes             types_;
+    const RowLayout*      rows_;
+    bool                  single_;
+};
+
+} // jitome
+#endif// JITOME_CODEGEN_HPP
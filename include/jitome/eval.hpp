@@ -2,11 +2,21 @@
 #define JITOME_EVAL_HPP
 #include "traits.hpp"
 #include "ast.hpp"
+#include "builtin.hpp"
+#include "ir.hpp"
+#include "payne_hanek.hpp"
+#include "util.hpp"
 
+#include <array>
+#include <cmath>
+#include <cstdint>
 #include <limits>
 #include <map>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <vector>
 
 namespace jitome
 {
@@ -58,6 +68,45 @@ inline double invoke_func(std::map<std::string, double>& env, const NodeExpressi
         return evaluate(env, node.operands.at(0)) /
                evaluate(env, node.operands.at(1));
     }
+    else if(node.function == "^"sv)
+    {
+        if(node.operands.size() != 2)
+        {
+            throw std::runtime_error("jitome::evaluate: invalid number of operands in `^`");
+        }
+        const auto x = evaluate(env, node.operands.at(0));
+        const auto n = evaluate(env, node.operands.at(1));
+        if(!is_integer_exponent(n))
+        {
+            throw std::runtime_error("jitome::evaluate: exponent of `^` should be an integer");
+        }
+        return powi(x, static_cast<std::int64_t>(n));
+    }
+    else if(is_comparison(node.function) || is_logical(node.function))
+    {
+        if(node.operands.size() != 2)
+        {
+            throw std::runtime_error("jitome::evaluate: invalid number of operands in `" +
+                                     std::string(node.function) + "`");
+        }
+        // both sides are evaluated, as the JIT does
+        return call_operator(node.function, evaluate(env, node.operands.at(0)),
+                                            evaluate(env, node.operands.at(1)));
+    }
+    else if(const auto* builtin = find_builtin(node.function))
+    {
+        if(node.operands.size() != builtin->arity)
+        {
+            throw std::runtime_error("jitome::evaluate: invalid number of arguments of " +
+                                     std::string(builtin->name));
+        }
+        std::array<double, max_builtin_arity> args{};
+        for(std::size_t i=0; i<builtin->arity; ++i)
+        {
+            args.at(i) = evaluate(env, node.operands.at(i));
+        }
+        return call_builtin(builtin->name, args.data());
+    }
     else
     {
         throw std::runtime_error("jitome::evaluate: unknown function name: " + std::string(node.function));
@@ -81,7 +130,17 @@ inline double evaluate(std::map<std::string, double>& env, const Node& root)
         }
         else if constexpr (is_typeof<decltype(node), NodeFunction>)
         {
-            return evaluate(env, node.body);
+            if(node.locals.empty())
+            {
+                return evaluate(env, node.body);
+            }
+            auto scope = env; // locals do not leak into the caller's env
+            for(const auto& local : node.locals)
+            {
+                const auto value = evaluate(scope, local.value);
+                scope[local.name] = value;
+            }
+            return evaluate(scope, node.body);
         }
         else
         {
@@ -90,5 +149,95 @@ inline double evaluate(std::map<std::string, double>& env, const Node& root)
     }, root.node);
 }
 
+// evaluates the lowered function. `values` is a buffer that holds all the
+// values in the program, so a shared subexpression is computed only once.
+// Output instructions write into `out`.
+//
+// T is float if the program computes in single precision.
+template<typename T>
+void evaluate(const Program& prog, const T* args, T* out, std::vector<T>& values)
+{
+    static_assert(std::is_same_v<T, double> || std::is_same_v<T, float>);
+    using bits_type = std::conditional_t<std::is_same_v<T, float>, std::uint32_t, std::uint64_t>;
+
+    const auto to_bits   = [](const T v)         {return bit_cast<bits_type>(v);};
+    const auto from_bits = [](const bits_type v) {return bit_cast<T>(v);};
+
+    if((prog.precision == Precision::Single) != std::is_same_v<T, float>)
+    {
+        throw std::runtime_error("jitome::evaluate: the precision of the program does not match");
+    }
+
+    values.resize(prog.code.size());
+    for(std::size_t i=0; i<prog.code.size(); ++i)
+    {
+        const auto& inst = prog.code[i];
+        const auto  lhs  = inst.operands[0];
+        const auto  rhs  = inst.operands[1];
+        const auto  acc  = inst.operands[2];
+        switch(inst.op)
+        {
+            case Opcode::Argument : {values[i] = args[inst.index];           break;}
+            case Opcode::Constant : {values[i] = from_bits(static_cast<bits_type>(inst.bits)); break;}
+            case Opcode::Add      : {values[i] = values[lhs] + values[rhs];  break;}
+            case Opcode::Sub      : {values[i] = values[lhs] - values[rhs];  break;}
+            case Opcode::Mul      : {values[i] = values[lhs] * values[rhs];  break;}
+            case Opcode::Div      : {values[i] = values[lhs] / values[rhs];  break;}
+            case Opcode::Neg      : {values[i] = -values[lhs];               break;}
+            case Opcode::MulAdd   : {values[i] = std::fma( values[lhs], values[rhs],  values[acc]); break;}
+            case Opcode::MulSub   : {values[i] = std::fma( values[lhs], values[rhs], -values[acc]); break;}
+            case Opcode::NegMulAdd: {values[i] = std::fma(-values[lhs], values[rhs],  values[acc]); break;}
+            case Opcode::Sqrt     : {values[i] = std::sqrt(values[lhs]);     break;}
+            case Opcode::Recip    : {values[i] = T(1) / values[lhs];            break;} // exact, not the approximation
+            case Opcode::RecipSqrt: {values[i] = T(1) / std::sqrt(values[lhs]); break;}
+            case Opcode::Min      : {values[i] = values[lhs] < values[rhs] ? values[lhs] : values[rhs]; break;}
+            case Opcode::Max      : {values[i] = values[lhs] > values[rhs] ? values[lhs] : values[rhs]; break;}
+            case Opcode::Less     : {values[i] = from_bits(values[lhs] < values[rhs] ? ~bits_type(0) : 0); break;}
+            case Opcode::LessEqual: {values[i] = from_bits(values[lhs] <= values[rhs] ? ~bits_type(0) : 0); break;}
+            case Opcode::Equal    : {values[i] = from_bits(values[lhs] == values[rhs] ? ~bits_type(0) : 0); break;}
+            case Opcode::NotEqual : {values[i] = from_bits(values[lhs] != values[rhs] ? ~bits_type(0) : 0); break;}
+            case Opcode::And      : {values[i] = from_bits( to_bits(values[lhs]) & to_bits(values[rhs])); break;}
+            case Opcode::AndNot   : {values[i] = from_bits(~to_bits(values[lhs]) & to_bits(values[rhs])); break;}
+            case Opcode::Or       : {values[i] = from_bits( to_bits(values[lhs]) | to_bits(values[rhs])); break;}
+            case Opcode::ShiftLeft : {values[i] = from_bits(to_bits(values[lhs]) << inst.index); break;}
+            case Opcode::ShiftRight: {values[i] = from_bits(to_bits(values[lhs]) >> inst.index); break;}
+            case Opcode::Reduce:
+            {
+                if(to_bits(values[acc]) != 0)
+                {
+                    values[i] = values[rhs];
+                    break;
+                }
+                const auto reduced = payne_hanek(static_cast<double>(values[lhs]));
+                values[i] = (inst.index == 0) ? static_cast<T>(reduced.remainder) :
+                                                static_cast<T>(reduced.quadrant);
+                break;
+            }
+            case Opcode::Call:
+            {
+                const double arg = values[lhs];
+                values[i] = static_cast<T>(call_builtin(builtins.at(inst.index).name, &arg));
+                break;
+            }
+            case Opcode::Output    : {out[inst.index] = values[lhs]; break;}
+            default:
+            {
+                throw std::runtime_error("jitome::evaluate: unsupported instruction: " +
+                                         std::string(to_string(inst.op)));
+            }
+        }
+    }
+}
+template<typename T>
+T evaluate(const Program& prog, const T* args, std::vector<T>& values)
+{
+    if(prog.result == Program::npos)
+    {
+        throw std::runtime_error("jitome::evaluate: the program has no return value");
+    }
+    evaluate<T>(prog, args, nullptr, values);
+    return values.at(prog.result);
+}
+
 } // jitome
 #endif// JITOME_EVAL_HPP
@@ -0,0 +1,276 @@
+#ifndef JITOME_GRADIENT_HPP
+#define JITOME_GRADIENT_HPP
+#include "ast.hpp"
+#include "builtin.hpp"
+
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace jitome
+{
+
+// Symbolic differentiation of the AST.
+//
+// A derivative is built from the operands of the original expression, so it
+// shares subexpressions like `sin(x)` in `d/dx sin(x)^2` with the value.
+// They are merged when the functions are lowered together (see gradient()).
+//
+// Terms that are exactly zero, e.g. the derivative of an immediate or of an
+// argument that is not differentiated, are dropped instead of being kept as
+// `0 * y`. The remaining `x * 1` and `x^1` are removed by simplify().
+//
+// At the points where a function is not differentiable, abs uses sign(x) (so
+// 0 at x == 0) and min and max take the derivative of the operand they return.
+// Comparisons are constant almost everywhere, so their derivative is 0, and
+// select(c, a, b) takes the derivative of the branch that it returns.
+
+struct Differentiator
+{
+    using Derivative = std::optional<Node>; // nullopt is exactly zero
+
+    std::string var;
+
+    // the derivatives of the locals that are assigned so far. A local with a
+    // non-zero derivative refers to another local that holds it.
+    std::map<std::string, Derivative> locals;
+
+    // name of the local that holds the derivative of a local. `'` is not
+    // allowed in an identifier, so it does not conflict with the others.
+    std::string derivative_name(const std::string& local) const
+    {
+        return local + "'" + var;
+    }
+
+    Derivative operator()(const Node& node) const
+    {
+        return std::visit([this](const auto& n) {return (*this)(n);}, node.node);
+    }
+    Derivative operator()(const NodeImmediate&) const
+    {
+        return std::nullopt;
+    }
+    Derivative operator()(const NodeVariable& node) const
+    {
+        if(const auto found = locals.find(node.name); found != locals.end())
+        {
+            return found->second;
+        }
+        if(node.name == var)
+        {
+            return Node{NodeImmediate{1.0}};
+        }
+        return std::nullopt;
+    }
+    Derivative operator()(const NodeFunction&) const
+    {
+        throw std::runtime_error("jitome::differentiate: nested function is not supported");
+    }
+
+    Derivative operator()(const NodeExpression& node) const
+    {
+        using namespace std::literals::string_view_literals;
+        const auto& ops = node.operands;
+        const auto  f   = node.function;
+
+        if(f == "-"sv && ops.size() == 1)
+        {
+            return negate((*this)(ops.at(0)));
+        }
+        if(f == "+"sv || f == "-"sv)
+        {
+            auto da = (*this)(ops.at(0));
+            auto db = (*this)(ops.at(1));
+            return (f == "+"sv) ? add(std::move(da), std::move(db)) :
+                                  add(std::move(da), negate(std::move(db)));
+        }
+        if(f == "*"sv)
+        {
+            return add(mul((*this)(ops.at(0)), ops.at(1)), mul((*this)(ops.at(1)), ops.at(0)));
+        }
+        if(f == "/"sv)
+        {
+            // (da - (a / b) db) / b
+            const Node quotient{node};
+            auto numerator = add((*this)(ops.at(0)),
+                                 negate(mul((*this)(ops.at(1)), quotient)));
+            return div(std::move(numerator), ops.at(1));
+        }
+        if(f == "^"sv)
+        {
+            // n x^(n-1) dx
+            const auto n = std::get<NodeImmediate>(ops.at(1).node).value;
+            if(n == 0.0)
+            {
+                return std::nullopt;
+            }
+            return mul(mul((*this)(ops.at(0)), Node{NodeExpression{"^"sv, ops.at(0),
+                           NodeImmediate{n - 1.0}}}), Node{NodeImmediate{n}});
+        }
+        if(is_comparison(f) || is_logical(f))
+        {
+            return std::nullopt;
+        }
+
+        const auto* builtin = find_builtin(f);
+        if(!builtin || builtin->arity != ops.size())
+        {
+            throw std::runtime_error("jitome::differentiate: unknown function: " + std::string(f));
+        }
+        const auto named = [](const std::string_view name, auto ... args) {
+            return Node{NodeExpression{builtin_name(name), std::move(args)...}};
+        };
+        const auto& x  = ops.at(0);
+        const auto  dx = (*this)(x);
+
+        if(f == "sqrt"sv)
+        {
+            return div(dx, Node{NodeExpression{"*"sv, NodeImmediate{2.0}, Node{node}}});
+        }
+        if(f == "abs"sv)
+        {
+            return mul(dx, named("sign"sv, x));
+        }
+        if(f == "sign"sv)
+        {
+            return std::nullopt;
+        }
+        if(f == "exp"sv)
+        {
+            return mul(dx, Node{node});
+        }
+        if(f == "log"sv)
+        {
+            return div(dx, x);
+        }
+        if(f == "sin"sv)
+        {
+            return mul(dx, named("cos"sv, x));
+        }
+        if(f == "cos"sv)
+        {
+            return negate(mul(dx, named("sin"sv, x)));
+        }
+        if(f == "select"sv)
+        {
+            // the derivative of the branch that is taken
+            auto da = (*this)(ops.at(1));
+            auto db = (*this)(ops.at(2));
+            if(!da && !db)
+            {
+                return std::nullopt;
+            }
+            return named("select"sv, x, da ? std::move(*da) : Node{NodeImmediate{0.0}},
+                                        db ? std::move(*db) : Node{NodeImmediate{0.0}});
+        }
+        if(f == "clamp"sv)
+        {
+            return (*this)(named("min"sv, named("max"sv, x, ops.at(1)), ops.at(2)));
+        }
+        if(f == "min"sv || f == "max"sv)
+        {
+            // w = 1 if the first one is returned: max(sign(b - a), 0) for min
+            const auto& y  = ops.at(1);
+            const auto  dy = (*this)(y);
+            const auto diff = (f == "min"sv) ? Node{NodeExpression{"-"sv, y, x}} :
+                                               Node{NodeExpression{"-"sv, x, y}};
+            const auto w = named("max"sv, named("sign"sv, diff), NodeImmediate{0.0});
+            return add(mul(dx, w), mul(dy, Node{NodeExpression{"-"sv, NodeImmediate{1.0}, w}}));
+        }
+        throw std::runtime_error("jitome::differentiate: unknown function: " + std::string(f));
+    }
+
+  private:
+
+    // the name in the builtin table, that outlives the AST
+    static std::string_view builtin_name(const std::string_view name)
+    {
+        return find_builtin(name)->name;
+    }
+
+    static Derivative negate(Derivative a)
+    {
+        using namespace std::literals::string_view_literals;
+        if(!a) {return std::nullopt;}
+        return Node{NodeExpression{"-"sv, std::move(*a)}};
+    }
+    static Derivative add(Derivative a, Derivative b)
+    {
+        using namespace std::literals::string_view_literals;
+        if(!a) {return b;}
+        if(!b) {return a;}
+        return Node{NodeExpression{"+"sv, std::move(*a), std::move(*b)}};
+    }
+    static Derivative mul(Derivative a, const Node& b)
+    {
+        using namespace std::literals::string_view_literals;
+        if(!a) {return std::nullopt;}
+        return Node{NodeExpression{"*"sv, std::move(*a), b}};
+    }
+    static Derivative div(Derivative a, const Node& b)
+    {
+        using namespace std::literals::string_view_literals;
+        if(!a) {return std::nullopt;}
+        return Node{NodeExpression{"/"sv, std::move(*a), b}};
+    }
+};
+
+// d func / d var as a function with the same arguments. If the derivative is
+// exactly zero, the body is the immediate 0.
+inline NodeFunction differentiate(const NodeFunction& func, const std::string& var)
+{
+    if(std::find(func.args.begin(), func.args.end(), var) == func.args.end())
+    {
+        throw std::invalid_argument("jitome::differentiate: unknown argument: " + var);
+    }
+    Differentiator d;
+    d.var = var;
+
+    NodeFunction retval{func.name + "'" + var, func.args, Node{NodeImmediate{0.0}}};
+    for(const auto& local : func.locals)
+    {
+        // the derivative is assigned first because it refers to the old value
+        // if the local is assigned again
+        auto dv = d(local.value.get());
+        if(dv)
+        {
+            const auto name = d.derivative_name(local.name);
+            retval.locals.push_back(NodeLocal{name, std::move(*dv)});
+            d.locals[local.name] = Node{NodeVariable{name}};
+        }
+        else
+        {
+            d.locals[local.name] = std::nullopt;
+        }
+        retval.locals.push_back(local);
+    }
+    if(auto body = d(func.body.get()))
+    {
+        retval.body = std::move(*body);
+    }
+    return retval;
+}
+
+// the function and its partial derivatives, {f, df/dx_0, df/dx_1, ...}, in
+// the order of `wrt`. An empty `wrt` means all the arguments.
+//
+// They have the same arguments, so they can be compiled into one kernel by
+// JitMultiCompiler, in which the common subexpressions are computed once.
+inline std::vector<NodeFunction> gradient(const NodeFunction& func,
+                                          const std::vector<std::string>& wrt = {})
+{
+    std::vector<NodeFunction> retval{func};
+    for(const auto& var : wrt.empty() ? func.args : wrt)
+    {
+        retval.push_back(differentiate(func, var));
+    }
+    return retval;
+}
+
+} // jitome
+#endif// JITOME_GRADIENT_HPP
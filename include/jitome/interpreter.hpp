@@ -2,12 +2,17 @@
 #define JITOME_INTERPRETER_HPP
 #include "ast.hpp"
 #include "eval.hpp"
+#include "ir.hpp"
+#include "optimize.hpp"
 
+#include <array>
 #include <limits>
 #include <map>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <vector>
 
 namespace jitome
 {
@@ -15,18 +20,31 @@ namespace jitome
 template<typename Ret, typename ... Args>
 struct Interpreter
 {
-    static_assert(std::conjunction_v<std::is_same<Args, double>...>,
-                  "currently, `double` is the only type allowed in jitome.");
+    static_assert(std::conjunction_v<std::disjunction<std::is_same<Args, double>,
+                                                      std::is_same<Args, float>>...>,
+                  "currently, `double` and `float` are the only types allowed in jitome.");
 
+    // the function computes in float only if all the types are float, the
+    // same as JitCompiler.
+    using value_type = std::conditional_t<std::conjunction_v<std::is_same<Ret, float>,
+                                          std::is_same<Args, float>...>, float, double>;
+
+    // the function is simplified and lowered once. Subexpressions that
+    // appear more than once are evaluated only once per call. exp, log, sin
+    // and cos call the C library, as evaluate() does, instead of the
+    // polynomials of the JIT.
     Interpreter(Node root)
-        : func_(std::move(root))
+        : func_(simplify(std::move(root))),
+          prog_(lower(std::get<NodeFunction>(func_.node),
+                      std::is_same_v<value_type, float> ? Precision::Single : Precision::Double,
+                      library()))
     {}
 
     Ret operator()(Args ... arguments)
     {
         using namespace std::literals::string_literals;
 
-        std::vector<double> args{arguments...};
+        const std::array<value_type, sizeof...(Args)> args{{static_cast<value_type>(arguments)...}};
 
         const auto& func = std::get<NodeFunction>(func_.node);
 
@@ -37,20 +55,27 @@ struct Interpreter
                     + "only "s + std::to_string(args.size()) + " are provided."s
                     );
         }
+        return static_cast<Ret>(evaluate(prog_, args.data(), values_));
+    }
 
-        std::map<std::string, double> env;
-        for(std::size_t i=0; i<args.size(); ++i)
-        {
-            env[func.args.at(i)] = args.at(i);
-        }
+    // number of AST nodes that are merged into a shared subexpression
+    std::size_t merged() const noexcept {return prog_.merged;}
 
-        return evaluate(env, func.body);
+  private:
+
+    static LoweringOptions library() noexcept
+    {
+        LoweringOptions options;
+        options.call_library = true;
+        return options;
     }
 
   private:
-    Node func_;
+    Node                    func_;
+    Program                 prog_;
+    std::vector<value_type> values_;
 };
 
 
 } // jitome
-#endif// JITOME_EVAL_HPP
+#endif// JITOME_INTERPRETER_HPP
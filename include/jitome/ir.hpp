@@ -0,0 +1,1245 @@
+#ifndef JITOME_IR_HPP
+#define JITOME_IR_HPP
+#include "ast.hpp"
+#include "builtin.hpp"
+#include "traits.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace jitome
+{
+
+// Linear intermediate representation that is consumed by the JIT backend.
+//
+// A Program is a list of instructions in evaluation order. Each instruction
+// defines one value, and the value is referred by the index of the
+// instruction. Operands always refer to the preceding instructions.
+
+enum class Opcode : std::uint8_t
+{
+    Argument,  // the `index`-th argument of the function
+    Constant,  // an immediate `value`
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Neg,       // operands[1] is a constant -0.0 that is used as a sign mask
+    MulAdd,    //   a * b + c, rounded once
+    MulSub,    //   a * b - c, rounded once
+    NegMulAdd, // -(a * b) + c, rounded once
+    Sqrt,
+    Recip,     // approximation of 1 / a, refined by Newton steps (see approximate_division)
+    RecipSqrt, // approximation of 1 / sqrt(a)
+    Min,       // a < b ? a : b. b if one of them is NaN, like minsd
+    Max,       // a > b ? a : b. b if one of them is NaN, like maxsd
+    Less,      // a < b ? all-one bits : 0. used as a mask
+    LessEqual, // a <= b
+    Equal,     // a == b
+    NotEqual,  // a != b, true if one of them is NaN
+    And,       // bitwise operations on the bit patterns
+    AndNot,    // ~a & b
+    Or,
+    ShiftLeft, // shifts the bit pattern as a 64-bit integer by `index`
+    ShiftRight,
+    Reduce,    // operands[1] where the mask operands[2] is true. Otherwise, x = operands[0]
+               // is reduced by payne_hanek() into the remainder (index 0) or the quadrant (1).
+    Call,      // builtins[index] of one argument by the C library. Only evaluate() runs it.
+    Output,    // writes operands[0] to the `index`-th output. It defines no value.
+};
+
+inline std::string_view to_string(Opcode op)
+{
+    switch(op)
+    {
+        case Opcode::Argument : {return "arg";}
+        case Opcode::Constant : {return "const";}
+        case Opcode::Add      : {return "add";}
+        case Opcode::Sub      : {return "sub";}
+        case Opcode::Mul      : {return "mul";}
+        case Opcode::Div      : {return "div";}
+        case Opcode::Neg      : {return "neg";}
+        case Opcode::MulAdd   : {return "muladd";}
+        case Opcode::MulSub   : {return "mulsub";}
+        case Opcode::NegMulAdd: {return "negmuladd";}
+        case Opcode::Sqrt     : {return "sqrt";}
+        case Opcode::Recip    : {return "rcp";}
+        case Opcode::RecipSqrt: {return "rsqrt";}
+        case Opcode::Min      : {return "min";}
+        case Opcode::Max      : {return "max";}
+        case Opcode::Less     : {return "lt";}
+        case Opcode::LessEqual: {return "le";}
+        case Opcode::Equal    : {return "eq";}
+        case Opcode::NotEqual : {return "ne";}
+        case Opcode::And      : {return "and";}
+        case Opcode::AndNot   : {return "andnot";}
+        case Opcode::Or       : {return "or";}
+        case Opcode::ShiftLeft : {return "shl";}
+        case Opcode::ShiftRight: {return "shr";}
+        case Opcode::Reduce    : {return "reduce";}
+        case Opcode::Call      : {return "call";}
+        case Opcode::Output    : {return "out";}
+    }
+    return "unknown";
+}
+
+inline std::size_t num_operands(Opcode op)
+{
+    switch(op)
+    {
+        case Opcode::Argument : {return 0;}
+        case Opcode::Constant : {return 0;}
+        case Opcode::Add      : {return 2;}
+        case Opcode::Sub      : {return 2;}
+        case Opcode::Mul      : {return 2;}
+        case Opcode::Div      : {return 2;}
+        case Opcode::Neg      : {return 2;}
+        case Opcode::MulAdd   : {return 3;}
+        case Opcode::MulSub   : {return 3;}
+        case Opcode::NegMulAdd: {return 3;}
+        case Opcode::Sqrt     : {return 1;}
+        case Opcode::Recip    : {return 1;}
+        case Opcode::RecipSqrt: {return 1;}
+        case Opcode::Min      : {return 2;}
+        case Opcode::Max      : {return 2;}
+        case Opcode::Less     : {return 2;}
+        case Opcode::LessEqual: {return 2;}
+        case Opcode::Equal    : {return 2;}
+        case Opcode::NotEqual : {return 2;}
+        case Opcode::And      : {return 2;}
+        case Opcode::AndNot   : {return 2;}
+        case Opcode::Or       : {return 2;}
+        case Opcode::ShiftLeft : {return 1;}
+        case Opcode::ShiftRight: {return 1;}
+        case Opcode::Reduce    : {return 3;}
+        case Opcode::Call      : {return 1;}
+        case Opcode::Output    : {return 1;}
+    }
+    return 0;
+}
+
+// fused multiply-add family. The first two operands are multiplied.
+inline bool is_fma(Opcode op)
+{
+    return op == Opcode::MulAdd || op == Opcode::MulSub || op == Opcode::NegMulAdd;
+}
+
+// if true, the operands can be swapped without changing the result.
+inline bool is_commutative(Opcode op)
+{
+    return op == Opcode::Add || op == Opcode::Mul || op == Opcode::Neg ||
+           op == Opcode::And || op == Opcode::Or  || op == Opcode::Equal || op == Opcode::NotEqual;
+}
+
+// comparisons that produce a mask
+inline bool is_comparison(Opcode op)
+{
+    return op == Opcode::Less || op == Opcode::LessEqual || op == Opcode::Equal ||
+           op == Opcode::NotEqual;
+}
+
+// operations on the bit patterns. The legacy SSE encoding reads 16 bytes
+// from an aligned address.
+inline bool is_bitwise(Opcode op)
+{
+    return op == Opcode::And || op == Opcode::AndNot || op == Opcode::Or;
+}
+
+inline bool is_shift(Opcode op)
+{
+    return op == Opcode::ShiftLeft || op == Opcode::ShiftRight;
+}
+
+// floating point format in which a Program computes, or of the arguments
+// and the results in memory
+enum class Precision : std::uint8_t
+{
+    Double,
+    Single,
+};
+
+inline std::string_view to_string(Precision p)
+{
+    switch(p)
+    {
+        case Precision::Double: {return "f64";}
+        case Precision::Single: {return "f32";}
+    }
+    return "unknown";
+}
+
+inline std::size_t size_of(Precision p)
+{
+    return p == Precision::Single ? sizeof(float) : sizeof(double);
+}
+
+// The bit pattern of a Constant is what the code and evaluate() use, so a
+// mask like 0x007FFFFF is never converted as a value (a subnormal float would
+// be flushed to zero under DAZ/FTZ). `value` is used to fold and print it.
+struct Instruction
+{
+    Opcode                     op;
+    std::array<std::size_t, 3> operands;
+    std::size_t                index;    // Argument
+    double                     value;    // Constant
+    std::uint64_t              bits = 0; // Constant, in the lower 32 bits for float
+};
+
+// bit pattern of a constant that is representable in the precision
+inline std::uint64_t bits_of(const double v, const Precision p)
+{
+    return p == Precision::Single ? bit_cast<std::uint32_t>(static_cast<float>(v)) :
+                                    bit_cast<std::uint64_t>(v);
+}
+
+struct Program
+{
+    static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+    std::size_t              arity   = 0;
+    std::size_t              result  = npos; // npos if the results are written by Output
+    std::size_t              outputs = 0;    // number of Output instructions
+    std::size_t              merged  = 0;    // AST nodes that reuse an existing value
+    Precision                precision = Precision::Double;
+    std::vector<Instruction> code;
+
+    std::size_t push(Opcode op, std::size_t lhs = npos, std::size_t rhs = npos,
+                     std::size_t acc = npos)
+    {
+        code.push_back(Instruction{op, {lhs, rhs, acc}, 0, 0.0});
+        return code.size() - 1;
+    }
+    std::size_t push_argument(std::size_t idx)
+    {
+        code.push_back(Instruction{Opcode::Argument, {npos, npos, npos}, idx, 0.0});
+        return code.size() - 1;
+    }
+    std::size_t push_constant(double v)
+    {
+        code.push_back(Instruction{Opcode::Constant, {npos, npos, npos}, 0, v, bits_of(v, precision)});
+        return code.size() - 1;
+    }
+};
+
+inline std::string dump(const Program& prog)
+{
+    std::string retval;
+    for(std::size_t i=0; i<prog.code.size(); ++i)
+    {
+        const auto& inst = prog.code.at(i);
+        retval += "%" + std::to_string(i) + " = ";
+        retval += to_string(inst.op);
+        if(inst.op == Opcode::Argument || inst.op == Opcode::Output || is_shift(inst.op) ||
+           inst.op == Opcode::Reduce   || inst.op == Opcode::Call)
+        {
+            retval += " " + std::to_string(inst.index);
+        }
+        else if(inst.op == Opcode::Constant)
+        {
+            retval += " " + std::to_string(inst.value);
+        }
+        for(std::size_t j=0; j<num_operands(inst.op); ++j)
+        {
+            retval += " %" + std::to_string(inst.operands.at(j));
+        }
+        retval += "\n";
+    }
+    if(prog.result != Program::npos)
+    {
+        retval += "ret %" + std::to_string(prog.result) + "\n";
+    }
+    return retval;
+}
+
+// ---------------------------------------------------------------------------
+// AST -> IR
+//
+// The AST is a tree, so the same subexpression may appear several times. The
+// lowering hash-conses the instructions: a value that has the same opcode and
+// operands as an existing one is not pushed again. The result is a DAG and
+// each subexpression is computed only once.
+
+// structural key of an instruction. Operands of commutative operations are
+// sorted, so `a*b` and `b*a` become the same value.
+struct ValueKey
+{
+    Opcode                     op;
+    std::array<std::size_t, 3> operands;
+    std::size_t                index;
+    std::uint64_t              value; // bit pattern, to distinguish 0.0 and -0.0
+
+    explicit ValueKey(const Instruction& inst)
+        : op(inst.op), operands(inst.operands), index(inst.index), value(inst.bits)
+    {
+        if(is_commutative(op) && operands[1] < operands[0])
+        {
+            std::swap(operands[0], operands[1]);
+        }
+    }
+
+    bool operator==(const ValueKey& other) const noexcept
+    {
+        return op == other.op && operands == other.operands &&
+               index == other.index && value == other.value;
+    }
+};
+
+struct ValueKeyHash
+{
+    std::size_t operator()(const ValueKey& key) const noexcept
+    {
+        std::size_t seed = static_cast<std::size_t>(key.op);
+        const auto combine = [&seed](const std::size_t v) {
+            seed ^= std::hash<std::size_t>{}(v) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+        };
+        for(const auto opr : key.operands) {combine(opr);}
+        combine(key.index);
+        combine(static_cast<std::size_t>(key.value));
+        return seed;
+    }
+};
+
+// Assumptions that the expansion of builtin functions may rely on to drop
+// the handling of special values (see CompileOptions in jit.hpp).
+struct LoweringOptions
+{
+    bool no_nans = false; // log(x) for x < 0 does not occur
+    bool no_infs = false; // log(inf) and log(0) do not occur
+
+    // exp, log, sin and cos are Call instructions to the C library instead
+    // of the polynomials. Only evaluate() can run the Program.
+    bool call_library = false;
+};
+
+struct Lowering
+{
+    LoweringOptions                    options;
+    Program                            prog;
+    std::map<std::string, std::size_t> args; // name -> Argument or the value of a local
+    std::unordered_map<ValueKey, std::size_t, ValueKeyHash> values;
+
+    // returns an existing value if any. `node` is false for the values that
+    // do not correspond to an AST node, e.g. the sign mask of Neg.
+    std::size_t intern(const Instruction& inst, const bool node = true)
+    {
+        const auto [found, inserted] = values.emplace(ValueKey(inst), prog.code.size());
+        if(!inserted)
+        {
+            if(node) {prog.merged += 1;}
+            return found->second;
+        }
+        prog.code.push_back(inst);
+        return found->second;
+    }
+    std::size_t intern(Opcode op, std::size_t lhs, std::size_t rhs, const bool node = true)
+    {
+        return this->intern(Instruction{op, {lhs, rhs, Program::npos}, 0, 0.0}, node);
+    }
+    // In single precision, constants are rounded to float. Any float value
+    // can be represented as a double, so it is kept in `value`.
+    std::size_t constant(double v, const bool node = true)
+    {
+        const auto npos = Program::npos;
+        if(this->single())
+        {
+            v = static_cast<double>(static_cast<float>(v));
+        }
+        return this->intern(Instruction{Opcode::Constant, {npos, npos, npos}, 0, v,
+                                        bits_of(v, prog.precision)}, node);
+    }
+    bool single() const noexcept {return prog.precision == Precision::Single;}
+
+    std::size_t lower(const Node& node)
+    {
+        return std::visit([this](const auto& n) {return this->lower(n);}, node.node);
+    }
+
+    std::size_t lower(const NodeVariable& node)
+    {
+        const auto found = args.find(node.name);
+        if(found == args.end())
+        {
+            throw std::runtime_error("jitome::lower: unknown variable: " + node.name);
+        }
+        return found->second;
+    }
+    std::size_t lower(const NodeImmediate& node)
+    {
+        return this->constant(node.value);
+    }
+    std::size_t lower(const NodeExpression& node)
+    {
+        using namespace std::literals::string_view_literals;
+
+        if(const auto* builtin = find_builtin(node.function))
+        {
+            return this->call(*builtin, node);
+        }
+        if(is_comparison(node.function) || is_logical(node.function))
+        {
+            // 1 or 0 from the mask
+            return this->node_value(this->op(Opcode::And, this->condition(node), this->imm(1.0)));
+        }
+        if(node.operands.size() == 1)
+        {
+            if(node.function != "-"sv)
+            {
+                throw std::runtime_error("jitome::lower: unknown unary operator: " +
+                                         std::string(node.function));
+            }
+            const auto x = this->lower(node.operands.at(0));
+            return this->intern(Opcode::Neg, x, this->constant(-0.0, false));
+        }
+        if(node.operands.size() != 2)
+        {
+            throw std::runtime_error("jitome::lower: invalid number of operands in binary operator");
+        }
+
+        if(node.function == "^"sv)
+        {
+            const auto* n = std::get_if<NodeImmediate>(&node.operands.at(1).node);
+            if(!n || !is_integer_exponent(n->value))
+            {
+                throw std::runtime_error("jitome::lower: exponent of `^` should be an integer immediate");
+            }
+            return this->power(this->lower(node.operands.at(0)),
+                               static_cast<std::int64_t>(n->value));
+        }
+
+        Opcode op;
+        if     (node.function == "+"sv) {op = Opcode::Add;}
+        else if(node.function == "-"sv) {op = Opcode::Sub;}
+        else if(node.function == "*"sv) {op = Opcode::Mul;}
+        else if(node.function == "/"sv) {op = Opcode::Div;}
+        else
+        {
+            throw std::runtime_error("jitome::lower: unknown binary operator: " +
+                                     std::string(node.function));
+        }
+        const auto lhs = this->lower(node.operands.at(0));
+        const auto rhs = this->lower(node.operands.at(1));
+        return this->intern(op, lhs, rhs);
+    }
+    // x^n as a chain of multiplications in the same order as powi(). The
+    // squares are interned, so x^2 in `x^8 + x^2` is computed once. Only the
+    // last instruction corresponds to the AST node.
+    std::size_t power(const std::size_t x, const std::int64_t n)
+    {
+        if(n == 0)
+        {
+            return this->constant(1.0);
+        }
+        const auto m = (n < 0) ? 0 - static_cast<std::uint64_t>(n) : static_cast<std::uint64_t>(n);
+
+        std::size_t r = x;
+        for(int bit = 62 - __builtin_clzll(m); 0 <= bit; --bit)
+        {
+            const bool odd  = (m >> bit) & 1u;
+            const bool last = (0 < n) && (bit == 0);
+            r = this->intern(Opcode::Mul, r, r, last && !odd);
+            if(odd)
+            {
+                r = this->intern(Opcode::Mul, r, x, last);
+            }
+        }
+        if(n < 0)
+        {
+            r = this->intern(Opcode::Div, this->constant(1.0, false), r);
+        }
+        return r;
+    }
+
+    // -----------------------------------------------------------------------
+    // conditions
+    //
+    // A condition is lowered into a mask, all-one bits if it is true. `&&`
+    // and `||` are bitwise operations on the masks and select() picks the
+    // bits, so the code has no branch and works in packed code as well.
+
+    std::size_t condition(const Node& node)
+    {
+        const auto* expr = std::get_if<NodeExpression>(&node.node);
+        if(!expr || !(is_comparison(expr->function) || is_logical(expr->function)))
+        {
+            // any value other than 0 is true. NaN != 0 is true as well.
+            return this->op(Opcode::NotEqual, this->lower(node), this->imm(0.0));
+        }
+        return this->condition(*expr);
+    }
+    std::size_t condition(const NodeExpression& expr)
+    {
+        using namespace std::literals::string_view_literals;
+        if(expr.operands.size() != 2)
+        {
+            throw std::runtime_error("jitome::lower: invalid number of operands in `" +
+                                     std::string(expr.function) + "`");
+        }
+        const auto f = expr.function;
+        if(is_logical(f))
+        {
+            const auto lhs = this->condition(expr.operands.at(0));
+            const auto rhs = this->condition(expr.operands.at(1));
+            return this->op((f == "&&"sv) ? Opcode::And : Opcode::Or, lhs, rhs);
+        }
+        const auto lhs = this->lower(expr.operands.at(0));
+        const auto rhs = this->lower(expr.operands.at(1));
+        if(f == "<"sv ) {return this->op(Opcode::Less,      lhs, rhs);}
+        if(f == "<="sv) {return this->op(Opcode::LessEqual, lhs, rhs);}
+        if(f == ">"sv ) {return this->op(Opcode::Less,      rhs, lhs);}
+        if(f == ">="sv) {return this->op(Opcode::LessEqual, rhs, lhs);}
+        if(f == "=="sv) {return this->op(Opcode::Equal,     lhs, rhs);}
+        return this->op(Opcode::NotEqual, lhs, rhs);
+    }
+
+    // counts the AST node as merged if `v` already existed
+    std::size_t node_value(const std::size_t v)
+    {
+        if(v + 1 != prog.code.size())
+        {
+            prog.merged += 1;
+        }
+        return v;
+    }
+
+    // -----------------------------------------------------------------------
+    // builtin functions
+    //
+    // Values created in the expansion do not correspond to AST nodes. If the
+    // whole call is an existing value, the call node is counted as merged.
+
+    std::size_t call(const Builtin& builtin, const NodeExpression& node)
+    {
+        using namespace std::literals::string_view_literals;
+        if(node.operands.size() != builtin.arity)
+        {
+            throw std::runtime_error("jitome::lower: invalid number of arguments of " +
+                                     std::string(builtin.name));
+        }
+        if(builtin.name == "select"sv)
+        {
+            const auto mask = this->condition(node.operands.at(0));
+            const auto a    = this->lower(node.operands.at(1));
+            const auto b    = this->lower(node.operands.at(2));
+            return this->node_value(this->select(mask, a, b));
+        }
+
+        std::array<std::size_t, max_builtin_arity> args{Program::npos, Program::npos, Program::npos};
+        for(std::size_t i=0; i<builtin.arity; ++i)
+        {
+            args.at(i) = this->lower(node.operands.at(i));
+        }
+        const auto lowered = prog.code.size();
+
+        std::size_t retval = Program::npos;
+        if(options.call_library && (builtin.name == "exp"sv || builtin.name == "log"sv ||
+                                    builtin.name == "sin"sv || builtin.name == "cos"sv))
+        {
+            const auto npos = Program::npos;
+            const auto idx  = static_cast<std::size_t>(&builtin - builtins.data());
+            retval = this->intern(Instruction{Opcode::Call, {args[0], npos, npos}, idx, 0.0}, false);
+        }
+        else if(builtin.name == "sqrt"sv) {retval = this->op(Opcode::Sqrt, args[0]);}
+        else if(builtin.name == "abs"sv ) {retval = this->abs(args[0]);}
+        else if(builtin.name == "min"sv ) {retval = this->op(Opcode::Min, args[0], args[1]);}
+        else if(builtin.name == "max"sv ) {retval = this->op(Opcode::Max, args[0], args[1]);}
+        else if(builtin.name == "exp"sv ) {retval = this->exp(args[0]);}
+        else if(builtin.name == "log"sv ) {retval = this->log(args[0]);}
+        else if(builtin.name == "sin"sv ) {retval = this->sincos(args[0], 0.0);}
+        else if(builtin.name == "cos"sv ) {retval = this->sincos(args[0], 1.0);}
+        else if(builtin.name == "sign"sv) {retval = this->sign(args[0]);}
+        else if(builtin.name == "clamp"sv)
+        {
+            retval = this->op(Opcode::Min, this->op(Opcode::Max, args[0], args[1]), args[2]);
+        }
+        else
+        {
+            throw std::runtime_error("jitome::lower: unknown function: " +
+                                     std::string(builtin.name));
+        }
+        if(prog.code.size() == lowered)
+        {
+            prog.merged += 1;
+        }
+        return retval;
+    }
+
+    std::size_t op(const Opcode code, const std::size_t a, const std::size_t b = Program::npos)
+    {
+        return this->intern(Instruction{code, {a, b, Program::npos}, 0, 0.0}, false);
+    }
+    std::size_t shift(const Opcode code, const std::size_t a, const std::size_t count)
+    {
+        return this->intern(Instruction{code, {a, Program::npos, Program::npos}, count, 0.0}, false);
+    }
+    std::size_t imm (const double v)         {return this->constant(v, false);}
+    // a bit pattern of the format of the program. For float, only the lower 32 bits are used.
+    std::size_t bits(std::uint64_t v)
+    {
+        const auto npos = Program::npos;
+        double value = bit_cast<double>(v);
+        if(this->single())
+        {
+            v     = static_cast<std::uint32_t>(v);
+            value = bit_cast<float>(static_cast<std::uint32_t>(v));
+        }
+        return this->intern(Instruction{Opcode::Constant, {npos, npos, npos}, 0, value, v}, false);
+    }
+    // number of the bits of the fraction and the exponent bias
+    std::size_t mantissa() const noexcept {return this->single() ? 23 : 52;}
+    double      bias()     const noexcept {return this->single() ? 127.0 : 1023.0;}
+    std::size_t add(const std::size_t a, const std::size_t b) {return this->op(Opcode::Add, a, b);}
+    std::size_t sub(const std::size_t a, const std::size_t b) {return this->op(Opcode::Sub, a, b);}
+    std::size_t mul(const std::size_t a, const std::size_t b) {return this->op(Opcode::Mul, a, b);}
+    std::size_t div(const std::size_t a, const std::size_t b) {return this->op(Opcode::Div, a, b);}
+
+    std::size_t abs(const std::size_t x)
+    {
+        return this->op(Opcode::And, x, this->bits(this->single() ? 0x7FFFFFFFull : 0x7FFFFFFFFFFFFFFFull));
+    }
+    // 1 or -1, or x itself if it is 0, -0 or NaN
+    std::size_t sign(const std::size_t x)
+    {
+        const auto zero = this->imm(0.0);
+        return this->select(this->op(Opcode::Less, zero, x), this->imm(1.0),
+                   this->select(this->op(Opcode::Less, x, zero), this->imm(-1.0), x));
+    }
+    // mask ? a : b
+    std::size_t select(const std::size_t mask, const std::size_t a, const std::size_t b)
+    {
+        return this->op(Opcode::Or, this->op(Opcode::And, mask, a), this->op(Opcode::AndNot, mask, b));
+    }
+    // rounds to the nearest integer (ties to even) if |x| < 2^51 (2^22 for
+    // float). Adding 1.5 * 2^52 (2^23) drops the fractional bits.
+    std::size_t magic() {return this->imm(this->single() ? 0x1.8p23 : 0x1.8p52);}
+    std::size_t round(const std::size_t x)
+    {
+        return this->sub(this->add(x, this->magic()), this->magic());
+    }
+    // 2^k for an integer k in [-1022, 1023] ([-126, 127] for float).
+    // 1.5 * 2^52 + (k + 1023) has k + 1023 in the lowest bits, and they are
+    // shifted to the exponent.
+    std::size_t pow2(const std::size_t k)
+    {
+        const double m = this->single() ? 0x1.8p23 : 0x1.8p52;
+        return this->shift(Opcode::ShiftLeft, this->add(k, this->imm(m + this->bias())), this->mantissa());
+    }
+    // c[0] + c[1] x + c[2] x^2 + ... by Horner's method
+    std::size_t polynomial(const std::size_t x, const std::vector<double>& c)
+    {
+        auto iter = std::rbegin(c);
+        std::size_t p = this->imm(*iter);
+        for(++iter; iter != std::rend(c); ++iter)
+        {
+            p = this->add(this->mul(p, x), this->imm(*iter));
+        }
+        return p;
+    }
+
+    // exp(x) = 2^k exp(r), where x = k ln2 + r and |r| <= ln2 / 2.
+    std::size_t exp(const std::size_t x0)
+    {
+        // k * ln2_hi is exact
+        const double ln2_hi = this->single() ? 6.9314575195e-01 : 6.93147180369123816490e-01;
+        const double ln2_lo = this->single() ? 1.4286067653e-06 : 1.90821492927058770002e-10;
+
+        // out of this range, the result is 0 or inf anyway. maxsd and minsd
+        // return the second operand if it is NaN, so NaN is kept.
+        const double limit = this->single() ? 150.0 : 1080.0;
+        const auto x = this->op(Opcode::Min, this->imm(limit),
+                                this->op(Opcode::Max, this->imm(-limit), x0));
+
+        const auto k = this->round(this->mul(x, this->imm(1.44269504088896338700e+00)));
+        const auto r = this->sub(this->sub(x, this->mul(k, this->imm(ln2_hi))),
+                                 this->mul(k, this->imm(ln2_lo)));
+
+        // Taylor series up to r^13 (r^8 for float). The truncation error is
+        // below 2^-57 (2^-27).
+        std::vector<double> c;
+        double factorial = 1.0;
+        for(std::size_t n=0; n < (this->single() ? 9u : 14u); ++n)
+        {
+            factorial *= (n == 0) ? 1.0 : static_cast<double>(n);
+            c.push_back(1.0 / factorial);
+        }
+        const auto p = this->polynomial(r, c);
+
+        // 2^k is split into two factors, so that the result overflows and
+        // underflows (into subnormal numbers) correctly.
+        const auto k1 = this->round(this->mul(k, this->imm(0.5)));
+        const auto k2 = this->sub(k, k1);
+        return this->mul(this->mul(p, this->pow2(k1)), this->pow2(k2));
+    }
+
+    // log(x) = e ln2 + log(m), where x = 2^e m and m is in [sqrt(2)/2, sqrt(2)).
+    // The kernel is the same as fdlibm.
+    std::size_t log(const std::size_t x)
+    {
+        // e * ln2_hi is exact
+        const double ln2_hi = this->single() ? 6.9314575195e-01 : 6.93147180369123816490e-01;
+        const double ln2_lo = this->single() ? 1.4286067653e-06 : 1.90821492927058770002e-10;
+        constexpr double inf = std::numeric_limits<double>::infinity();
+
+        // subnormal numbers are scaled by 2^52 (2^23 for float)
+        const auto   mbits  = static_cast<double>(this->mantissa());
+        const double scale  = std::ldexp(1.0, static_cast<int>(this->mantissa()));
+        const auto   tiny   = this->op(Opcode::Less, x, this->imm(this->single() ? 0x1p-126 : 0x1p-1022));
+        const auto   xs     = this->select(tiny, this->mul(x, this->imm(scale)), x);
+
+        // the exponent field is converted by putting it in the lowest bits of 2^52
+        const auto ef = this->op(Opcode::Or, this->shift(Opcode::ShiftRight, xs, this->mantissa()),
+                                 this->imm(scale));
+        const auto e0 = this->sub(this->sub(ef, this->imm(scale + this->bias())),
+                                  this->op(Opcode::And, tiny, this->imm(mbits)));
+        const auto fraction = this->single() ? 0x007FFFFFull : 0x000FFFFFFFFFFFFFull;
+        const auto m0 = this->op(Opcode::Or, this->op(Opcode::And, xs, this->bits(fraction)),
+                                 this->imm(1.0));
+
+        // m0 is in [1, 2). halve it if m0 >= sqrt(2). c is 0 or 1.
+        const auto c = this->round(this->sub(this->mul(m0, this->imm(0x1.6a09e667f3bcdp-1)), this->imm(0.5)));
+        const auto e = this->add(e0, c);
+        const auto m = this->mul(m0, this->sub(this->imm(1.0), this->mul(c, this->imm(0.5))));
+
+        const auto f    = this->sub(m, this->imm(1.0));
+        const auto s    = this->div(f, this->add(this->imm(2.0), f));
+        const auto z    = this->mul(s, s);
+        const auto w    = this->mul(z, z);
+        const auto t1   = this->mul(w, this->polynomial(w, {
+                3.999999999940941908e-01, 2.222219843214978396e-01, 1.531383769920937332e-01}));
+        const auto t2   = this->mul(z, this->polynomial(w, {
+                6.666666666666735130e-01, 2.857142874366239149e-01,
+                1.818357216161805012e-01, 1.479819860511658591e-01}));
+        const auto R    = this->add(t2, t1);
+        const auto hfsq = this->mul(this->mul(this->imm(0.5), f), f);
+
+        // e ln2_hi - ((hfsq - (s (hfsq + R) + e ln2_lo)) - f)
+        const auto y = this->sub(this->mul(e, this->imm(ln2_hi)),
+            this->sub(this->sub(hfsq, this->add(this->mul(s, this->add(hfsq, R)),
+                                                this->mul(e, this->imm(ln2_lo)))), f));
+
+        // +inf and NaN are returned as they are. For x <= 0, sqrt(x) is +0,
+        // -0 or NaN, so sqrt(x) - inf is -inf for zeros and NaN otherwise.
+        const auto y1 = options.no_infs ? y :
+                        this->select(this->op(Opcode::Less, x, this->imm(inf)), y, x);
+        if(options.no_nans && options.no_infs)
+        {
+            return y1;
+        }
+        return this->select(this->op(Opcode::Less, this->imm(0.0), x), y1,
+                            this->sub(this->op(Opcode::Sqrt, x), this->imm(inf)));
+    }
+
+    // sin(x) if phase is 0, cos(x) if phase is 1. cos(x) is sin(x + pi/2).
+    std::size_t sincos(const std::size_t x, const double phase)
+    {
+        // x = k pi/2 + r, |r| <= pi/4. pi/2 is split into three parts of 33
+        // bits, so k * p1 and k * p2 are exact if |k| < 2^20. For float, the
+        // first two parts have 12 bits and |k| < 2^12. This is used for
+        // |x| < 1e6 (4096 for float).
+        const double p1 = this->single() ?  0x1.922p0      : 0x1.921fb544p0;
+        const double p2 = this->single() ? -0x1.2aep-18    : 0x1.0b4611a6p-34;
+        const double p3 = this->single() ? -0x1.de973ep-31 : 0x1.3198a2ep-69;
+
+        const auto k0 = this->round(this->mul(x, this->imm(0x1.45f306dc9c883p-1)));
+        const auto r0 = this->sub(this->sub(this->sub(x, this->mul(k0, this->imm(p1))),
+                                            this->mul(k0, this->imm(p2))),
+                                  this->mul(k0, this->imm(p3)));
+
+        // The other lanes, including inf and NaN, are reduced by Payne-Hanek
+        // (payne_hanek.hpp). k is then the quadrant in [0, 4).
+        const auto in_range = this->op(Opcode::Less, this->abs(x),
+                                       this->imm(this->single() ? 4096.0 : 1e6));
+        const auto k = this->reduce(1, x, k0, in_range);
+        const auto r = this->reduce(0, x, r0, in_range);
+
+        // kernels of fdlibm on [-pi/4, pi/4]
+        const auto z = this->mul(r, r);
+        const auto s = this->add(r, this->mul(this->mul(z, r), this->polynomial(z, {
+                -1.66666666666666324348e-01,  8.33333333332248946124e-03,
+                -1.98412698298579493134e-04,  2.75573137070700676789e-06,
+                -2.50507602534068634195e-08,  1.58969099521155010221e-10})));
+        const auto hz = this->mul(this->imm(0.5), z);
+        const auto w  = this->sub(this->imm(1.0), hz);
+        const auto c  = this->add(w, this->add(this->sub(this->sub(this->imm(1.0), w), hz),
+            this->mul(this->mul(z, z), this->polynomial(z, {
+                 4.16666666666666019037e-02, -1.38888888888741095749e-03,
+                 2.48015872894767294178e-05, -2.75573143513906633035e-07,
+                 2.08757232129817482790e-09, -1.13596475577881948265e-11}))));
+
+        // q = (k + phase) mod 4 selects one of s, c, -s and -c. b0 and b1
+        // are the bits of q. floor(y) is round(y - 0.375) for y = k/4.
+        const auto kq = (phase == 0.0) ? k : this->add(k, this->imm(phase));
+        const auto q  = this->sub(kq, this->mul(this->imm(4.0), this->round(
+                            this->sub(this->mul(kq, this->imm(0.25)), this->imm(0.375)))));
+        const auto b1 = this->round(this->sub(this->mul(q, this->imm(0.5)), this->imm(0.25)));
+        const auto b0 = this->sub(q, this->mul(this->imm(2.0), b1));
+
+        // (1 - b0) s + b0 c, with the sign flipped if b1 == 1
+        const auto y  = this->add(this->mul(s, this->sub(this->imm(1.0), b0)), this->mul(c, b0));
+        const auto ys = this->mul(y, this->sub(this->imm(1.0), this->mul(this->imm(2.0), b1)));
+
+        // sin(x) is x for tiny x, as in fdlibm. It also keeps the sign of -0.
+        if(phase == 0.0)
+        {
+            return this->select(this->op(Opcode::Less, this->abs(x),
+                this->imm(this->single() ? 0x1p-12 : 0x1p-27)), x, ys);
+        }
+        return ys;
+    }
+    // Reduce: `fast` where `in_range` is true, otherwise the remainder
+    // (idx 0) or the quadrant (idx 1) of x by Payne-Hanek
+    std::size_t reduce(const std::size_t idx, const std::size_t x, const std::size_t fast,
+                       const std::size_t in_range)
+    {
+        return this->intern(Instruction{Opcode::Reduce, {x, fast, in_range}, idx, 0.0}, false);
+    }
+
+    std::size_t lower(const NodeFunction&)
+    {
+        throw std::runtime_error("function call is not supported");
+    }
+
+    // A local is just a name of a value, so it lives in a register as long
+    // as it is used, like any other value.
+    std::size_t lower_body(const NodeFunction& func)
+    {
+        const auto scope = this->args;
+        for(const auto& local : func.locals)
+        {
+            const auto value = this->lower(local.value.get());
+            this->args[local.name] = value;
+        }
+        const auto retval = this->lower(func.body.get());
+        this->args = scope;
+        return retval;
+    }
+};
+
+// arguments are placed at the beginning of the program in the same order as
+// the function definition, even if they are not used.
+inline Program lower(const NodeFunction& func, const Precision precision = Precision::Double,
+                     const LoweringOptions& options = LoweringOptions{})
+{
+    Lowering l;
+    l.options        = options;
+    l.prog.arity     = func.args.size();
+    l.prog.precision = precision;
+    for(std::size_t i=0; i<func.args.size(); ++i)
+    {
+        l.args[func.args.at(i)] = l.prog.push_argument(i);
+    }
+    l.prog.result = l.lower_body(func);
+    return std::move(l.prog);
+}
+
+// Lowers functions that have the same arguments into one Program that writes
+// the result of the i-th function to the i-th output. Values are shared
+// between the functions, so a common subexpression is computed only once.
+inline Program lower(const std::vector<NodeFunction>& funcs,
+                     const Precision precision = Precision::Double,
+                     const LoweringOptions& options = LoweringOptions{})
+{
+    if(funcs.empty())
+    {
+        throw std::runtime_error("jitome::lower: no function");
+    }
+    Lowering l;
+    l.options        = options;
+    const auto& args = funcs.front().args;
+    l.prog.arity     = args.size();
+    l.prog.precision = precision;
+    for(std::size_t i=0; i<args.size(); ++i)
+    {
+        l.args[args.at(i)] = l.prog.push_argument(i);
+    }
+    for(std::size_t i=0; i<funcs.size(); ++i)
+    {
+        if(funcs.at(i).args != args)
+        {
+            throw std::runtime_error("jitome::lower: functions should have the same arguments");
+        }
+        const auto v = l.lower_body(funcs.at(i));
+        l.prog.code.push_back(Instruction{Opcode::Output, {v, Program::npos, Program::npos}, i, 0.0});
+    }
+    l.prog.outputs = funcs.size();
+    return std::move(l.prog);
+}
+
+// ---------------------------------------------------------------------------
+// passes
+
+// number of uses of each value. The result counts as a use.
+inline std::vector<std::size_t> count_uses(const Program& prog)
+{
+    std::vector<std::size_t> uses(prog.code.size(), 0);
+    for(const auto& inst : prog.code)
+    {
+        for(std::size_t j=0; j<num_operands(inst.op); ++j)
+        {
+            uses.at(inst.operands.at(j)) += 1;
+        }
+    }
+    if(prog.result != Program::npos)
+    {
+        uses.at(prog.result) += 1;
+    }
+    return uses;
+}
+
+// removes values that are not used. Arguments and outputs are always kept.
+inline Program eliminate_dead_code(const Program& prog)
+{
+    std::vector<bool> live(prog.code.size(), false);
+    if(prog.result != Program::npos)
+    {
+        live.at(prog.result) = true;
+    }
+    for(std::size_t i=prog.code.size(); i != 0; --i)
+    {
+        const auto& inst = prog.code.at(i-1);
+        if(inst.op == Opcode::Argument || inst.op == Opcode::Output)
+        {
+            live.at(i-1) = true;
+        }
+        if(!live.at(i-1))
+        {
+            continue;
+        }
+        for(std::size_t j=0; j<num_operands(inst.op); ++j)
+        {
+            live.at(inst.operands.at(j)) = true;
+        }
+    }
+
+    Program retval;
+    retval.arity     = prog.arity;
+    retval.merged    = prog.merged;
+    retval.outputs   = prog.outputs;
+    retval.precision = prog.precision;
+    std::vector<std::size_t> renamed(prog.code.size(), Program::npos);
+    for(std::size_t i=0; i<prog.code.size(); ++i)
+    {
+        if(!live.at(i))
+        {
+            continue;
+        }
+        auto inst = prog.code.at(i);
+        for(std::size_t j=0; j<num_operands(inst.op); ++j)
+        {
+            inst.operands.at(j) = renamed.at(inst.operands.at(j));
+        }
+        renamed.at(i) = retval.code.size();
+        retval.code.push_back(inst);
+    }
+    retval.result = (prog.result == Program::npos) ? Program::npos : renamed.at(prog.result);
+    return retval;
+}
+
+// maximum number of values that are live at the same time, i.e. the number
+// of registers needed to run the program without spilling. A value is live
+// from its definition to its last use, and an argument from its first use
+// because it can be loaded from memory when it is needed. Constants are not
+// counted because they are used as memory operands.
+inline std::size_t max_live(const Program& prog)
+{
+    const auto npos = Program::npos;
+    std::vector<std::size_t> first(prog.code.size(), npos), last(prog.code.size(), 0);
+    for(std::size_t i=0; i<prog.code.size(); ++i)
+    {
+        const auto& inst = prog.code.at(i);
+        for(std::size_t j=0; j<num_operands(inst.op); ++j)
+        {
+            const auto v = inst.operands.at(j);
+            first.at(v) = std::min(first.at(v), i);
+            last.at(v)  = i;
+        }
+    }
+    if(prog.result != npos)
+    {
+        last.at(prog.result) = prog.code.size();
+    }
+
+    // +1 where a value becomes live and -1 where it dies
+    std::vector<std::ptrdiff_t> delta(prog.code.size() + 1, 0);
+    for(std::size_t v=0; v<prog.code.size(); ++v)
+    {
+        const auto op    = prog.code.at(v).op;
+        const auto start = (op == Opcode::Argument) ? first.at(v) : v;
+        if(op == Opcode::Constant || op == Opcode::Output || start == npos || last.at(v) <= start)
+        {
+            continue;
+        }
+        delta.at(start)   += 1;
+        delta.at(last.at(v)) -= 1;
+    }
+    std::ptrdiff_t live = 0, peak = 0;
+    for(const auto d : delta)
+    {
+        live += d;
+        peak  = std::max(peak, live);
+    }
+    return static_cast<std::size_t>(peak);
+}
+
+// Reorders the instructions to reduce the number of live values (Sethi-Ullman
+// ordering). Lowering evaluates operands from left to right, so a right-heavy
+// tree like `f(a) + (f(b) + (f(c) + f(d)))` keeps all of f(a), f(b), f(c)
+// alive until f(d) is computed. This evaluates the operand that needs more
+// registers (its Ershov number) first. Only the order of evaluation changes;
+// the operands keep their positions, so `-` and `/` are not affected.
+//
+// The numbers are computed as if the DAG were a tree. Arguments stay at the
+// beginning and values that are not used are removed.
+inline Program schedule(const Program& prog)
+{
+    const auto npos = Program::npos;
+
+    // distinct operands, in the order of the positions
+    const auto operands_of = [&prog](const std::size_t v) {
+        const auto& inst = prog.code.at(v);
+        std::vector<std::size_t> ops;
+        for(std::size_t j=0; j<num_operands(inst.op); ++j)
+        {
+            if(std::find(ops.begin(), ops.end(), inst.operands.at(j)) == ops.end())
+            {
+                ops.push_back(inst.operands.at(j));
+            }
+        }
+        return ops;
+    };
+
+    // operands always precede, so one forward walk is enough
+    std::vector<std::size_t> need(prog.code.size(), 0);
+    for(std::size_t v=0; v<prog.code.size(); ++v)
+    {
+        const auto op = prog.code.at(v).op;
+        if(op == Opcode::Argument)
+        {
+            need.at(v) = 1;
+            continue;
+        }
+        std::vector<std::size_t> needs;
+        for(const auto opr : operands_of(v))
+        {
+            needs.push_back(need.at(opr));
+        }
+        std::sort(needs.begin(), needs.end(), std::greater<std::size_t>{});
+        for(std::size_t i=0; i<needs.size(); ++i)
+        {
+            need.at(v) = std::max(need.at(v), needs.at(i) + i);
+        }
+        if(op != Opcode::Constant)
+        {
+            need.at(v) = std::max<std::size_t>(need.at(v), 1);
+        }
+    }
+
+    Program retval;
+    retval.arity     = prog.arity;
+    retval.merged    = prog.merged;
+    retval.outputs   = prog.outputs;
+    retval.precision = prog.precision;
+    std::vector<std::size_t> renamed(prog.code.size(), npos);
+
+    const std::function<void(std::size_t)> visit = [&](const std::size_t v) {
+        if(renamed.at(v) != npos)
+        {
+            return;
+        }
+        auto ops = operands_of(v);
+        std::stable_sort(ops.begin(), ops.end(), [&need](const std::size_t a, const std::size_t b) {
+            return need.at(a) > need.at(b);
+        });
+        for(const auto opr : ops)
+        {
+            visit(opr);
+        }
+        auto inst = prog.code.at(v);
+        for(std::size_t j=0; j<num_operands(inst.op); ++j)
+        {
+            inst.operands.at(j) = renamed.at(inst.operands.at(j));
+        }
+        renamed.at(v) = retval.code.size();
+        retval.code.push_back(inst);
+    };
+    for(std::size_t v=0; v<prog.code.size(); ++v)
+    {
+        if(prog.code.at(v).op == Opcode::Argument)
+        {
+            visit(v);
+        }
+    }
+    for(std::size_t v=0; v<prog.code.size(); ++v)
+    {
+        if(prog.code.at(v).op == Opcode::Output)
+        {
+            visit(v);
+        }
+    }
+    if(prog.result != npos)
+    {
+        visit(prog.result);
+        retval.result = renamed.at(prog.result);
+    }
+    return retval;
+}
+
+// Contracts a multiplication and the following addition or subtraction into
+// a fused multiply-add. It changes the result because the product is not
+// rounded, so it should be used only if it is explicitly requested.
+//
+//   a * b + c -> MulAdd(a, b, c)
+//   a * b - c -> MulSub(a, b, c)
+//   c - a * b -> NegMulAdd(a, b, c)
+//
+// Only products that are not used elsewhere are contracted.
+inline Program contract(Program prog)
+{
+    const auto uses = count_uses(prog);
+    const auto is_product = [&](const std::size_t v) {
+        return prog.code.at(v).op == Opcode::Mul && uses.at(v) == 1;
+    };
+
+    bool changed = false;
+    for(auto& inst : prog.code)
+    {
+        if(inst.op != Opcode::Add && inst.op != Opcode::Sub)
+        {
+            continue;
+        }
+        const auto lhs = inst.operands.at(0);
+        const auto rhs = inst.operands.at(1);
+        if(lhs == rhs)
+        {
+            continue;
+        }
+        std::size_t mul = Program::npos;
+        std::size_t acc = Program::npos;
+        if(is_product(lhs))
+        {
+            mul = lhs;
+            acc = rhs;
+            inst.op = (inst.op == Opcode::Add) ? Opcode::MulAdd : Opcode::MulSub;
+        }
+        else if(is_product(rhs))
+        {
+            mul = rhs;
+            acc = lhs;
+            inst.op = (inst.op == Opcode::Add) ? Opcode::MulAdd : Opcode::NegMulAdd;
+        }
+        else
+        {
+            continue;
+        }
+        inst.operands = {prog.code.at(mul).operands.at(0),
+                         prog.code.at(mul).operands.at(1), acc};
+        changed = true;
+    }
+    return changed ? eliminate_dead_code(prog) : prog;
+}
+
+// Replaces division with the approximate reciprocal (rcp, about 12 or 14
+// bits) refined by `steps` Newton-Raphson iterations. Each step roughly
+// doubles the number of correct bits. The result differs by a few ulp, and
+// the approximation is not correct for divisors that are 0, inf or
+// subnormal.
+//
+//   a / sqrt(b) -> a * y, y = rsqrt(b), y <- y * (1.5 - (0.5 * b) * y * y)
+//   a / b       -> a * r, r = rcp(b),   r <- r * (2 - b * r)
+//   a / c       -> a * (1 / c) for a constant c, if 1 / c is a normal number
+//
+// `1 / b` is the refined reciprocal itself.
+inline Program approximate_division(const Program& prog, const std::size_t steps)
+{
+    const auto npos   = Program::npos;
+    const bool single = prog.precision == Precision::Single;
+
+    Program retval;
+    retval.arity     = prog.arity;
+    retval.merged    = prog.merged;
+    retval.outputs   = prog.outputs;
+    retval.precision = prog.precision;
+    const auto rounded = [single](const double v) {
+        return single ? static_cast<double>(static_cast<float>(v)) : v;
+    };
+    const auto constant = [&retval, &rounded](const double v) {
+        return retval.push_constant(rounded(v));
+    };
+    const auto is_one = [&retval](const std::size_t v) {
+        return retval.code.at(v).op == Opcode::Constant && retval.code.at(v).value == 1.0;
+    };
+
+    bool changed = false;
+    std::vector<std::size_t> renamed(prog.code.size(), npos);
+    for(std::size_t v=0; v<prog.code.size(); ++v)
+    {
+        auto inst = prog.code.at(v);
+        for(std::size_t j=0; j<num_operands(inst.op); ++j)
+        {
+            inst.operands.at(j) = renamed.at(inst.operands.at(j));
+        }
+        // a constant whose reciprocal overflows or is subnormal is kept
+        const auto divisor = (inst.op == Opcode::Div) ? retval.code.at(inst.operands.at(1)) : inst;
+        if(inst.op != Opcode::Div ||
+           (divisor.op == Opcode::Constant && !std::isnormal(rounded(1.0 / divisor.value))))
+        {
+            renamed.at(v) = retval.code.size();
+            retval.code.push_back(inst);
+            continue;
+        }
+        changed = true;
+
+        const auto lhs = inst.operands.at(0);
+        const auto rhs = inst.operands.at(1);
+        std::size_t recip = npos;
+        if(divisor.op == Opcode::Constant)
+        {
+            recip = constant(1.0 / divisor.value);
+        }
+        else if(divisor.op == Opcode::Sqrt)
+        {
+            const auto b  = divisor.operands.at(0);
+            const auto hb = retval.push(Opcode::Mul, constant(0.5), b);
+            recip = retval.push(Opcode::RecipSqrt, b);
+            for(std::size_t i=0; i<steps; ++i)
+            {
+                const auto yy = retval.push(Opcode::Mul, recip, recip);
+                const auto t  = retval.push(Opcode::Sub, constant(1.5),
+                                            retval.push(Opcode::Mul, hb, yy));
+                recip = retval.push(Opcode::Mul, recip, t);
+            }
+        }
+        else
+        {
+            recip = retval.push(Opcode::Recip, rhs);
+            for(std::size_t i=0; i<steps; ++i)
+            {
+                const auto t = retval.push(Opcode::Sub, constant(2.0),
+                                           retval.push(Opcode::Mul, rhs, recip));
+                recip = retval.push(Opcode::Mul, recip, t);
+            }
+        }
+        renamed.at(v) = is_one(lhs) ? recip : retval.push(Opcode::Mul, lhs, recip);
+    }
+    if(!changed)
+    {
+        return prog;
+    }
+    retval.result = (prog.result == npos) ? npos : renamed.at(prog.result);
+    return eliminate_dead_code(retval);
+}
+
+} // jitome
+#endif// JITOME_IR_HPP
@@ -0,0 +1,103 @@
+#ifndef JITOME_ISA_HPP
+#define JITOME_ISA_HPP
+#include "xbyak_util.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace jitome
+{
+
+// Instruction sets that the code generator can target.
+//
+// - SSE2:   legacy two-operand encoding. batch kernels are scalar.
+// - AVX:    VEX three-operand encoding. batch kernels use 4 lanes (ymm).
+// - AVX512: batch kernels use 8 lanes (zmm). scalar code is the same as AVX,
+//           except that rcp and rsqrt are the 14-bit ones.
+//
+// FMA3 is used only if it is requested by CompileOptions and the CPU has it.
+enum class Isa : std::uint8_t
+{
+    Auto, // the best one that the CPU supports
+    SSE2,
+    AVX,
+    AVX512,
+};
+
+inline std::string_view to_string(const Isa isa)
+{
+    switch(isa)
+    {
+        case Isa::Auto  : {return "auto";}
+        case Isa::SSE2  : {return "sse2";}
+        case Isa::AVX   : {return "avx";}
+        case Isa::AVX512: {return "avx512";}
+    }
+    return "unknown";
+}
+
+// the CPU that runs the code. It is queried once.
+inline const Xbyak::util::Cpu& host_cpu()
+{
+    static const Xbyak::util::Cpu cpu;
+    return cpu;
+}
+
+inline bool is_supported(const Isa isa)
+{
+    using Cpu = Xbyak::util::Cpu;
+    switch(isa)
+    {
+        case Isa::Auto  : {return true;}
+        case Isa::SSE2  : {return host_cpu().has(Cpu::tSSE2);}
+        case Isa::AVX   : {return host_cpu().has(Cpu::tAVX);}
+        case Isa::AVX512: {return host_cpu().has(Cpu::tAVX | Cpu::tAVX512F);}
+    }
+    return false;
+}
+
+// The best instruction set on this CPU. If the environment variable
+// `JITOME_ISA` is set to one of "sse2", "avx" or "avx512", the result is
+// capped by it. Useful to compare the backends without rebuilding.
+inline Isa host_isa()
+{
+    static const Isa isa = [] {
+        Isa best = Isa::SSE2;
+        if(is_supported(Isa::AVX))    {best = Isa::AVX;}
+        if(is_supported(Isa::AVX512)) {best = Isa::AVX512;}
+
+        if(const char* env = std::getenv("JITOME_ISA"))
+        {
+            for(const auto cap : {Isa::SSE2, Isa::AVX, Isa::AVX512})
+            {
+                if(to_string(cap) == std::string_view(env) && cap < best)
+                {
+                    best = cap;
+                }
+            }
+        }
+        return best;
+    }();
+    return isa;
+}
+
+// resolves Isa::Auto. throws if the CPU does not support the requested one.
+inline Isa resolve(const Isa isa)
+{
+    if(isa == Isa::Auto)
+    {
+        return host_isa();
+    }
+    if(!is_supported(isa))
+    {
+        throw std::runtime_error("jitome: this CPU does not support " +
+                                 std::string(to_string(isa)));
+    }
+    return isa;
+}
+
+} // jitome
+#endif// JITOME_ISA_HPP
@@ -1,12 +1,26 @@
 #ifndef JITOME_JIT_HPP
 #define JITOME_JIT_HPP
 #include "ast.hpp"
+#include "codegen.hpp"
+#include "gradient.hpp"
+#include "ir.hpp"
+#include "isa.hpp"
+#include "optimize.hpp"
 #include "parser.hpp"
+#include "regalloc.hpp"
 #include "tokenizer.hpp"
 #include "util.hpp"
 #include "xbyak.h"
+#include "xbyak_util.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
 #include <string_view>
+#include <type_traits>
+#include <vector>
 #include <cassert>
 
 #ifdef XBYAK32
@@ -20,6 +34,620 @@
 namespace jitome
 {
 
+// Options that change the generated code.
+struct CompileOptions
+{
+    // The instruction set to use. Compilation fails if the CPU does not
+    // support it.
+    Isa isa = Isa::Auto;
+
+    // Contract `a * b + c` into a fused multiply-add if the CPU supports
+    // FMA3. The result changes because the product is not rounded.
+    bool contract = false;
+
+    // Replace `x / c` with `x * (1 / c)` for any constant c. The result may
+    // differ by 1 ulp. Division by a power of two is always replaced because
+    // it is exact (see optimize.hpp).
+    bool reciprocal = false;
+
+    // Fast-math options. They change the result and are independent of
+    // each other. See the tests in test_jit.cpp for the divergence.
+    //
+    // Rebuild chains of `+` and `*` as balanced trees. Sums of values that
+    // cancel may lose all the digits.
+    bool reassociate = false;
+
+    // Replace division and 1 / sqrt with rcp and rsqrt refined by Newton
+    // steps, one for float and two for double (see approximate_division()
+    // in ir.hpp). A few ulp for normal divisors. It is wrong for divisors
+    // that are 0, inf or subnormal. Double requires AVX-512 and is ignored
+    // without it.
+    bool approx_division = false;
+
+    // Assume that the arguments and the results are not NaN. x - x and x / x
+    // are folded, and log() does not check its domain.
+    bool no_nans = false;
+
+    // Assume that the arguments and the results are finite. log() does not
+    // check for inf, and 0 (with no_nans).
+    bool no_infs = false;
+
+    // Assume that the sign of zero does not matter: x + 0 -> x, 0 - x -> -x
+    bool no_signed_zeros = false;
+};
+
+// Isa::Auto is written as the resolved one, so it can be used as a key.
+inline std::string dump(const CompileOptions& options)
+{
+    const auto isa = (options.isa == Isa::Auto) ? host_isa() : options.isa;
+    return std::string("isa=") + std::string(to_string(isa)) +
+           ",contract=" + (options.contract ? "1" : "0") +
+           ",reciprocal=" + (options.reciprocal ? "1" : "0") +
+           ",reassociate=" + (options.reassociate ? "1" : "0") +
+           ",approx_division=" + (options.approx_division ? "1" : "0") +
+           ",no_nans=" + (options.no_nans ? "1" : "0") +
+           ",no_infs=" + (options.no_infs ? "1" : "0") +
+           ",no_signed_zeros=" + (options.no_signed_zeros ? "1" : "0");
+}
+
+inline SimplifyOptions simplify_options(const CompileOptions& options) noexcept
+{
+    SimplifyOptions retval;
+    retval.reciprocal      = options.reciprocal;
+    retval.reassociate     = options.reassociate;
+    retval.no_nans         = options.no_nans;
+    retval.no_signed_zeros = options.no_signed_zeros;
+    return retval;
+}
+
+inline LoweringOptions lowering_options(const CompileOptions& options) noexcept
+{
+    LoweringOptions retval;
+    retval.no_nans = options.no_nans;
+    retval.no_infs = options.no_infs;
+    return retval;
+}
+
+// version of the generated code. Increment this with any change of the
+// lowering (ir.hpp), the emitter (codegen.hpp) or the kernels below that
+// changes the code of a function, so that PersistentCache does not execute
+// the code in the files written before.
+inline constexpr std::uint64_t codegen_version = 2;
+
+// The Program that is emitted: divisions approximated if requested (double
+// only with AVX-512), contracted if FMA is requested and supported (only with
+// AVX), and scheduled to reduce the registers in use. The emit_prepared_*
+// functions take it, so that a compiler that inspects the Program (e.g. for
+// max_live) runs the passes once. The emit_* functions prepare it by
+// themselves.
+inline Program prepare(const Program& lowered, const CompileOptions& options = CompileOptions{})
+{
+    using namespace Xbyak::util;
+    const auto isa    = resolve(options.isa);
+    const bool vex    = isa != Isa::SSE2;
+    const bool fma    = vex && options.contract && host_cpu().has(Cpu::tFMA);
+    const bool single = lowered.precision == Precision::Single;
+    const bool approx = options.approx_division && (single || isa == Isa::AVX512);
+
+    const auto prog = approx ? approximate_division(lowered, single ? 1 : 2) : lowered;
+    return schedule(fma ? contract(prog) : prog);
+}
+
+// The code generators below emit position independent code: jumps are
+// relative and constants are referred with rip-relative addressing. So the
+// code can be copied to another place, e.g. JitModule, as long as the
+// alignment returned by them is kept.
+
+// argumnet register
+// - rdi, rsi, rdx, rcx, r8, r9
+// - xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7
+//
+// return register:
+// - rax,  rdx
+// - xmm0, xmm1
+//
+// A Program with Output instructions, e.g. lowered from several functions,
+// returns nothing and writes the results into the array passed in rdi.
+//
+// float arguments are converted to double in the prologue if the Program
+// computes in double, and so is the result in the epilogue.
+inline std::size_t emit_prepared_function(Xbyak::CodeGenerator& gen, const Program& prog,
+                                          const CompileOptions& options = CompileOptions{},
+                                          const DataTypes types = DataTypes{})
+{
+    using namespace Xbyak::util;
+
+    const auto isa  = resolve(options.isa);
+    const bool vex  = isa != Isa::SSE2;
+
+    RegisterAllocatorConfig config;
+    config.registers              = 16;
+    config.three_operand          = vex;
+    config.arguments_in_registers = true;
+    config.result_register        = 0; // xmm0
+    config.load_arguments         = types.converts_arguments();
+    const auto alloc = allocate_registers(prog, config);
+
+    gen.push(rbp); // prologue
+    gen.mov(rbp, rsp);
+    if(alloc.spill_slots != 0)
+    {
+        gen.and_(rsp, -16);
+        gen.sub (rsp, static_cast<std::uint32_t>(alloc.spill_slots * 16));
+    }
+    if(types.converts_arguments())
+    {
+        for(int i=0; i < static_cast<int>(std::min<std::size_t>(prog.arity, 8)); ++i)
+        {
+            if(vex) {gen.vcvtss2sd(Xbyak::Xmm(i), Xbyak::Xmm(i), Xbyak::Xmm(i));}
+            else    {gen.cvtss2sd (Xbyak::Xmm(i), Xbyak::Xmm(i));}
+        }
+    }
+
+    ConstantPool pool(16, prog.precision);
+    Emitter emitter(gen, prog, pool, Emitter::Arguments::Registers,
+                    /*lanes = */1, isa, /*slot = */16, types);
+    emitter.emit(alloc);
+    if(prog.result != Program::npos && types.converts_result())
+    {
+        const auto res = emitter.vreg(alloc.result.index);
+        if(vex) {gen.vcvtsd2ss(xmm0, res, res);} else {gen.cvtsd2ss(xmm0, res);}
+    }
+    else if(prog.result != Program::npos)
+    {
+        emitter.copy(xmm0, emitter.vreg(alloc.result.index));
+    }
+
+    gen.mov(rsp, rbp);
+    gen.pop(rbp); // epilogue
+    gen.ret();
+
+    pool.emit(gen);
+    return pool.size() == 0 ? 1 : pool.entry();
+}
+inline std::size_t emit_function(Xbyak::CodeGenerator& gen, const Program& lowered,
+                                 const CompileOptions& options = CompileOptions{},
+                                 const DataTypes types = DataTypes{})
+{
+    return emit_prepared_function(gen, prepare(lowered, options), options, types);
+}
+inline std::size_t emit_function(Xbyak::CodeGenerator& gen, const NodeFunction& func,
+                                 const CompileOptions& options = CompileOptions{},
+                                 const DataTypes types = DataTypes{})
+{
+    return emit_function(gen, lower(func, types.compute(), lowering_options(options)), options, types);
+}
+
+// number of rows processed by one iteration of the packed loop in a batch
+// kernel. 1 means that only the scalar loop is used.
+inline std::size_t batch_lanes(const Isa isa = Isa::Auto,
+                               const Precision precision = Precision::Double)
+{
+    switch(resolve(isa))
+    {
+        case Isa::AVX512: {return 64 / size_of(precision);}
+        case Isa::AVX   : {return 32 / size_of(precision);}
+        default         : {return 1;}
+    }
+}
+
+// 256-bit integer instructions, that exp() and log() use, require AVX2.
+// Without it, batch kernels that contain them use only the scalar loop.
+inline std::size_t batch_lanes(const Program& prog, const Isa isa = Isa::Auto)
+{
+    using namespace Xbyak::util;
+    const auto lanes = batch_lanes(isa, prog.precision);
+    const bool shift = std::any_of(prog.code.begin(), prog.code.end(),
+                                   [](const Instruction& inst) {return is_shift(inst.op);});
+    if(resolve(isa) == Isa::AVX && shift && !host_cpu().has(Cpu::tAVX2))
+    {
+        return 1;
+    }
+    return lanes;
+}
+
+// argument register
+// - rdi: columns
+// - rsi: out
+// - rdx: n
+//
+// rcx is used as a row index, r8 as the end of the packed loop, and rax
+// as a scratch register.
+//
+// If the Program has Output instructions, rsi points an array of output
+// columns instead.
+//
+// The columns have the types in DataTypes. If they are float and the Program
+// computes in double, a packed iteration reads 4 (AVX) or 8 (AVX-512) floats
+// and converts them.
+//
+// With a RowLayout, rdi points the first row of an array of structs of
+// doubles instead, and r9 points the current row. If the rows are not
+// contiguous, the packed loop gathers the arguments: AVX-512 uses vgatherqpd
+// and AVX uses two scalar loads per 128-bit half, which is faster than a
+// 4-lane gather on most cores.
+//
+// FMA contraction is done only if AVX is used.
+inline std::size_t emit_prepared_batch_function(Xbyak::CodeGenerator& gen, const Program& prog,
+                                                const CompileOptions& options = CompileOptions{},
+                                                const DataTypes types = DataTypes{},
+                                                const RowLayout* rows = nullptr)
+{
+    using namespace Xbyak::util;
+    using Xbyak::CodeGenerator;
+
+    const auto isa    = resolve(options.isa);
+    const bool avx    = isa != Isa::SSE2;
+    const auto lanes  = batch_lanes(prog, options.isa);
+    const bool packed = (lanes != 1);
+    const bool gather = packed && rows && !rows->contiguous();
+    const auto args   = rows ? Emitter::Arguments::Rows : Emitter::Arguments::Columns;
+    const std::size_t bytes = lanes * size_of(prog.precision); // of a register
+
+    // the same allocation is used for the packed and the scalar loop
+    RegisterAllocatorConfig config;
+    config.registers              = (gather && bytes == 32) ? 15 : 16; // xmm15 for gather
+    config.three_operand          = avx;
+    config.arguments_in_registers = false;
+    config.load_arguments         = types.converts_arguments() || gather;
+    const auto alloc = allocate_registers(prog, config);
+
+    const std::size_t slot  = std::max<std::size_t>(16, bytes);
+    const int         size  = static_cast<int>(size_of(types.result));
+
+    gen.push(rbp);
+    gen.mov(rbp, rsp);
+    if(alloc.spill_slots != 0)
+    {
+        gen.and_(rsp, -static_cast<int>(slot));
+        gen.sub (rsp, static_cast<std::uint32_t>(alloc.spill_slots * slot));
+    }
+
+    ConstantPool pool(bytes == 32 ? 32 : 16, prog.precision);
+    Xbyak::Label packed_loop, scalar_loop, done, row_offsets;
+
+    gen.xor_(rcx, rcx);
+    if(rows)
+    {
+        gen.mov(r9, rdi);
+    }
+    if(gather && bytes == 64)
+    {
+        gen.vmovdqu64(Xbyak::Zmm(31), ptr[rip + row_offsets]);
+    }
+    if(packed)
+    {
+        gen.mov (r8, rdx);
+        gen.and_(r8, -static_cast<int>(lanes)); // round down to a multiple of lanes
+
+        gen.L(packed_loop);
+        gen.cmp(rcx, r8);
+        gen.jae(scalar_loop, CodeGenerator::T_NEAR);
+
+        Emitter packed(gen, prog, pool, args, lanes, isa, slot, types, rows);
+        packed.emit(alloc);
+        if(prog.result != Program::npos)
+        {
+            packed.write(ptr[rsi + rcx * size], packed.vreg(alloc.result.index));
+        }
+
+        gen.add(rcx, static_cast<int>(lanes));
+        if(rows)
+        {
+            gen.add(r9, static_cast<int>(rows->stride * lanes));
+        }
+        gen.jmp(packed_loop, CodeGenerator::T_NEAR);
+    }
+
+    gen.L(scalar_loop);
+    gen.cmp(rcx, rdx);
+    gen.jae(done, CodeGenerator::T_NEAR);
+    {
+        Emitter scalar(gen, prog, pool, args, 1, isa, slot, types, rows);
+        scalar.emit(alloc);
+        if(prog.result != Program::npos)
+        {
+            scalar.write(ptr[rsi + rcx * size], scalar.vreg(alloc.result.index));
+        }
+    }
+    gen.inc(rcx);
+    if(rows)
+    {
+        gen.add(r9, static_cast<int>(rows->stride));
+    }
+    gen.jmp(scalar_loop, CodeGenerator::T_NEAR);
+
+    gen.L(done);
+    if(avx)
+    {
+        gen.vzeroupper();
+    }
+    gen.mov(rsp, rbp);
+    gen.pop(rbp);
+    gen.ret();
+
+    pool.emit(gen);
+    if(gather && bytes == 64)
+    {
+        gen.align(8);
+        gen.L(row_offsets);
+        for(std::size_t i=0; i<lanes; ++i)
+        {
+            gen.dq(i * rows->stride);
+        }
+    }
+    return pool.size() == 0 ? 1 : pool.entry();
+}
+inline std::size_t emit_batch_function(Xbyak::CodeGenerator& gen, const Program& lowered,
+                                       const CompileOptions& options = CompileOptions{},
+                                       const DataTypes types = DataTypes{},
+                                       const RowLayout* rows = nullptr)
+{
+    return emit_prepared_batch_function(gen, prepare(lowered, options), options, types, rows);
+}
+inline std::size_t emit_batch_function(Xbyak::CodeGenerator& gen, const NodeFunction& func,
+                                       const CompileOptions& options = CompileOptions{},
+                                       const DataTypes types = DataTypes{})
+{
+    return emit_batch_function(gen, lower(func, types.compute(), lowering_options(options)),
+                               options, types);
+}
+
+// Reductions over the rows of a batch. Dot products are sums of a product,
+// e.g. `(a, b) {a * b}`.
+enum class Reduction : std::uint8_t
+{
+    Sum,
+    Mean,
+    Min,
+    Max,
+};
+
+inline std::string_view to_string(const Reduction reduction)
+{
+    switch(reduction)
+    {
+        case Reduction::Sum : {return "sum";}
+        case Reduction::Mean: {return "mean";}
+        case Reduction::Min : {return "min";}
+        case Reduction::Max : {return "max";}
+        default             : {return "unknown";}
+    }
+}
+
+// argument register
+// - rdi: columns
+// - rsi: n
+//
+// returns the reduction of the values of the function in xmm0. n is moved to
+// rdx, so the registers are the same as emit_batch_function's.
+//
+// The result of a row is accumulated in a register and never written to
+// memory. The packed loop is unrolled 4 times into independent accumulators
+// in xmm12-15 (the allocator gets the other 12 registers), so consecutive
+// additions do not wait for each other. The rest of the rows is accumulated
+// into the first one. Then they are combined as ((0 + 1) + (2 + 3)), the
+// lanes are folded in halves, and the remaining rows are added one by one.
+// So the result depends on n and the ISA but not on anything else.
+//
+// min and max ignore NaN, like std::fmin. They return +inf and -inf if there
+// is no other value, and mean returns NaN if n is 0.
+inline std::size_t emit_prepared_reduce_function(Xbyak::CodeGenerator& gen, const Program& prog,
+                                                 const Reduction reduction,
+                                                 const CompileOptions& options = CompileOptions{})
+{
+    using namespace Xbyak::util;
+    using Xbyak::CodeGenerator;
+
+    if(prog.result == Program::npos || prog.precision != Precision::Double)
+    {
+        throw std::invalid_argument("jitome::emit_reduce_function: "
+                                    "a function that returns a double is expected");
+    }
+
+    const auto isa    = resolve(options.isa);
+    const bool avx    = isa != Isa::SSE2;
+    const auto lanes  = batch_lanes(prog, options.isa);
+    const std::size_t bytes = lanes * sizeof(double);
+
+    constexpr std::size_t accumulators = 4;
+    constexpr int         first        = 16 - accumulators;
+
+    RegisterAllocatorConfig config;
+    config.registers              = first;
+    config.three_operand          = avx;
+    config.arguments_in_registers = false;
+    const auto alloc = allocate_registers(prog, config);
+
+    const std::size_t slot = std::max<std::size_t>(16, bytes);
+
+    const auto acc = [bytes](const std::size_t i, const std::size_t width) -> Xbyak::Xmm {
+        const int idx = first + static_cast<int>(i);
+        switch(std::min(bytes, width))
+        {
+            case 64: {return Xbyak::Zmm(idx);}
+            case 32: {return Xbyak::Ymm(idx);}
+            default: {return Xbyak::Xmm(idx);}
+        }
+    };
+
+    // lhs = lhs op rhs. rhs may be overwritten. The value in lhs is kept if
+    // rhs is NaN (minpd returns the second operand if one of them is NaN).
+    const auto accumulate = [&gen, avx, reduction](const Xbyak::Xmm& lhs, const Xbyak::Xmm& rhs,
+                                                   const bool scalar) {
+        switch(reduction)
+        {
+            case Reduction::Sum:
+            case Reduction::Mean:
+            {
+                if(!avx)        {gen.addsd (lhs, rhs);}
+                else if(scalar) {gen.vaddsd(lhs, lhs, rhs);}
+                else            {gen.vaddpd(lhs, lhs, rhs);}
+                break;
+            }
+            case Reduction::Min:
+            {
+                if(!avx)        {gen.minsd (rhs, lhs); gen.movapd(lhs, rhs);}
+                else if(scalar) {gen.vminsd(lhs, rhs, lhs);}
+                else            {gen.vminpd(lhs, rhs, lhs);}
+                break;
+            }
+            case Reduction::Max:
+            {
+                if(!avx)        {gen.maxsd (rhs, lhs); gen.movapd(lhs, rhs);}
+                else if(scalar) {gen.vmaxsd(lhs, rhs, lhs);}
+                else            {gen.vmaxpd(lhs, rhs, lhs);}
+                break;
+            }
+        }
+    };
+
+    gen.push(rbp);
+    gen.mov(rbp, rsp);
+    if(alloc.spill_slots != 0)
+    {
+        gen.and_(rsp, -static_cast<int>(slot));
+        gen.sub (rsp, static_cast<std::uint32_t>(alloc.spill_slots * slot));
+    }
+
+    ConstantPool pool(bytes == 32 ? 32 : 16, prog.precision);
+    Xbyak::Label unrolled_loop, packed_loop, combine, scalar_loop, done;
+
+    const double inf  = std::numeric_limits<double>::infinity();
+    const double init = (reduction == Reduction::Min) ? inf :
+                        (reduction == Reduction::Max) ? -inf : 0.0;
+    auto& init_label = pool.label(bit_cast<std::uint64_t>(init));
+    for(std::size_t i=0; i<accumulators; ++i)
+    {
+        if(bytes >= 32) {gen.vbroadcastsd(acc(i, 64), ptr[rip + init_label]);}
+        else if(avx)    {gen.vmovsd(acc(i, 16), ptr[rip + init_label]);}
+        else            {gen.movsd (acc(i, 16), ptr[rip + init_label]);}
+    }
+
+    gen.mov(rdx, rsi);
+    gen.xor_(rcx, rcx);
+
+    // lanes == 1 (SSE2) also uses the unrolled loop for the independent sums
+    gen.mov (r8, rdx);
+    gen.and_(r8, -static_cast<int>(lanes * accumulators));
+    gen.L(unrolled_loop);
+    gen.cmp(rcx, r8);
+    gen.jae(packed_loop, CodeGenerator::T_NEAR);
+    for(std::size_t i=0; i<accumulators; ++i)
+    {
+        Emitter body(gen, prog, pool, Emitter::Arguments::Columns, lanes, isa, slot);
+        body.emit(alloc);
+        accumulate(acc(i, 64), body.vreg(alloc.result.index), lanes == 1);
+        gen.add(rcx, static_cast<int>(lanes));
+    }
+    gen.jmp(unrolled_loop, CodeGenerator::T_NEAR);
+
+    gen.L(packed_loop);
+    if(lanes != 1)
+    {
+        gen.mov (r8, rdx);
+        gen.and_(r8, -static_cast<int>(lanes));
+        gen.cmp(rcx, r8);
+        gen.jae(combine, CodeGenerator::T_NEAR);
+
+        Emitter body(gen, prog, pool, Emitter::Arguments::Columns, lanes, isa, slot);
+        body.emit(alloc);
+        accumulate(acc(0, 64), body.vreg(alloc.result.index), false);
+        gen.add(rcx, static_cast<int>(lanes));
+        gen.jmp(packed_loop, CodeGenerator::T_NEAR);
+    }
+
+    gen.L(combine);
+    accumulate(acc(0, 64), acc(1, 64), lanes == 1);
+    accumulate(acc(2, 64), acc(3, 64), lanes == 1);
+    accumulate(acc(0, 64), acc(2, 64), lanes == 1);
+    if(bytes == 64)
+    {
+        gen.vextractf64x4(acc(1, 32), acc(0, 64), 1);
+        accumulate(acc(0, 32), acc(1, 32), false);
+    }
+    if(bytes >= 32)
+    {
+        gen.vextractf128(acc(1, 16), acc(0, 32), 1);
+        accumulate(acc(0, 16), acc(1, 16), false);
+        gen.vunpckhpd(acc(1, 16), acc(0, 16), acc(0, 16));
+        accumulate(acc(0, 16), acc(1, 16), true);
+    }
+
+    gen.L(scalar_loop);
+    gen.cmp(rcx, rdx);
+    gen.jae(done, CodeGenerator::T_NEAR);
+    {
+        Emitter body(gen, prog, pool, Emitter::Arguments::Columns, 1, isa, slot);
+        body.emit(alloc);
+        accumulate(acc(0, 16), body.vreg(alloc.result.index), true);
+    }
+    gen.inc(rcx);
+    gen.jmp(scalar_loop, CodeGenerator::T_NEAR);
+
+    gen.L(done);
+    if(reduction == Reduction::Mean)
+    {
+        if(avx)
+        {
+            gen.vcvtsi2sd(acc(1, 16), acc(1, 16), rdx);
+            gen.vdivsd(acc(0, 16), acc(0, 16), acc(1, 16));
+        }
+        else
+        {
+            gen.cvtsi2sd(acc(1, 16), rdx);
+            gen.divsd(acc(0, 16), acc(1, 16));
+        }
+    }
+    if(avx)
+    {
+        gen.vmovapd(xmm0, acc(0, 16));
+        gen.vzeroupper();
+    }
+    else
+    {
+        gen.movapd(xmm0, acc(0, 16));
+    }
+    gen.mov(rsp, rbp);
+    gen.pop(rbp);
+    gen.ret();
+
+    pool.emit(gen);
+    return pool.size() == 0 ? 1 : pool.entry();
+}
+inline std::size_t emit_reduce_function(Xbyak::CodeGenerator& gen, const Program& lowered,
+                                        const Reduction reduction,
+                                        const CompileOptions& options = CompileOptions{})
+{
+    return emit_prepared_reduce_function(gen, prepare(lowered, options), reduction, options);
+}
+
+template<typename T>
+constexpr Precision precision_of() noexcept
+{
+    static_assert(std::is_same_v<T, double> || std::is_same_v<T, float>,
+                  "currently, `double` and `float` are the only types allowed in jitome.");
+    return std::is_same_v<T, float> ? Precision::Single : Precision::Double;
+}
+
+// DataTypes of a function type like `float(float, float)`. All the arguments
+// should have the same type.
+template<typename F>
+struct function_types;
+template<typename R, typename ... Args>
+struct function_types<R(Args...)>
+{
+    static_assert(sizeof...(Args) > 0, "jitome: a function should have at least one argument");
+    static_assert(std::conjunction_v<std::is_same<Args, float>...> ||
+                  std::conjunction_v<std::is_same<Args, double>...>,
+                  "jitome: the arguments should have the same type");
+
+    static constexpr DataTypes value{
+        (precision_of<R>(), ..., precision_of<Args>()),
+        precision_of<R>()
+    };
+};
+
 template<typename F>
 struct JitCompiler : public Xbyak::CodeGenerator
 {
@@ -29,8 +657,9 @@ struct JitCompiler : public Xbyak::CodeGenerator
 
   public:
 
-    JitCompiler(std::string code)
-        : f_(nullptr)
+    JitCompiler(std::string code, const CompileOptions& options = CompileOptions{})
+        : Xbyak::CodeGenerator(Xbyak::DEFAULT_MAX_CODE_SIZE, Xbyak::AutoGrow),
+          f_(nullptr), peak_registers_(0)
     {
         auto tks = tokenize(code);
         if(tks.is_err())
@@ -42,13 +671,14 @@ struct JitCompiler : public Xbyak::CodeGenerator
         {
             throw std::runtime_error(prs.as_err().msg);
         }
-        this->compile(std::move(prs.as_val()));
+        this->compile(std::move(prs.as_val()), options);
     }
 
-    JitCompiler(Node root)
-        : f_(nullptr)
+    JitCompiler(Node root, const CompileOptions& options = CompileOptions{})
+        : Xbyak::CodeGenerator(Xbyak::DEFAULT_MAX_CODE_SIZE, Xbyak::AutoGrow),
+          f_(nullptr), peak_registers_(0)
     {
-        this->compile(std::move(root));
+        this->compile(std::move(root), options);
     }
 
     operator func_ptr() const noexcept
@@ -61,141 +691,491 @@ struct JitCompiler : public Xbyak::CodeGenerator
         return f_;
     }
 
-  private:
+    // peak number of values in registers in the emitted code, before spilling
+    // (see max_live() in ir.hpp)
+    std::size_t peak_registers() const noexcept {return peak_registers_;}
 
-    // argumnet register
-    // - rdi, rsi, rdx, rcx, r8, r9
-    // - xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7
-    //
-    // return register:
-    // - rax,  rdx
-    // - xmm0, xmm1
+  private:
 
-    void compile(Node root)
+    void compile(Node root, const CompileOptions& options)
     {
-        auto func = std::get<NodeFunction>(std::move(root.node));
-        // assuming func has enough small number of argument
+        constexpr auto types = function_types<F>::value;
+        const auto func = std::get<NodeFunction>(simplify(std::move(root), simplify_options(options)).node);
+        const auto prog = prepare(lower(func, types.compute(), lowering_options(options)), options);
+        this->peak_registers_ = max_live(prog);
+
+        emit_prepared_function(*this, prog, options, types);
+
+        this->ready(); // code may be relocated by AutoGrow
+        this->f_ = this->getCode<func_ptr>();
+    }
+
+  private:
 
-        std::map<std::string, std::size_t> narg;
-        for(std::size_t i=0; i<func.args.size(); ++i)
+    func_ptr    f_;
+    std::size_t peak_registers_;
+};
+
+// JitBatchCompiler compiles the same kind of function as JitCompiler into a
+// loop that applies it to columns of arguments at once.
+//
+//   void f(const double* const* columns, double* out, std::size_t n);
+//
+// computes `out[i] = func(columns[0][i], columns[1][i], ...)` for i in [0, n).
+// The body of the loop uses packed instructions over 8 (AVX-512) or 4 (AVX)
+// lanes and the remaining rows are processed one by one.
+//
+// BasicJitBatchCompiler<float> computes in float, over 16 or 8 lanes. With
+// mixed types, e.g. <float, double>, it computes in double.
+template<typename In, typename Out = In>
+struct BasicJitBatchCompiler : public Xbyak::CodeGenerator
+{
+  public:
+
+    using func_type = void(const In* const*, Out*, std::size_t);
+    using func_ptr  = func_type*;
+
+    static constexpr DataTypes types{precision_of<In>(), precision_of<Out>()};
+
+  public:
+
+    BasicJitBatchCompiler(std::string code, const CompileOptions& options = CompileOptions{})
+        : Xbyak::CodeGenerator(Xbyak::DEFAULT_MAX_CODE_SIZE, Xbyak::AutoGrow),
+          f_(nullptr), lanes_(1), arity_(0), peak_registers_(0)
+    {
+        auto tks = tokenize(code);
+        if(tks.is_err())
+        {
+            throw std::runtime_error(tks.as_err().msg);
+        }
+        auto prs = parse(tks.as_val());
+        if(prs.is_err())
         {
-            narg[func.args.at(i)] = i;
+            throw std::runtime_error(prs.as_err().msg);
         }
+        this->compile(std::move(prs.as_val()), options);
+    }
 
-        push(rbp); // prologue
-        mov(rbp, rsp);
+    BasicJitBatchCompiler(Node root, const CompileOptions& options = CompileOptions{})
+        : Xbyak::CodeGenerator(Xbyak::DEFAULT_MAX_CODE_SIZE, Xbyak::AutoGrow),
+          f_(nullptr), lanes_(1), arity_(0), peak_registers_(0)
+    {
+        this->compile(std::move(root), options);
+    }
 
-        int stk = static_cast<int>(narg.size());
-        std::visit([&stk, &narg, this](const auto& n) {
-                return this->expand_recursively(stk, narg, n);
-            }, func.body.get().node);
+    void operator()(const In* const* columns, Out* out, std::size_t n) const
+    {
+        f_(columns, out, n);
+    }
 
-        stk -= 1;
-        movsd(xmm0, Xbyak::Xmm(stk));
+    func_ptr get_func_ptr() const noexcept
+    {
+        return f_;
+    }
+
+    // number of rows processed by one iteration of the packed loop.
+    // 1 means that only the scalar loop is used.
+    std::size_t lanes() const noexcept {return lanes_;}
+
+    // number of columns that are read
+    std::size_t arity() const noexcept {return arity_;}
+
+    // peak number of values in registers in the emitted code, before spilling
+    // (see max_live() in ir.hpp)
+    std::size_t peak_registers() const noexcept {return peak_registers_;}
+
+  private:
+
+    void compile(Node root, const CompileOptions& options)
+    {
+        const auto func = std::get<NodeFunction>(simplify(std::move(root), simplify_options(options)).node);
+        const auto prog = prepare(lower(func, types.compute(), lowering_options(options)), options);
+        this->arity_ = func.args.size();
+        this->lanes_ = batch_lanes(prog, options.isa);
+        this->peak_registers_ = max_live(prog);
 
-        mov(rsp, rbp);
-        pop(rbp); // epilogue
-        ret();
+        emit_prepared_batch_function(*this, prog, options, types);
 
+        this->ready(); // code may be relocated by AutoGrow
         this->f_ = this->getCode<func_ptr>();
     }
 
-    template<typename T>
-    void expand_recursively(int& stk, const std::map<std::string, std::size_t>& narg, const T& node)
+  private:
+
+    func_ptr    f_;
+    std::size_t lanes_;
+    std::size_t arity_;
+    std::size_t peak_registers_;
+};
+using JitBatchCompiler = BasicJitBatchCompiler<double>;
+
+// parses the functions of a multi-output kernel
+inline std::vector<NodeFunction> parse_functions(const std::vector<std::string>& codes)
+{
+    std::vector<NodeFunction> funcs;
+    for(const auto& code : codes)
     {
-        if constexpr (is_typeof<T, NodeVariable>)
+        auto tks = tokenize(code);
+        if(tks.is_err())
         {
-            if(narg.count(node.name) == 0)
-            {
-                throw std::runtime_error("variable definition is currently not supported");
-            }
-            movsd(Xbyak::Xmm(stk), Xbyak::Xmm(narg.at(node.name)));
-            stk += 1;
+            throw std::runtime_error(tks.as_err().msg);
         }
-        else if constexpr (is_typeof<T, NodeImmediate>)
+        auto prs = parse(tks.as_val());
+        if(prs.is_err())
         {
-            auto casted_to_int = bit_cast<std::uint64_t>(node.value);
-            mov  (rax,             casted_to_int);
-            sub  (rsp,             sizeof(std::uint64_t));
-            mov  (ptr[rsp],        rax);
-            movsd(Xbyak::Xmm(stk), ptr[rsp]);
-            stk += 1;
+            throw std::runtime_error(prs.as_err().msg);
         }
-        else if constexpr (is_typeof<T, NodeExpression>)
-        {
-            using namespace std::literals::string_view_literals;
+        funcs.push_back(std::get<NodeFunction>(std::move(prs.as_val().node)));
+    }
+    return funcs;
+}
 
-            if (node.operands.size() == 1)
-            {
-                std::visit([&stk, &narg, this](const auto& n) {
-                        return this->expand_recursively(stk, narg, n);
-                    }, node.operands[0].node);
-                stk -= 1;
-                movsd(xmm15, Xbyak::Xmm(stk));
-            }
-            else
-            {
-                if(node.operands.size() != 2)
-                {
-                    throw std::runtime_error("jitome::jit: invalid number of operands in binary operator");
-                }
-
-                std::visit([&stk, &narg, this](const auto& n) {
-                        return this->expand_recursively(stk, narg, n);
-                    }, node.operands[0].node);
-                std::visit([&stk, &narg, this](const auto& n) {
-                        return this->expand_recursively(stk, narg, n);
-                    }, node.operands[1].node);
-
-                stk -= 1;
-                movsd(xmm15, Xbyak::Xmm(stk));
-                stk -= 1;
-                movsd(xmm14, Xbyak::Xmm(stk));
-            }
+// simplifies the functions and lowers them into one Program
+inline Program lower_functions(std::vector<NodeFunction> funcs,
+                               const CompileOptions& options = CompileOptions{})
+{
+    for(auto& func : funcs)
+    {
+        func = std::get<NodeFunction>(simplify(Node{std::move(func)}, simplify_options(options)).node);
+    }
+    return lower(funcs, Precision::Double, lowering_options(options));
+}
 
-            if (node.function == "+"sv)
-            {
-                addsd(xmm15, xmm14);
-            }
-            else if (node.function == "-"sv && node.operands.size() == 2)
-            {
-                subsd(xmm15, xmm14);
-            }
-            else if (node.function == "*"sv)
-            {
-                mulsd(xmm15, xmm14);
-            }
-            else if (node.function == "/"sv)
-            {
-                divsd(xmm15, xmm14);
-            }
-            else if (node.function == "-"sv && node.operands.size() == 1)
-            {
-                movsd(xmm14, xmm15);
-                pxor (xmm15, xmm15);
-                subsd(xmm15, xmm14);
-            }
-            movsd(Xbyak::Xmm(stk), xmm15);
-            stk += 1;
-        }
-        else if constexpr (is_typeof<T, NodeFunction>)
+// JitMultiCompiler compiles several functions with the same arguments into
+// one function that writes their results into an array.
+//
+//   const std::vector<std::string> codes = {"(a, b) {a * b}", "(a, b) {a * b + 1}"};
+//   JitMultiCompiler<void(double*, double, double)> f(codes);
+//   double out[2];
+//   f(out, 2.0, 3.0); // out = {6, 7}
+//
+// The arguments are loaded once and common subexpressions are computed once.
+// Multi-output kernels compute in double only.
+template<typename F>
+struct is_multi_function : std::false_type {};
+template<typename ... Args>
+struct is_multi_function<void(double*, Args...)>
+    : std::conjunction<std::is_same<Args, double>...> {};
+
+template<typename F>
+struct JitMultiCompiler : public Xbyak::CodeGenerator
+{
+    static_assert(is_multi_function<F>::value,
+                  "jitome: JitMultiCompiler takes `void(double*, double, ...)`");
+
+  public:
+
+    using func_ptr = F*;
+
+  public:
+
+    JitMultiCompiler(const std::vector<std::string>& codes,
+                     const CompileOptions& options = CompileOptions{})
+        : JitMultiCompiler(parse_functions(codes), options)
+    {}
+
+    JitMultiCompiler(std::vector<NodeFunction> funcs, const CompileOptions& options = CompileOptions{})
+        : Xbyak::CodeGenerator(Xbyak::DEFAULT_MAX_CODE_SIZE, Xbyak::AutoGrow),
+          f_(nullptr), outputs_(funcs.size()), peak_registers_(0)
+    {
+        const auto prog = prepare(lower_functions(std::move(funcs), options), options);
+        this->peak_registers_ = max_live(prog);
+
+        emit_prepared_function(*this, prog, options);
+
+        this->ready(); // code may be relocated by AutoGrow
+        this->f_ = this->getCode<func_ptr>();
+    }
+
+    operator func_ptr() const noexcept
+    {
+        return f_;
+    }
+
+    func_ptr get_func_ptr() const noexcept
+    {
+        return f_;
+    }
+
+    // number of results
+    std::size_t outputs() const noexcept {return outputs_;}
+
+    // peak number of values in registers in the emitted code, before spilling
+    // (see max_live() in ir.hpp)
+    std::size_t peak_registers() const noexcept {return peak_registers_;}
+
+  private:
+
+    func_ptr    f_;
+    std::size_t outputs_;
+    std::size_t peak_registers_;
+};
+
+// The batch version of JitMultiCompiler.
+//
+//   void f(const double* const* columns, double* const* outs, std::size_t n);
+//
+// computes `outs[k][i] = func_k(columns[0][i], columns[1][i], ...)`.
+struct JitMultiBatchCompiler : public Xbyak::CodeGenerator
+{
+  public:
+
+    using func_type = void(const double* const*, double* const*, std::size_t);
+    using func_ptr  = func_type*;
+
+  public:
+
+    JitMultiBatchCompiler(const std::vector<std::string>& codes,
+                          const CompileOptions& options = CompileOptions{})
+        : JitMultiBatchCompiler(parse_functions(codes), options)
+    {}
+
+    JitMultiBatchCompiler(std::vector<NodeFunction> funcs,
+                          const CompileOptions& options = CompileOptions{})
+        : Xbyak::CodeGenerator(Xbyak::DEFAULT_MAX_CODE_SIZE, Xbyak::AutoGrow),
+          f_(nullptr), lanes_(1), arity_(0), outputs_(funcs.size()), peak_registers_(0)
+    {
+        const auto prog = prepare(lower_functions(std::move(funcs), options), options);
+        this->arity_ = prog.arity;
+        this->lanes_ = batch_lanes(prog, options.isa);
+        this->peak_registers_ = max_live(prog);
+
+        emit_prepared_batch_function(*this, prog, options);
+
+        this->ready(); // code may be relocated by AutoGrow
+        this->f_ = this->getCode<func_ptr>();
+    }
+
+    void operator()(const double* const* columns, double* const* outs, std::size_t n) const
+    {
+        f_(columns, outs, n);
+    }
+
+    func_ptr get_func_ptr() const noexcept
+    {
+        return f_;
+    }
+
+    // number of rows processed by one iteration of the packed loop.
+    // 1 means that only the scalar loop is used.
+    std::size_t lanes() const noexcept {return lanes_;}
+
+    // number of columns that are read
+    std::size_t arity() const noexcept {return arity_;}
+
+    // number of columns that are written
+    std::size_t outputs() const noexcept {return outputs_;}
+
+    // peak number of values in registers in the emitted code, before spilling
+    // (see max_live() in ir.hpp)
+    std::size_t peak_registers() const noexcept {return peak_registers_;}
+
+  private:
+
+    func_ptr    f_;
+    std::size_t lanes_;
+    std::size_t arity_;
+    std::size_t outputs_;
+    std::size_t peak_registers_;
+};
+
+// parses one function, e.g. for gradient()
+inline NodeFunction parse_function(const std::string& code)
+{
+    return std::move(parse_functions({code}).front());
+}
+
+// JitRowBatchCompiler compiles a function into a loop over an array of
+// structs, without transposing it into columns first.
+//
+//   struct Quote {double bid, ask, size;};
+//   JitRowBatchCompiler f("(bid, ask) {(bid + ask) / 2}",
+//       RowLayout{sizeof(Quote), {offsetof(Quote, bid), offsetof(Quote, ask)}});
+//   f(quotes.data(), out.data(), quotes.size());
+//
+// computes `out[i] = func(row_i.bid, row_i.ask)` for i in [0, n). The k-th
+// argument is read from offsets[k] of a row.
+struct JitRowBatchCompiler : public Xbyak::CodeGenerator
+{
+  public:
+
+    using func_type = void(const void*, double*, std::size_t);
+    using func_ptr  = func_type*;
+
+  public:
+
+    JitRowBatchCompiler(const std::string& code, RowLayout layout,
+                        const CompileOptions& options = CompileOptions{})
+        : JitRowBatchCompiler(Node{parse_function(code)}, std::move(layout), options)
+    {}
+
+    JitRowBatchCompiler(Node root, RowLayout layout, const CompileOptions& options = CompileOptions{})
+        : Xbyak::CodeGenerator(Xbyak::DEFAULT_MAX_CODE_SIZE, Xbyak::AutoGrow),
+          f_(nullptr), lanes_(1), peak_registers_(0), layout_(std::move(layout))
+    {
+        const auto func = std::get<NodeFunction>(simplify(std::move(root), simplify_options(options)).node);
+        if(layout_.offsets.size() != func.args.size())
         {
-            throw std::runtime_error("function call is not supported");
+            throw std::invalid_argument("jitome::JitRowBatchCompiler: " +
+                std::to_string(func.args.size()) + " offsets are expected, but " +
+                std::to_string(layout_.offsets.size()) + " are given");
         }
-        else
+        // displacements of the loads in a packed iteration are 32-bit
+        std::size_t last = 0;
+        for(const auto offset : layout_.offsets)
         {
-            throw std::runtime_error("unknown node appeared");
+            last = std::max(last, offset);
         }
-
-        if(stk > 13)
+        if(layout_.stride < sizeof(double) || 0x7FFFFFFF < last + layout_.stride * 16)
         {
-            throw std::runtime_error("jitome: register run out");
+            throw std::invalid_argument("jitome::JitRowBatchCompiler: invalid layout");
         }
+        const auto prog = prepare(lower(func, Precision::Double, lowering_options(options)), options);
+        this->lanes_ = batch_lanes(prog, options.isa);
+        this->peak_registers_ = max_live(prog);
+
+        emit_prepared_batch_function(*this, prog, options, DataTypes{}, &layout_);
+
+        this->ready(); // code may be relocated by AutoGrow
+        this->f_ = this->getCode<func_ptr>();
+    }
+
+    void operator()(const void* rows, double* out, std::size_t n) const
+    {
+        f_(rows, out, n);
     }
 
+    func_ptr get_func_ptr() const noexcept
+    {
+        return f_;
+    }
+
+    // number of rows processed by one iteration of the packed loop.
+    std::size_t lanes() const noexcept {return lanes_;}
+
+    const RowLayout& layout() const noexcept {return layout_;}
+
+    // peak number of values in registers in the emitted code, before spilling
+    // (see max_live() in ir.hpp)
+    std::size_t peak_registers() const noexcept {return peak_registers_;}
+
   private:
 
-    func_ptr f_;
+    func_ptr    f_;
+    std::size_t lanes_;
+    std::size_t peak_registers_;
+    RowLayout   layout_;
+};
+
+// JitReduceCompiler compiles a function into a loop that reduces its values
+// over the rows of columns, without writing them to memory.
+//
+//   JitReduceCompiler dot("(a, b) {a * b}", Reduction::Sum);
+//   const double* columns[] = {a.data(), b.data()};
+//   const double r = dot(columns, n);
+//
+// The order of the additions is fixed (see emit_reduce_function), so the
+// same input gives the same result every time. It is not the order of a
+// sequential loop, so the rounding differs from it.
+struct JitReduceCompiler : public Xbyak::CodeGenerator
+{
+  public:
+
+    using func_type = double(const double* const*, std::size_t);
+    using func_ptr  = func_type*;
+
+  public:
+
+    JitReduceCompiler(const std::string& code, const Reduction reduction,
+                      const CompileOptions& options = CompileOptions{})
+        : JitReduceCompiler(Node{parse_function(code)}, reduction, options)
+    {}
+
+    JitReduceCompiler(Node root, const Reduction reduction,
+                      const CompileOptions& options = CompileOptions{})
+        : Xbyak::CodeGenerator(Xbyak::DEFAULT_MAX_CODE_SIZE, Xbyak::AutoGrow),
+          f_(nullptr), lanes_(1), arity_(0), peak_registers_(0), reduction_(reduction)
+    {
+        const auto func = std::get<NodeFunction>(simplify(std::move(root), simplify_options(options)).node);
+        this->arity_ = func.args.size();
+
+        const auto prog = prepare(lower(func, Precision::Double, lowering_options(options)), options);
+        this->lanes_ = batch_lanes(prog, options.isa);
+        this->peak_registers_ = max_live(prog);
+
+        emit_prepared_reduce_function(*this, prog, reduction, options);
+
+        this->ready(); // code may be relocated by AutoGrow
+        this->f_ = this->getCode<func_ptr>();
+    }
+
+    double operator()(const double* const* columns, std::size_t n) const
+    {
+        return f_(columns, n);
+    }
+
+    func_ptr get_func_ptr() const noexcept
+    {
+        return f_;
+    }
+
+    // number of rows added to one accumulator at a time.
+    std::size_t lanes() const noexcept {return lanes_;}
+
+    // number of columns that are read
+    std::size_t arity() const noexcept {return arity_;}
+
+    Reduction reduction() const noexcept {return reduction_;}
+
+    // peak number of values in registers in the emitted code, before spilling
+    // (see max_live() in ir.hpp)
+    std::size_t peak_registers() const noexcept {return peak_registers_;}
+
+  private:
+
+    func_ptr    f_;
+    std::size_t lanes_;
+    std::size_t arity_;
+    std::size_t peak_registers_;
+    Reduction   reduction_;
+};
+
+// JitGradientCompiler compiles a function into one that writes the value and
+// the partial derivatives with respect to the arguments in `wrt` (all the
+// arguments if it is empty).
+//
+//   JitGradientCompiler<void(double*, double, double)> f("(a, b) {a * sin(b)}");
+//   double out[3];
+//   f(out, a, b); // {a sin(b), sin(b), a cos(b)}
+//
+// The derivatives are symbolic (see gradient.hpp), and the value and the
+// derivatives share subexpressions, so one call is much cheaper than the
+// 2N+1 calls of central finite differences.
+template<typename F>
+struct JitGradientCompiler : public JitMultiCompiler<F>
+{
+    JitGradientCompiler(const std::string& code, const std::vector<std::string>& wrt = {},
+                        const CompileOptions& options = CompileOptions{})
+        : JitGradientCompiler(parse_function(code), wrt, options)
+    {}
+    JitGradientCompiler(const NodeFunction& func, const std::vector<std::string>& wrt = {},
+                        const CompileOptions& options = CompileOptions{})
+        : JitMultiCompiler<F>(gradient(func, wrt), options)
+    {}
+};
+
+// The batch version of JitGradientCompiler. outs[0] is the value and outs[k]
+// is the derivative with respect to the k-th argument in `wrt`.
+struct JitGradientBatchCompiler : public JitMultiBatchCompiler
+{
+    JitGradientBatchCompiler(const std::string& code, const std::vector<std::string>& wrt = {},
+                             const CompileOptions& options = CompileOptions{})
+        : JitGradientBatchCompiler(parse_function(code), wrt, options)
+    {}
+    JitGradientBatchCompiler(const NodeFunction& func, const std::vector<std::string>& wrt = {},
+                             const CompileOptions& options = CompileOptions{})
+        : JitMultiBatchCompiler(gradient(func, wrt), options)
+    {}
 };
 
 } // jitome
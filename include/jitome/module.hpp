@@ -0,0 +1,229 @@
+#ifndef JITOME_MODULE_HPP
+#define JITOME_MODULE_HPP
+#include "ast.hpp"
+#include "jit.hpp"
+#include "optimize.hpp"
+#include "parser.hpp"
+#include "tokenizer.hpp"
+#include "xbyak.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace jitome
+{
+
+// A handle to a function in a JitModule. It is just a pointer to the code and
+// is valid while the module is alive.
+template<typename F>
+struct JitFunction
+{
+    using func_ptr = F*;
+
+    func_ptr    ptr  = nullptr;
+    std::size_t size = 0; // in bytes
+
+    operator func_ptr() const noexcept {return ptr;}
+    func_ptr get_func_ptr() const noexcept {return ptr;}
+
+    template<typename ... Ts>
+    decltype(auto) operator()(Ts&& ... args) const
+    {
+        return ptr(std::forward<Ts>(args)...);
+    }
+};
+
+// JitModule compiles many functions into a shared executable arena.
+//
+// JitCompiler owns a code buffer per function. With many small functions,
+// most of the pages are empty. JitModule generates the code in a scratch
+// buffer and copies it into large chunks, packing functions next to each
+// other with the requested alignment.
+//
+// Like the default of Xbyak::CodeGenerator, the chunks are readable, writable
+// and executable, so functions can be added while others are running. Adding
+// functions is not thread-safe.
+class JitModule
+{
+  public:
+
+    using batch_func_type = JitBatchCompiler::func_type;
+
+  public:
+
+    explicit JitModule(std::size_t chunk_size = 1024 * 1024)
+        : chunk_size_(round_up(chunk_size, page_size())),
+          scratch_(Xbyak::DEFAULT_MAX_CODE_SIZE, Xbyak::AutoGrow)
+    {}
+    ~JitModule()
+    {
+        for(const auto& chunk : chunks_)
+        {
+            ::munmap(chunk.base, chunk.capacity);
+        }
+    }
+
+    JitModule(const JitModule&) = delete;
+    JitModule& operator=(const JitModule&) = delete;
+
+    template<typename F>
+    JitFunction<F> compile(const std::string& code, std::size_t alignment = 16,
+                           const CompileOptions& options = CompileOptions{})
+    {
+        return this->compile<F>(parse_code(code), alignment, options);
+    }
+    template<typename F>
+    JitFunction<F> compile(Node root, std::size_t alignment = 16,
+                           const CompileOptions& options = CompileOptions{})
+    {
+        const auto func = std::get<NodeFunction>(simplify(std::move(root), simplify_options(options)).node);
+
+        scratch_.reset();
+        const auto required = emit_function(scratch_, func, options, function_types<F>::value);
+        return this->place<F>(std::max(alignment, required));
+    }
+
+    // the same as JitBatchCompiler
+    JitFunction<batch_func_type> compile_batch(const std::string& code, std::size_t alignment = 16,
+                                               const CompileOptions& options = CompileOptions{})
+    {
+        return this->compile_batch(parse_code(code), alignment, options);
+    }
+    JitFunction<batch_func_type> compile_batch(Node root, std::size_t alignment = 16,
+                                               const CompileOptions& options = CompileOptions{})
+    {
+        const auto func = std::get<NodeFunction>(simplify(std::move(root), simplify_options(options)).node);
+
+        scratch_.reset();
+        const auto required = emit_batch_function(scratch_, func, options);
+        return this->place<batch_func_type>(std::max(alignment, required));
+    }
+
+    // number of functions
+    std::size_t size() const noexcept {return functions_;}
+
+    // total size of the code of the functions
+    std::size_t code_bytes() const noexcept {return code_bytes_;}
+
+    // code and padding between functions
+    std::size_t used_bytes() const noexcept
+    {
+        std::size_t used = 0;
+        for(const auto& chunk : chunks_)
+        {
+            used += chunk.used;
+        }
+        return used;
+    }
+
+    // size of the executable memory mapped by this module
+    std::size_t reserved_bytes() const noexcept
+    {
+        std::size_t reserved = 0;
+        for(const auto& chunk : chunks_)
+        {
+            reserved += chunk.capacity;
+        }
+        return reserved;
+    }
+
+  private:
+
+    struct Chunk
+    {
+        std::uint8_t* base;
+        std::size_t   capacity;
+        std::size_t   used;
+    };
+
+    static std::size_t page_size()
+    {
+        return static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    }
+    static std::size_t round_up(const std::size_t x, const std::size_t align)
+    {
+        return (x + align - 1) / align * align;
+    }
+
+    static Node parse_code(const std::string& code)
+    {
+        auto tks = tokenize(code);
+        if(tks.is_err())
+        {
+            throw std::runtime_error(tks.as_err().msg);
+        }
+        auto prs = parse(tks.as_val());
+        if(prs.is_err())
+        {
+            throw std::runtime_error(prs.as_err().msg);
+        }
+        return std::move(prs.as_val());
+    }
+
+    // copies the code in the scratch buffer into the arena
+    template<typename F>
+    JitFunction<F> place(const std::size_t alignment)
+    {
+        if(alignment == 0 || (alignment & (alignment - 1)) != 0 || page_size() < alignment)
+        {
+            throw std::invalid_argument("jitome::JitModule: invalid alignment: " +
+                                        std::to_string(alignment));
+        }
+        scratch_.ready(); // resolve labels
+        const auto* code = scratch_.getCode();
+        const auto  size = scratch_.getSize();
+
+        auto* dst = this->allocate(size, alignment);
+        std::memcpy(dst, code, size);
+        __builtin___clear_cache(reinterpret_cast<char*>(dst),
+                                reinterpret_cast<char*>(dst + size));
+
+        functions_  += 1;
+        code_bytes_ += size;
+        return JitFunction<F>{reinterpret_cast<F*>(dst), size};
+    }
+
+    std::uint8_t* allocate(const std::size_t size, const std::size_t alignment)
+    {
+        if(!chunks_.empty())
+        {
+            auto& chunk = chunks_.back();
+            const auto offset = round_up(chunk.used, alignment);
+            if(offset + size <= chunk.capacity)
+            {
+                chunk.used = offset + size;
+                return chunk.base + offset;
+            }
+        }
+
+        // a function larger than a chunk gets its own chunk
+        const auto capacity = std::max(chunk_size_, round_up(size, page_size()));
+        void* mem = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE | PROT_EXEC,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(mem == MAP_FAILED)
+        {
+            throw std::runtime_error("jitome::JitModule: failed to map executable memory");
+        }
+        chunks_.push_back(Chunk{static_cast<std::uint8_t*>(mem), capacity, size});
+        return chunks_.back().base;
+    }
+
+  private:
+
+    std::size_t          chunk_size_;
+    std::size_t          functions_  = 0;
+    std::size_t          code_bytes_ = 0;
+    std::vector<Chunk>   chunks_;
+    Xbyak::CodeGenerator scratch_;
+};
+
+} // jitome
+#endif// JITOME_MODULE_HPP
@@ -0,0 +1,445 @@
+#ifndef JITOME_OPTIMIZE_HPP
+#define JITOME_OPTIMIZE_HPP
+#include "ast.hpp"
+#include "builtin.hpp"
+#include "traits.hpp"
+#include "util.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace jitome
+{
+
+// Simplification pass over the AST that is applied before evaluate() and the
+// JIT backends.
+//
+// All the rewrites keep the result bit-identical under IEEE 754 (except for
+// NaN payloads), including the sign of zero. So `x + 0.0` is kept because
+// `-0.0 + 0.0` is `+0.0`, and `0 * x` is kept because x may be negative, inf
+// or NaN.
+//
+// Strength reduction is done here as well, so that evaluate() and the JIT
+// compute the same thing:
+//
+// - x * 2 -> x + x
+// - x / 2^k -> x * 2^-k, for |k| <= 126 so that both are normal in float
+// - x / c -> x * (1 / c) for the other constants, only if
+//   SimplifyOptions::reciprocal is set. It may differ by 1 ulp.
+//
+// x^n is expanded into multiplications in lowering and powi() (see ir.hpp).
+//
+// The other options relax IEEE 754 in exchange for speed (fast-math). Each
+// of them is independent.
+//
+// - reassociate: a chain of `+` or `*` is rebuilt as a balanced tree with the
+//   constants folded into one, e.g. `((a + 1) + b) + 2 -> (a + b) + 3`. The
+//   depth of the chain, i.e. the latency, becomes log2 of its length. The
+//   rounding errors are accumulated in a different order.
+// - no_signed_zeros: x + 0 -> x, 0 - x -> -x
+// - no_nans: x - x -> 0, x / x -> 1, and x * 0 -> 0 with no_signed_zeros.
+//   They are wrong if x is NaN or inf (or 0 for x / x).
+
+struct SimplifyOptions
+{
+    bool reciprocal      = false; // x / c -> x * (1 / c) for any constant c
+    bool reassociate     = false; // (a + b) + c == a + (b + c), and so is `*`
+    bool no_nans         = false; // the arguments and the results are not NaN
+    bool no_signed_zeros = false; // -0 is the same as +0
+};
+
+struct SimplifyReport
+{
+    std::size_t folded     = 0; // subtrees replaced by an immediate
+    std::size_t identities = 0; // x*1, x/1, x+(-0), x-0, x*(-1), (-0)-x, x^1, x^0, select(c, a, b)
+    std::size_t negations  = 0; // --x, x-(-y), x+(-y), (-x)*(-y), (-x)/(-y), (-x)^2n
+    std::size_t strength   = 0; // x*2, x/2^k, x/c
+    std::size_t fast_math  = 0; // rewrites that depend on the relaxed SimplifyOptions
+
+    std::size_t total() const noexcept
+    {
+        return folded + identities + negations + strength + fast_math;
+    }
+    bool changed() const noexcept {return this->total() != 0;}
+};
+
+inline std::string dump(const SimplifyReport& report)
+{
+    return "folded: "       + std::to_string(report.folded)     +
+           ", identities: " + std::to_string(report.identities) +
+           ", negations: "  + std::to_string(report.negations)  +
+           ", strength: "   + std::to_string(report.strength)   +
+           ", fast_math: "  + std::to_string(report.fast_math);
+}
+
+struct Simplifier
+{
+    SimplifyOptions options;
+    SimplifyReport  report;
+
+    Node simplify(Node node)
+    {
+        return std::visit([this](auto&& n) {return this->simplify(std::move(n));},
+                          std::move(node.node));
+    }
+
+    Node simplify(NodeVariable node)  {return Node{std::move(node)};}
+    Node simplify(NodeImmediate node) {return Node{std::move(node)};}
+
+    Node simplify(NodeFunction node)
+    {
+        for(auto& local : node.locals)
+        {
+            local.value.get() = this->simplify(std::move(local.value.get()));
+        }
+        node.body.get() = this->simplify(std::move(node.body.get()));
+        return Node{std::move(node)};
+    }
+
+    Node simplify(NodeExpression node)
+    {
+        using namespace std::literals::string_view_literals;
+
+        // a chain of `+` or `*` is reassociated once, at the top of it
+        const bool chain = options.reassociate && node.operands.size() == 2 &&
+                           (node.function == "+"sv || node.function == "*"sv);
+        const auto outer = std::exchange(chain_, chain ? node.function : std::string_view{});
+        for(auto& operand : node.operands)
+        {
+            operand = this->simplify(std::move(operand));
+        }
+        chain_ = outer;
+
+        if(const auto* builtin = find_builtin(node.function))
+        {
+            if(node.operands.size() != builtin->arity)
+            {
+                return Node{std::move(node)};
+            }
+            // select with a constant condition is one of the branches
+            if(builtin->name == "select"sv)
+            {
+                if(const auto* c = std::get_if<NodeImmediate>(&node.operands.at(0).node))
+                {
+                    report.identities += 1;
+                    return std::move(node.operands.at(c->value != 0.0 ? 1 : 2));
+                }
+            }
+            std::array<double, max_builtin_arity> args{};
+            for(std::size_t i=0; i<node.operands.size(); ++i)
+            {
+                const auto* imm = std::get_if<NodeImmediate>(&node.operands.at(i).node);
+                if(!imm)
+                {
+                    return Node{std::move(node)};
+                }
+                args.at(i) = imm->value;
+            }
+            report.folded += 1;
+            return Node{NodeImmediate{call_builtin(builtin->name, args.data())}};
+        }
+
+        if(node.operands.size() == 1)
+        {
+            if(node.function != "-"sv)
+            {
+                return Node{std::move(node)};
+            }
+            auto& x = node.operands.at(0);
+            if(const auto* imm = std::get_if<NodeImmediate>(&x.node))
+            {
+                report.folded += 1;
+                return Node{NodeImmediate{-imm->value}};
+            }
+            if(is_negation(x))
+            {
+                report.negations += 1;
+                return take_negated(std::move(x));
+            }
+            return Node{std::move(node)};
+        }
+        if(node.operands.size() != 2)
+        {
+            return Node{std::move(node)};
+        }
+
+        auto& lhs = node.operands.at(0);
+        auto& rhs = node.operands.at(1);
+        const auto* l = std::get_if<NodeImmediate>(&lhs.node);
+        const auto* r = std::get_if<NodeImmediate>(&rhs.node);
+
+        if(l && r && (node.function != "^"sv || is_integer_exponent(r->value)))
+        {
+            report.folded += 1;
+            return Node{NodeImmediate{fold(node.function, l->value, r->value)}};
+        }
+
+        if(node.function == "+"sv)
+        {
+            if(is_negative_zero(r)) {report.identities += 1; return std::move(lhs);}
+            if(is_negative_zero(l)) {report.identities += 1; return std::move(rhs);}
+
+            // a + (-b) is defined as a - b in IEEE 754
+            if(is_negation(rhs))
+            {
+                report.negations += 1;
+                return Node{NodeExpression{"-"sv, std::move(lhs), take_negated(std::move(rhs))}};
+            }
+            if(is_negation(lhs))
+            {
+                report.negations += 1;
+                return Node{NodeExpression{"-"sv, std::move(rhs), take_negated(std::move(lhs))}};
+            }
+
+            if(options.no_signed_zeros)
+            {
+                if(is_positive_zero(r)) {report.fast_math += 1; return std::move(lhs);}
+                if(is_positive_zero(l)) {report.fast_math += 1; return std::move(rhs);}
+            }
+            if(options.reassociate && chain_ != node.function)
+            {
+                return this->reassociate(std::move(node));
+            }
+        }
+        else if(node.function == "-"sv)
+        {
+            if(is_positive_zero(r)) {report.identities += 1; return std::move(lhs);}
+            if(is_negative_zero(l))
+            {
+                // -0 - (+0) == -0 and -0 - (-0) == +0, same as negation
+                report.identities += 1;
+                return this->negate(std::move(rhs));
+            }
+            if(is_negation(rhs))
+            {
+                report.negations += 1;
+                return Node{NodeExpression{"+"sv, std::move(lhs), take_negated(std::move(rhs))}};
+            }
+
+            if(options.no_signed_zeros)
+            {
+                if(is_negative_zero(r)) {report.fast_math += 1; return std::move(lhs);}
+                if(is_positive_zero(l)) {report.fast_math += 1; return this->negate(std::move(rhs));}
+            }
+            if(options.no_nans && lhs == rhs)
+            {
+                report.fast_math += 1;
+                return Node{NodeImmediate{0.0}};
+            }
+        }
+        else if(node.function == "*"sv)
+        {
+            if(is_value(r,  1.0)) {report.identities += 1; return std::move(lhs);}
+            if(is_value(l,  1.0)) {report.identities += 1; return std::move(rhs);}
+            if(is_value(r, -1.0)) {report.identities += 1; return this->negate(std::move(lhs));}
+            if(is_value(l, -1.0)) {report.identities += 1; return this->negate(std::move(rhs));}
+
+            if(is_negation(lhs) && is_negation(rhs))
+            {
+                report.negations += 1;
+                return Node{NodeExpression{"*"sv, take_negated(std::move(lhs)),
+                                                  take_negated(std::move(rhs))}};
+            }
+
+            // x + x is exact and does not need the constant
+            if(is_value(r, 2.0)) {report.strength += 1; return Node{NodeExpression{"+"sv, lhs, lhs}};}
+            if(is_value(l, 2.0)) {report.strength += 1; return Node{NodeExpression{"+"sv, rhs, rhs}};}
+
+            if(options.no_nans && options.no_signed_zeros && (is_value(l, 0.0) || is_value(r, 0.0)))
+            {
+                report.fast_math += 1;
+                return Node{NodeImmediate{0.0}};
+            }
+            if(options.reassociate && chain_ != node.function)
+            {
+                return this->reassociate(std::move(node));
+            }
+        }
+        else if(node.function == "/"sv)
+        {
+            if(is_value(r,  1.0)) {report.identities += 1; return std::move(lhs);}
+            if(is_value(r, -1.0)) {report.identities += 1; return this->negate(std::move(lhs));}
+
+            if(is_negation(lhs) && is_negation(rhs))
+            {
+                report.negations += 1;
+                return Node{NodeExpression{"/"sv, take_negated(std::move(lhs)),
+                                                  take_negated(std::move(rhs))}};
+            }
+
+            if(r && (is_power_of_two(r->value) || (options.reciprocal && has_reciprocal(r->value))))
+            {
+                report.strength += 1;
+                return Node{NodeExpression{"*"sv, std::move(lhs), NodeImmediate{1.0 / r->value}}};
+            }
+            if(options.no_nans && lhs == rhs)
+            {
+                report.fast_math += 1;
+                return Node{NodeImmediate{1.0}};
+            }
+        }
+        else if(node.function == "^"sv)
+        {
+            if(is_value(r, 1.0)) {report.identities += 1; return std::move(lhs);}
+            if(is_value(r, 0.0)) {report.identities += 1; return Node{NodeImmediate{1.0}};}
+
+            // (-x)^n == x^n if n is even
+            if(r && is_integer_exponent(r->value) && std::fmod(r->value, 2.0) == 0.0 &&
+               is_negation(lhs))
+            {
+                report.negations += 1;
+                return Node{NodeExpression{"^"sv, take_negated(std::move(lhs)), std::move(rhs)}};
+            }
+        }
+        return Node{std::move(node)};
+    }
+
+  private:
+
+    std::string_view chain_; // function of the chain that contains the current node
+
+    // rebuilds a chain of `+` or `*` as a balanced tree. The constants are
+    // folded into one, that is placed at the end.
+    Node reassociate(NodeExpression node)
+    {
+        using namespace std::literals::string_view_literals;
+        const auto f = node.function;
+
+        std::vector<Node> terms;
+        std::size_t constants = 0;
+        double      constant  = (f == "+"sv) ? -0.0 : 1.0; // identity
+        const std::function<void(Node&&)> flatten = [&](Node&& n) {
+            if(auto* expr = std::get_if<NodeExpression>(&n.node);
+               expr && expr->function == f && expr->operands.size() == 2)
+            {
+                flatten(std::move(expr->operands.at(0)));
+                flatten(std::move(expr->operands.at(1)));
+            }
+            else if(const auto* imm = std::get_if<NodeImmediate>(&n.node))
+            {
+                constants += 1;
+                constant = fold(f, constant, imm->value);
+            }
+            else
+            {
+                terms.push_back(std::move(n));
+            }
+        };
+        const Node original{node};
+        flatten(Node{std::move(node)});
+
+        // x + (-0) and x * 1 are exactly x
+        const bool identity = (f == "+"sv) ? (constant == 0.0 && std::signbit(constant)) : constant == 1.0;
+        if(terms.empty() || (constants != 0 && !identity))
+        {
+            terms.push_back(Node{NodeImmediate{constant}});
+        }
+
+        const std::function<Node(std::size_t, std::size_t)> build =
+            [&](const std::size_t first, const std::size_t last) {
+                if(last - first == 1)
+                {
+                    return std::move(terms.at(first));
+                }
+                const auto mid = first + (last - first + 1) / 2;
+                auto lhs = build(first, mid);
+                return Node{NodeExpression{f, std::move(lhs), build(mid, last)}};
+            };
+        auto retval = build(0, terms.size());
+        if(retval != original)
+        {
+            report.fast_math += 1;
+        }
+        return retval;
+    }
+
+    static double fold(const std::string_view f, const double lhs, const double rhs)
+    {
+        using namespace std::literals::string_view_literals;
+        if(f == "+"sv) {return lhs + rhs;}
+        if(f == "-"sv) {return lhs - rhs;}
+        if(f == "*"sv) {return lhs * rhs;}
+        if(f == "/"sv) {return lhs / rhs;}
+        if(f == "^"sv) {return powi(lhs, static_cast<std::int64_t>(rhs));}
+        if(is_comparison(f) || is_logical(f)) {return call_operator(f, lhs, rhs);}
+        throw std::runtime_error("jitome::simplify: unknown function name: " + std::string(f));
+    }
+
+    static bool is_value(const NodeImmediate* imm, const double v) noexcept
+    {
+        return imm && imm->value == v;
+    }
+    static bool is_positive_zero(const NodeImmediate* imm) noexcept
+    {
+        return imm && imm->value == 0.0 && !std::signbit(imm->value);
+    }
+    static bool is_negative_zero(const NodeImmediate* imm) noexcept
+    {
+        return imm && imm->value == 0.0 && std::signbit(imm->value);
+    }
+
+    // 2^k, so that x * 2^-k is exactly x / 2^k
+    static bool is_power_of_two(const double v) noexcept
+    {
+        int exponent = 0;
+        const auto mantissa = std::frexp(v, &exponent);
+        return std::isfinite(v) && std::fabs(mantissa) == 0.5 && -125 <= exponent && exponent <= 127;
+    }
+    static bool has_reciprocal(const double v) noexcept
+    {
+        return std::isnormal(v) && std::isnormal(1.0 / v);
+    }
+
+    static bool is_negation(const Node& node) noexcept
+    {
+        using namespace std::literals::string_view_literals;
+        const auto* expr = std::get_if<NodeExpression>(&node.node);
+        return expr && expr->function == "-"sv && expr->operands.size() == 1;
+    }
+    // -x -> x
+    static Node take_negated(Node node)
+    {
+        return std::move(std::get<NodeExpression>(node.node).operands.at(0));
+    }
+
+    // builds -x, simplifying it if possible
+    Node negate(Node node)
+    {
+        using namespace std::literals::string_view_literals;
+        if(const auto* imm = std::get_if<NodeImmediate>(&node.node))
+        {
+            return Node{NodeImmediate{-imm->value}};
+        }
+        if(is_negation(node))
+        {
+            report.negations += 1;
+            return take_negated(std::move(node));
+        }
+        return Node{NodeExpression{"-"sv, std::move(node)}};
+    }
+};
+
+inline Node simplify(Node node, SimplifyReport& report,
+                     const SimplifyOptions& options = SimplifyOptions{})
+{
+    Simplifier s;
+    s.options = options;
+    auto retval = s.simplify(std::move(node));
+    report = s.report;
+    return retval;
+}
+inline Node simplify(Node node, const SimplifyOptions& options = SimplifyOptions{})
+{
+    SimplifyReport report;
+    return simplify(std::move(node), report, options);
+}
+
+} // jitome
+#endif// JITOME_OPTIMIZE_HPP
@@ -0,0 +1,382 @@
+#ifndef JITOME_PARALLEL_HPP
+#define JITOME_PARALLEL_HPP
+#include "jit.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace jitome
+{
+
+// ---------------------------------------------------------------------------
+// thread pool
+//
+// A fixed set of worker threads that run the tasks of run(). Task i always
+// runs on worker i % size(), so a chunk of rows is processed by the same
+// thread every time. Together with first_touch(), the pages of an output
+// buffer are allocated on the NUMA node of the thread that writes them.
+//
+// With `pin`, worker i is bound to the i-th CPU that the process is allowed
+// to run on.
+
+class ThreadPool
+{
+  public:
+
+    // 0 threads means std::thread::hardware_concurrency(). With pin, the
+    // workers are pinned to the CPUs the process may run on, in turn. If a
+    // thread cannot be started or pinned, the started ones are joined and
+    // the exception is thrown.
+    explicit ThreadPool(std::size_t threads = 0, const bool pin = false)
+    {
+        if(threads == 0)
+        {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        std::vector<int> cpus;
+        if(pin)
+        {
+            cpu_set_t allowed;
+            CPU_ZERO(&allowed);
+            if(::sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+            {
+                throw std::runtime_error("jitome::ThreadPool: sched_getaffinity failed");
+            }
+            for(int cpu=0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if(CPU_ISSET(cpu, &allowed))
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+
+        workers_.reserve(threads);
+        try
+        {
+            for(std::size_t id=0; id<threads; ++id)
+            {
+                const int cpu = cpus.empty() ? -1 : cpus.at(id % cpus.size());
+                workers_.emplace_back([this, id, cpu] {this->work(id, cpu);});
+            }
+            // wait until all the workers are pinned
+            bool pinned = false;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                finish_.wait(lock, [this] {return started_ == workers_.size();});
+                pinned = !unpinned_;
+            }
+            if(!pinned)
+            {
+                throw std::runtime_error("jitome::ThreadPool: pthread_setaffinity_np failed");
+            }
+        }
+        catch(...)
+        {
+            // the destructor is not called, and a joinable std::thread
+            // calls std::terminate when it is destroyed
+            this->stop();
+            throw;
+        }
+    }
+    ~ThreadPool()
+    {
+        this->stop();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    std::size_t size() const noexcept {return workers_.size();}
+
+    // calls f(i) for i in [0, tasks) and waits for all of them. The first
+    // exception thrown by f is rethrown here, after the other tasks finish.
+    // run() itself is not reentrant; calls from several threads are
+    // serialized.
+    void run(const std::size_t tasks, std::function<void(std::size_t)> f)
+    {
+        std::lock_guard<std::mutex> serial(run_mtx_);
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            task_       = std::move(f);
+            tasks_      = tasks;
+            running_    = workers_.size();
+            error_      = nullptr;
+            generation_ += 1;
+        }
+        start_.notify_all();
+
+        std::unique_lock<std::mutex> lock(mtx_);
+        finish_.wait(lock, [this] {return running_ == 0;});
+        task_ = nullptr;
+        if(error_)
+        {
+            std::rethrow_exception(error_);
+        }
+    }
+
+  private:
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stop_ = true;
+        }
+        start_.notify_all();
+        for(auto& worker : workers_)
+        {
+            worker.join();
+        }
+    }
+
+    // cpu: the CPU to be pinned to, or -1. The worker pins itself before it
+    // waits for the first task, so it never runs a task on another CPU.
+    void work(const std::size_t id, const int cpu)
+    {
+        bool pinned = true;
+        if(cpu >= 0)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pinned = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            started_  += 1;
+            unpinned_ = unpinned_ || !pinned;
+        }
+        finish_.notify_one();
+
+        std::size_t seen = 0;
+        while(true)
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            start_.wait(lock, [this, seen] {return stop_ || generation_ != seen;});
+            if(stop_)
+            {
+                return;
+            }
+            seen = generation_;
+            const auto& task  = task_;
+            const auto  tasks = tasks_;
+            lock.unlock();
+
+            std::exception_ptr error = nullptr;
+            for(std::size_t i=id; i<tasks && !error; i+=workers_.size())
+            {
+                try
+                {
+                    task(i);
+                }
+                catch(...)
+                {
+                    error = std::current_exception();
+                }
+            }
+
+            lock.lock();
+            if(error && !error_)
+            {
+                error_ = error;
+            }
+            if(--running_ == 0)
+            {
+                finish_.notify_one();
+            }
+        }
+    }
+
+  private:
+
+    std::mutex                         run_mtx_;
+    std::mutex                         mtx_;
+    std::condition_variable            start_;
+    std::condition_variable            finish_;
+    std::function<void(std::size_t)>   task_;
+    std::size_t                        tasks_      = 0;
+    std::size_t                        running_    = 0;
+    std::size_t                        generation_ = 0;
+    std::size_t                        started_    = 0;     // workers that are pinned or failed to
+    bool                               unpinned_   = false; // some worker failed to be pinned
+    std::exception_ptr                 error_      = nullptr;
+    bool                               stop_       = false;
+    std::vector<std::thread>           workers_; // constructed last
+};
+
+// ---------------------------------------------------------------------------
+// parallel batch evaluation
+//
+// The rows are split into chunks of `chunk` rows and chunk i is processed by
+// worker i % pool.size(). The default is small enough that the columns of a
+// chunk stay in L2 while a kernel with a few arguments reads them.
+
+inline constexpr std::size_t default_chunk_rows = 16 * 1024;
+
+inline std::size_t chunk_count(const std::size_t n, const std::size_t chunk)
+{
+    if(chunk == 0)
+    {
+        throw std::invalid_argument("jitome::parallel: chunk must not be 0");
+    }
+    return (n + chunk - 1) / chunk;
+}
+
+// writes zeros to out with the same chunks and threads as parallel_evaluate,
+// so that the pages are allocated on the node of the thread that uses them.
+// Call it on a buffer that is not touched yet, e.g. just after new[].
+template<typename T>
+void first_touch(ThreadPool& pool, T* out, const std::size_t n,
+                 const std::size_t chunk = default_chunk_rows)
+{
+    pool.run(chunk_count(n, chunk), [=](const std::size_t i) {
+        const auto begin = i * chunk;
+        std::fill(out + begin, out + std::min(n, begin + chunk), T{});
+    });
+}
+
+// the columns advanced by `begin` rows. Up to 16 of them are kept on the
+// stack, so that a chunk does not allocate for a usual number of arguments.
+template<typename T>
+class OffsetColumns
+{
+  public:
+
+    OffsetColumns(T* const* columns, const std::size_t count, const std::size_t begin)
+        : data_(count <= local_.size() ? local_.data() : nullptr)
+    {
+        if(!data_)
+        {
+            heap_.resize(count);
+            data_ = heap_.data();
+        }
+        for(std::size_t i=0; i<count; ++i)
+        {
+            data_[i] = columns[i] + begin;
+        }
+    }
+    OffsetColumns(const OffsetColumns&) = delete;
+    OffsetColumns& operator=(const OffsetColumns&) = delete;
+
+    T* const* data() const noexcept {return data_;}
+
+  private:
+
+    std::array<T*, 16> local_;
+    std::vector<T*>    heap_;
+    T**                data_;
+};
+
+template<typename In, typename Out>
+void parallel_evaluate(ThreadPool& pool, const BasicJitBatchCompiler<In, Out>& f,
+                       const In* const* columns, Out* out, const std::size_t n,
+                       const std::size_t chunk = default_chunk_rows)
+{
+    const auto func  = f.get_func_ptr();
+    const auto arity = f.arity();
+    pool.run(chunk_count(n, chunk), [=](const std::size_t i) {
+        const auto begin = i * chunk;
+        const OffsetColumns<const In> cols(columns, arity, begin);
+        func(cols.data(), out + begin, std::min(chunk, n - begin));
+    });
+}
+
+inline void parallel_evaluate(ThreadPool& pool, const JitMultiBatchCompiler& f,
+                              const double* const* columns, double* const* outs,
+                              const std::size_t n, const std::size_t chunk = default_chunk_rows)
+{
+    const auto func    = f.get_func_ptr();
+    const auto arity   = f.arity();
+    const auto outputs = f.outputs();
+    pool.run(chunk_count(n, chunk), [=](const std::size_t i) {
+        const auto begin = i * chunk;
+        const OffsetColumns<const double> cols(columns, arity,   begin);
+        const OffsetColumns<double>       dsts(outs,    outputs, begin);
+        func(cols.data(), dsts.data(), std::min(chunk, n - begin));
+    });
+}
+
+inline void parallel_evaluate(ThreadPool& pool, const JitRowBatchCompiler& f,
+                              const void* rows, double* out, const std::size_t n,
+                              const std::size_t chunk = default_chunk_rows)
+{
+    const auto func   = f.get_func_ptr();
+    const auto stride = f.layout().stride;
+    pool.run(chunk_count(n, chunk), [=](const std::size_t i) {
+        const auto begin = i * chunk;
+        func(static_cast<const char*>(rows) + begin * stride, out + begin,
+             std::min(chunk, n - begin));
+    });
+}
+
+// The partial result of each chunk is combined in the order of the chunks,
+// so the result does not depend on the number of threads. It depends on the
+// chunk size, because the rows are added in a different order in a kernel.
+// The mean is combined from the means of the chunks weighted by their rows.
+inline double parallel_reduce(ThreadPool& pool, const JitReduceCompiler& f,
+                              const double* const* columns, const std::size_t n,
+                              const std::size_t chunk = default_chunk_rows)
+{
+    const auto func  = f.get_func_ptr();
+    const auto arity = f.arity();
+    const auto count = chunk_count(n, chunk);
+    if(count <= 1)
+    {
+        return func(columns, n);
+    }
+
+    std::vector<double> partials(count);
+    double* results = partials.data();
+    pool.run(count, [=](const std::size_t i) {
+        const auto begin = i * chunk;
+        const OffsetColumns<const double> cols(columns, arity, begin);
+        results[i] = func(cols.data(), std::min(chunk, n - begin));
+    });
+
+    switch(f.reduction())
+    {
+        case Reduction::Min:
+        {
+            double r = std::numeric_limits<double>::infinity();
+            for(const auto p : partials) {r = (p < r) ? p : r;}
+            return r;
+        }
+        case Reduction::Max:
+        {
+            double r = -std::numeric_limits<double>::infinity();
+            for(const auto p : partials) {r = (p > r) ? p : r;}
+            return r;
+        }
+        case Reduction::Mean:
+        {
+            double r = 0.0;
+            for(std::size_t i=0; i<count; ++i)
+            {
+                r += partials[i] * static_cast<double>(std::min(chunk, n - i * chunk));
+            }
+            return r / static_cast<double>(n);
+        }
+        default:
+        {
+            double r = 0.0;
+            for(const auto p : partials) {r += p;}
+            return r;
+        }
+    }
+}
+
+} // jitome
+#endif// JITOME_PARALLEL_HPP
@@ -1,21 +1,77 @@
 #ifndef JITOME_PARSER_HPP
 #define JITOME_PARSER_HPP
 #include "ast.hpp"
+#include "builtin.hpp"
 #include "tokenizer.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <sstream>
 #include <string_view>
 #include <deque>
 #include <cassert>
-#include <cctype>
 
 namespace jitome
 {
 Result<Node> parse_expr(std::deque<Token>& tokens);
 
+// function-call = ident `(` [ expression *( `,` expression ) ] `)`
+//
+// Only the builtin functions can be called.
+inline Result<Node> parse_call(std::deque<Token>& tokens)
+{
+    const auto name = tokens.front();
+    const auto* builtin = find_builtin(name.str);
+    if(!builtin)
+    {
+        return err(make_error_message("parse_call: unknown function:", name));
+    }
+    tokens.pop_front(); // name
+    tokens.pop_front(); // (
+
+    NodeExpression call(builtin->name);
+    while(not tokens.empty() && tokens.front().kind != TokenKind::RightParen)
+    {
+        if(!call.operands.empty())
+        {
+            if(tokens.front().kind != TokenKind::Comma)
+            {
+                return err(make_error_message("parse_call: expected comma, but found:",
+                           tokens.front()));
+            }
+            tokens.pop_front(); // ,
+        }
+        auto arg = parse_expr(tokens);
+        if(arg.is_err())
+        {
+            return arg;
+        }
+        call.operands.push_back(std::move(arg.as_val()));
+    }
+    if(tokens.empty())
+    {
+        return err("parse_call: expected right bracket `)`, but EOF is found");
+    }
+    tokens.pop_front(); // )
+
+    if(call.operands.size() != builtin->arity)
+    {
+        return err(make_error_message("parse_call: " + std::to_string(builtin->arity) +
+            " argument(s) are expected, but " + std::to_string(call.operands.size()) +
+            " are given:", name));
+    }
+    return ok(Node{std::move(call)});
+}
+
 inline Result<Node> parse_primary(std::deque<Token>& tokens)
 {
+    if(tokens.empty())
+    {
+        return err("parse_primary: expected an expression, but EOF is found");
+    }
     if(tokens.front().kind == TokenKind::LeftParen)
     {
         tokens.pop_front();
@@ -51,18 +107,83 @@ inline Result<Node> parse_primary(std::deque<Token>& tokens)
     }
     else if(tokens.front().kind == TokenKind::Identifier)
     {
-        std::string ident(tokens.front().str);
-        tokens.pop_front();
-        return ok(Node{NodeVariable{std::move(ident)}});
+        if(tokens.size() < 2 || tokens.at(1).kind != TokenKind::LeftParen)
+        {
+            std::string ident(tokens.front().str);
+            tokens.pop_front();
+            return ok(Node{NodeVariable{std::move(ident)}});
+        }
+        return parse_call(tokens);
     }
     return err(make_error_message("parse_primary: unexpected token appeared",
                                   tokens.front()));
 }
 
+// power = primary [ `^` [ sign ] integer ]
+//
+// The exponent should be an integer immediate. `^` is not associative
+// because `x^2^3` cannot be written in this form, so it is rejected.
+inline Result<Node> parse_power(std::deque<Token>& tokens)
+{
+    using namespace std::literals::string_view_literals;
+    auto base = parse_primary(tokens);
+
+    if(base.is_err())
+    {
+        return base;
+    }
+    if(tokens.empty() || tokens.front().kind != TokenKind::Operator ||
+       tokens.front().str != "^")
+    {
+        return base;
+    }
+    tokens.pop_front(); // ^
+
+    bool negative = false;
+    if(!tokens.empty() && tokens.front().kind == TokenKind::Operator &&
+       (tokens.front().str == "+" || tokens.front().str == "-"))
+    {
+        negative = (tokens.front().str == "-");
+        tokens.pop_front();
+    }
+    if(tokens.empty())
+    {
+        return err("parse_power: expected an integer exponent, but EOF is found");
+    }
+
+    const auto& exponent = tokens.front();
+    const bool is_integer = exponent.kind == TokenKind::Immediate &&
+        std::all_of(exponent.str.begin(), exponent.str.end(), is_digit);
+    if(!is_integer)
+    {
+        return err(make_error_message(
+            "parse_power: exponent should be an integer, but found:", exponent));
+    }
+    std::int64_t n = 0;
+    for(const char c : exponent.str)
+    {
+        n = n * 10 + (c - '0');
+        if(max_exponent < n)
+        {
+            return err(make_error_message("parse_power: exponent is too large:", exponent));
+        }
+    }
+    tokens.pop_front();
+
+    if(!tokens.empty() && tokens.front().kind == TokenKind::Operator &&
+       tokens.front().str == "^")
+    {
+        return err(make_error_message(
+            "parse_power: `^` is not associative, use parentheses:", tokens.front()));
+    }
+    return ok(Node{NodeExpression{"^"sv, std::move(base.as_val()),
+                                  NodeImmediate{static_cast<double>(negative ? -n : n)}}});
+}
+
 inline Result<Node> parse_mul(std::deque<Token>& tokens)
 {
     using namespace std::literals::string_view_literals;
-    auto lhs = parse_primary(tokens);
+    auto lhs = parse_power(tokens);
 
     if(lhs.is_err())
     {
@@ -74,7 +195,7 @@ inline Result<Node> parse_mul(std::deque<Token>& tokens)
         if(tokens.front().kind == TokenKind::Operator && tokens.front().str == "*")
         {
             tokens.pop_front();
-            auto rhs = parse_primary(tokens);
+            auto rhs = parse_power(tokens);
             if(rhs.is_err())
             {
                 return rhs;
@@ -87,7 +208,7 @@ inline Result<Node> parse_mul(std::deque<Token>& tokens)
         else if(tokens.front().kind == TokenKind::Operator && tokens.front().str == "/")
         {
             tokens.pop_front();
-            auto rhs = parse_primary(tokens);
+            auto rhs = parse_power(tokens);
             if(rhs.is_err())
             {
                 return rhs;
@@ -105,7 +226,7 @@ inline Result<Node> parse_mul(std::deque<Token>& tokens)
     return lhs;
 }
 
-inline Result<Node> parse_expr(std::deque<Token>& tokens)
+inline Result<Node> parse_add(std::deque<Token>& tokens)
 {
     using namespace std::literals::string_view_literals;
     auto lhs = parse_mul(tokens);
@@ -151,6 +272,169 @@ inline Result<Node> parse_expr(std::deque<Token>& tokens)
     return lhs;
 }
 
+// Parses left-associative binary operators of the same precedence, e.g.
+// `a < b < c` is `(a < b) < c`. The name of the operator in the AST is the
+// one in `ops`, so that it outlives the source code.
+template<std::size_t N>
+Result<Node> parse_binary(std::deque<Token>& tokens, Result<Node> (*operand)(std::deque<Token>&),
+                          const std::array<std::string_view, N>& ops)
+{
+    auto lhs = operand(tokens);
+    if(lhs.is_err())
+    {
+        return lhs;
+    }
+    while(not tokens.empty() && tokens.front().kind == TokenKind::Operator)
+    {
+        const auto found = std::find(ops.begin(), ops.end(), tokens.front().str);
+        if(found == ops.end())
+        {
+            return lhs;
+        }
+        tokens.pop_front();
+        auto rhs = operand(tokens);
+        if(rhs.is_err())
+        {
+            return rhs;
+        }
+        lhs = Node{NodeExpression{*found, std::move(lhs.as_val()), std::move(rhs.as_val())}};
+    }
+    return lhs;
+}
+
+// relational = sum *( (`<` / `<=` / `>` / `>=`) sum )
+inline Result<Node> parse_relational(std::deque<Token>& tokens)
+{
+    using namespace std::literals::string_view_literals;
+    return parse_binary(tokens, parse_add, std::array{"<"sv, "<="sv, ">"sv, ">="sv});
+}
+// equality = relational *( (`==` / `!=`) relational )
+inline Result<Node> parse_equality(std::deque<Token>& tokens)
+{
+    using namespace std::literals::string_view_literals;
+    return parse_binary(tokens, parse_relational, std::array{"=="sv, "!="sv});
+}
+inline Result<Node> parse_and(std::deque<Token>& tokens)
+{
+    using namespace std::literals::string_view_literals;
+    return parse_binary(tokens, parse_equality, std::array{"&&"sv});
+}
+inline Result<Node> parse_or(std::deque<Token>& tokens)
+{
+    using namespace std::literals::string_view_literals;
+    return parse_binary(tokens, parse_and, std::array{"||"sv});
+}
+
+// expression = or [ `?` expression `:` expression ]
+//
+// The precedence is the same as C. `c ? a : b` is select(c, a, b), and both
+// of a and b are evaluated.
+inline Result<Node> parse_expr(std::deque<Token>& tokens)
+{
+    auto cond = parse_or(tokens);
+    if(cond.is_err())
+    {
+        return cond;
+    }
+    if(tokens.empty() || tokens.front().kind != TokenKind::Operator || tokens.front().str != "?")
+    {
+        return cond;
+    }
+    tokens.pop_front(); // ?
+
+    auto lhs = parse_expr(tokens);
+    if(lhs.is_err())
+    {
+        return lhs;
+    }
+    if(tokens.empty())
+    {
+        return err("parse_expr: expected `:`, but EOF is found");
+    }
+    if(tokens.front().kind != TokenKind::Operator || tokens.front().str != ":")
+    {
+        return err(make_error_message("parse_expr: expected `:`, but found:", tokens.front()));
+    }
+    tokens.pop_front(); // :
+
+    auto rhs = parse_expr(tokens);
+    if(rhs.is_err())
+    {
+        return rhs;
+    }
+    return ok(Node{NodeExpression{find_builtin("select")->name, std::move(cond.as_val()),
+                                  std::move(lhs.as_val()), std::move(rhs.as_val())}});
+}
+
+// function-body = expression
+//               / *( [ ident `=` ] expression `;` ) `return` expression `;`
+//
+// Assignments are appended to the locals of the function and the returned
+// expression is the body. A statement without assignment has no effect and
+// is dropped.
+inline Result<Node> parse_body(std::deque<Token>& tokens, NodeFunction& defun)
+{
+    bool statements = false;
+    while(not tokens.empty())
+    {
+        if(statements && tokens.front().kind == TokenKind::RightCurly)
+        {
+            return err(make_error_message("parse_body: expected `return`, but found:",
+                       tokens.front()));
+        }
+        const bool returns = (tokens.front().kind == TokenKind::Keyword);
+        if(returns)
+        {
+            tokens.pop_front(); // return
+        }
+        std::string local;
+        if(!returns && tokens.size() >= 2 && tokens.front().kind == TokenKind::Identifier &&
+           tokens.at(1).kind == TokenKind::Operator && tokens.at(1).str == "=")
+        {
+            local = std::string(tokens.front().str);
+            tokens.pop_front(); // name
+            tokens.pop_front(); // =
+        }
+        if(tokens.empty())
+        {
+            return err("parse_body: expected expression, but no tokens left");
+        }
+
+        auto expr = parse_expr(tokens);
+        if(expr.is_err())
+        {
+            return expr;
+        }
+        if(!returns && !statements && local.empty() &&
+           !tokens.empty() && tokens.front().kind == TokenKind::RightCurly)
+        {
+            return expr; // `{expr}`
+        }
+
+        if(tokens.empty())
+        {
+            return err("parse_body: expected semicolon, but no tokens left");
+        }
+        if(tokens.front().kind != TokenKind::Semicolon)
+        {
+            return err(make_error_message("parse_body: expected semicolon, but found:",
+                       tokens.front()));
+        }
+        tokens.pop_front(); // ;
+
+        if(returns)
+        {
+            return expr;
+        }
+        if(!local.empty())
+        {
+            defun.locals.push_back(NodeLocal{std::move(local), std::move(expr.as_val())});
+        }
+        statements = true;
+    }
+    return err("parse_body: expected `return`, but no tokens left");
+}
+
 inline Result<Node> parse_funcdef(std::deque<Token>& tokens)
 {
     if(tokens.empty())
@@ -216,13 +500,17 @@ inline Result<Node> parse_funcdef(std::deque<Token>& tokens)
     }
     tokens.pop_front(); // pop LeftCurly
 
-    auto expr = parse_expr(tokens);
-    if(expr.is_err())
+    auto body = parse_body(tokens, defun);
+    if(body.is_err())
     {
-        return expr;
+        return body;
     }
-    defun.body = std::move(expr.as_val());
+    defun.body = std::move(body.as_val());
 
+    if(tokens.empty())
+    {
+        return err("parse_funcdef: expected right curly brace, but no tokens left");
+    }
     if(tokens.front().kind != TokenKind::RightCurly)
     {
         return err(make_error_message("parse_funcdef: expected right curly brace, but found: ",
@@ -0,0 +1,105 @@
+#ifndef JITOME_PAYNE_HANEK_HPP
+#define JITOME_PAYNE_HANEK_HPP
+#include "util.hpp"
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+namespace jitome
+{
+
+// Argument reduction of sin and cos for large |x| (Payne and Hanek).
+//
+// x = m 2^e for a 53-bit integer m. The bits of 2/pi above 2^(1-e) make
+// x 2/pi a multiple of 4, so only the 192 bits of 2/pi below them are
+// multiplied by m. The product is x 2/pi mod 4 in a fixed point number of
+// 128 bits with 2 integer bits. The error is about 2^-125, and x 2/pi is
+// at least 2^-61 away from an integer for any double, so the remainder
+// keeps its precision.
+//
+// Emitter (codegen.hpp) emits the same computation, so the JIT and
+// evaluate() give the same result.
+
+// bits of 2/pi after a zero word. The highest bit of two_over_pi[1] is 2^-1.
+inline constexpr std::array<std::uint64_t, 20> two_over_pi = {{
+    0x0000000000000000, 0xA2F9836E4E441529,
+    0xFC2757D1F534DDC0, 0xDB6295993C439041,
+    0xFE5163ABDEBBC561, 0xB7246E3A424DD2E0,
+    0x06492EEA09D1921C, 0xFE1DEB1CB129A73E,
+    0xE88235F52EBB4484, 0xE99C7026B45F7E41,
+    0x3991D639835339F4, 0x9C845F8BBDF9283B,
+    0x1FF897FFDE05980F, 0xEF2F118B5A0A6D1F,
+    0x6D367ECF27CB09B7, 0x4F463F669E5FEA2D,
+    0x7527BAC7EBE5F17B, 0x3D0739F78A5292EA,
+    0x6BFB5FB11F8D5D08, 0x56033046FC7B6BAB,
+}};
+
+// pi/2 * 2^63, rounded
+inline constexpr std::uint64_t pi_over_2 = 0xC90FDAA22168C235ull;
+
+// x = quadrant pi/2 + remainder (mod 2 pi), |remainder| <= pi/4
+struct Reduced
+{
+    double        remainder;
+    std::uint64_t quadrant; // 0, 1, 2 or 3
+};
+
+// |x| should be at least 2^-10. inf and NaN are reduced to NaN.
+inline Reduced payne_hanek(const double x)
+{
+    using uint128_t = unsigned __int128;
+
+    const auto bits = bit_cast<std::uint64_t>(x);
+    const auto biased = (bits >> 52) & 0x7FF;
+    if(biased == 0x7FF)
+    {
+        return Reduced{std::numeric_limits<double>::quiet_NaN(), 0};
+    }
+    const std::uint64_t m = (bits & 0x000FFFFFFFFFFFFFull) | (1ull << 52);
+
+    // the first bit of the window, counted from the highest bit of the table
+    const auto j = biased - 1013;
+    const auto w = j / 64;
+    const auto s = j % 64;
+    const auto window = [w, s](const std::size_t i) {
+        const auto hi = two_over_pi.at(w + i);
+        const auto lo = two_over_pi.at(w + i + 1);
+        return s == 0 ? hi : (hi << s) | (lo >> (64 - s));
+    };
+
+    // (hi, lo) = m * (w0, w1, w2), dropping the lower half of m * w2 and
+    // the upper half of m * w0
+    const auto p2 = static_cast<uint128_t>(m) * window(2);
+    const auto p1 = static_cast<uint128_t>(m) * window(1);
+    const auto sum = static_cast<uint128_t>(static_cast<std::uint64_t>(p2 >> 64)) +
+                     static_cast<std::uint64_t>(p1);
+    const auto lo = static_cast<std::uint64_t>(sum);
+    const auto hi = static_cast<std::uint64_t>(p1 >> 64) + m * window(0) +
+                    static_cast<std::uint64_t>(sum >> 64);
+
+    // round to the nearest quadrant. f is the rest in [-1/2, 1/2) * 2^62.
+    const auto n = (hi + (1ull << 61)) >> 62;
+    const auto f = static_cast<std::int64_t>(hi - (n << 62));
+
+    // |(f, lo)| is normalized to 64 bits and multiplied by pi/2, so the
+    // remainder is rounded only once. a is not 0 by the bound above.
+    auto a = static_cast<std::uint64_t>(f);
+    auto b = lo;
+    if(f < 0)
+    {
+        a = ~a + (b == 0 ? 1 : 0);
+        b = 0 - b;
+    }
+    const int z = __builtin_clzll(a | 1);
+    const auto u = (a << z) | (b >> (64 - z));
+    const auto p = static_cast<std::uint64_t>((static_cast<uint128_t>(u) * pi_over_2) >> 64);
+    const auto r = static_cast<double>(static_cast<std::int64_t>(p >> 1)) *
+                   bit_cast<double>(static_cast<std::uint64_t>(963 - z) << 52); // 2^(-60-z)
+
+    const bool negative = (x < 0.0);
+    return Reduced{(f < 0) != negative ? -r : r, negative ? (4 - n) & 3 : n};
+}
+
+} // jitome
+#endif// JITOME_PAYNE_HANEK_HPP
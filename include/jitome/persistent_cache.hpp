@@ -0,0 +1,395 @@
+#ifndef JITOME_PERSISTENT_CACHE_HPP
+#define JITOME_PERSISTENT_CACHE_HPP
+#include "ast.hpp"
+#include "cache.hpp"
+#include "jit.hpp"
+#include "module.hpp"
+#include "isa.hpp"
+#include "optimize.hpp"
+#include "xbyak_util.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace jitome
+{
+
+// CPU features that change the generated code, as a bit set.
+inline std::uint64_t cpu_features()
+{
+    using Cpu = Xbyak::util::Cpu;
+    const Cpu& cpu = host_cpu();
+    const Cpu::Type features[] = {
+        Cpu::tSSE2, Cpu::tSSE3, Cpu::tSSSE3, Cpu::tSSE41, Cpu::tSSE42,
+        Cpu::tAVX, Cpu::tAVX2, Cpu::tFMA,
+        Cpu::tAVX512F, Cpu::tAVX512DQ, Cpu::tAVX512VL, Cpu::tAVX512BW,
+    };
+    std::uint64_t bits = 0;
+    for(std::size_t i=0; i<std::size(features); ++i)
+    {
+        if(cpu.has(features[i]))
+        {
+            bits |= (std::uint64_t(1) << i);
+        }
+    }
+    return bits;
+}
+
+// ---------------------------------------------------------------------------
+// PersistentCache
+//
+// Keeps compiled code in a file so that the next process can use it without
+// compiling. On construction, the file is mapped into executable memory and
+// functions are looked up by the hash of their key. Functions that are not
+// in the file are compiled into a JitModule, and save() writes all of them.
+//
+// The key is the type of the function, the options and the source code as
+// is, so that a hit does not need to tokenize nor parse. Functions given as
+// Node are keyed by the canonical form.
+//
+// The file is ignored if it was written by another version of jitome or on
+// a CPU with different features. The version is the layout of the file and
+// the version of the code generator (codegen_version in jit.hpp), so a file
+// written before a change of the generated code is never executed. This
+// class is not thread-safe.
+//
+// file layout (native byte order):
+//
+//   FileHeader
+//   IndexEntry[count]   sorted by hash
+//   keys
+//   padding             to page boundary
+//   code                each function is aligned to `code_alignment`
+
+class PersistentCache
+{
+  public:
+
+    // increment this when the file layout changes. Changes of the generated
+    // code are recorded by codegen_version.
+    static constexpr std::uint32_t version        = 2;
+    static constexpr std::size_t   code_alignment = 64;
+
+    using batch_func_type = JitBatchCompiler::func_type;
+
+  public:
+
+    explicit PersistentCache(std::string path)
+        : path_(std::move(path))
+    {
+        this->map_file();
+    }
+    ~PersistentCache()
+    {
+        this->unmap_file();
+    }
+
+    PersistentCache(const PersistentCache&) = delete;
+    PersistentCache& operator=(const PersistentCache&) = delete;
+
+    template<typename F>
+    JitFunction<F> compile(const std::string& code, const CompileOptions& options = CompileOptions{})
+    {
+        return this->lookup<F>(key_of<JitCompiler<F>>(options, "src:" + code), [&] {
+                return module_.compile<F>(code, 16, options);
+            });
+    }
+    template<typename F>
+    JitFunction<F> compile(Node root, const CompileOptions& options = CompileOptions{})
+    {
+        root = simplify(std::move(root));
+        return this->lookup<F>(key_of<JitCompiler<F>>(options, "ast:" + canonicalize(root)), [&] {
+                return module_.compile<F>(std::move(root), 16, options);
+            });
+    }
+
+    JitFunction<batch_func_type>
+    compile_batch(const std::string& code, const CompileOptions& options = CompileOptions{})
+    {
+        return this->lookup<batch_func_type>(key_of<JitBatchCompiler>(options, "src:" + code), [&] {
+                return module_.compile_batch(code, 16, options);
+            });
+    }
+    JitFunction<batch_func_type>
+    compile_batch(Node root, const CompileOptions& options = CompileOptions{})
+    {
+        root = simplify(std::move(root));
+        return this->lookup<batch_func_type>(key_of<JitBatchCompiler>(options, "ast:" + canonicalize(root)), [&] {
+                return module_.compile_batch(std::move(root), 16, options);
+            });
+    }
+
+    // writes the functions in the file and the ones compiled in this process.
+    // The file is replaced atomically, so the running code is not affected.
+    void save() const;
+
+    const std::string& path() const noexcept {return path_;}
+
+    std::size_t loaded() const noexcept {return count_;}          // in the file
+    std::size_t hits()   const noexcept {return hits_;}           // not compiled
+    std::size_t misses() const noexcept {return misses_;}         // compiled
+    std::size_t size()   const noexcept {return count_ + added_.size();}
+
+  private:
+
+    struct FileHeader
+    {
+        char          magic[8];
+        std::uint32_t version;
+        std::uint32_t count;
+        std::uint64_t features;
+        std::uint64_t codegen;
+        std::uint64_t index_offset;
+        std::uint64_t code_offset;
+        std::uint64_t file_size;
+    };
+    struct IndexEntry
+    {
+        std::uint64_t hash;
+        std::uint64_t key_offset;
+        std::uint64_t key_size;
+        std::uint64_t code_offset;
+        std::uint64_t code_size;
+    };
+    static constexpr char magic[8] = {'J', 'I', 'T', 'O', 'M', 'E', 'C', 'C'};
+
+    struct Record
+    {
+        std::string  key;
+        const void*  code;
+        std::size_t  size;
+    };
+
+    // FNV-1a
+    static std::uint64_t hash_of(const std::string_view key) noexcept
+    {
+        std::uint64_t h = 0xcbf29ce484222325ull;
+        for(const char c : key)
+        {
+            h ^= static_cast<std::uint8_t>(c);
+            h *= 0x100000001b3ull;
+        }
+        return h;
+    }
+
+    template<typename Compiler>
+    static std::string key_of(const CompileOptions& options, const std::string& code)
+    {
+        return std::string(typeid(Compiler).name()) + ":" + dump(options) + ":" + code;
+    }
+
+    template<typename F, typename Compile>
+    JitFunction<F> lookup(const std::string& key, Compile&& compile)
+    {
+        if(const auto* entry = this->find(key))
+        {
+            hits_ += 1;
+            return JitFunction<F>{reinterpret_cast<F*>(base_ + entry->code_offset),
+                                  static_cast<std::size_t>(entry->code_size)};
+        }
+        const auto found = added_.find(key);
+        if(found != added_.end())
+        {
+            hits_ += 1;
+            return JitFunction<F>{reinterpret_cast<F*>(const_cast<void*>(found->second.code)),
+                                  found->second.size};
+        }
+        misses_ += 1;
+        const JitFunction<F> f = compile();
+        added_.emplace(key, Record{key, reinterpret_cast<const void*>(f.ptr), f.size});
+        return f;
+    }
+
+    const IndexEntry* find(const std::string_view key) const noexcept
+    {
+        if(count_ == 0)
+        {
+            return nullptr;
+        }
+        const auto h = hash_of(key);
+        const auto* first = index_;
+        const auto* last  = index_ + count_;
+        auto iter = std::lower_bound(first, last, h,
+            [](const IndexEntry& e, const std::uint64_t v) {return e.hash < v;});
+        for(; iter != last && iter->hash == h; ++iter)
+        {
+            const std::string_view k(reinterpret_cast<const char*>(base_ + iter->key_offset),
+                                     static_cast<std::size_t>(iter->key_size));
+            if(k == key)
+            {
+                return iter;
+            }
+        }
+        return nullptr;
+    }
+
+    // maps the file if it is valid. otherwise, the cache starts empty.
+    void map_file()
+    {
+        const int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0)
+        {
+            return;
+        }
+        struct stat st;
+        if(::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(FileHeader))
+        {
+            ::close(fd);
+            return;
+        }
+        const auto size = static_cast<std::size_t>(st.st_size);
+        void* mem = ::mmap(nullptr, size, PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(mem == MAP_FAILED) // e.g. on a noexec filesystem
+        {
+            return;
+        }
+        base_ = static_cast<const std::uint8_t*>(mem);
+        mapped_size_ = size;
+
+        FileHeader header;
+        std::memcpy(&header, base_, sizeof(FileHeader));
+
+        const bool valid =
+            std::memcmp(header.magic, magic, sizeof(magic)) == 0 &&
+            header.version   == version         &&
+            header.features  == cpu_features()  &&
+            header.codegen   == codegen_version  &&
+            header.file_size == size            &&
+            header.index_offset + std::uint64_t(header.count) * sizeof(IndexEntry) <= size &&
+            header.code_offset <= size;
+        if(!valid)
+        {
+            this->unmap_file();
+            return;
+        }
+        index_ = reinterpret_cast<const IndexEntry*>(base_ + header.index_offset);
+        count_ = header.count;
+        for(std::size_t i=0; i<count_; ++i)
+        {
+            const auto& e = index_[i];
+            if(size < e.key_offset + e.key_size || size < e.code_offset + e.code_size ||
+               e.code_offset < header.code_offset)
+            {
+                this->unmap_file();
+                return;
+            }
+        }
+    }
+
+    void unmap_file() noexcept
+    {
+        if(base_)
+        {
+            ::munmap(const_cast<std::uint8_t*>(base_), mapped_size_);
+        }
+        base_        = nullptr;
+        mapped_size_ = 0;
+        index_       = nullptr;
+        count_       = 0;
+    }
+
+  private:
+
+    std::string        path_;
+    const std::uint8_t* base_        = nullptr;
+    std::size_t        mapped_size_ = 0;
+    const IndexEntry*  index_       = nullptr;
+    std::size_t        count_       = 0;
+    std::size_t        hits_        = 0;
+    std::size_t        misses_      = 0;
+    JitModule          module_;
+    std::unordered_map<std::string, Record> added_;
+};
+
+inline void PersistentCache::save() const
+{
+    std::vector<Record> records;
+    for(std::size_t i=0; i<count_; ++i)
+    {
+        const auto& e = index_[i];
+        records.push_back(Record{
+                std::string(reinterpret_cast<const char*>(base_ + e.key_offset), e.key_size),
+                base_ + e.code_offset, static_cast<std::size_t>(e.code_size)});
+    }
+    for(const auto& [key, record] : added_)
+    {
+        records.push_back(record);
+    }
+    std::sort(records.begin(), records.end(), [](const Record& lhs, const Record& rhs) {
+            return hash_of(lhs.key) < hash_of(rhs.key);
+        });
+
+    const auto round_up = [](const std::size_t x, const std::size_t align) {
+        return (x + align - 1) / align * align;
+    };
+    const std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+
+    FileHeader header;
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version      = version;
+    header.count        = static_cast<std::uint32_t>(records.size());
+    header.features     = cpu_features();
+    header.codegen      = codegen_version;
+    header.index_offset = sizeof(FileHeader);
+
+    std::vector<IndexEntry> index(records.size());
+    std::size_t offset = sizeof(FileHeader) + sizeof(IndexEntry) * records.size();
+    for(std::size_t i=0; i<records.size(); ++i)
+    {
+        index[i].hash       = hash_of(records[i].key);
+        index[i].key_offset = offset;
+        index[i].key_size   = records[i].key.size();
+        offset += records[i].key.size();
+    }
+    offset = round_up(offset, page);
+    header.code_offset = offset;
+    for(std::size_t i=0; i<records.size(); ++i)
+    {
+        offset = round_up(offset, code_alignment);
+        index[i].code_offset = offset;
+        index[i].code_size   = records[i].size;
+        offset += records[i].size;
+    }
+    header.file_size = offset;
+
+    std::vector<std::uint8_t> buffer(offset, 0);
+    std::memcpy(buffer.data(), &header, sizeof(FileHeader));
+    std::memcpy(buffer.data() + header.index_offset, index.data(), sizeof(IndexEntry) * index.size());
+    for(std::size_t i=0; i<records.size(); ++i)
+    {
+        std::memcpy(buffer.data() + index[i].key_offset, records[i].key.data(), records[i].key.size());
+        std::memcpy(buffer.data() + index[i].code_offset, records[i].code, records[i].size);
+    }
+
+    const std::string tmp = path_ + ".tmp." + std::to_string(::getpid());
+    std::FILE* fp = std::fopen(tmp.c_str(), "wb");
+    if(!fp)
+    {
+        throw std::runtime_error("jitome::PersistentCache: cannot open " + tmp);
+    }
+    const bool written = std::fwrite(buffer.data(), 1, buffer.size(), fp) == buffer.size();
+    if(std::fclose(fp) != 0 || !written || std::rename(tmp.c_str(), path_.c_str()) != 0)
+    {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("jitome::PersistentCache: cannot write " + path_);
+    }
+}
+
+} // jitome
+#endif// JITOME_PERSISTENT_CACHE_HPP
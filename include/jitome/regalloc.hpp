@@ -0,0 +1,570 @@
+#ifndef JITOME_REGALLOC_HPP
+#define JITOME_REGALLOC_HPP
+#include "ir.hpp"
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace jitome
+{
+
+// Register allocation for a straight-line Program.
+//
+// Since a Program has no branch, the allocator walks the instructions once
+// and, when it runs out of registers, evicts the value whose next use is the
+// furthest (Belady's MIN). Evicted values are stored to a stack slot unless a
+// copy already exists in memory, e.g. an argument passed in memory.
+//
+// The result is a sequence of MachineOps that the code generator translates
+// into instructions one by one.
+
+struct Location
+{
+    enum class Kind : std::uint8_t
+    {
+        Nowhere,
+        Register, // vector register `index`
+        Spill,    // stack slot `index`
+        Argument, // memory passed by the caller that contains argument `index`
+        Constant, // immediate value defined by instruction `index`
+    };
+    Kind        kind  = Kind::Nowhere;
+    std::size_t index = 0;
+
+    static Location reg     (std::size_t i) noexcept {return Location{Kind::Register, i};}
+    static Location spill   (std::size_t i) noexcept {return Location{Kind::Spill,    i};}
+    static Location argument(std::size_t i) noexcept {return Location{Kind::Argument, i};}
+    static Location constant(std::size_t i) noexcept {return Location{Kind::Constant, i};}
+
+    bool is_register() const noexcept {return kind == Kind::Register;}
+
+    bool operator==(const Location& other) const noexcept
+    {
+        return this->kind == other.kind && this->index == other.index;
+    }
+    bool operator!=(const Location& other) const noexcept
+    {
+        return !(*this == other);
+    }
+};
+
+struct MachineOp
+{
+    enum class Kind : std::uint8_t
+    {
+        Load,    // dst (register) <- src[0] (Spill, Argument or Constant)
+        Store,   // dst (Spill)    <- src[0] (register)
+        Move,    // dst (register) <- src[0] (register)
+        Compute, // dst (register) <- prog.code[inst](src...)
+                 // for Output, dst is Nowhere and src[0] is a register
+    };
+    Kind                    kind;
+    std::size_t             inst;
+    Location                dst;
+    std::array<Location, 3> src;
+};
+
+struct RegisterAllocatorConfig
+{
+    // number of vector registers that can be used
+    std::size_t registers = 16;
+
+    // If false, the destination of an instruction must be the same as the
+    // first operand, like `addsd xmm0, xmm1` in legacy SSE.
+    bool three_operand = false;
+
+    // If true, the first 8 arguments are passed in xmm0-xmm7 (System V ABI)
+    // and the rest are passed in memory. Otherwise all the arguments are in
+    // memory.
+    bool arguments_in_registers = true;
+
+    // If true, constants are placed in memory and can be used as memory
+    // operands. Otherwise they are materialized in a register when used.
+    bool constants_in_memory = true;
+
+    // If true, arguments in memory should be loaded into a register before
+    // they are used, e.g. to convert them or to gather them from rows.
+    bool load_arguments = false;
+
+    // The register in which the caller wants the result, e.g. 0 for xmm0.
+    // With three-operand form, the last instruction writes into it if it is
+    // free. npos means no preference.
+    std::size_t result_register = std::numeric_limits<std::size_t>::max();
+};
+
+struct Allocation
+{
+    std::vector<MachineOp> ops;
+    Location               result;          // register that holds the result, if any
+    std::size_t            spill_slots = 0; // number of stack slots required
+    std::size_t            stores      = 0;
+    std::size_t            loads       = 0;
+    std::size_t            moves       = 0;
+};
+
+inline std::string dump(const Location& loc)
+{
+    switch(loc.kind)
+    {
+        case Location::Kind::Nowhere : {return "none";}
+        case Location::Kind::Register: {return "r"     + std::to_string(loc.index);}
+        case Location::Kind::Spill   : {return "slot"  + std::to_string(loc.index);}
+        case Location::Kind::Argument: {return "arg"   + std::to_string(loc.index);}
+        case Location::Kind::Constant: {return "const%" + std::to_string(loc.index);}
+    }
+    return "unknown";
+}
+
+inline std::string dump(const Program& prog, const Allocation& alloc)
+{
+    std::string retval;
+    for(const auto& op : alloc.ops)
+    {
+        switch(op.kind)
+        {
+            case MachineOp::Kind::Load   : {retval += "load  "; break;}
+            case MachineOp::Kind::Store  : {retval += "store "; break;}
+            case MachineOp::Kind::Move   : {retval += "move  "; break;}
+            case MachineOp::Kind::Compute:
+            {
+                retval += std::string(to_string(prog.code.at(op.inst).op)) + "   ";
+                break;
+            }
+        }
+        retval += dump(op.dst);
+        const std::size_t n = (op.kind == MachineOp::Kind::Compute) ?
+            num_operands(prog.code.at(op.inst).op) : 1;
+        for(std::size_t i=0; i<n; ++i)
+        {
+            retval += ", " + dump(op.src.at(i));
+        }
+        retval += "\n";
+    }
+    retval += "result " + dump(alloc.result) + "\n";
+    return retval;
+}
+
+struct RegisterAllocator
+{
+    static constexpr std::size_t npos  = std::numeric_limits<std::size_t>::max();
+    static constexpr std::size_t never = std::numeric_limits<std::size_t>::max();
+
+    RegisterAllocator(const Program& prog, const RegisterAllocatorConfig& config)
+        : prog_(prog), config_(config),
+          uses_(prog.code.size()), slot_of_(prog.code.size(), npos),
+          reg_of_(prog.code.size(), npos), owner_(config.registers, npos)
+    {
+        if(config_.registers < 3)
+        {
+            throw std::runtime_error("jitome::allocate_registers: too few registers");
+        }
+        for(std::size_t i=0; i<prog_.code.size(); ++i)
+        {
+            const auto& inst = prog_.code.at(i);
+            for(std::size_t j=0; j<num_operands(inst.op); ++j)
+            {
+                uses_.at(inst.operands.at(j)).push_back(i);
+            }
+        }
+        // the result is used after the last instruction
+        if(prog_.result != npos)
+        {
+            uses_.at(prog_.result).push_back(prog_.code.size());
+        }
+    }
+
+    Allocation run()
+    {
+        // arguments passed in registers are already there.
+        if(config_.arguments_in_registers)
+        {
+            for(std::size_t i=0; i<prog_.code.size(); ++i)
+            {
+                const auto& inst = prog_.code.at(i);
+                if(inst.op == Opcode::Argument && inst.index < 8 &&
+                   inst.index < config_.registers && !uses_.at(i).empty())
+                {
+                    this->assign(i, inst.index);
+                }
+            }
+        }
+
+        for(std::size_t i=0; i<prog_.code.size(); ++i)
+        {
+            const auto& inst = prog_.code.at(i);
+            if(inst.op == Opcode::Argument || inst.op == Opcode::Constant)
+            {
+                continue; // loaded when it is used
+            }
+            this->compute(i);
+        }
+
+        const auto res = prog_.result;
+        if(res == npos)
+        {
+            return std::move(alloc_);
+        }
+        if(reg_of_.at(res) == npos)
+        {
+            this->load(res, this->acquire(prog_.code.size(), {res, npos, npos}));
+        }
+        alloc_.result = Location::reg(reg_of_.at(res));
+        return std::move(alloc_);
+    }
+
+  private:
+
+    // the first position in which v is used after pos
+    std::size_t next_use(const std::size_t v, const std::size_t pos) const
+    {
+        const auto& u = uses_.at(v);
+        const auto found = std::upper_bound(u.begin(), u.end(), pos);
+        return found == u.end() ? never : *found;
+    }
+    bool dies_at(const std::size_t v, const std::size_t pos) const
+    {
+        return next_use(v, pos) == never;
+    }
+
+    // memory location that contains the value, if any
+    Location memory(const std::size_t v) const
+    {
+        if(slot_of_.at(v) != npos)
+        {
+            return Location::spill(slot_of_.at(v));
+        }
+        const auto& inst = prog_.code.at(v);
+        if(inst.op == Opcode::Argument &&
+           (!config_.arguments_in_registers || 8 <= inst.index))
+        {
+            return Location::argument(inst.index);
+        }
+        if(inst.op == Opcode::Constant)
+        {
+            return Location::constant(v);
+        }
+        return Location{};
+    }
+    // whether the value can be used as a memory operand directly
+    bool in_memory(const std::size_t v) const
+    {
+        const auto loc = this->memory(v);
+        return loc.kind == Location::Kind::Spill ||
+              (loc.kind == Location::Kind::Argument && !config_.load_arguments) ||
+              (loc.kind == Location::Kind::Constant && config_.constants_in_memory);
+    }
+
+    // Bitwise operations have no scalar form, so a memory operand is read
+    // with the width of the register, e.g. 16 bytes for andpd. An argument
+    // may be a single element at the end of a column (the scalar loop uses
+    // the same allocation as the packed loop), so it is loaded first.
+    bool too_narrow(const Opcode op, const std::size_t v) const
+    {
+        return is_bitwise(op) && this->memory(v).kind == Location::Kind::Argument;
+    }
+
+    void assign(const std::size_t v, const std::size_t r)
+    {
+        owner_.at(r)  = v;
+        reg_of_.at(v) = r;
+    }
+    void release(const std::size_t r)
+    {
+        if(owner_.at(r) != npos)
+        {
+            reg_of_.at(owner_.at(r)) = npos;
+            owner_.at(r) = npos;
+        }
+    }
+
+    // find a register that can be overwritten. Values in `keep` are the
+    // operands of the current instruction and will never be evicted.
+    std::size_t acquire(const std::size_t pos, const std::array<std::size_t, 3>& keep)
+    {
+        for(std::size_t r=0; r<owner_.size(); ++r)
+        {
+            if(owner_.at(r) == npos)
+            {
+                return r;
+            }
+        }
+
+        std::size_t victim   = npos;
+        std::size_t furthest = 0;
+        bool        clean    = false;
+        for(std::size_t r=0; r<owner_.size(); ++r)
+        {
+            const auto v = owner_.at(r);
+            if(std::find(keep.begin(), keep.end(), v) != keep.end())
+            {
+                continue;
+            }
+            const auto nu = this->next_use(v, pos);
+            const bool cl = this->memory(v).kind != Location::Kind::Nowhere;
+            // prefer the one that does not need to be stored if tied
+            if(victim == npos || furthest < nu || (furthest == nu && !clean && cl))
+            {
+                victim   = r;
+                furthest = nu;
+                clean    = cl;
+            }
+        }
+        if(victim == npos)
+        {
+            throw std::runtime_error("jitome::allocate_registers: register run out");
+        }
+
+        const auto v = owner_.at(victim);
+        if(this->memory(v).kind == Location::Kind::Nowhere)
+        {
+            const auto slot = this->new_slot();
+            slot_of_.at(v) = slot;
+            alloc_.ops.push_back(MachineOp{MachineOp::Kind::Store, npos,
+                    Location::spill(slot), {Location::reg(victim), {}, {}}});
+            alloc_.stores += 1;
+        }
+        this->release(victim);
+        return victim;
+    }
+
+    std::size_t new_slot()
+    {
+        if(!free_slots_.empty())
+        {
+            const auto s = free_slots_.back();
+            free_slots_.pop_back();
+            return s;
+        }
+        return alloc_.spill_slots++;
+    }
+
+    void load(const std::size_t v, const std::size_t r)
+    {
+        alloc_.ops.push_back(MachineOp{MachineOp::Kind::Load, npos,
+                Location::reg(r), {this->memory(v), {}, {}}});
+        alloc_.loads += 1;
+        this->assign(v, r);
+    }
+
+    // the value is stored from a register
+    void output(const std::size_t i)
+    {
+        const std::array<std::size_t, 3> opr{prog_.code.at(i).operands.at(0), npos, npos};
+        const auto v = opr.at(0);
+        if(reg_of_.at(v) == npos)
+        {
+            this->load(v, this->acquire(i, opr));
+        }
+        alloc_.ops.push_back(MachineOp{MachineOp::Kind::Compute, i,
+                Location{}, {Location::reg(reg_of_.at(v)), {}, {}}});
+        this->retire(opr, 1, i);
+    }
+
+    // releases the registers and slots of operands that are not used anymore
+    void retire(const std::array<std::size_t, 3>& opr, const std::size_t n, const std::size_t i)
+    {
+        for(std::size_t j=0; j<n; ++j)
+        {
+            const auto v = opr.at(j);
+            if(!dies_at(v, i))
+            {
+                continue;
+            }
+            if(reg_of_.at(v) != npos)
+            {
+                this->release(reg_of_.at(v));
+            }
+            if(slot_of_.at(v) != npos)
+            {
+                free_slots_.push_back(slot_of_.at(v));
+                slot_of_.at(v) = npos;
+            }
+        }
+    }
+
+    void compute(const std::size_t i)
+    {
+        const auto& inst = prog_.code.at(i);
+        const auto  n    = num_operands(inst.op);
+        if(inst.op == Opcode::Output)
+        {
+            this->output(i);
+            return;
+        }
+
+        // FMA instructions always overwrite one of the operands, like the
+        // legacy SSE two-operand form.
+        const bool tied = !config_.three_operand || is_fma(inst.op);
+
+        // operands in the order of allocation and their position in `inst`
+        std::array<std::size_t, 3> opr{npos, npos, npos};
+        std::array<std::size_t, 3> pos{0, 1, 2};
+        for(std::size_t j=0; j<n; ++j)
+        {
+            opr.at(j) = inst.operands.at(j);
+        }
+
+        // With the two-operand form, the first operand will be overwritten.
+        // If the other one is not used later but the first one is, swap them
+        // to avoid a move.
+        if(!config_.three_operand && n == 2 && is_commutative(inst.op))
+        {
+            const auto lhs_free = reg_of_.at(opr[0]) != npos && dies_at(opr[0], i);
+            const auto rhs_free = reg_of_.at(opr[1]) != npos && dies_at(opr[1], i);
+            if(!lhs_free && rhs_free)
+            {
+                std::swap(opr[0], opr[1]);
+            }
+        }
+        // FMA can overwrite any of the operands (vfmadd231 overwrites the
+        // addend, vfmadd213 one of the factors). Choose one that is in a
+        // register and dies here, preferring the addend. The last one in the
+        // allocation order can be a memory operand.
+        if(is_fma(inst.op))
+        {
+            std::size_t t = 2;
+            for(const std::size_t j : {2, 0, 1})
+            {
+                const auto v = inst.operands.at(j);
+                if(reg_of_.at(v) != npos && dies_at(v, i))
+                {
+                    t = j;
+                    break;
+                }
+            }
+            if(t == 2) {pos = {2, 0, 1};}
+            if(t == 0) {pos = {0, 1, 2};}
+            if(t == 1) {pos = {1, 0, 2};}
+            for(std::size_t j=0; j<n; ++j)
+            {
+                opr.at(j) = inst.operands.at(pos.at(j));
+            }
+        }
+
+        // The last operand can be a memory operand. The first operand of
+        // two-operand form can be loaded directly into the destination.
+        // Reduce reads all of them from registers.
+        const std::size_t mem = (inst.op == Opcode::Reduce) ? npos : n - 1;
+        for(std::size_t j=0; j<n; ++j)
+        {
+            const auto v = opr.at(j);
+            if(reg_of_.at(v) != npos)
+            {
+                continue;
+            }
+            if(j == mem && 0 < j && this->in_memory(v) && !this->too_narrow(inst.op, v))
+            {
+                continue;
+            }
+            if(j == 0 && tied && !dies_at(v, i))
+            {
+                continue;
+            }
+            this->load(v, this->acquire(i, opr));
+        }
+
+        std::size_t dst = npos;
+        if(tied)
+        {
+            const auto v = opr.at(0);
+            if(reg_of_.at(v) != npos && dies_at(v, i))
+            {
+                dst = reg_of_.at(v);
+            }
+            else
+            {
+                dst = this->acquire(i, opr);
+                if(reg_of_.at(v) != npos)
+                {
+                    alloc_.ops.push_back(MachineOp{MachineOp::Kind::Move, npos,
+                        Location::reg(dst), {Location::reg(reg_of_.at(v)), {}, {}}});
+                    alloc_.moves += 1;
+                }
+                else
+                {
+                    alloc_.ops.push_back(MachineOp{MachineOp::Kind::Load, npos,
+                        Location::reg(dst), {this->memory(v), {}, {}}});
+                    alloc_.loads += 1;
+                }
+            }
+        }
+        else
+        {
+            // write the result directly into the return register if possible
+            const auto hint = config_.result_register;
+            if(i == prog_.result && hint < owner_.size())
+            {
+                const auto v = owner_.at(hint);
+                if(v == npos || (std::find(opr.begin(), opr.end(), v) != opr.end() &&
+                                 dies_at(v, i)))
+                {
+                    dst = hint;
+                }
+            }
+            for(std::size_t j=0; j<n && dst == npos; ++j)
+            {
+                const auto v = opr.at(j);
+                if(reg_of_.at(v) != npos && dies_at(v, i))
+                {
+                    dst = reg_of_.at(v);
+                }
+            }
+            if(dst == npos)
+            {
+                dst = this->acquire(i, opr);
+            }
+        }
+
+        // src is in the order of operands in `inst`, except that commutative
+        // operands may be swapped. For FMA, the overwritten operand is dst.
+        MachineOp op{MachineOp::Kind::Compute, i, Location::reg(dst), {}};
+        for(std::size_t j=0; j<n; ++j)
+        {
+            const auto v = opr.at(j);
+            auto& src = op.src.at(pos.at(j));
+            if(j == 0 && tied)
+            {
+                src = Location::reg(dst);
+            }
+            else if(reg_of_.at(v) != npos)
+            {
+                src = Location::reg(reg_of_.at(v));
+            }
+            else
+            {
+                src = this->memory(v);
+            }
+        }
+        alloc_.ops.push_back(op);
+
+        this->retire(opr, n, i);
+        this->release(dst);
+        if(uses_.at(i).empty())
+        {
+            return; // not used anywhere
+        }
+        this->assign(i, dst);
+    }
+
+  private:
+
+    const Program&                        prog_;
+    RegisterAllocatorConfig               config_;
+    std::vector<std::vector<std::size_t>> uses_;
+    std::vector<std::size_t>              slot_of_;
+    std::vector<std::size_t>              reg_of_;
+    std::vector<std::size_t>              owner_;
+    std::vector<std::size_t>              free_slots_;
+    Allocation                            alloc_;
+};
+
+inline Allocation allocate_registers(const Program& prog, const RegisterAllocatorConfig& config)
+{
+    return RegisterAllocator(prog, config).run();
+}
+
+} // jitome
+#endif// JITOME_REGALLOC_HPP
@@ -0,0 +1,752 @@
+#ifndef JITOME_STATIC_HPP
+#define JITOME_STATIC_HPP
+#include "builtin.hpp"
+#include "token.hpp"
+#include "tokenizer.hpp"
+#include "util.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace jitome
+{
+
+// ---------------------------------------------------------------------------
+// compile-time functions
+//
+// A function that is known when the program is built does not need the JIT.
+// parse_static() parses the same syntax as parse() in a constant expression
+// into a flat table of nodes, and StaticFunction evaluates the table by
+// nested template instantiations, one per node. The result is plain C++
+// arithmetic that the compiler inlines into the caller and vectorizes in a
+// loop, with no parsing or code generation at runtime.
+//
+//   constexpr auto f = JITOME_STATIC_FUNCTION("(a, b) {a * b + 1}");
+//   for(std::size_t i=0; i<n; ++i) {out[i] = f(a[i], b[i]);}
+//
+// C++17 has no string literals as template arguments, so the code is passed
+// by a type with `static constexpr std::string_view value()`. The macro
+// defines such a type in a lambda.
+//
+// A syntax error is thrown as std::invalid_argument. In a constant
+// expression, that is a compile error that points to the message.
+//
+// With double arguments the result is identical to evaluate(), because the
+// builtins call the same C library functions and `^` multiplies in the same
+// order. With float arguments the function computes in single precision.
+// Immediates with more than 19 significant digits or an exponent beyond
+// +-22 are converted in long double and may differ by 1 ulp from parse().
+
+enum class StaticOp : std::uint8_t
+{
+    Immediate, Argument, Local,
+    Add, Sub, Mul, Div, Power,
+    Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual, And, Or,
+    Sqrt, Abs, Exp, Log, Sin, Cos, Sign, Min, Max, Select, Clamp,
+};
+
+struct StaticNode
+{
+    StaticOp                   op       = StaticOp::Immediate;
+    std::array<std::size_t, 3> operands = {{0, 0, 0}};
+    std::int64_t               index    = 0;   // argument, local or exponent
+    double                     value    = 0.0; // immediate
+};
+
+inline constexpr std::size_t static_max_nodes = 256;
+inline constexpr std::size_t static_max_names = 32;
+
+struct StaticTree
+{
+    std::array<StaticNode, static_max_nodes>       nodes{};
+    std::array<std::string_view, static_max_names> args{};
+    std::array<std::string_view, static_max_names> local_names{};
+    std::array<std::size_t, static_max_names>      locals{}; // the value of each local
+    std::size_t size       = 0;
+    std::size_t arity      = 0;
+    std::size_t num_locals = 0;
+    std::size_t body       = 0;
+};
+
+// converts an immediate that follows the syntax. If the digits and the power
+// of 10 are exact in double, one multiplication or division rounds correctly.
+constexpr double static_immediate(const std::string_view str)
+{
+    std::uint64_t mantissa = 0;
+    int  digits   = 0;
+    int  exponent = 0;
+    bool exact    = true;
+
+    std::size_t i = 0;
+    const auto push = [&](const char c, const bool fraction) {
+        if(mantissa == 0 && c == '0')
+        {
+            exponent -= fraction ? 1 : 0;
+        }
+        else if(digits < 19)
+        {
+            mantissa = mantissa * 10 + static_cast<std::uint64_t>(c - '0');
+            digits  += 1;
+            exponent -= fraction ? 1 : 0;
+        }
+        else
+        {
+            exact = exact && c == '0';
+            exponent += fraction ? 0 : 1;
+        }
+    };
+    for(; i < str.size() && is_digit(str[i]); ++i) {push(str[i], false);}
+    if(i < str.size() && str[i] == '.')
+    {
+        for(++i; i < str.size() && is_digit(str[i]); ++i) {push(str[i], true);}
+    }
+    if(i < str.size() && (str[i] == 'e' || str[i] == 'E'))
+    {
+        ++i;
+        const bool negative = (i < str.size() && str[i] == '-');
+        i += (i < str.size() && (str[i] == '+' || str[i] == '-')) ? 1 : 0;
+        int e = 0;
+        for(; i < str.size() && is_digit(str[i]); ++i)
+        {
+            e = (e < 100000) ? e * 10 + (str[i] - '0') : e;
+        }
+        exponent += negative ? -e : e;
+    }
+
+    if(mantissa == 0)
+    {
+        return 0.0;
+    }
+    if(exact && mantissa <= (std::uint64_t(1) << 53) && -22 <= exponent && exponent <= 22)
+    {
+        double p = 1.0;
+        for(int k=0; k < (exponent < 0 ? -exponent : exponent); ++k) {p *= 10.0;}
+        return exponent < 0 ? static_cast<double>(mantissa) / p : static_cast<double>(mantissa) * p;
+    }
+    if(310 < exponent + digits)
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+    if(exponent + digits < -330)
+    {
+        return 0.0;
+    }
+    long double p = 1.0L, base = 10.0L;
+    for(int k = (exponent < 0 ? -exponent : exponent); k != 0; k /= 2)
+    {
+        p    *= (k % 2 == 1) ? base : 1.0L;
+        base *= base;
+    }
+    const long double m = static_cast<long double>(mantissa);
+    return static_cast<double>(exponent < 0 ? m / p : m * p);
+}
+
+// The parser follows parse_funcdef() and the functions it calls, on a
+// range of characters instead of tokens.
+class StaticParser
+{
+  public:
+
+    constexpr explicit StaticParser(const std::string_view src) noexcept
+        : iter_(src.data()), end_(src.data() + src.size())
+    {}
+
+    constexpr StaticTree parse()
+    {
+        expect(TokenKind::LeftParen, "parse_static: expected left paren");
+        do
+        {
+            const auto arg = next();
+            if(arg.kind != TokenKind::Identifier)
+            {
+                fail("parse_static: expected identifier");
+            }
+            if(tree_.arity == static_max_names)
+            {
+                fail("parse_static: too many arguments");
+            }
+            tree_.args[tree_.arity++] = arg.str;
+        }
+        while(consume(TokenKind::Comma));
+        expect(TokenKind::RightParen, "parse_static: expected right paren");
+        expect(TokenKind::LeftCurly,  "parse_static: expected left curly brace");
+
+        tree_.body = parse_body();
+
+        expect(TokenKind::RightCurly, "parse_static: expected right curly brace");
+        if(peek().kind != TokenKind::Invalid)
+        {
+            fail("parse_static: unexpected token after the function");
+        }
+        return tree_;
+    }
+
+  private:
+
+    struct Lexeme
+    {
+        TokenKind        kind = TokenKind::Invalid; // Invalid at the end
+        std::string_view str;
+        const char*      last = nullptr;
+    };
+
+    [[noreturn]] static void fail(const char* msg)
+    {
+        throw std::invalid_argument(msg);
+    }
+
+    constexpr Lexeme scan() const
+    {
+        const char* iter = skip_negligible(iter_, end_);
+        const char* first = iter;
+        const auto lexeme = [first](const TokenKind kind, const char* last) {
+            return Lexeme{kind, std::string_view(first, static_cast<std::size_t>(last - first)), last};
+        };
+        if(iter == end_ || *iter == '\0')
+        {
+            return Lexeme{TokenKind::Invalid, std::string_view{}, iter};
+        }
+        if(is_digit(*iter))
+        {
+            if(*iter == '0') {++iter;} else {while(iter != end_ && is_digit(*iter)) {++iter;}}
+            if(iter != end_ && *iter == '.')
+            {
+                ++iter;
+                if(iter == end_ || !is_digit(*iter))
+                {
+                    fail("parse_static: at least 1 digit should follow `.`");
+                }
+                while(iter != end_ && is_digit(*iter)) {++iter;}
+            }
+            if(iter != end_ && (*iter == 'e' || *iter == 'E'))
+            {
+                ++iter;
+                if(iter != end_ && (*iter == '+' || *iter == '-')) {++iter;}
+                if(iter == end_ || !is_digit(*iter))
+                {
+                    fail("parse_static: at least 1 digit should follow `e`");
+                }
+                while(iter != end_ && is_digit(*iter)) {++iter;}
+            }
+            return lexeme(TokenKind::Immediate, iter);
+        }
+        if(is_alpha(*iter))
+        {
+            while(iter != end_ && (is_alnum(*iter) || *iter == '_')) {++iter;}
+            if(iter - first == 6 && is_chars(first, iter, "return"))
+            {
+                return lexeme(TokenKind::Keyword, iter);
+            }
+            return lexeme(TokenKind::Identifier, iter);
+        }
+        if(is_chars(iter, end_, "<=") || is_chars(iter, end_, ">=") || is_chars(iter, end_, "==") ||
+           is_chars(iter, end_, "!=") || is_chars(iter, end_, "&&") || is_chars(iter, end_, "||"))
+        {
+            return lexeme(TokenKind::Operator, iter + 2);
+        }
+        if(is_oneof(iter, end_, "+-*/^=<>?:")) {return lexeme(TokenKind::Operator,   iter + 1);}
+        if(*iter == '(')                        {return lexeme(TokenKind::LeftParen,  iter + 1);}
+        if(*iter == ')')                        {return lexeme(TokenKind::RightParen, iter + 1);}
+        if(*iter == '{')                        {return lexeme(TokenKind::LeftCurly,  iter + 1);}
+        if(*iter == '}')                        {return lexeme(TokenKind::RightCurly, iter + 1);}
+        if(*iter == ',')                        {return lexeme(TokenKind::Comma,      iter + 1);}
+        if(*iter == ';')                        {return lexeme(TokenKind::Semicolon,  iter + 1);}
+        fail("parse_static: unknown token appeared");
+    }
+
+    constexpr Lexeme peek() const {return scan();}
+    constexpr Lexeme next()
+    {
+        const auto lex = scan();
+        iter_ = lex.last;
+        return lex;
+    }
+    constexpr bool is_operator(const Lexeme& lex, const std::string_view op) const noexcept
+    {
+        return lex.kind == TokenKind::Operator && lex.str == op;
+    }
+    constexpr bool consume(const TokenKind kind)
+    {
+        if(peek().kind != kind)
+        {
+            return false;
+        }
+        next();
+        return true;
+    }
+    constexpr bool consume(const std::string_view op)
+    {
+        if(!is_operator(peek(), op))
+        {
+            return false;
+        }
+        next();
+        return true;
+    }
+    constexpr void expect(const TokenKind kind, const char* msg)
+    {
+        if(!consume(kind))
+        {
+            fail(msg);
+        }
+    }
+
+    constexpr std::size_t push(const StaticOp op, const std::size_t lhs = 0,
+                               const std::size_t rhs = 0, const std::size_t acc = 0)
+    {
+        if(tree_.size == static_max_nodes)
+        {
+            fail("parse_static: too many nodes");
+        }
+        tree_.nodes[tree_.size].op       = op;
+        tree_.nodes[tree_.size].operands = {{lhs, rhs, acc}};
+        return tree_.size++;
+    }
+
+    // function-body = expression
+    //               / *( [ ident `=` ] expression `;` ) `return` expression `;`
+    constexpr std::size_t parse_body()
+    {
+        bool statements = false;
+        while(true)
+        {
+            const bool returns = consume(TokenKind::Keyword);
+
+            std::string_view local;
+            if(!returns && peek().kind == TokenKind::Identifier)
+            {
+                const auto saved = iter_;
+                const auto name  = next();
+                if(consume("="))
+                {
+                    local = name.str;
+                }
+                else
+                {
+                    iter_ = saved;
+                }
+            }
+
+            const auto expr = parse_expr();
+            if(!returns && !statements && local.empty() && peek().kind == TokenKind::RightCurly)
+            {
+                return expr; // `{expr}`
+            }
+            expect(TokenKind::Semicolon, "parse_static: expected semicolon");
+            if(returns)
+            {
+                return expr;
+            }
+            if(!local.empty())
+            {
+                if(tree_.num_locals == static_max_names)
+                {
+                    fail("parse_static: too many locals");
+                }
+                tree_.local_names[tree_.num_locals] = local;
+                tree_.locals     [tree_.num_locals] = expr;
+                tree_.num_locals += 1;
+            }
+            statements = true;
+            if(peek().kind == TokenKind::RightCurly || peek().kind == TokenKind::Invalid)
+            {
+                fail("parse_static: expected `return`");
+            }
+        }
+    }
+
+    // expression = or [ `?` expression `:` expression ]
+    constexpr std::size_t parse_expr()
+    {
+        const auto cond = parse_or();
+        if(!consume("?"))
+        {
+            return cond;
+        }
+        const auto lhs = parse_expr();
+        if(!consume(":"))
+        {
+            fail("parse_static: expected `:`");
+        }
+        const auto rhs = parse_expr();
+        return push(StaticOp::Select, cond, lhs, rhs);
+    }
+
+    constexpr std::size_t parse_or()
+    {
+        auto lhs = parse_and();
+        while(consume("||")) {lhs = push(StaticOp::Or, lhs, parse_and());}
+        return lhs;
+    }
+    constexpr std::size_t parse_and()
+    {
+        auto lhs = parse_equality();
+        while(consume("&&")) {lhs = push(StaticOp::And, lhs, parse_equality());}
+        return lhs;
+    }
+    constexpr std::size_t parse_equality()
+    {
+        auto lhs = parse_relational();
+        while(true)
+        {
+            if     (consume("==")) {lhs = push(StaticOp::Equal,    lhs, parse_relational());}
+            else if(consume("!=")) {lhs = push(StaticOp::NotEqual, lhs, parse_relational());}
+            else {return lhs;}
+        }
+    }
+    constexpr std::size_t parse_relational()
+    {
+        auto lhs = parse_add();
+        while(true)
+        {
+            if     (consume("<=")) {lhs = push(StaticOp::LessEqual,    lhs, parse_add());}
+            else if(consume(">=")) {lhs = push(StaticOp::GreaterEqual, lhs, parse_add());}
+            else if(consume("<" )) {lhs = push(StaticOp::Less,         lhs, parse_add());}
+            else if(consume(">" )) {lhs = push(StaticOp::Greater,      lhs, parse_add());}
+            else {return lhs;}
+        }
+    }
+    constexpr std::size_t parse_add()
+    {
+        auto lhs = parse_mul();
+        while(true)
+        {
+            if     (consume("+")) {lhs = push(StaticOp::Add, lhs, parse_mul());}
+            else if(consume("-")) {lhs = push(StaticOp::Sub, lhs, parse_mul());}
+            else {return lhs;}
+        }
+    }
+    constexpr std::size_t parse_mul()
+    {
+        auto lhs = parse_power();
+        while(true)
+        {
+            if     (consume("*")) {lhs = push(StaticOp::Mul, lhs, parse_power());}
+            else if(consume("/")) {lhs = push(StaticOp::Div, lhs, parse_power());}
+            else {return lhs;}
+        }
+    }
+
+    // power = primary [ `^` [ sign ] integer ]
+    constexpr std::size_t parse_power()
+    {
+        const auto base = parse_primary();
+        if(!consume("^"))
+        {
+            return base;
+        }
+        const bool negative = consume("-");
+        if(!negative)
+        {
+            consume("+");
+        }
+        const auto exponent = next();
+        std::int64_t n = 0;
+        for(const char c : exponent.str)
+        {
+            if(exponent.kind != TokenKind::Immediate || !is_digit(c))
+            {
+                fail("parse_static: exponent should be an integer");
+            }
+            n = n * 10 + (c - '0');
+            if(max_exponent < n)
+            {
+                fail("parse_static: exponent is too large");
+            }
+        }
+        if(exponent.kind != TokenKind::Immediate)
+        {
+            fail("parse_static: exponent should be an integer");
+        }
+        if(is_operator(peek(), "^"))
+        {
+            fail("parse_static: `^` is not associative, use parentheses");
+        }
+        const auto node = push(StaticOp::Power, base);
+        tree_.nodes[node].index = negative ? -n : n;
+        return node;
+    }
+
+    constexpr std::size_t parse_primary()
+    {
+        const auto token = next();
+        if(token.kind == TokenKind::LeftParen)
+        {
+            const auto expr = parse_expr();
+            expect(TokenKind::RightParen, "parse_static: expected right bracket `)`");
+            return expr;
+        }
+        if(token.kind == TokenKind::Immediate)
+        {
+            const auto node = push(StaticOp::Immediate);
+            tree_.nodes[node].value = static_immediate(token.str);
+            return node;
+        }
+        if(token.kind != TokenKind::Identifier)
+        {
+            fail("parse_static: unexpected token appeared");
+        }
+        if(peek().kind == TokenKind::LeftParen)
+        {
+            return parse_call(token.str);
+        }
+
+        // the last assignment to a local hides the arguments and the earlier ones
+        for(std::size_t i = tree_.num_locals; i != 0; --i)
+        {
+            if(tree_.local_names[i-1] == token.str)
+            {
+                const auto node = push(StaticOp::Local);
+                tree_.nodes[node].index = static_cast<std::int64_t>(i-1);
+                return node;
+            }
+        }
+        for(std::size_t i = 0; i < tree_.arity; ++i)
+        {
+            if(tree_.args[i] == token.str)
+            {
+                const auto node = push(StaticOp::Argument);
+                tree_.nodes[node].index = static_cast<std::int64_t>(i);
+                return node;
+            }
+        }
+        fail("parse_static: unknown variable");
+    }
+
+    constexpr std::size_t parse_call(const std::string_view name)
+    {
+        using namespace std::literals::string_view_literals;
+        const auto* builtin = find_builtin(name);
+        if(builtin == nullptr)
+        {
+            fail("parse_static: unknown function");
+        }
+        expect(TokenKind::LeftParen, "parse_static: expected left paren");
+
+        std::array<std::size_t, max_builtin_arity> args{};
+        std::size_t n = 0;
+        if(!consume(TokenKind::RightParen))
+        {
+            do
+            {
+                if(n == max_builtin_arity)
+                {
+                    fail("parse_static: wrong number of arguments");
+                }
+                args[n++] = parse_expr();
+            }
+            while(consume(TokenKind::Comma));
+            expect(TokenKind::RightParen, "parse_static: expected right bracket `)`");
+        }
+        if(n != builtin->arity)
+        {
+            fail("parse_static: wrong number of arguments");
+        }
+
+        constexpr std::array<std::pair<std::string_view, StaticOp>, builtins.size()> ops = {{
+            {"sqrt"sv, StaticOp::Sqrt}, {"abs"sv, StaticOp::Abs}, {"min"sv, StaticOp::Min},
+            {"max"sv,  StaticOp::Max},  {"exp"sv, StaticOp::Exp}, {"log"sv, StaticOp::Log},
+            {"sin"sv,  StaticOp::Sin},  {"cos"sv, StaticOp::Cos}, {"sign"sv, StaticOp::Sign},
+            {"select"sv, StaticOp::Select}, {"clamp"sv, StaticOp::Clamp},
+        }};
+        for(const auto& op : ops)
+        {
+            if(op.first == builtin->name)
+            {
+                return push(op.second, args[0], args[1], args[2]);
+            }
+        }
+        fail("parse_static: unknown function");
+    }
+
+  private:
+
+    const char* iter_;
+    const char* end_;
+    StaticTree  tree_{};
+};
+
+constexpr StaticTree parse_static(const std::string_view src)
+{
+    return StaticParser(src).parse();
+}
+
+// Source is a type with `static constexpr std::string_view value()`.
+// The arguments are converted to their common type, that should be float
+// or double, and the function computes in it.
+template<typename Source>
+class StaticFunction
+{
+  public:
+
+    static constexpr StaticTree  tree  = parse_static(Source::value());
+    static constexpr std::size_t arity = tree.arity;
+
+    template<typename ... Ts>
+    constexpr std::common_type_t<Ts...> operator()(const Ts ... xs) const noexcept
+    {
+        using T = std::common_type_t<Ts...>;
+        static_assert(sizeof...(Ts) == arity, "jitome::StaticFunction: wrong number of arguments");
+        static_assert(std::is_floating_point_v<T>, "jitome::StaticFunction: arguments should be float or double");
+
+        const T args[] = {static_cast<T>(xs)...};
+        return call<T>(args, std::make_index_sequence<tree.num_locals>{});
+    }
+
+  private:
+
+    template<typename T, std::size_t ... Is>
+    static constexpr T call(const T* args, std::index_sequence<Is...>) noexcept
+    {
+        T locals[sizeof...(Is) + 1] = {};
+        ((locals[Is] = eval<tree.locals[Is], T>(args, locals)), ...);
+        return eval<tree.body, T>(args, locals);
+    }
+
+    static constexpr bool is_unary(const StaticOp op) noexcept
+    {
+        return op == StaticOp::Power || op == StaticOp::Sqrt || op == StaticOp::Abs ||
+               op == StaticOp::Exp   || op == StaticOp::Log  || op == StaticOp::Sin ||
+               op == StaticOp::Cos   || op == StaticOp::Sign;
+    }
+
+    // x^n by the left-to-right binary method, in the order of powi().
+    template<std::uint64_t M, int Bit, typename T>
+    static constexpr T power(const T r, const T x) noexcept
+    {
+        if constexpr (Bit < 0)
+        {
+            return r;
+        }
+        else if constexpr (((M >> Bit) & 1u) != 0)
+        {
+            return power<M, Bit - 1>(r * r * x, x);
+        }
+        else
+        {
+            return power<M, Bit - 1>(r * r, x);
+        }
+    }
+    static constexpr int top_bit(std::uint64_t m) noexcept
+    {
+        int bit = -1;
+        for(; m != 0; m >>= 1) {++bit;}
+        return bit;
+    }
+
+    template<std::size_t I, typename T>
+    static constexpr T eval(const T* args, const T* locals) noexcept
+    {
+        constexpr StaticNode node = tree.nodes[I];
+        constexpr auto a = node.operands[0];
+        constexpr auto b = node.operands[1];
+        constexpr auto c = node.operands[2];
+
+        if constexpr (node.op == StaticOp::Immediate)
+        {
+            return static_cast<T>(node.value);
+        }
+        else if constexpr (node.op == StaticOp::Argument)
+        {
+            return args[node.index];
+        }
+        else if constexpr (node.op == StaticOp::Local)
+        {
+            return locals[node.index];
+        }
+        else if constexpr (node.op == StaticOp::Select || node.op == StaticOp::Clamp)
+        {
+            // both branches are evaluated, so the compiler can use a blend
+            const T x = eval<a, T>(args, locals);
+            const T y = eval<b, T>(args, locals);
+            const T z = eval<c, T>(args, locals);
+            if constexpr (node.op == StaticOp::Select)
+            {
+                return x != T(0) ? y : z;
+            }
+            else
+            {
+                const T m = x > y ? x : y;
+                return m < z ? m : z;
+            }
+        }
+        else if constexpr (is_unary(node.op))
+        {
+            const T x = eval<a, T>(args, locals);
+            if constexpr (node.op == StaticOp::Power)
+            {
+                constexpr std::uint64_t m = (node.index < 0) ?
+                    0 - static_cast<std::uint64_t>(node.index) : static_cast<std::uint64_t>(node.index);
+                if constexpr (m == 0)
+                {
+                    return T(1);
+                }
+                else
+                {
+                    const T r = power<m, top_bit(m) - 1>(x, x);
+                    return (node.index < 0) ? T(1) / r : r;
+                }
+            }
+            else if constexpr (node.op == StaticOp::Sqrt) {return std::sqrt(x);}
+            else if constexpr (node.op == StaticOp::Abs ) {return std::fabs(x);}
+            else if constexpr (node.op == StaticOp::Exp ) {return std::exp(x);}
+            else if constexpr (node.op == StaticOp::Log ) {return std::log(x);}
+            else if constexpr (node.op == StaticOp::Sin ) {return std::sin(x);}
+            else if constexpr (node.op == StaticOp::Cos ) {return std::cos(x);}
+            else
+            {
+                return T(0) < x ? T(1) : x < T(0) ? T(-1) : x;
+            }
+        }
+        else
+        {
+            const T x = eval<a, T>(args, locals);
+            const T y = eval<b, T>(args, locals);
+            if      constexpr (node.op == StaticOp::Add) {return x + y;}
+            else if constexpr (node.op == StaticOp::Sub) {return x - y;}
+            else if constexpr (node.op == StaticOp::Mul) {return x * y;}
+            else if constexpr (node.op == StaticOp::Div) {return x / y;}
+            else if constexpr (node.op == StaticOp::Min) {return x < y ? x : y;}
+            else if constexpr (node.op == StaticOp::Max) {return x > y ? x : y;}
+            else if constexpr (node.op == StaticOp::Less        ) {return x <  y ? T(1) : T(0);}
+            else if constexpr (node.op == StaticOp::LessEqual   ) {return x <= y ? T(1) : T(0);}
+            else if constexpr (node.op == StaticOp::Greater     ) {return x >  y ? T(1) : T(0);}
+            else if constexpr (node.op == StaticOp::GreaterEqual) {return x >= y ? T(1) : T(0);}
+            else if constexpr (node.op == StaticOp::Equal       ) {return x == y ? T(1) : T(0);}
+            else if constexpr (node.op == StaticOp::NotEqual    ) {return x != y ? T(1) : T(0);}
+            else if constexpr (node.op == StaticOp::And) {return (x != T(0)) & (y != T(0)) ? T(1) : T(0);}
+            else
+            {
+                static_assert(node.op == StaticOp::Or);
+                return (x != T(0)) | (y != T(0)) ? T(1) : T(0);
+            }
+        }
+    }
+};
+
+template<typename Source>
+constexpr StaticFunction<Source> make_static_function(Source) noexcept
+{
+    return StaticFunction<Source>{};
+}
+
+} // jitome
+
+// constexpr auto f = JITOME_STATIC_FUNCTION("(x) {x * x}");
+#define JITOME_STATIC_FUNCTION(code)                                          \
+    ::jitome::make_static_function([] {                                       \
+        struct jitome_static_source                                           \
+        {                                                                     \
+            static constexpr std::string_view value() noexcept {return code;} \
+        };                                                                    \
+        return jitome_static_source{};                                        \
+    }())
+
+#endif// JITOME_STATIC_HPP
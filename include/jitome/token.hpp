@@ -20,6 +20,7 @@ enum class TokenKind
     LeftCurly,
     RightCurly,
     Comma,
+    Semicolon,
     Invalid
 };
 
@@ -36,6 +37,7 @@ inline std::ostream& operator<<(std::ostream& os, TokenKind k)
         case TokenKind::LeftCurly   : {os << "LeftCurly "  ; break;}
         case TokenKind::RightCurly  : {os << "RightCurly"  ; break;}
         case TokenKind::Comma       : {os << "Comma"       ; break;}
+        case TokenKind::Semicolon   : {os << "Semicolon"   ; break;}
         case TokenKind::Invalid     : {os << "Invalid"     ; break;}
     }
     return os;
@@ -54,6 +56,7 @@ inline std::string to_string(TokenKind k)
         case TokenKind::LeftCurly   : {return std::string("LeftCurly "  );}
         case TokenKind::RightCurly  : {return std::string("RightCurly"  );}
         case TokenKind::Comma       : {return std::string("Comma"       );}
+        case TokenKind::Semicolon   : {return std::string("Semicolon"   );}
         case TokenKind::Invalid     : {return std::string("Invalid"     );}
     }
     return "Unknown";
@@ -8,13 +8,22 @@
 #include <string_view>
 #include <deque>
 #include <cassert>
-#include <cctype>
 
 namespace jitome
 {
 
+// The character classes and the skip_* helpers are constexpr, so that the
+// compile-time parser in static.hpp shares them. Unlike <cctype>, they do
+// not depend on the locale.
+constexpr bool is_digit(const char c) noexcept {return '0' <= c && c <= '9';}
+constexpr bool is_alpha(const char c) noexcept
+{
+    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z');
+}
+constexpr bool is_alnum(const char c) noexcept {return is_digit(c) || is_alpha(c);}
+
 template<typename Iter, std::size_t N>
-bool is_chars(Iter iter, Iter end, const char (&cs)[N])
+constexpr bool is_chars(Iter iter, Iter end, const char (&cs)[N])
 {
     for(std::size_t i=0; i<N-1; ++i) // N-1 for null character
     {
@@ -25,7 +34,7 @@ bool is_chars(Iter iter, Iter end, const char (&cs)[N])
 }
 
 template<typename Iter, std::size_t N>
-bool is_oneof(Iter iter, Iter end, const char (&cs)[N])
+constexpr bool is_oneof(Iter iter, Iter end, const char (&cs)[N])
 {
     static_assert(1 <= N);
     if(iter == end)
@@ -45,13 +54,13 @@ bool is_oneof(Iter iter, Iter end, const char (&cs)[N])
 
 
 template<typename Iter>
-bool is_newline(Iter iter, Iter end)
+constexpr bool is_newline(Iter iter, Iter end)
 {
     return (iter != end && *iter == '\n') || is_chars(iter, end, "\r\n");
 }
 
 template<typename Iter>
-Iter skip_newline(Iter iter, Iter end)
+constexpr Iter skip_newline(Iter iter, Iter end)
 {
     if(iter != end && *iter == '\n')
     {
@@ -65,7 +74,7 @@ Iter skip_newline(Iter iter, Iter end)
 }
 
 template<typename Iter>
-Iter skip_whitespace(Iter iter, Iter end)
+constexpr Iter skip_whitespace(Iter iter, Iter end)
 {
     while(iter != end && (*iter == ' ' || *iter == '\t'))
     {
@@ -74,7 +83,7 @@ Iter skip_whitespace(Iter iter, Iter end)
     return iter;
 }
 template<typename Iter>
-Iter skip_comment_line(Iter iter, Iter end)
+constexpr Iter skip_comment_line(Iter iter, Iter end)
 {
     if (is_chars(iter, end, "//"))
     {
@@ -90,7 +99,7 @@ Iter skip_comment_line(Iter iter, Iter end)
     return iter;
 }
 template<typename Iter>
-Iter skip_comment(Iter iter, Iter end)
+constexpr Iter skip_comment(Iter iter, Iter end)
 {
     if (is_chars(iter, end, "/*"))
     {
@@ -109,7 +118,7 @@ Iter skip_comment(Iter iter, Iter end)
 }
 
 template<typename Iter>
-Iter skip_negligible(Iter iter, Iter end)
+constexpr Iter skip_negligible(Iter iter, Iter end)
 {
     while(iter != end)
     {
@@ -148,7 +157,7 @@ Result<Token> scan_immediate(Iter& iter, Iter end, std::shared_ptr<std::string>
     }
     else
     {
-        while(iter != end && std::isdigit(*iter))
+        while(iter != end && is_digit(*iter))
         {
             iter = std::next(iter);
         }
@@ -159,11 +168,11 @@ Result<Token> scan_immediate(Iter& iter, Iter end, std::shared_ptr<std::string>
     {
         iter = std::next(iter);
 
-        if(iter == end || !std::isdigit(*iter))
+        if(iter == end || !is_digit(*iter))
         {
             return err("scan_immediate: at least 1 digit should follow `.`");
         }
-        while(iter != end && std::isdigit(*iter))
+        while(iter != end && is_digit(*iter))
         {
             iter = std::next(iter);
         }
@@ -179,11 +188,11 @@ Result<Token> scan_immediate(Iter& iter, Iter end, std::shared_ptr<std::string>
             iter = std::next(iter);
         }
 
-        if(iter == end || !std::isdigit(*iter))
+        if(iter == end || !is_digit(*iter))
         {
             return err("scan_immediate: at least 1 digit should follow `e`");
         }
-        while(iter != end && std::isdigit(*iter))
+        while(iter != end && is_digit(*iter))
         {
             iter = std::next(iter);
         }
@@ -201,17 +210,22 @@ Result<Token> scan_identifier(Iter& iter, Iter end, std::shared_ptr<std::string>
     }
     const auto first = iter;
 
-    if(!std::isalpha(*iter))
+    if(!is_alpha(*iter))
     {
         return err("scan_immediate: the first character of an identifier should be an alphabet.");
     }
     iter = std::next(iter);
 
-    while(iter != end && (std::isalnum(*iter) || *iter == '_'))
+    while(iter != end && (is_alnum(*iter) || *iter == '_'))
     {
         iter = std::next(iter);
     }
 
+    // `return` is the only keyword
+    if(std::distance(first, iter) == 6 && is_chars(first, iter, "return"))
+    {
+        return make_token(TokenKind::Keyword, first, iter, std::move(src));
+    }
     return make_token(TokenKind::Identifier, first, iter, std::move(src));
 }
 
@@ -224,7 +238,14 @@ Result<Token> scan_operator(Iter& iter, Iter end, std::shared_ptr<std::string> s
     }
     const auto first = iter;
 
-    if(is_oneof(iter, end, "+-*/"))
+    // two-character operators go first, so that `<=` is not `<` and `=`
+    if(is_chars(iter, end, "<=") || is_chars(iter, end, ">=") || is_chars(iter, end, "==") ||
+       is_chars(iter, end, "!=") || is_chars(iter, end, "&&") || is_chars(iter, end, "||"))
+    {
+        iter = std::next(iter, 2);
+        return make_token(TokenKind::Operator, first, iter, std::move(src));
+    }
+    if(is_oneof(iter, end, "+-*/^=<>?:"))
     {
         iter = std::next(iter);
         return make_token(TokenKind::Operator, first, iter, std::move(src));
@@ -254,6 +275,11 @@ Result<Token> scan_operator(Iter& iter, Iter end, std::shared_ptr<std::string> s
         iter = std::next(iter);
         return make_token(TokenKind::Comma, first, iter, std::move(src));
     }
+    else if(*iter == ';')
+    {
+        iter = std::next(iter);
+        return make_token(TokenKind::Semicolon, first, iter, std::move(src));
+    }
     return err(make_error_message("scan_operator: unknown operator appeared",
         make_token(TokenKind::Invalid, iter, std::next(iter), std::move(src))));
 }
@@ -268,21 +294,15 @@ Result<Token> scan_token(Iter& iter, Iter end, std::shared_ptr<std::string> src)
     }
     assert(*iter != '\0');
 
-    if(std::isdigit(*iter))
+    if(is_digit(*iter))
     {
         return scan_immediate(iter, end, std::move(src));
     }
-    else if(std::isalpha(*iter))
+    else if(is_alpha(*iter))
     {
-        if(is_chars(iter, end, "return ") || is_chars(iter, end, "return\t"))
-        {
-            const auto first = iter;
-            iter = std::next(iter, 6);
-            return make_token(TokenKind::Keyword, first, iter, std::move(src));
-        }
         return scan_identifier(iter, end, std::move(src));
     }
-    else if(is_oneof(iter, end, "+-*/(){},"))
+    else if(is_oneof(iter, end, "+-*/^=(){},;<>!&|?:"))
     {
         return scan_operator(iter, end, std::move(src));
     }
@@ -1,5 +1,7 @@
 #ifndef JITOME_UTIL_HPP
 #define JITOME_UTIL_HPP
+#include <cmath>
+#include <cstdint>
 #include <memory>
 #include <stdexcept>
 #include <type_traits>
@@ -45,8 +47,9 @@ struct copyable_dynamic_storage
         }
         else
         {
-            this->storage_.release();
+            this->storage_.reset();
         }
+        return *this;
     }
 
     copyable_dynamic_storage(copyable_dynamic_storage&&) = default;
@@ -91,6 +94,35 @@ struct copyable_dynamic_storage
     std::unique_ptr<T> storage_;
 };
 
+// the largest magnitude of an exponent of `^`
+inline constexpr std::int64_t max_exponent = 0x7FFFFFFF;
+
+inline bool is_integer_exponent(const double n) noexcept
+{
+    return std::trunc(n) == n && std::abs(n) <= static_cast<double>(max_exponent);
+}
+
+// x^n by the left-to-right binary method. The JIT multiplies in the same
+// order, so the results are bit-identical. If n is negative, 1 / x^|n|.
+inline double powi(const double x, const std::int64_t n) noexcept
+{
+    if(n == 0)
+    {
+        return 1.0;
+    }
+    const auto m = (n < 0) ? 0 - static_cast<std::uint64_t>(n) : static_cast<std::uint64_t>(n);
+
+    double r = x;
+    for(int bit = 62 - __builtin_clzll(m); 0 <= bit; --bit)
+    {
+        r = r * r;
+        if((m >> bit) & 1u)
+        {
+            r = r * x;
+        }
+    }
+    return (n < 0) ? 1.0 / r : r;
+}
 
 } // jitome
 #endif// JITOME_UTIL_HPP
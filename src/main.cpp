@@ -1,5 +1,6 @@
 #include "jitome/ast.hpp"
 #include "jitome/eval.hpp"
+#include "jitome/optimize.hpp"
 #include "jitome/parser.hpp"
 #include "jitome/tokenizer.hpp"
 #include <iostream>
@@ -29,6 +30,6 @@ int main(int argc, char **argv)
     }
 
     std::map<std::string, double> env;
-    std::cout << jitome::evaluate(env, root.as_val()) << std::endl;
+    std::cout << jitome::evaluate(env, jitome::simplify(root.as_val())) << std::endl;
     return 0;
 }
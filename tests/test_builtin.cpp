@@ -0,0 +1,380 @@
+#include "jitome/builtin.hpp"
+#include "jitome/eval.hpp"
+#include "jitome/jit.hpp"
+#include <boost/ut.hpp>
+#include <xmmintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// distance between two doubles in units in the last place
+double ulp_error(const double actual, const double expect)
+{
+    if(std::isnan(expect) || std::isinf(expect) || expect == 0.0)
+    {
+        const bool same = (std::isnan(actual) && std::isnan(expect)) ||
+                          (actual == expect && std::signbit(actual) == std::signbit(expect));
+        return same ? 0.0 : std::numeric_limits<double>::infinity();
+    }
+    const auto ulp = std::nextafter(std::fabs(expect), std::numeric_limits<double>::infinity()) -
+                     std::fabs(expect);
+    return std::fabs(actual - expect) / ulp;
+}
+
+// the same for a float result, that is compared with the correctly rounded one
+double ulp_error(const float actual, const double expect)
+{
+    const auto rounded = static_cast<float>(expect);
+    if(std::isnan(expect) || std::isinf(rounded) || rounded == 0.0f)
+    {
+        return ulp_error(static_cast<double>(actual), static_cast<double>(rounded));
+    }
+    const auto ulp = std::nextafter(std::fabs(rounded), std::numeric_limits<float>::infinity()) -
+                     std::fabs(rounded);
+    return std::fabs(actual - expect) / ulp;
+}
+
+struct Case
+{
+    std::string name;
+    double      lower, upper; // range of random arguments
+    double      max_ulp;
+    bool        logscale = false; // over the exponents as well
+};
+
+int main()
+{
+    using namespace boost::ut::literals;
+
+    "exact"_test = []
+    {
+        jitome::JitCompiler<double(double, double)> f("(x, y) {sqrt(abs(x)) + min(x, y) * max(x, y)}");
+        for(const double x : {-2.5, 0.0, 1.0, 7.25})
+        {
+            for(const double y : {-1.0, 0.5, 3.0})
+            {
+                const double ref = std::sqrt(std::fabs(x)) + std::min(x, y) * std::max(x, y);
+                boost::ut::expect(ref == f(x, y));
+            }
+        }
+    };
+
+    "sign"_test = []
+    {
+        jitome::JitCompiler<double(double)> f("(x) {sign(x)}");
+        jitome::JitBatchCompiler g("(x) {sign(x)}");
+        const double inf = std::numeric_limits<double>::infinity();
+        const std::vector<double> xs = {2.5, -0.5, 0.0, -0.0, inf, -inf, 0x1p-1074, -0x1p-1074};
+        std::vector<double> out(xs.size());
+        const double* columns[] = {xs.data()};
+        g(columns, out.data(), xs.size());
+        for(std::size_t i=0; i<xs.size(); ++i)
+        {
+            const double ref = jitome::call_builtin("sign", &xs[i]);
+            boost::ut::expect(ulp_error(f(xs[i]), ref) == 0.0 && ulp_error(out[i], ref) == 0.0)
+                << "sign(" << xs[i] << ")";
+        }
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        boost::ut::expect(std::isnan(f(nan)));
+    };
+
+    "accuracy"_test = []
+    {
+        const std::vector<Case> cases = {
+            {"exp", -745.5, 709.7, 1.0},
+            {"log", 0x1p-1070, 1e300, 1.0, true},
+            {"log", 0.5, 2.0, 1.0, true},
+            {"sin", -10.0, 10.0, 2.0},
+            {"sin", -9.9e5, 9.9e5, 2.0},
+            {"sin", 1e6, 1e300, 2.0, true},
+            {"cos", -10.0, 10.0, 2.0},
+            {"cos", -9.9e5, 9.9e5, 2.0},
+            {"cos", 1e6, 1e300, 2.0, true},
+        };
+
+        std::mt19937_64 rng(123456789);
+        using jitome::Isa;
+        for(const auto isa : {Isa::SSE2, Isa::AVX, Isa::AVX512})
+        {
+            if(!jitome::is_supported(isa))
+            {
+                continue;
+            }
+            jitome::CompileOptions options;
+            options.isa = isa;
+            for(const auto& c : cases)
+            {
+                const auto code = "(x) {" + c.name + "(x)}";
+                jitome::JitCompiler<double(double)> f(code, options);
+                jitome::JitBatchCompiler g(code, options);
+
+                const bool logscale = c.logscale;
+                std::uniform_real_distribution<double> dist(
+                    logscale ? std::log2(c.lower) : c.lower, logscale ? std::log2(c.upper) : c.upper);
+
+                std::vector<double> xs(10003);
+                for(auto& x : xs)
+                {
+                    x = logscale ? std::exp2(dist(rng)) : dist(rng);
+                }
+                std::vector<double> out(xs.size());
+                const double* columns[] = {xs.data()};
+                g(columns, out.data(), xs.size());
+
+                double worst = 0.0;
+                for(std::size_t i=0; i<xs.size(); ++i)
+                {
+                    const double ref = jitome::call_builtin(c.name, &xs[i]);
+                    worst = std::max({worst, ulp_error(f(xs[i]), ref), ulp_error(out[i], ref)});
+                }
+                boost::ut::expect(worst <= c.max_ulp)
+                    << code << jitome::to_string(isa) << "[" << c.lower << "," << c.upper << "]:" << worst;
+            }
+        }
+    };
+
+    "special"_test = []
+    {
+        const double inf = std::numeric_limits<double>::infinity();
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+
+        // argument and the expected result
+        const std::vector<std::pair<std::string, std::vector<std::pair<double, double>>>> cases = {
+            {"exp", {{0.0, 1.0}, {-0.0, 1.0}, {inf, inf}, {-inf, 0.0}, {nan, nan},
+                     {710.0, inf}, {-746.0, 0.0}, {-745.0, std::exp(-745.0)}, {1e300, inf}}},
+            {"log", {{1.0, 0.0}, {0.0, -inf}, {-0.0, -inf}, {inf, inf}, {-inf, nan}, {nan, nan},
+                     {-1.0, nan}, {0x1p-1074, std::log(0x1p-1074)}, {0x1p-1030, std::log(0x1p-1030)},
+                     {std::numeric_limits<double>::max(), std::log(std::numeric_limits<double>::max())}}},
+            {"sin", {{0.0, 0.0}, {-0.0, -0.0}, {1e-300, 1e-300}, {inf, nan}, {-inf, nan}, {nan, nan}}},
+            {"cos", {{0.0, 1.0}, {-0.0, 1.0}, {inf, nan}, {-inf, nan}, {nan, nan}}},
+        };
+        for(const auto& [name, values] : cases)
+        {
+            const auto code = "(x) {" + name + "(x)}";
+            jitome::JitCompiler<double(double)> f(code);
+            jitome::JitBatchCompiler g(code);
+
+            std::vector<double> xs, out(values.size());
+            for(const auto& [x, y] : values)
+            {
+                xs.push_back(x);
+            }
+            const double* columns[] = {xs.data()};
+            g(columns, out.data(), xs.size());
+
+            for(std::size_t i=0; i<values.size(); ++i)
+            {
+                const auto [x, y] = values.at(i);
+                boost::ut::expect(ulp_error(f(x), y) <= 1.0) << name << "(" << x << ") =" << f(x);
+                boost::ut::expect(ulp_error(out.at(i), y) <= 1.0) << name << "(" << x << ") =" << out.at(i);
+            }
+        }
+    };
+
+    "lanes"_test = []
+    {
+        // vector shifts on ymm require AVX2
+        using jitome::Isa;
+        if(!jitome::is_supported(Isa::AVX))
+        {
+            return;
+        }
+        jitome::CompileOptions options;
+        options.isa = Isa::AVX;
+        const bool avx2 = jitome::host_cpu().has(Xbyak::util::Cpu::tAVX2);
+        boost::ut::expect(jitome::JitBatchCompiler("(x) {exp(x)}",  options).lanes() == (avx2 ? 4u : 1u));
+        boost::ut::expect(jitome::JitBatchCompiler("(x) {sqrt(x)}", options).lanes() == 4u);
+    };
+
+    "float"_test = []
+    {
+        const std::vector<Case> cases = {
+            {"exp", -103.9, 88.7, 2.0},
+            {"log", 0x1p-149, 3e38, 1.0, true},
+            {"sin", -4000.0, 4000.0, 3.0},
+            {"sin", 4096.0, 3e38, 3.0, true},
+            {"cos", -4000.0, 4000.0, 3.0},
+            {"cos", 4096.0, 3e38, 3.0, true},
+        };
+
+        std::mt19937_64 rng(987654321);
+        using jitome::Isa;
+        for(const auto isa : {Isa::SSE2, Isa::AVX, Isa::AVX512})
+        {
+            if(!jitome::is_supported(isa))
+            {
+                continue;
+            }
+            jitome::CompileOptions options;
+            options.isa = isa;
+            for(const auto& c : cases)
+            {
+                const auto code = "(x) {" + c.name + "(x)}";
+                jitome::JitCompiler<float(float)> f(code, options);
+                jitome::BasicJitBatchCompiler<float> g(code, options);
+
+                const bool logscale = c.logscale;
+                std::uniform_real_distribution<double> dist(
+                    logscale ? std::log2(c.lower) : c.lower, logscale ? std::log2(c.upper) : c.upper);
+
+                std::vector<float> xs(10003);
+                for(auto& x : xs)
+                {
+                    x = static_cast<float>(logscale ? std::exp2(dist(rng)) : dist(rng));
+                }
+                std::vector<float> out(xs.size());
+                const float* columns[] = {xs.data()};
+                g(columns, out.data(), xs.size());
+
+                double worst = 0.0;
+                for(std::size_t i=0; i<xs.size(); ++i)
+                {
+                    const double x   = xs[i];
+                    const double ref = jitome::call_builtin(c.name, &x);
+                    worst = std::max({worst, ulp_error(f(xs[i]), ref), ulp_error(out[i], ref)});
+                }
+                boost::ut::expect(worst <= c.max_ulp)
+                    << code << jitome::to_string(isa) << "[" << c.lower << "," << c.upper << "]:" << worst;
+            }
+        }
+
+        const float inf = std::numeric_limits<float>::infinity();
+        jitome::JitCompiler<float(float)> exp("(x) {exp(x)}");
+        jitome::JitCompiler<float(float)> log("(x) {log(x)}");
+        jitome::JitCompiler<float(float)> sin("(x) {sin(x)}");
+        boost::ut::expect(exp(89.0f) == inf);
+        boost::ut::expect(exp(-104.0f) == 0.0f);
+        boost::ut::expect(exp(-inf) == 0.0f);
+        boost::ut::expect(log(0.0f) == -inf);
+        boost::ut::expect(std::isnan(log(-1.0f)));
+        boost::ut::expect(std::signbit(sin(-0.0f)));
+        boost::ut::expect(ulp_error(sin(5000.0f), std::sin(5000.0)) <= 3.0);
+    };
+
+    "large_arguments"_test = []
+    {
+        // Payne-Hanek beyond 1e6 (4096 for float), mixed with the lanes in range
+        const std::vector<double> xs = {
+            1e7, -1e7, 1e15, -1e15, 1.0, 1e22, -3.0, 0x1p1023, -0x1.8p1000,
+            1e300, 9.9e5, std::numeric_limits<double>::max(), 1e6, -1e6, 123456789.0};
+
+        // the closest double to a multiple of pi/2. The C library is 8 ulp
+        // off in cos, so it is compared with the correctly rounded value.
+        const double hardest = 6381956970095103.0 * 0x1p797;
+        const std::vector<float> fs = {
+            4097.0f, -4097.0f, 1.0f, 4095.0f, 1e10f, -3e38f, 0.5f, 5000.0f, 4096.0f,
+            -1e7f, 3.0f, 1e15f, 16777216.0f, -2.0f, 8.5e37f, 65536.0f, 4097.0f};
+
+        using jitome::Isa;
+        for(const std::string name : {"sin", "cos"})
+        {
+            const auto code = "(x) {" + name + "(x)}";
+            for(const auto isa : {Isa::SSE2, Isa::AVX, Isa::AVX512})
+            {
+                if(!jitome::is_supported(isa))
+                {
+                    continue;
+                }
+                jitome::CompileOptions options;
+                options.isa = isa;
+                jitome::JitCompiler<double(double)> f(code, options);
+                jitome::JitBatchCompiler g(code, options);
+                jitome::JitCompiler<float(float)> h(code, options);
+                jitome::BasicJitBatchCompiler<float> k(code, options);
+
+                std::vector<double> out(xs.size());
+                const double* columns[] = {xs.data()};
+                g(columns, out.data(), xs.size());
+                for(std::size_t i=0; i<xs.size(); ++i)
+                {
+                    const double ref = jitome::call_builtin(name, &xs[i]);
+                    boost::ut::expect(ulp_error(f(xs[i]), ref) <= 2.0) << code << xs[i] << f(xs[i]);
+                    boost::ut::expect(ulp_error(out[i],   ref) <= 2.0) << code << xs[i] << out[i];
+                }
+                const double exact = (name == "sin") ? 1.0 : -0x1.14ae72e6ba22fp-61;
+                boost::ut::expect(ulp_error(f(hardest), exact) <= 1.0) << code << f(hardest);
+
+                std::vector<float> fout(fs.size());
+                const float* fcolumns[] = {fs.data()};
+                k(fcolumns, fout.data(), fs.size());
+                for(std::size_t i=0; i<fs.size(); ++i)
+                {
+                    const double x   = fs[i];
+                    const double ref = jitome::call_builtin(name, &x);
+                    boost::ut::expect(ulp_error(h(fs[i]), ref) <= 3.0) << code << fs[i] << h(fs[i]);
+                    boost::ut::expect(ulp_error(fout[i],  ref) <= 3.0) << code << fs[i] << fout[i];
+                }
+            }
+
+            // the other values are kept across the reduction
+            for(const auto isa : {Isa::SSE2, Isa::AVX, Isa::AVX512})
+            {
+                if(!jitome::is_supported(isa))
+                {
+                    continue;
+                }
+                jitome::CompileOptions options;
+                options.isa = isa;
+                jitome::JitBatchCompiler g("(x, y) {" + name + "(x) * 2 + " + name + "(y) * 4 + x - y}", options);
+
+                std::vector<double> ys(xs.rbegin(), xs.rend()), out(xs.size());
+                const double* columns[] = {xs.data(), ys.data()};
+                g(columns, out.data(), xs.size());
+                for(std::size_t i=0; i<xs.size(); ++i)
+                {
+                    const double ref = jitome::call_builtin(name, &xs[i]) * 2 +
+                                       jitome::call_builtin(name, &ys[i]) * 4 + xs[i] - ys[i];
+                    boost::ut::expect(std::fabs(out[i] - ref) <= 1e-14 * (std::fabs(xs[i]) + std::fabs(ys[i]) + 8.0))
+                        << name << xs[i] << ys[i] << out[i];
+                }
+            }
+
+            // evaluate() runs the same reduction
+            auto tks = jitome::tokenize(code);
+            auto prs = jitome::parse(tks.as_val());
+            const auto prog = jitome::lower(std::get<jitome::NodeFunction>(prs.as_val().node));
+            std::vector<double> values;
+            for(const auto x : xs)
+            {
+                const double ref = jitome::call_builtin(name, &x);
+                boost::ut::expect(ulp_error(jitome::evaluate(prog, &x, values), ref) <= 2.0) << code << x;
+            }
+        }
+    };
+
+    "flush_to_zero"_test = []
+    {
+        // log masks the fraction by 0x007FFFFF, a subnormal float. Compiling
+        // it with DAZ and FTZ set must not flush the mask to zero.
+        const std::string code = "(x) {log(x) + abs(x)}";
+        std::vector<float> xs = {0.1f, 0.75f, 1.0f, 1.5f, 2.0f, 3.0f, 1e-30f, 1e30f, 7.0f};
+        const float* columns[] = {xs.data()};
+
+        using jitome::Isa;
+        for(const auto isa : {Isa::SSE2, Isa::AVX, Isa::AVX512})
+        {
+            if(!jitome::is_supported(isa))
+            {
+                continue;
+            }
+            jitome::CompileOptions options;
+            options.isa = isa;
+            jitome::BasicJitBatchCompiler<float> g(code, options);
+
+            const auto csr = _mm_getcsr();
+            _mm_setcsr(csr | 0x8040); // FTZ | DAZ
+            jitome::BasicJitBatchCompiler<float> h(code, options);
+            _mm_setcsr(csr);
+
+            std::vector<float> expect(xs.size()), actual(xs.size());
+            g(columns, expect.data(), xs.size());
+            h(columns, actual.data(), xs.size());
+            boost::ut::expect(expect == actual) << jitome::to_string(isa);
+        }
+    };
+}
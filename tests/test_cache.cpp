@@ -0,0 +1,115 @@
+#include "jitome/cache.hpp"
+#include <boost/ut.hpp>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main()
+{
+    using namespace boost::ut::literals;
+
+    "canonicalize"_test = []
+    {
+        const auto canon = [](const std::string& code) {
+            auto tks = jitome::tokenize(code);
+            auto prs = jitome::parse(tks.as_val());
+            return jitome::canonicalize(prs.as_val());
+        };
+        boost::ut::expect(canon("(a, b) {b + a * 2}") == canon("(x, y) {y + 2 * x}"));
+        boost::ut::expect(canon("(a, b) {b + a * 2}") == canon("(a,b){/* comment */ a*2+b}"));
+        boost::ut::expect(canon("(a, b) {a - b}") != canon("(a, b) {b - a}"));
+        boost::ut::expect(canon("(a, b) {a / b}") != canon("(b, a) {a / b}"));
+        boost::ut::expect(canon("(a) {a + 1}") != canon("(a) {a + 1.0000001}"));
+        boost::ut::expect(canon("(a) {a + 1}") != canon("(a, b) {a + 1}"));
+
+        // locals are numbered
+        boost::ut::expect(canon("(a) {t = a + 1; return t * t;}") == canon("(x) {u = 1 + x; return u * u;}"));
+        boost::ut::expect(canon("(a) {t = a + 1; return t * t;}") != canon("(a) {t = a + 1; return t * a;}"));
+        boost::ut::expect(canon("(a) {t = a; return a;}") != canon("(a) {a}"));
+    };
+
+    "hit_and_miss"_test = []
+    {
+        jitome::JitCache cache(16);
+        const auto f = cache.compile<double(double, double)>("(a, b) {a * b + 1}");
+        const auto g = cache.compile<double(double, double)>("(x, y) { 1 + y*x }");
+        const auto h = cache.compile<double(double, double)>("(x, y) {x * y - 1}");
+
+        boost::ut::expect(f == g);
+        boost::ut::expect(f != h);
+        boost::ut::expect((*f)(2.0, 3.0) == 7.0);
+        boost::ut::expect((*h)(2.0, 3.0) == 5.0);
+
+        // different kind of compiler is a different entry
+        const auto b = cache.compile_batch("(a, b) {a * b + 1}");
+        boost::ut::expect(b->arity() == 2);
+
+        const auto s = cache.stats();
+        boost::ut::expect(s.hits   == 1);
+        boost::ut::expect(s.misses == 3);
+        boost::ut::expect(s.size   == 3);
+    };
+
+    "lru"_test = []
+    {
+        jitome::JitCache cache(2);
+        const auto a = cache.compile<double(double)>("(x) {x + 1}");
+        cache.compile<double(double)>("(x) {x + 2}");
+        cache.compile<double(double)>("(x) {x + 1}"); // x+2 is now the oldest
+        cache.compile<double(double)>("(x) {x + 3}"); // evicts x+2
+
+        auto s = cache.stats();
+        boost::ut::expect(s.evictions == 1);
+        boost::ut::expect(s.size == 2);
+
+        boost::ut::expect(cache.compile<double(double)>("(y) {1 + y}") == a);
+        cache.compile<double(double)>("(x) {x + 2}");
+        s = cache.stats();
+        boost::ut::expect(s.hits   == 2);
+        boost::ut::expect(s.misses == 4);
+
+        // evicted function is still valid
+        cache.clear();
+        boost::ut::expect((*a)(1.0) == 2.0);
+    };
+
+    "threads"_test = []
+    {
+        jitome::JitCache cache(8);
+        const std::vector<std::string> codes{
+            "(a, b) {a + b}", "(a, b) {a - b}", "(a, b) {a * b}",
+        };
+        std::vector<std::thread> threads;
+        std::vector<int> ok(4, 1);
+        for(std::size_t t=0; t<ok.size(); ++t)
+        {
+            threads.emplace_back([&, t] {
+                for(int i=0; i<10; ++i)
+                {
+                    const auto& code = codes.at((t + i) % codes.size());
+                    const auto f = cache.compile<double(double, double)>(code);
+                    const double r = (*f)(3.0, 2.0);
+                    const double e = code == codes[0] ? 5.0 : code == codes[1] ? 1.0 : 6.0;
+                    ok[t] = ok[t] && r == e;
+                }
+            });
+        }
+        for(auto& th : threads) {th.join();}
+
+        bool all = true;
+        for(const auto v : ok) {all = all && v;}
+        boost::ut::expect(all);
+
+        const auto s = cache.stats();
+        boost::ut::expect(s.hits + s.misses == 40);
+        boost::ut::expect(s.size == 3);
+    };
+
+    "global"_test = []
+    {
+        auto& cache = jitome::global_jit_cache();
+        const auto f = cache.compile<double(double)>("(x) {x * x}");
+        boost::ut::expect(f == jitome::global_jit_cache().compile<double(double)>("(y) {y * y}"));
+    };
+}
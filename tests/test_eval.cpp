@@ -1,7 +1,13 @@
 #include "jitome/ast.hpp"
 #include "jitome/eval.hpp"
+#include "jitome/parser.hpp"
+#include "jitome/tokenizer.hpp"
 #include <boost/ut.hpp>
+#include <cmath>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <string>
 
 int main()
 {
@@ -36,4 +42,84 @@ int main()
         std::map<std::string, double> env;
         boost::ut::expect(2.0 * (3.14 + 2.71) == jitome::evaluate(env, root));
     };
+
+    "power"_test = []
+    {
+        const auto power = [](const double n) {
+            return jitome::Node{jitome::NodeExpression{"^"sv,
+                jitome::NodeVariable{"x"}, jitome::NodeImmediate{n}
+            }};
+        };
+
+        std::map<std::string, double> env{{"x", 2.0}};
+        boost::ut::expect(1024.0 == jitome::evaluate(env, power(10.0)));
+        boost::ut::expect(0.25   == jitome::evaluate(env, power(-2.0)));
+        boost::ut::expect(1.0    == jitome::evaluate(env, power(0.0)));
+
+        env["x"] = 1.1;
+        boost::ut::expect(((1.1 * 1.1) * (1.1 * 1.1)) * 1.1 == jitome::evaluate(env, power(5.0)));
+
+        boost::ut::expect(boost::ut::throws([&] {jitome::evaluate(env, power(0.5));}));
+    };
+
+    "builtin"_test = []
+    {
+        const auto call = [](const std::string_view name, const double a, const double b) {
+            jitome::NodeExpression node{name, jitome::NodeImmediate{a}};
+            if(jitome::find_builtin(name)->arity == 2)
+            {
+                node.operands.push_back(jitome::Node{jitome::NodeImmediate{b}});
+            }
+            std::map<std::string, double> env;
+            return jitome::evaluate(env, jitome::Node{std::move(node)});
+        };
+        boost::ut::expect(1.5 == call("sqrt"sv, 2.25, 0.0));
+        boost::ut::expect(2.0 == call("abs"sv, -2.0, 0.0));
+        boost::ut::expect(1.0 == call("min"sv, 1.0, 2.0));
+        boost::ut::expect(2.0 == call("max"sv, 1.0, 2.0));
+        boost::ut::expect(std::exp(0.5) == call("exp"sv, 0.5, 0.0));
+        boost::ut::expect(std::log(0.5) == call("log"sv, 0.5, 0.0));
+        boost::ut::expect(std::sin(0.5) == call("sin"sv, 0.5, 0.0));
+        boost::ut::expect(std::cos(0.5) == call("cos"sv, 0.5, 0.0));
+    };
+
+    "conditions"_test = []
+    {
+        auto tks = jitome::tokenize("(x, y) {(x < y) + 2 * (x <= y) + 4 * (x == y) + 8 * (x != y) + "
+                                    "16 * (x > 0 && y > 0) + 32 * (x || y) + 64 * (x > y ? 1 : 0)}");
+        auto prs = jitome::parse(tks.as_val());
+        boost::ut::expect(prs.is_ok());
+        const auto eval = [&prs](const double x, const double y) {
+            std::map<std::string, double> env{{"x", x}, {"y", y}};
+            return jitome::evaluate(env, prs.as_val());
+        };
+        boost::ut::expect(eval(1.0, 2.0) == 1 + 2 + 8 + 16 + 32);
+        boost::ut::expect(eval(2.0, 2.0) == 2 + 4 + 16 + 32);
+        boost::ut::expect(eval(0.0, -1.0) == 8 + 32 + 64);
+        boost::ut::expect(eval(0.0, 0.0) == 2 + 4);
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        boost::ut::expect(eval(nan, 1.0) == 8 + 32); // NaN is true, and only `!=` holds
+
+        auto clamp = jitome::parse(jitome::tokenize("(x) {clamp(x, 0 - 1, 1)}").as_val());
+        std::map<std::string, double> env{{"x", 3.0}};
+        boost::ut::expect(jitome::evaluate(env, clamp.as_val()) == 1.0);
+        env["x"] = -0.5;
+        boost::ut::expect(jitome::evaluate(env, clamp.as_val()) == -0.5);
+        env["x"] = nan;
+        boost::ut::expect(jitome::evaluate(env, clamp.as_val()) == -1.0); // as maxsd
+    };
+
+    "locals"_test = []
+    {
+        auto tks = jitome::tokenize("(a, b) {t = a*b + 1; t = t*t - t; return t / a;}");
+        auto prs = jitome::parse(tks.as_val());
+        boost::ut::expect(prs.is_ok());
+
+        std::map<std::string, double> env{{"a", 1.5}, {"b", -2.0}};
+        const double t = 1.5 * -2.0 + 1;
+        boost::ut::expect((t*t - t) / 1.5 == jitome::evaluate(env, prs.as_val()));
+
+        // locals are not written into env
+        boost::ut::expect(env.size() == 2u);
+    };
 }
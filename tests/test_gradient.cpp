@@ -0,0 +1,141 @@
+#include "jitome/eval.hpp"
+#include "jitome/gradient.hpp"
+#include "jitome/jit.hpp"
+#include <boost/ut.hpp>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+int main()
+{
+    using namespace boost::ut::literals;
+
+    "symbolic"_test = []
+    {
+        jitome::JitGradientCompiler<void(double*, double, double)> f("(a, b) {a * sin(b)}");
+        boost::ut::expect(f.outputs() == 3u);
+
+        const double a = 1.25, b = 0.75;
+        double out[3] = {};
+        f.get_func_ptr()(out, a, b);
+        boost::ut::expect(std::fabs(out[0] - a * std::sin(b)) <= 1e-15);
+        boost::ut::expect(std::fabs(out[1] -     std::sin(b)) <= 1e-15);
+        boost::ut::expect(std::fabs(out[2] - a * std::cos(b)) <= 1e-15);
+
+        // exactly zero, not `0 * x`
+        jitome::JitGradientCompiler<void(double*, double, double)> g("(a, b) {a * 2}");
+        const double inf = std::numeric_limits<double>::infinity();
+        g.get_func_ptr()(out, inf, 1.0);
+        boost::ut::expect(out[1] == 2.0);
+        boost::ut::expect(out[2] == 0.0);
+    };
+
+    "finite_difference"_test = []
+    {
+        const std::vector<std::string> codes = {
+            "(a, b, c) {a * b + c / a - b^3}",
+            "(a, b, c) {sqrt(a*a + b*b) * exp(0 - c) + log(a) / b}",
+            "(a, b, c) {sin(a * b) - cos(c)^2 + (a - c)^-2}",
+            "(a, b, c) {t = a * b + 1; u = t * t - c; t = u / t; return sin(t) + u;}",
+            "(a, b, c) {abs(a - c) + min(a, b) * max(b, c)}",
+            "(a, b, c) {(a > b && c < 1 ? a * c : b^2) + clamp(a * b, c, 3) * (b < c)}",
+        };
+        const std::vector<std::vector<double>> points = {
+            {1.5, 0.5, -0.25}, {0.75, -1.25, 2.0}, {2.5, 1.75, 0.5},
+        };
+        for(const auto& code : codes)
+        {
+            const auto func = jitome::parse_function(code);
+            jitome::JitGradientCompiler<void(double*, double, double, double)> f(func);
+            for(const auto& x : points)
+            {
+                double out[4] = {};
+                f.get_func_ptr()(out, x[0], x[1], x[2]);
+
+                const auto value = [&func](std::vector<double> y) {
+                    std::map<std::string, double> env{{"a", y[0]}, {"b", y[1]}, {"c", y[2]}};
+                    return jitome::evaluate(env, jitome::Node{func});
+                };
+                boost::ut::expect(std::fabs(out[0] - value(x)) <= 1e-12 * (1.0 + std::fabs(out[0])));
+                for(std::size_t i=0; i<3; ++i)
+                {
+                    const double h = 1e-6;
+                    auto lo = x, hi = x;
+                    lo[i] -= h;
+                    hi[i] += h;
+                    const double fd = (value(hi) - value(lo)) / (2 * h);
+                    boost::ut::expect(std::fabs(out[i+1] - fd) <= 1e-6 * (1.0 + std::fabs(fd)))
+                        << code << "d/d" << i << ":" << out[i+1] << "vs" << fd;
+                }
+            }
+        }
+    };
+
+    "wrt"_test = []
+    {
+        const std::vector<std::string> wrt = {"c", "a"};
+        jitome::JitGradientCompiler<void(double*, double, double, double)>
+            f("(a, b, c) {a * b * c}", wrt);
+        boost::ut::expect(f.outputs() == 3u);
+
+        double out[3] = {};
+        f.get_func_ptr()(out, 2.0, 3.0, 5.0);
+        boost::ut::expect(out[0] == 30.0);
+        boost::ut::expect(out[1] ==  6.0);
+        boost::ut::expect(out[2] == 15.0);
+
+        const std::vector<std::string> unknown = {"x"};
+        boost::ut::expect(boost::ut::throws([&] {
+                jitome::gradient(jitome::parse_function("(a) {a}"), unknown);
+            }));
+    };
+
+    "nondifferentiable"_test = []
+    {
+        jitome::JitGradientCompiler<void(double*, double, double)> f("(a, b) {abs(a) + min(a, b)}");
+        double out[3] = {};
+        f.get_func_ptr()(out, 0.0, 1.0); // abs'(0) = 0, min returns a
+        boost::ut::expect(out[1] == 1.0);
+        boost::ut::expect(out[2] == 0.0);
+        f.get_func_ptr()(out, 2.0, 2.0); // min returns b
+        boost::ut::expect(out[1] == 1.0);
+        boost::ut::expect(out[2] == 1.0);
+    };
+
+    "shared"_test = []
+    {
+        // d/dx exp(x) is exp(x) itself, so the gradient only adds an output
+        const auto func  = jitome::parse_function("(x) {exp(x)}");
+        const auto value = jitome::lower_functions({func});
+        const auto grad  = jitome::lower_functions(jitome::gradient(func));
+        boost::ut::expect(grad.code.size() == value.code.size() + 1);
+    };
+
+    "batch"_test = []
+    {
+        jitome::JitGradientBatchCompiler f("(a, b) {t = a / b; return t * t + log(b);}");
+        boost::ut::expect(f.outputs() == 3u);
+
+        const std::size_t n = 13;
+        std::vector<double> a(n), b(n), v(n), da(n), db(n);
+        for(std::size_t i=0; i<n; ++i)
+        {
+            a[i] = 0.5 * i - 2.0;
+            b[i] = 1.0 + 0.25 * i;
+        }
+        const double* columns[] = {a.data(), b.data()};
+        double* outs[] = {v.data(), da.data(), db.data()};
+        f(columns, outs, n);
+
+        bool ok = true;
+        for(std::size_t i=0; i<n; ++i)
+        {
+            const double t = a[i] / b[i];
+            ok = ok && std::fabs(da[i] - 2 * t / b[i]) <= 1e-14;
+            ok = ok && std::fabs(db[i] - (1.0 - 2 * t * t) / b[i]) <= 1e-14;
+        }
+        boost::ut::expect(ok);
+    };
+}
@@ -1,8 +1,13 @@
 #include "jitome/ast.hpp"
 #include "jitome/eval.hpp"
 #include "jitome/interpreter.hpp"
+#include "jitome/parser.hpp"
+#include "jitome/tokenizer.hpp"
 #include <boost/ut.hpp>
+#include <cmath>
 #include <iostream>
+#include <map>
+#include <string>
 
 int main()
 {
@@ -48,4 +53,47 @@ int main()
 
         boost::ut::expect(2.0 * (3.14 + 2.71) == dep(2.0, 3.14, 2.71));
     };
+
+    "cse"_test = []
+    {
+        auto tks = jitome::tokenize("(a, b) {(a*b + 1) * (a*b + 1) / (a*b)}");
+        auto prs = jitome::parse(tks.as_val());
+        jitome::Interpreter<double, double, double> f(std::move(prs.as_val()));
+
+        boost::ut::expect(f.merged() == 4);
+        const double a = 1.5, b = -2.25;
+        boost::ut::expect((a*b + 1) * (a*b + 1) / (a*b) == f(a, b));
+        boost::ut::expect((b*a + 1) * (b*a + 1) / (b*a) == f(b, a));
+    };
+
+    "float"_test = []
+    {
+        auto tks = jitome::tokenize("(a, b) {(a - b) * (a + 0.1) / b}");
+        auto prs = jitome::parse(tks.as_val());
+        jitome::Interpreter<float, float, float>  f(prs.as_val());
+        jitome::Interpreter<double, float, float> g(prs.as_val());
+
+        const float a = 1.7f, b = -2.3f;
+        boost::ut::expect((a - b) * (a + 0.1f) / b == f(a, b));
+        const double da = a, db = b;
+        boost::ut::expect((da - db) * (da + 0.1) / db == g(a, b));
+    };
+
+    "builtin"_test = []
+    {
+        // the C library, the same as evaluate(), not the polynomials of the JIT
+        auto tks = jitome::tokenize("(x) {sin(x) + cos(x) * exp(x / 1e7) - log(abs(x)) + sin(x)}");
+        auto prs = jitome::parse(tks.as_val());
+        jitome::Interpreter<double, double> f(prs.as_val());
+        const auto simplified = jitome::simplify(prs.as_val());
+
+        for(const double x : {0.5, -3.0, 1e7, 1e15, -1e22})
+        {
+            std::map<std::string, double> env{{"x", x}};
+            boost::ut::expect(jitome::evaluate(env, simplified) == f(x)) << x;
+        }
+        boost::ut::expect(f(1e7) == std::sin(1e7) + std::cos(1e7) * std::exp(1e7 / 1e7) -
+                                    std::log(1e7) + std::sin(1e7));
+        boost::ut::expect(f.merged() == 1); // the second sin(x)
+    };
 }
@@ -2,7 +2,16 @@
 #include "jitome/eval.hpp"
 #include "jitome/jit.hpp"
 #include <boost/ut.hpp>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
 
 int main()
 {
@@ -65,4 +74,1003 @@ int main()
         jitome::JitCompiler<double(double, double, double)> dep("(a, b, c) {a * (c + b)}");
         boost::ut::expect(2.0 * (3.14 + 2.71) == dep(2.0, 3.14, 2.71));
     };
+
+    "batch"_test = []
+    {
+        jitome::JitBatchCompiler fma("(a, b, c) {a + b * c}");
+        boost::ut::expect(fma.arity() == 3);
+
+        // not a multiple of lanes() to run the scalar loop as well
+        const std::size_t n = 1003;
+        std::vector<double> a(n), b(n), c(n), out(n, 0.0);
+        for(std::size_t i=0; i<n; ++i)
+        {
+            a[i] = 0.5 * i;
+            b[i] = 1.0 + 0.25 * i;
+            c[i] = 3.0 - 0.125 * i;
+        }
+        const double* columns[] = {a.data(), b.data(), c.data()};
+        fma(columns, out.data(), n);
+
+        bool ok = true;
+        for(std::size_t i=0; i<n; ++i)
+        {
+            ok = ok && (out[i] == a[i] + b[i] * c[i]);
+        }
+        boost::ut::expect(ok);
+    };
+
+    "batch_order"_test = []
+    {
+        jitome::JitBatchCompiler f("(a, b) {(a - b) / (b - 2.5) - a}");
+
+        const std::size_t n = 37;
+        std::vector<double> a(n), b(n), out(n, 0.0);
+        for(std::size_t i=0; i<n; ++i)
+        {
+            a[i] = 1.5 * i;
+            b[i] = 10.0 - 0.5 * i;
+        }
+        const double* columns[] = {a.data(), b.data()};
+        f(columns, out.data(), n);
+
+        bool ok = true;
+        for(std::size_t i=0; i<n; ++i)
+        {
+            ok = ok && (out[i] == (a[i] - b[i]) / (b[i] - 2.5) - a[i]);
+        }
+        boost::ut::expect(ok);
+
+        // n == 0 should not touch anything
+        f(columns, out.data(), 0);
+    };
+
+    "sub_div"_test = []
+    {
+        jitome::JitCompiler<double(double, double)> sub("(a, b) {a - b}");
+        jitome::JitCompiler<double(double, double)> div("(a, b) {a / b}");
+        boost::ut::expect(3.14 - 2.71 == sub(3.14, 2.71));
+        boost::ut::expect(3.14 / 2.71 == div(3.14, 2.71));
+    };
+
+    "many_args"_test = []
+    {
+        jitome::JitCompiler<double(double, double, double, double, double,
+                                   double, double, double, double, double)>
+            f("(a, b, c, d, e, f, g, h, i, j) {(a - j) * (b + i) - c / h + d * g - e / f}");
+
+        const auto expect = (1.0 - 10.0) * (2.0 + 9.0) - 3.0 / 8.0 + 4.0 * 7.0 - 5.0 / 6.0;
+        boost::ut::expect(expect == f(1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0, 10.0));
+    };
+
+    "deep"_test = []
+    {
+        // a * (b + (a * (b + ... ))) keeps one value per level alive and
+        // requires far more than 16 registers
+        std::string code("(a, b) {");
+        std::string close;
+        for(std::size_t i=0; i<64; ++i)
+        {
+            code  += "a * (b + (" + std::to_string(i % 7 + 1) + " - (";
+            close += ")))";
+        }
+        code += "a" + close + "}";
+
+        const double a = 0.5, b = 1.25;
+        double expect = a;
+        for(std::size_t i=64; i != 0; --i)
+        {
+            expect = a * (b + (static_cast<double>((i-1) % 7 + 1) - expect));
+        }
+
+        jitome::JitCompiler<double(double, double)> f(code);
+        boost::ut::expect(expect == f(a, b));
+
+        jitome::JitBatchCompiler g(code);
+        const std::size_t n = 19;
+        std::vector<double> as(n, a), bs(n, b), out(n, 0.0);
+        const double* columns[] = {as.data(), bs.data()};
+        g(columns, out.data(), n);
+        boost::ut::expect(std::all_of(out.begin(), out.end(),
+                    [expect](const double x) {return x == expect;}));
+    };
+
+    "constants"_test = []
+    {
+        // +0.0 and -0.0 are different constants
+        jitome::Node root{
+            jitome::NodeFunction{
+                "f",
+                std::vector{"x"s},
+                jitome::Node{
+                    jitome::NodeExpression{"-"sv,
+                        jitome::NodeExpression{"/"sv,
+                            jitome::NodeImmediate{1.0},
+                            jitome::NodeExpression{"*"sv,
+                                jitome::NodeVariable{"x"},
+                                jitome::NodeImmediate{-0.0}
+                            }
+                        },
+                        jitome::NodeExpression{"/"sv,
+                            jitome::NodeImmediate{1.0},
+                            jitome::NodeExpression{"*"sv,
+                                jitome::NodeVariable{"x"},
+                                jitome::NodeImmediate{0.0}
+                            }
+                        }
+                    }
+                }
+            }
+        };
+        jitome::JitCompiler<double(double)> f(root);
+        const auto r = f(1.0);
+        boost::ut::expect(std::isinf(r) && r < 0.0);
+
+        jitome::JitBatchCompiler g(root);
+        const std::size_t n = 11;
+        std::vector<double> x(n, 1.0), out(n, 0.0);
+        const double* columns[] = {x.data()};
+        g(columns, out.data(), n);
+        boost::ut::expect(std::all_of(out.begin(), out.end(),
+                    [](const double v) {return std::isinf(v) && v < 0.0;}));
+    };
+
+    "negation"_test = []
+    {
+        jitome::Node root{
+            jitome::NodeFunction{
+                "neg",
+                std::vector{"x"s},
+                jitome::Node{
+                    jitome::NodeExpression{"-"sv, jitome::NodeVariable{"x"}}
+                }
+            }
+        };
+        jitome::JitCompiler<double(double)> f(root);
+        boost::ut::expect(f(2.5) == -2.5);
+        boost::ut::expect(std::signbit(f(0.0)));
+        boost::ut::expect(!std::signbit(f(-0.0)));
+
+        jitome::JitBatchCompiler g(root);
+        const std::size_t n = 13;
+        std::vector<double> x(n), out(n, 0.0);
+        for(std::size_t i=0; i<n; ++i)
+        {
+            x[i] = (i % 2 == 0) ? 0.0 : 1.0 * i;
+        }
+        const double* columns[] = {x.data()};
+        g(columns, out.data(), n);
+        bool ok = true;
+        for(std::size_t i=0; i<n; ++i)
+        {
+            ok = ok && out[i] == -x[i] && std::signbit(out[i]);
+        }
+        boost::ut::expect(ok);
+    };
+
+    "cse"_test = []
+    {
+        // a*b and (a - b) are shared by all the terms and live until the end
+        std::string body = "a*b";
+        for(int k=1; k<=24; ++k)
+        {
+            body = "(" + body + " * (a - b) + a*b / " + std::to_string(k) + ")";
+        }
+        const std::string code = "(a, b) {" + body + "}";
+
+        auto tks = jitome::tokenize(code);
+        auto prs = jitome::parse(tks.as_val());
+        const auto root = prs.as_val();
+
+        const auto ref = [&root](const double a, const double b) {
+            std::map<std::string, double> env{{"a", a}, {"b", b}};
+            return jitome::evaluate(env, root);
+        };
+
+        jitome::JitCompiler<double(double, double)> f(root);
+        boost::ut::expect(f(0.75, 1.25) == ref(0.75, 1.25));
+        boost::ut::expect(f(-3.0, 0.5) == ref(-3.0, 0.5));
+
+        jitome::JitBatchCompiler g(root);
+        const std::size_t n = 21;
+        std::vector<double> a(n), b(n), out(n, 0.0);
+        for(std::size_t i=0; i<n; ++i)
+        {
+            a[i] = 0.125 * i - 1.0;
+            b[i] = 1.0 / (i + 1.0);
+        }
+        const double* columns[] = {a.data(), b.data()};
+        g(columns, out.data(), n);
+        bool ok = true;
+        for(std::size_t i=0; i<n; ++i)
+        {
+            ok = ok && out[i] == ref(a[i], b[i]);
+        }
+        boost::ut::expect(ok);
+    };
+
+    "contract"_test = []
+    {
+        const bool fma = jitome::host_cpu().has(Xbyak::util::Cpu::tFMA);
+
+        // a * b is not representable, so a fused result differs
+        const double a = 1.0 + std::ldexp(1.0, -30);
+        const double fused   = std::fma(a, a, -1.0);
+        const double unfused = a * a - 1.0;
+        boost::ut::expect(fused != unfused);
+
+        jitome::CompileOptions options;
+        options.contract = true;
+        jitome::JitCompiler<double(double, double, double)> f("(a, b, c) {a * b - c}", options);
+        jitome::JitCompiler<double(double, double, double)> g("(a, b, c) {a * b - c}");
+        boost::ut::expect(f(a, a, 1.0) == (fma ? fused : unfused));
+        boost::ut::expect(g(a, a, 1.0) == unfused);
+
+        jitome::JitCompiler<double(double, double, double)> h("(a, b, c) {c - a * b + a * c}", options);
+        boost::ut::expect(h(2.0, 3.0, 4.0) == 4.0 - 6.0 + 8.0);
+
+        const std::string code = "(a, b, c) {a * b - c + (b * c + a) * (c - a * a)}";
+        jitome::JitBatchCompiler batch(code, options);
+        const bool packed_fma = fma && batch.lanes() != 1;
+
+        auto tks = jitome::tokenize(code);
+        auto prs = jitome::parse(tks.as_val());
+        const auto& func = std::get<jitome::NodeFunction>(prs.as_val().node);
+        const auto prog = packed_fma ? jitome::contract(jitome::lower(func)) : jitome::lower(func);
+
+        const std::size_t n = 23;
+        std::vector<double> x(n), y(n), z(n), out(n);
+        for(std::size_t i=0; i<n; ++i)
+        {
+            x[i] = a + i;
+            y[i] = a - 0.25 * i;
+            z[i] = 1.0 / (i + 1.0);
+        }
+        const double* columns[] = {x.data(), y.data(), z.data()};
+        batch(columns, out.data(), n);
+
+        bool ok = true;
+        std::vector<double> values;
+        for(std::size_t i=0; i<n; ++i)
+        {
+            const double args[] = {x[i], y[i], z[i]};
+            ok = ok && out[i] == jitome::evaluate(prog, args, values);
+        }
+        boost::ut::expect(ok);
+    };
+
+    "isa"_test = []
+    {
+        const std::string code = "(a, b) {(a - b) * (a + 2) / (b * b + 1) - a}";
+        auto tks = jitome::tokenize(code);
+        auto prs = jitome::parse(tks.as_val());
+        const auto root = prs.as_val();
+        const auto ref = [&root](const double a, const double b) {
+            std::map<std::string, double> env{{"a", a}, {"b", b}};
+            return jitome::evaluate(env, root);
+        };
+
+        const std::size_t n = 13;
+        std::vector<double> a(n), b(n);
+        for(std::size_t i=0; i<n; ++i)
+        {
+            a[i] = 0.75 * i - 3.0;
+            b[i] = 1.0 / (i + 1.0);
+        }
+        const double* columns[] = {a.data(), b.data()};
+
+        using jitome::Isa;
+        for(const auto isa : {Isa::SSE2, Isa::AVX, Isa::AVX512})
+        {
+            jitome::CompileOptions options;
+            options.isa = isa;
+            if(!jitome::is_supported(isa))
+            {
+                boost::ut::expect(boost::ut::throws([&] {
+                        jitome::JitCompiler<double(double, double)> f(root, options);
+                    }));
+                continue;
+            }
+            jitome::JitCompiler<double(double, double)> f(root, options);
+            jitome::JitBatchCompiler g(root, options);
+            boost::ut::expect(g.lanes() == (isa == Isa::SSE2 ? 1u : isa == Isa::AVX ? 4u : 8u));
+
+            std::vector<double> out(n, 0.0);
+            g(columns, out.data(), n);
+            bool ok = true;
+            for(std::size_t i=0; i<n; ++i)
+            {
+                ok = ok && f(a[i], b[i]) == ref(a[i], b[i]) && out[i] == ref(a[i], b[i]);
+            }
+            boost::ut::expect(ok) << jitome::to_string(isa);
+        }
+        boost::ut::expect(jitome::is_supported(jitome::host_isa()));
+    };
+
+    "power"_test = []
+    {
+        // x^8 is 3 multiplications. x^2 and x^4 are shared with the other terms.
+        const auto prog = jitome::lower(std::get<jitome::NodeFunction>(
+            jitome::parse(jitome::tokenize("(x) {x^8 + x^4 - x^2}").as_val()).as_val().node));
+        const auto muls = std::count_if(prog.code.begin(), prog.code.end(),
+            [](const auto& inst) {return inst.op == jitome::Opcode::Mul;});
+        boost::ut::expect(muls == 3) << jitome::dump(prog);
+
+        const auto inv = jitome::lower(std::get<jitome::NodeFunction>(
+            jitome::parse(jitome::tokenize("(x) {x^-5}").as_val()).as_val().node));
+        const auto divs = std::count_if(inv.code.begin(), inv.code.end(),
+            [](const auto& inst) {return inst.op == jitome::Opcode::Div;});
+        boost::ut::expect(divs == 1) << jitome::dump(inv);
+
+        const double xs[] = {0.0, -0.0, 1.1, -0.7, 3.0, 1e-3, 1e10};
+        for(const auto n : {0, 1, 2, 3, 7, 8, 15, 31, 64, -1, -2, -7})
+        {
+            const auto code = "(x, y) {y * x^" + std::to_string(n) + " + x}";
+            auto tks = jitome::tokenize(code);
+            auto prs = jitome::parse(tks.as_val());
+            const auto root = prs.as_val();
+
+            jitome::JitCompiler<double(double, double)> f(root);
+            for(const double x : xs)
+            {
+                std::map<std::string, double> env{{"x", x}, {"y", 0.5}};
+                const auto ref = jitome::evaluate(env, root);
+                boost::ut::expect(f(x, 0.5) == ref || (std::isnan(ref) && std::isnan(f(x, 0.5))))
+                    << code << " at " << x;
+            }
+            if(n == 7)
+            {
+                boost::ut::expect(f(1.1, 1.0) == jitome::powi(1.1, 7) + 1.1);
+            }
+
+            jitome::JitBatchCompiler g(root);
+            const std::size_t len = 13;
+            std::vector<double> x(len), y(len, 0.25), out(len, 0.0);
+            for(std::size_t i=0; i<len; ++i)
+            {
+                x[i] = 0.25 * i - 1.5;
+            }
+            const double* columns[] = {x.data(), y.data()};
+            g(columns, out.data(), len);
+            bool ok = true;
+            for(std::size_t i=0; i<len; ++i)
+            {
+                std::map<std::string, double> env{{"x", x[i]}, {"y", 0.25}};
+                const auto ref = jitome::evaluate(env, root);
+                ok = ok && (out[i] == ref || (std::isnan(ref) && std::isnan(out[i])));
+            }
+            boost::ut::expect(ok) << code;
+        }
+    };
+
+    "multi"_test = []
+    {
+        const std::vector<std::string> codes = {
+            "(s, k, t) {s * t - k}",
+            "(s, k, t) {(s * t - k) * (s * t - k)}",
+            "(s, k, t) {t}",
+            "(s, k, t) {2.5}",
+            "(s, k, t) {sqrt(s * t) / k}",
+        };
+        const auto ref = [](const double s, const double k, const double t) {
+            return std::vector<double>{s * t - k, (s * t - k) * (s * t - k), t, 2.5,
+                                       std::sqrt(s * t) / k};
+        };
+
+        using jitome::Isa;
+        for(const auto isa : {Isa::SSE2, Isa::AVX, Isa::AVX512})
+        {
+            if(!jitome::is_supported(isa))
+            {
+                continue;
+            }
+            jitome::CompileOptions options;
+            options.isa = isa;
+
+            jitome::JitMultiCompiler<void(double*, double, double, double)> f(codes, options);
+            boost::ut::expect(f.outputs() == codes.size());
+            std::vector<double> out(codes.size(), 0.0);
+            f(out.data(), 1.5, 0.25, 4.0);
+            boost::ut::expect(out == ref(1.5, 0.25, 4.0)) << jitome::to_string(isa);
+
+            jitome::JitMultiBatchCompiler g(codes, options);
+            boost::ut::expect(g.arity() == 3);
+            boost::ut::expect(g.outputs() == codes.size());
+
+            const std::size_t n = 21;
+            std::vector<double> s(n), k(n), t(n);
+            std::vector<std::vector<double>> outs(codes.size(), std::vector<double>(n, 0.0));
+            for(std::size_t i=0; i<n; ++i)
+            {
+                s[i] = 1.0 + 0.5 * i;
+                k[i] = 2.0 - 0.125 * i;
+                t[i] = 0.25 * i;
+            }
+            const double* columns[] = {s.data(), k.data(), t.data()};
+            std::vector<double*> out_columns;
+            for(auto& o : outs) {out_columns.push_back(o.data());}
+            g(columns, out_columns.data(), n);
+
+            bool ok = true;
+            for(std::size_t i=0; i<n; ++i)
+            {
+                const auto r = ref(s[i], k[i], t[i]);
+                for(std::size_t j=0; j<codes.size(); ++j)
+                {
+                    ok = ok && outs[j][i] == r[j];
+                }
+            }
+            boost::ut::expect(ok) << jitome::to_string(isa);
+        }
+
+        // the argument lists should be the same
+        boost::ut::expect(boost::ut::throws([] {
+                const std::vector<std::string> codes = {"(a, b) {a}", "(a, c) {a}"};
+                jitome::JitMultiCompiler<void(double*, double, double)> f(codes);
+            }));
+    };
+
+    "multi_spill"_test = []
+    {
+        // more outputs than registers. Each one is stored as soon as it is computed.
+        std::vector<std::string> codes;
+        for(std::size_t i=0; i<30; ++i)
+        {
+            codes.push_back("(a, b) {a * " + std::to_string(i) + " + b}");
+        }
+        jitome::JitMultiCompiler<void(double*, double, double)> f(codes);
+        std::vector<double> out(codes.size(), 0.0);
+        f(out.data(), 1.5, -2.0);
+
+        bool ok = true;
+        for(std::size_t i=0; i<codes.size(); ++i)
+        {
+            ok = ok && out[i] == 1.5 * static_cast<double>(i) - 2.0;
+        }
+        boost::ut::expect(ok);
+    };
+
+    "float"_test = []
+    {
+        const std::string code = "(a, b) {(a - b) * (a + 2) / (b * b + 1) - a}";
+        const auto ref = [](const auto a, const auto b) {return (a - b) * (a + 2) / (b * b + 1) - a;};
+
+        const std::size_t n = 37;
+        std::vector<float> a(n), b(n);
+        for(std::size_t i=0; i<n; ++i)
+        {
+            a[i] = 0.75f * i - 3.0f;
+            b[i] = 1.0f / (i + 1.0f);
+        }
+        const float* columns[] = {a.data(), b.data()};
+
+        using jitome::Isa;
+        for(const auto isa : {Isa::SSE2, Isa::AVX, Isa::AVX512})
+        {
+            if(!jitome::is_supported(isa))
+            {
+                continue;
+            }
+            jitome::CompileOptions options;
+            options.isa = isa;
+
+            // computed in float
+            jitome::JitCompiler<float(float, float)> f(code, options);
+            jitome::BasicJitBatchCompiler<float> g(code, options);
+            boost::ut::expect(g.lanes() == (isa == Isa::SSE2 ? 1u : isa == Isa::AVX ? 8u : 16u));
+
+            // computed in double
+            jitome::JitCompiler<double(float, float)> h(code, options);
+            jitome::JitCompiler<float(double, double)> k(code, options);
+            jitome::BasicJitBatchCompiler<float, double> p(code, options);
+            jitome::BasicJitBatchCompiler<double, float> q(code, options);
+            boost::ut::expect(p.lanes() == (isa == Isa::SSE2 ? 1u : isa == Isa::AVX ? 4u : 8u));
+
+            std::vector<float>  out_g(n), out_q(n);
+            std::vector<double> out_p(n), da(a.begin(), a.end()), db(b.begin(), b.end());
+            const double* dcolumns[] = {da.data(), db.data()};
+            g(columns,  out_g.data(), n);
+            p(columns,  out_p.data(), n);
+            q(dcolumns, out_q.data(), n);
+
+            bool ok = true;
+            for(std::size_t i=0; i<n; ++i)
+            {
+                const float  single = ref(a[i], b[i]);
+                const double mixed  = ref(da[i], db[i]);
+                ok = ok && f(a[i], b[i]) == single && out_g[i] == single;
+                ok = ok && h(a[i], b[i]) == mixed  && out_p[i] == mixed;
+                ok = ok && k(da[i], db[i]) == static_cast<float>(mixed) &&
+                           out_q[i] == static_cast<float>(mixed);
+            }
+            boost::ut::expect(ok) << jitome::to_string(isa);
+        }
+    };
+
+    "float_many_args"_test = []
+    {
+        // the last two are passed on the stack
+        const std::string code = "(a, b, c, d, e, f, g, h, i, j) {a - b*c + d/e - f*g + h - i*j}";
+        jitome::JitCompiler<float(float, float, float, float, float, float, float, float, float, float)>
+            f(code);
+        jitome::JitCompiler<double(float, float, float, float, float, float, float, float, float, float)>
+            g(code);
+
+        const float x[] = {1.5f, 2.0f, -3.25f, 4.0f, 0.3f, -6.0f, 7.5f, 8.0f, 9.25f, -0.1f};
+        const auto ref = [&x](const auto zero) {
+            using T = decltype(zero);
+            const auto v = [&x](const std::size_t i) {return static_cast<T>(x[i]);};
+            return v(0) - v(1)*v(2) + v(3)/v(4) - v(5)*v(6) + v(7) - v(8)*v(9);
+        };
+        boost::ut::expect(f(x[0], x[1], x[2], x[3], x[4], x[5], x[6], x[7], x[8], x[9]) == ref(0.0f));
+        boost::ut::expect(g(x[0], x[1], x[2], x[3], x[4], x[5], x[6], x[7], x[8], x[9]) == ref(0.0));
+    };
+
+    "locals"_test = []
+    {
+        const std::string code = "(a, b) { t = a*b + 1; u = t*t - t; t = u / b; return t + u; }";
+        auto tks = jitome::tokenize(code);
+        auto prs = jitome::parse(tks.as_val());
+        const auto root = prs.as_val();
+
+        jitome::JitCompiler<double(double, double)> f(root);
+        jitome::JitBatchCompiler g(root);
+
+        // a local is computed once
+        const auto prog = jitome::lower(std::get<jitome::NodeFunction>(root.node));
+        const auto muls = std::count_if(prog.code.begin(), prog.code.end(),
+            [](const jitome::Instruction& inst) {return inst.op == jitome::Opcode::Mul;});
+        boost::ut::expect(muls == 2);
+
+        const std::size_t n = 11;
+        std::vector<double> a(n), b(n), out(n);
+        for(std::size_t i=0; i<n; ++i)
+        {
+            a[i] = 0.5 * i - 2.0;
+            b[i] = 1.0 + 0.25 * i;
+        }
+        const double* columns[] = {a.data(), b.data()};
+        g(columns, out.data(), n);
+
+        bool ok = true;
+        for(std::size_t i=0; i<n; ++i)
+        {
+            std::map<std::string, double> env{{"a", a[i]}, {"b", b[i]}};
+            const double ref = jitome::evaluate(env, root);
+            ok = ok && f(a[i], b[i]) == ref && out[i] == ref;
+        }
+        boost::ut::expect(ok);
+    };
+
+    "rows"_test = []
+    {
+        struct Quote {double bid, ask, size, pad;};
+        const std::string code = "(bid, ask, size) {(ask - bid) * size + bid / ask}";
+        const auto ref = [](const Quote& q) {return (q.ask - q.bid) * q.size + q.bid / q.ask;};
+
+        const std::size_t n = 37;
+        std::vector<Quote> quotes(n);
+        for(std::size_t i=0; i<n; ++i)
+        {
+            quotes[i] = Quote{100.0 + 0.5 * i, 100.25 + 0.75 * i, 10.0 - 0.125 * i, -1.0};
+        }
+        const jitome::RowLayout layout{sizeof(Quote),
+            {offsetof(Quote, bid), offsetof(Quote, ask), offsetof(Quote, size)}};
+
+        // a single column is contiguous
+        std::vector<double> xs(n);
+        for(std::size_t i=0; i<n; ++i)
+        {
+            xs[i] = 0.5 * i - 3.0;
+        }
+
+        using jitome::Isa;
+        for(const auto isa : {Isa::SSE2, Isa::AVX, Isa::AVX512})
+        {
+            if(!jitome::is_supported(isa))
+            {
+                continue;
+            }
+            jitome::CompileOptions options;
+            options.isa = isa;
+
+            jitome::JitRowBatchCompiler f(code, layout, options);
+            boost::ut::expect(f.lanes() == jitome::batch_lanes(isa));
+            std::vector<double> out(n, 0.0);
+            f(quotes.data(), out.data(), n);
+
+            // keeps more values alive, next to the temporary register of AVX
+            jitome::JitRowBatchCompiler g("(a, b) {a*1.5 + b*2.5 + (a+b)*(a-b) + a/b + (a*b - 3)/(a + 4)}",
+                jitome::RowLayout{sizeof(Quote), {offsetof(Quote, size), offsetof(Quote, bid)}}, options);
+            std::vector<double> out_g(n, 0.0);
+            g(quotes.data(), out_g.data(), n);
+
+            jitome::JitRowBatchCompiler h("(x) {x * x - 1}", jitome::RowLayout{sizeof(double), {0}}, options);
+            std::vector<double> out_h(n, 0.0);
+            h(xs.data(), out_h.data(), n);
+
+            bool ok = true;
+            for(std::size_t i=0; i<n; ++i)
+            {
+                const double a = quotes[i].size, b = quotes[i].bid;
+                ok = ok && out[i] == ref(quotes[i]);
+                ok = ok && out_g[i] == a*1.5 + b*2.5 + (a+b)*(a-b) + a/b + (a*b - 3)/(a + 4);
+                ok = ok && out_h[i] == xs[i] * xs[i] - 1;
+            }
+            boost::ut::expect(ok) << jitome::to_string(isa);
+        }
+
+        const jitome::RowLayout wrong{sizeof(Quote), {0}};
+        boost::ut::expect(boost::ut::throws([&] {jitome::JitRowBatchCompiler f(code, wrong);}));
+    };
+
+    "reduce"_test = []
+    {
+        using jitome::Isa;
+        using jitome::Reduction;
+        const double inf = std::numeric_limits<double>::infinity();
+        for(const auto isa : {Isa::SSE2, Isa::AVX, Isa::AVX512})
+        {
+            if(!jitome::is_supported(isa))
+            {
+                continue;
+            }
+            jitome::CompileOptions options;
+            options.isa = isa;
+            jitome::JitReduceCompiler dot("(a, b) {a * b}", Reduction::Sum, options);
+            jitome::JitReduceCompiler mean("(x, y) {x * x - 3 * y}", Reduction::Mean, options);
+            jitome::JitReduceCompiler min("(x, y) {log(x) + y}", Reduction::Min, options);
+            jitome::JitReduceCompiler max("(x, y) {log(x) + y}", Reduction::Max, options);
+            jitome::JitReduceCompiler sum("(x, y) {sin(x) * y}", Reduction::Sum, options);
+
+            for(const std::size_t n : {0u, 1u, 3u, 7u, 8u, 31u, 32u, 33u, 100u, 1003u})
+            {
+                // integers, so that the sums are exact in any order
+                std::vector<double> x(n), y(n);
+                for(std::size_t i=0; i<n; ++i)
+                {
+                    x[i] = static_cast<double>((i * 7) % 23) - 5.0;
+                    y[i] = static_cast<double>((i * 5) % 11) + 1.0;
+                }
+                const double* columns[] = {x.data(), y.data()};
+
+                double ref_dot = 0.0, ref_mean = 0.0, ref_sum = 0.0, ref_min = inf, ref_max = -inf;
+                for(std::size_t i=0; i<n; ++i)
+                {
+                    ref_dot  += x[i] * y[i];
+                    ref_mean += x[i] * x[i] - 3 * y[i];
+                    ref_sum  += std::sin(x[i]) * y[i];
+                    if(0.0 <= x[i]) // NaN is skipped
+                    {
+                        ref_min = std::min(ref_min, std::log(x[i]) + y[i]);
+                        ref_max = std::max(ref_max, std::log(x[i]) + y[i]);
+                    }
+                }
+                ref_mean /= static_cast<double>(n);
+
+                boost::ut::expect(dot(columns, n) == ref_dot) << jitome::to_string(isa) << n;
+                boost::ut::expect(mean(columns, n) == ref_mean || (n == 0 && std::isnan(mean(columns, n))))
+                    << jitome::to_string(isa) << n;
+                boost::ut::expect(std::fabs(min(columns, n) - ref_min) <= 1e-15 * std::fabs(ref_min) ||
+                                  min(columns, n) == ref_min) << jitome::to_string(isa) << n;
+                boost::ut::expect(std::fabs(max(columns, n) - ref_max) <= 1e-15 * std::fabs(ref_max) ||
+                                  max(columns, n) == ref_max) << jitome::to_string(isa) << n;
+                boost::ut::expect(std::fabs(sum(columns, n) - ref_sum) <= 1e-13 * (1.0 + n))
+                    << jitome::to_string(isa) << n;
+
+                // the order of the additions is fixed
+                boost::ut::expect(sum(columns, n) == sum(columns, n));
+            }
+        }
+        boost::ut::expect(boost::ut::throws([] {
+                jitome::JitReduceCompiler f("(x) {y}", Reduction::Sum);
+            }));
+    };
+
+    "schedule"_test = []
+    {
+        const std::string code = "(a, b, c, d, e) {sqrt(a) * (sqrt(b) - (sqrt(c) / (sqrt(d) + sqrt(e))))}";
+        jitome::JitCompiler<double(double, double, double, double, double)> f(code);
+        jitome::JitBatchCompiler g(code);
+        boost::ut::expect(f.peak_registers() <= 3u) << f.peak_registers();
+        boost::ut::expect(g.peak_registers() <= 3u) << g.peak_registers();
+
+        const double ref = std::sqrt(2.0) * (std::sqrt(3.0) - (std::sqrt(5.0) / (std::sqrt(7.0) + std::sqrt(11.0))));
+        boost::ut::expect(f(2.0, 3.0, 5.0, 7.0, 11.0) == ref);
+    };
+
+    "reciprocal"_test = []
+    {
+        jitome::JitCompiler<double(double)> exact("(x) {x / 8 + x * 2}");
+        jitome::JitBatchCompiler batch("(x) {x / 8 + x * 2}");
+        jitome::CompileOptions options;
+        options.reciprocal = true;
+        jitome::JitCompiler<double(double)> approx("(x) {x / 10}", options);
+
+        std::vector<double> xs = {0.0, -0.0, 1.0, 3.0, 1e-310, 0x1p-1074, 1e308, -7.25};
+        std::vector<double> out(xs.size());
+        const double* columns[] = {xs.data()};
+        batch(columns, out.data(), xs.size());
+        bool ok = true;
+        for(std::size_t i=0; i<xs.size(); ++i)
+        {
+            const double x = xs[i];
+            ok = ok && exact(x) == x / 8 + x * 2 && out[i] == x / 8 + x * 2;
+            ok = ok && approx(x) == x * (1.0 / 10);
+        }
+        boost::ut::expect(ok);
+        boost::ut::expect(jitome::dump(options) != jitome::dump(jitome::CompileOptions{}));
+    };
+
+    "fast_math"_test = []
+    {
+        using jitome::Isa;
+
+        // |actual - expect| in units of the machine epsilon, relative to |expect|
+        const auto divergence = [](const double actual, const double expect, const double eps) {
+            return std::fabs(actual - expect) / (std::fabs(expect) * eps);
+        };
+
+        const std::size_t n = 1001;
+        std::vector<double> a(n), b(n), c(n), d(n);
+        for(std::size_t i=0; i<n; ++i)
+        {
+            a[i] = 1.0 + 0.001 * i;
+            b[i] = 3.0 / (i + 1.0);
+            c[i] = 0.1 * i + 1e-3;
+            d[i] = 7.0 - 0.005 * i;
+        }
+        const double* columns[] = {a.data(), b.data(), c.data(), d.data()};
+
+        // reassociation: a sum or a product of k positive values has at most
+        // k - 1 roundings in any order, so the two differ by 2 (k - 1) eps.
+        {
+            const std::string code = "(a, b, c, d) {a + b + c + d + 1 + a * b * c * d * 3}";
+            jitome::CompileOptions options;
+            options.reassociate = true;
+            jitome::JitBatchCompiler strict(code), fast(code, options);
+            std::vector<double> expect(n), actual(n);
+            strict(columns, expect.data(), n);
+            fast  (columns, actual.data(), n);
+            double worst = 0.0;
+            for(std::size_t i=0; i<n; ++i)
+            {
+                worst = std::max(worst, divergence(actual[i], expect[i], 0x1p-52));
+            }
+            boost::ut::expect(worst <= 8.0) << worst;
+        }
+
+        // rcp and rsqrt with Newton steps
+        for(const auto isa : {Isa::SSE2, Isa::AVX, Isa::AVX512})
+        {
+            if(!jitome::is_supported(isa))
+            {
+                continue;
+            }
+            const std::string code = "(a, b) {a / b + a / sqrt(b) - 1 / (a + b)}";
+            jitome::CompileOptions strict;
+            strict.isa = isa;
+            auto options = strict;
+            options.approx_division = true;
+
+            jitome::JitBatchCompiler exact_d(code, strict), fast_d(code, options);
+            jitome::JitCompiler<double(double, double)> scalar_d(code, options);
+            std::vector<double> expect(n), actual(n);
+            exact_d(columns, expect.data(), n);
+            fast_d (columns, actual.data(), n);
+            double worst = 0.0;
+            for(std::size_t i=0; i<n; ++i)
+            {
+                worst = std::max({worst, divergence(actual[i], expect[i], 0x1p-52),
+                                         divergence(scalar_d(a[i], b[i]), expect[i], 0x1p-52)});
+            }
+            // double has no rcp before AVX-512 and the division is kept
+            boost::ut::expect(isa == Isa::AVX512 ? worst <= 4.0 : worst == 0.0) << worst;
+
+            std::vector<float> af(a.begin(), a.end()), bf(b.begin(), b.end());
+            const float* columns_f[] = {af.data(), bf.data()};
+            jitome::BasicJitBatchCompiler<float> exact_f(code, strict), fast_f(code, options);
+            jitome::JitCompiler<float(float, float)> scalar_f(code, options);
+            std::vector<float> expect_f(n), actual_f(n);
+            exact_f(columns_f, expect_f.data(), n);
+            fast_f (columns_f, actual_f.data(), n);
+            worst = 0.0;
+            for(std::size_t i=0; i<n; ++i)
+            {
+                worst = std::max({worst, divergence(actual_f[i], expect_f[i], 0x1p-23),
+                                         divergence(scalar_f(af[i], bf[i]), expect_f[i], 0x1p-23)});
+            }
+            boost::ut::expect(worst <= 4.0) << worst;
+
+            // a row gives the same result in the packed loop and in the
+            // scalar loop for the rest, whatever n % lanes is
+            const auto lanes = fast_f.lanes();
+            std::vector<float> at(2 * lanes - 1), bt(2 * lanes - 1), out_t(2 * lanes - 1);
+            for(std::size_t i=0; i<at.size(); ++i)
+            {
+                at[i] = af[(i % lanes) * 7];
+                bt[i] = bf[(i % lanes) * 7];
+            }
+            const float* columns_t[] = {at.data(), bt.data()};
+            fast_f(columns_t, out_t.data(), out_t.size());
+            bool same = true;
+            for(std::size_t i=lanes; i<out_t.size(); ++i)
+            {
+                same = same && out_t[i] == out_t[i - lanes] && scalar_f(at[i], bt[i]) == out_t[i];
+            }
+            boost::ut::expect(same) << jitome::to_string(isa);
+        }
+
+        // no_nans and no_infs only drop the special cases. Inside the domain
+        // the result is the same.
+        {
+            const std::string code = "(x) {log(x) + sin(x) - cos(x) + (x - x) + x / x}";
+            for(const auto flags : {1, 2, 3})
+            {
+                jitome::CompileOptions options;
+                options.no_nans = (flags & 1) != 0;
+                options.no_infs = (flags & 2) != 0;
+                jitome::JitBatchCompiler strict(code), fast(code, options);
+                std::vector<double> expect(n), actual(n);
+                strict(columns + 2, expect.data(), n);
+                fast  (columns + 2, actual.data(), n);
+                boost::ut::expect(actual == expect) << flags;
+            }
+        }
+
+        // no_signed_zeros: the same value, except that the sign of a zero
+        // may differ
+        {
+            const std::string code = "(x) {(x + 0) * (0 - x)}";
+            jitome::CompileOptions options;
+            options.no_signed_zeros = true;
+            jitome::JitCompiler<double(double)> strict(code), fast(code, options);
+            for(const double x : {-0.0, 0.0, 1.5, -2.25, 1e-310})
+            {
+                boost::ut::expect(fast(x) == strict(x)) << x;
+            }
+            boost::ut::expect(std::signbit(fast(-0.0)) && !std::signbit(strict(-0.0)));
+        }
+    };
+
+    "conditions"_test = []
+    {
+        using jitome::Isa;
+        const std::vector<std::string> codes = {
+            "(x, y) {x < y ? x * 2 : y - 1}",
+            "(x, y) {(x <= y) + 2 * (x == y) + 4 * (x != y) + 8 * (x >= y) + 16 * (x > y)}",
+            "(x, y) {(x > 0 && y > 0) || x == y ? 1 : 0 - 1}",
+            "(x, y) {select(x - y, x, y) + select(x && y, 10, 20)}",
+            "(x, y) {clamp(x, 0 - 1, 1) + min(x, y) * max(x, 2)}",
+            "(x, y) {clamp(x, y, 4) + (x > y) * (x - y)}",
+        };
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        const double inf = std::numeric_limits<double>::infinity();
+        const std::vector<double> values = {-2.0, -0.0, 0.0, 0.5, 1.0, 3.0, inf, -inf, nan};
+        std::vector<double> xs, ys;
+        for(const auto x : values)
+        {
+            for(const auto y : values)
+            {
+                xs.push_back(x);
+                ys.push_back(y);
+            }
+        }
+        const std::size_t n = xs.size();
+        std::vector<float> xf(xs.begin(), xs.end()), yf(ys.begin(), ys.end());
+        const double* columns[]   = {xs.data(), ys.data()};
+        const float*  columns_f[] = {xf.data(), yf.data()};
+        const auto same = [](const double a, const double b) {
+            return (std::isnan(a) && std::isnan(b)) || a == b;
+        };
+
+        for(const auto& code : codes)
+        {
+            auto tks = jitome::tokenize(code);
+            auto prs = jitome::parse(tks.as_val());
+            boost::ut::expect(prs.is_ok()) << code;
+            const auto& func = std::get<jitome::NodeFunction>(prs.as_val().node);
+            std::vector<double> expect(n);
+            for(std::size_t i=0; i<n; ++i)
+            {
+                std::map<std::string, double> env{{"x", xs[i]}, {"y", ys[i]}};
+                expect[i] = jitome::evaluate(env, func.body);
+            }
+
+            for(const auto isa : {Isa::SSE2, Isa::AVX, Isa::AVX512})
+            {
+                if(!jitome::is_supported(isa))
+                {
+                    continue;
+                }
+                jitome::CompileOptions options;
+                options.isa = isa;
+                jitome::JitCompiler<double(double, double)> f(code, options);
+                jitome::JitBatchCompiler g(code, options);
+                jitome::BasicJitBatchCompiler<float> h(code, options);
+                // no branch, so the batch kernels are packed
+                boost::ut::expect(g.lanes() == jitome::batch_lanes(isa)) << code;
+
+                std::vector<double> out(n);
+                std::vector<float>  out_f(n);
+                g(columns, out.data(), n);
+                h(columns_f, out_f.data(), n);
+                bool ok = true;
+                for(std::size_t i=0; i<n; ++i)
+                {
+                    // the values are exact in float as well
+                    ok = ok && same(f(xs[i], ys[i]), expect[i]) && same(out[i], expect[i]) &&
+                         same(out_f[i], expect[i]);
+                }
+                boost::ut::expect(ok) << code << jitome::to_string(isa);
+            }
+        }
+
+        // a comparison used as a condition is not converted into 1 or 0
+        auto tks = jitome::tokenize("(x, y) {x < y && y < 3 ? x : y}");
+        auto prs = jitome::parse(tks.as_val());
+        const auto prog = jitome::lower(std::get<jitome::NodeFunction>(prs.as_val().node));
+        const auto count = [&prog](const jitome::Opcode op) {
+            return std::count_if(prog.code.begin(), prog.code.end(),
+                                 [op](const jitome::Instruction& inst) {return inst.op == op;});
+        };
+        boost::ut::expect(count(jitome::Opcode::Less) == 2 && count(jitome::Opcode::And) == 2 &&
+                          count(jitome::Opcode::NotEqual) == 0) << jitome::dump(prog);
+    };
+
+    "guard_page"_test = []
+    {
+        // The last element of a column is followed by a page that cannot be
+        // read. A bitwise operation must not read it as a 16-byte operand.
+        using jitome::Isa;
+        const std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        void* mem = ::mmap(nullptr, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        boost::ut::expect(mem != MAP_FAILED);
+        ::mprotect(static_cast<char*>(mem) + page, page, PROT_NONE);
+        const auto last = [mem, page](auto zero) {
+            using T = decltype(zero);
+            return reinterpret_cast<T*>(static_cast<char*>(mem) + page - sizeof(T));
+        };
+
+        const std::vector<std::string> codes = {
+            "(b, a) {select(b < a, b, a)}",
+            "(b, a) {b < 1 || a > 1 ? b : a}",
+            "(b, a) {(b != a) * 3 - (a == 2)}",
+        };
+        for(const auto& code : codes)
+        {
+            for(const auto isa : {Isa::SSE2, Isa::AVX, Isa::AVX512})
+            {
+                if(!jitome::is_supported(isa))
+                {
+                    continue;
+                }
+                jitome::CompileOptions options;
+                options.isa = isa;
+                jitome::JitBatchCompiler          g(code, options);
+                jitome::BasicJitBatchCompiler<float> h(code, options);
+                jitome::JitReduceCompiler         r(code, jitome::Reduction::Sum, options);
+
+                double b = 2.0;
+                float  bf = 2.0f;
+                *last(0.0)  = 2.0;
+                *last(0.0f) = 2.0f;
+                const double* columns[]   = {&b,  last(0.0)};
+                const float*  columns_f[] = {&bf, last(0.0f)};
+                double out   = 1.0;
+                float  out_f = 1.0f;
+                g(columns, &out, 1);
+                h(columns_f, &out_f, 1);
+                const double sum = r(columns, 1);
+
+                std::map<std::string, double> env{{"a", 2.0}, {"b", 2.0}};
+                auto tks = jitome::tokenize(code);
+                auto prs = jitome::parse(tks.as_val());
+                const auto expect = jitome::evaluate(env, prs.as_val());
+                boost::ut::expect(out == expect && out_f == expect && sum == expect)
+                    << code << jitome::to_string(isa);
+            }
+        }
+        ::munmap(mem, 2 * page);
+    };
 }
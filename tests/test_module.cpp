@@ -0,0 +1,78 @@
+#include "jitome/module.hpp"
+#include <boost/ut.hpp>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main()
+{
+    using namespace boost::ut::literals;
+
+    "compile"_test = []
+    {
+        jitome::JitModule mod;
+        auto add = mod.compile<double(double, double)>("(a, b) {a + b}");
+        auto mul = mod.compile<double(double, double)>("(a, b) {a * b * 2.5}");
+
+        boost::ut::expect(add(1.5, 2.0) == 3.5);
+        boost::ut::expect(mul(1.5, 2.0) == 7.5);
+        boost::ut::expect(mod.size() == 2);
+        boost::ut::expect(mod.code_bytes() == add.size + mul.size);
+        boost::ut::expect(mod.code_bytes() <= mod.used_bytes());
+
+        double (*f)(double, double) = add;
+        boost::ut::expect(f(0.25, 0.5) == 0.75);
+
+        boost::ut::expect(boost::ut::throws([&] {mod.compile<double(double)>("(a) {a +}");}));
+    };
+
+    "packing"_test = []
+    {
+        jitome::JitModule mod(4096);
+        std::vector<jitome::JitFunction<double(double)>> fs;
+        for(int i=0; i<200; ++i)
+        {
+            fs.push_back(mod.compile<double(double)>(
+                    "(x) {x * " + std::to_string(i) + " + 0.5}", 32));
+        }
+        bool ok = true;
+        for(int i=0; i<200; ++i)
+        {
+            const auto addr = reinterpret_cast<std::uintptr_t>(fs[i].get_func_ptr());
+            ok = ok && (addr % 32 == 0) && fs[i](2.0) == 2.0 * i + 0.5;
+        }
+        boost::ut::expect(ok);
+
+        // functions share pages instead of having their own buffer
+        boost::ut::expect(mod.reserved_bytes() < 200 * 4096);
+        boost::ut::expect(mod.used_bytes() <= mod.reserved_bytes());
+
+        boost::ut::expect(boost::ut::throws([&] {mod.compile<double(double)>("(x) {x}", 24);}));
+    };
+
+    "batch"_test = []
+    {
+        jitome::JitModule mod;
+        auto f = mod.compile_batch("(a, b) {a * b - 1}");
+        auto g = mod.compile_batch("(a, b) {a / b + 3}");
+
+        const std::size_t n = 19;
+        std::vector<double> a(n), b(n), x(n), y(n);
+        for(std::size_t i=0; i<n; ++i)
+        {
+            a[i] = 0.5 * i;
+            b[i] = 1.0 + i;
+        }
+        const double* columns[] = {a.data(), b.data()};
+        f(columns, x.data(), n);
+        g(columns, y.data(), n);
+
+        bool ok = true;
+        for(std::size_t i=0; i<n; ++i)
+        {
+            ok = ok && x[i] == a[i] * b[i] - 1 && y[i] == a[i] / b[i] + 3;
+        }
+        boost::ut::expect(ok);
+    };
+}
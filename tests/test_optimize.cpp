@@ -0,0 +1,322 @@
+#include "jitome/ast.hpp"
+#include "jitome/eval.hpp"
+#include "jitome/optimize.hpp"
+#include "jitome/parser.hpp"
+#include <boost/ut.hpp>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <string>
+
+jitome::Node parse_code(const std::string& code)
+{
+    auto tks = jitome::tokenize(code);
+    auto prs = jitome::parse(tks.as_val());
+    return std::get<jitome::NodeFunction>(prs.as_val().node).body.get();
+}
+
+double eval_xy(const jitome::Node& node, const double x, const double y)
+{
+    std::map<std::string, double> env{{"x", x}, {"y", y}};
+    return jitome::evaluate(env, node);
+}
+
+bool same_bits(const double lhs, const double rhs)
+{
+    return (std::isnan(lhs) && std::isnan(rhs)) ||
+           (lhs == rhs && std::signbit(lhs) == std::signbit(rhs));
+}
+
+int main()
+{
+    using namespace boost::ut::literals;
+    using namespace std::literals::string_view_literals;
+
+    "fold"_test = []
+    {
+        jitome::SimplifyReport report;
+        const auto node = jitome::simplify(parse_code("(x, y) {x * 1 + 0 * y + 2 * 3}"), report);
+
+        // x * 1 -> x, 2 * 3 -> 6. 0 * y is kept because y may be inf or NaN.
+        const jitome::Node expected{jitome::NodeExpression{"+"sv,
+            jitome::NodeExpression{"+"sv,
+                jitome::NodeVariable{"x"},
+                jitome::NodeExpression{"*"sv,
+                    jitome::NodeImmediate{0.0},
+                    jitome::NodeVariable{"y"}
+                }
+            },
+            jitome::NodeImmediate{6.0}
+        }};
+        boost::ut::expect(node == expected) << jitome::dump(node);
+        boost::ut::expect(report.folded     == 1);
+        boost::ut::expect(report.identities == 1);
+        boost::ut::expect(report.changed());
+
+        const auto nothing = jitome::simplify(parse_code("(x, y) {x * y + 1}"), report);
+        boost::ut::expect(!report.changed());
+        boost::ut::expect(nothing == parse_code("(x, y) {x * y + 1}"));
+    };
+
+    "signed_zero"_test = []
+    {
+        jitome::SimplifyReport report;
+        const auto x = jitome::Node{jitome::NodeVariable{"x"}};
+
+        // x + 0.0 is not x if x is -0.0
+        const auto plus_zero = jitome::simplify(parse_code("(x) {x + 0.0}"), report);
+        boost::ut::expect(!report.changed());
+        boost::ut::expect(std::holds_alternative<jitome::NodeExpression>(plus_zero.node));
+
+        const auto minus_zero = jitome::simplify(parse_code("(x) {x - 0.0}"), report);
+        boost::ut::expect(report.identities == 1);
+        boost::ut::expect(minus_zero == x);
+
+        // x + (-0.0) -> x. the parser does not support negative literal
+        jitome::Node plus_neg_zero{jitome::NodeExpression{"+"sv,
+            jitome::NodeVariable{"x"},
+            jitome::NodeExpression{"-"sv, jitome::NodeImmediate{0.0}}
+        }};
+        boost::ut::expect(jitome::simplify(plus_neg_zero, report) == x);
+        boost::ut::expect(report.folded == 1);
+        boost::ut::expect(report.identities == 1);
+    };
+
+    "negation"_test = []
+    {
+        jitome::SimplifyReport report;
+        const auto x = jitome::Node{jitome::NodeVariable{"x"}};
+
+        jitome::Node negneg{jitome::NodeExpression{"-"sv,
+            jitome::NodeExpression{"-"sv, jitome::NodeVariable{"x"}}
+        }};
+        boost::ut::expect(jitome::simplify(negneg, report) == x);
+        boost::ut::expect(report.negations == 1);
+
+        // x - (-y) -> x + y
+        jitome::Node sub_neg{jitome::NodeExpression{"-"sv,
+            jitome::NodeVariable{"x"},
+            jitome::NodeExpression{"-"sv, jitome::NodeVariable{"y"}}
+        }};
+        const jitome::Node add{jitome::NodeExpression{"+"sv,
+            jitome::NodeVariable{"x"}, jitome::NodeVariable{"y"}
+        }};
+        boost::ut::expect(jitome::simplify(sub_neg, report) == add);
+        boost::ut::expect(report.negations == 1);
+
+        // x * -1 -> -x, and then -(-x) -> x
+        jitome::Node mul_m1{jitome::NodeExpression{"-"sv,
+            jitome::NodeExpression{"*"sv,
+                jitome::NodeVariable{"x"},
+                jitome::NodeExpression{"-"sv, jitome::NodeImmediate{1.0}}
+            }
+        }};
+        boost::ut::expect(jitome::simplify(mul_m1, report) == x);
+        boost::ut::expect(report.total() == 3);
+    };
+
+    "power"_test = []
+    {
+        jitome::SimplifyReport report;
+        const auto x = jitome::Node{jitome::NodeVariable{"x"}};
+
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {x^1}"), report) == x);
+        boost::ut::expect(report.identities == 1);
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {x^0}"), report) ==
+                          jitome::Node{jitome::NodeImmediate{1.0}});
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {2^-3 + 1.5^4}"), report) ==
+                          jitome::Node{jitome::NodeImmediate{0.125 + 5.0625}});
+        boost::ut::expect(report.folded == 3);
+
+        // (-x)^4 -> x^4, but (-x)^3 is kept
+        const jitome::Node neg_x{jitome::NodeExpression{"-"sv, jitome::NodeVariable{"x"}}};
+        const jitome::Node even{jitome::NodeExpression{"^"sv, neg_x, jitome::NodeImmediate{4.0}}};
+        const jitome::Node odd {jitome::NodeExpression{"^"sv, neg_x, jitome::NodeImmediate{3.0}}};
+        boost::ut::expect(jitome::simplify(even, report) ==
+            jitome::Node{jitome::NodeExpression{"^"sv, x, jitome::NodeImmediate{4.0}}});
+        boost::ut::expect(report.negations == 1);
+        boost::ut::expect(jitome::simplify(odd, report) == odd);
+        boost::ut::expect(!report.changed());
+    };
+
+    "builtin"_test = []
+    {
+        jitome::SimplifyReport report;
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {sqrt(4) + max(2, 3)}"), report) ==
+                          jitome::Node{jitome::NodeImmediate{5.0}});
+        boost::ut::expect(report.folded == 3);
+
+        // calls with a variable are kept
+        const auto call = parse_code("(x, y) {exp(x)}");
+        boost::ut::expect(jitome::simplify(call, report) == call);
+        boost::ut::expect(!report.changed());
+
+        // conditions on constants
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {(1 < 2) + (3 == 3 && 0 || 1 != 1)}"),
+                          report) == jitome::Node{jitome::NodeImmediate{1.0}});
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {2 > 1 ? exp(x) : y}"), report) == call);
+        boost::ut::expect(report.folded == 1 && report.identities == 1);
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {clamp(5, 0, 1)}")) ==
+                          jitome::Node{jitome::NodeImmediate{1.0}});
+    };
+
+    "bit_identical"_test = []
+    {
+        const double inf = std::numeric_limits<double>::infinity();
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        const double values[] = {0.0, -0.0, 1.0, -2.5, 1e-310, 0x1p-1074, 1.5e308, inf, -inf, nan};
+
+        const jitome::Node y{jitome::NodeVariable{"y"}};
+        const jitome::Node neg_y{jitome::NodeExpression{"-"sv, jitome::NodeVariable{"y"}}};
+        const jitome::Node neg_zero{jitome::NodeExpression{"-"sv, jitome::NodeImmediate{0.0}}};
+
+        const jitome::Node exprs[] = {
+            parse_code("(x, y) {x * 1 + y / 1 - 0}"),
+            parse_code("(x, y) {(x + 0) * (0 * y) + 0}"),
+            parse_code("(x, y) {1 * x / (2 - 1) * (y - 0.0)}"),
+            parse_code("(x, y) {x^1 * y^0 + x^2}"),
+            jitome::Node{jitome::NodeExpression{"-"sv, neg_zero, jitome::NodeVariable{"x"}}},
+            jitome::Node{jitome::NodeExpression{"+"sv, neg_y, jitome::NodeVariable{"x"}}},
+            jitome::Node{jitome::NodeExpression{"*"sv, neg_y, neg_y}},
+            jitome::Node{jitome::NodeExpression{"^"sv, neg_y, jitome::NodeImmediate{4.0}}},
+            jitome::Node{jitome::NodeExpression{"/"sv, neg_y,
+                jitome::NodeExpression{"-"sv, jitome::NodeVariable{"x"}}}},
+            jitome::Node{jitome::NodeExpression{"+"sv, neg_zero,
+                jitome::NodeExpression{"-"sv, jitome::NodeVariable{"x"}, y}}},
+            parse_code("(x, y) {x * 2 + 2 * (x - y) + y / 8 + x / 0.25 + x / 2^-126}"),
+            parse_code("(x, y) {(x < y) * 1 + (0 < 1 ? x : y) + select(x - 0, y, x) * (x != 0)}"),
+        };
+        for(const auto& expr : exprs)
+        {
+            const auto simplified = jitome::simplify(expr);
+            for(const double x : values)
+            {
+                for(const double yv : values)
+                {
+                    const auto ref = eval_xy(expr, x, yv);
+                    const auto opt = eval_xy(simplified, x, yv);
+                    boost::ut::expect(same_bits(ref, opt))
+                        << jitome::dump(expr) << " at " << x << ", " << yv;
+                }
+            }
+        }
+    };
+
+    "strength"_test = []
+    {
+        jitome::SimplifyReport report;
+        const jitome::Node x{jitome::NodeVariable{"x"}};
+        const auto x_plus_x = jitome::Node{jitome::NodeExpression{"+"sv, x, x}};
+        const auto x_times  = [&x](const double c) {
+            return jitome::Node{jitome::NodeExpression{"*"sv, x, jitome::NodeImmediate{c}}};
+        };
+
+        boost::ut::expect(jitome::simplify(parse_code("(x) {x * 2}"), report) == x_plus_x);
+        boost::ut::expect(jitome::simplify(parse_code("(x) {2 * x}"), report) == x_plus_x);
+        boost::ut::expect(report.strength == 1);
+        boost::ut::expect(jitome::simplify(parse_code("(x) {x / 1024}"), report) == x_times(1.0 / 1024));
+        boost::ut::expect(jitome::simplify(parse_code("(x) {x / 0.5}"),  report) == x_times(2.0));
+        boost::ut::expect(report.strength == 1);
+
+        // other divisors are kept by default
+        for(const auto code : {"(x) {x / 1000}", "(x) {x / 0}", "(x) {2 / x}"})
+        {
+            const auto node = parse_code(code);
+            boost::ut::expect(jitome::simplify(node, report) == node) << code;
+            boost::ut::expect(!report.changed());
+        }
+        // 2^-130 is subnormal in float
+        jitome::simplify(parse_code("(x) {x / 2^-130}"), report);
+        boost::ut::expect(report.folded == 1 && report.strength == 0);
+
+        jitome::SimplifyOptions options;
+        options.reciprocal = true;
+        boost::ut::expect(jitome::simplify(parse_code("(x) {x / 1000}"), report, options) ==
+                          x_times(1.0 / 1000));
+        boost::ut::expect(report.strength == 1);
+        const auto zero = parse_code("(x) {x / 0}");
+        boost::ut::expect(jitome::simplify(zero, options) == zero);
+        const auto huge = parse_code("(x) {x / 1e-310}"); // 1 / 1e-310 overflows
+        boost::ut::expect(jitome::simplify(huge, options) == huge);
+    };
+
+    "fast_math"_test = []
+    {
+        jitome::SimplifyReport report;
+        const jitome::SimplifyOptions strict;
+
+        // none of them is applied by default
+        for(const auto code : {"(x, y) {((x + 1) + y) + 2}", "(x, y) {x * y * x * y}",
+                               "(x, y) {x + 0}", "(x, y) {0 - x}", "(x, y) {x - x}",
+                               "(x, y) {(x * y) / (x * y)}", "(x, y) {x * 0}"})
+        {
+            const auto node = parse_code(code);
+            boost::ut::expect(jitome::simplify(node, report, strict) == node) << code;
+            boost::ut::expect(!report.changed()) << code;
+        }
+
+        jitome::SimplifyOptions reassociate;
+        reassociate.reassociate = true;
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {((x + 1) + y) + 2}"), report, reassociate) ==
+                          parse_code("(x, y) {(x + y) + 3}"));
+        boost::ut::expect(report.fast_math != 0);
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {x * y * x * y}"), reassociate) ==
+                          parse_code("(x, y) {(x * y) * (x * y)}"));
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {4 * x * 0.25 * y}"), reassociate) ==
+                          parse_code("(x, y) {x * y}"));
+        // x + 0 is not x for x = -0
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {(x + 1) + (0 - 1)}"), reassociate) ==
+                          parse_code("(x, y) {x + 0}"));
+        const auto balanced = parse_code("(x, y) {(x + y) + (x - y)}");
+        jitome::simplify(balanced, report, reassociate);
+        boost::ut::expect(!report.changed());
+
+        // a long chain is flattened once at its top, not at every level
+        std::string chain = "x";
+        for(std::size_t i=0; i<500; ++i)
+        {
+            chain += (i % 2 == 0) ? " + y" : " + x";
+        }
+        const auto flat = jitome::simplify(parse_code("(x, y) {" + chain + "}"), report, reassociate);
+        boost::ut::expect(report.fast_math == 1);
+        boost::ut::expect(jitome::simplify(flat, report, reassociate) == flat);
+        boost::ut::expect(!report.changed());
+
+        jitome::SimplifyOptions nsz;
+        nsz.no_signed_zeros = true;
+        const auto x = parse_code("(x, y) {x}");
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {x + 0}"), nsz) == x);
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {0 + x}"), nsz) == x);
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {x - 0 * (0 - 1)}"), report, nsz) == x);
+        boost::ut::expect(report.fast_math == 1);
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {0 - x * y}"), nsz) ==
+                          jitome::Node{jitome::NodeExpression{"-"sv, parse_code("(x, y) {x * y}")}});
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {x * 0}"), nsz) ==
+                          parse_code("(x, y) {x * 0}"));
+
+        jitome::SimplifyOptions no_nans;
+        no_nans.no_nans = true;
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {x * y - x * y}"), no_nans) ==
+                          parse_code("(x, y) {0}"));
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {sqrt(x) / sqrt(x)}"), no_nans) ==
+                          parse_code("(x, y) {1}"));
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {x - y}"), no_nans) ==
+                          parse_code("(x, y) {x - y}"));
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {x * 0}"), no_nans) ==
+                          parse_code("(x, y) {x * 0}"));
+        no_nans.no_signed_zeros = true;
+        boost::ut::expect(jitome::simplify(parse_code("(x, y) {0 * (x + y)}"), no_nans) ==
+                          parse_code("(x, y) {0}"));
+
+        // evaluate() agrees in the assumed domain
+        const auto node = parse_code("(x, y) {(x + y) * 3 + (x * 0.5 - x) * y + (y - y) + 0 - 1}");
+        jitome::SimplifyOptions all;
+        all.reassociate = all.no_nans = all.no_signed_zeros = true;
+        const auto fast = jitome::simplify(node, all);
+        for(const double v : {-3.0, 0.5, 7.25})
+        {
+            const double expect = eval_xy(node, v, 2.0 * v);
+            boost::ut::expect(std::fabs(eval_xy(fast, v, 2.0 * v) - expect) <= 4e-16 * std::fabs(expect));
+        }
+    };
+}
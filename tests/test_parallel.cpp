@@ -0,0 +1,160 @@
+#include "jitome/jit.hpp"
+#include "jitome/parallel.hpp"
+#include <boost/ut.hpp>
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main()
+{
+    using namespace boost::ut::literals;
+
+    "pool"_test = []
+    {
+        jitome::ThreadPool pool(3);
+        boost::ut::expect(pool.size() == 3u);
+
+        std::vector<std::thread::id> ids(10);
+        pool.run(ids.size(), [&ids](const std::size_t i) {ids[i] = std::this_thread::get_id();});
+        for(std::size_t i=0; i<ids.size(); ++i)
+        {
+            boost::ut::expect(ids[i] == ids[i % 3]) << i; // task i runs on worker i % 3
+        }
+        boost::ut::expect(ids[0] != ids[1] && ids[1] != ids[2]);
+
+        std::atomic<std::size_t> count{0};
+        boost::ut::expect(boost::ut::throws<std::runtime_error>([&] {
+                pool.run(7, [&count](const std::size_t i) {
+                    count += 1;
+                    if(i == 4) {throw std::runtime_error("task");}
+                });
+            }));
+        pool.run(0, [](std::size_t) {});
+        pool.run(5, [&count](std::size_t) {count += 1;});
+        boost::ut::expect(count.load() == 12u);
+
+        // a pinned worker is bound to one CPU before its first task
+        jitome::ThreadPool pinned(2, true);
+        std::atomic<std::size_t> bound{0};
+        pinned.run(4, [&count, &bound](std::size_t) {
+            count += 1;
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            if(::pthread_getaffinity_np(::pthread_self(), sizeof(set), &set) == 0 && CPU_COUNT(&set) == 1)
+            {
+                bound += 1;
+            }
+        });
+        boost::ut::expect(count.load() == 16u);
+        boost::ut::expect(bound.load() == 4u);
+    };
+
+    "evaluate"_test = []
+    {
+        jitome::JitBatchCompiler f("(a, b) {sqrt(a * a + b) - exp(b)}");
+        jitome::JitRowBatchCompiler g("(a, b) {sqrt(a * a + b) - exp(b)}",
+                                      jitome::RowLayout{2 * sizeof(double), {0, sizeof(double)}});
+        const std::vector<std::string> codes = {"(a, b) {a + b}", "(a, b) {a * b}"};
+        jitome::JitMultiBatchCompiler h(codes);
+
+        for(const std::size_t threads : {1u, 3u, 4u})
+        {
+            jitome::ThreadPool pool(threads);
+            for(const std::size_t n : {0u, 1u, 99u, 1000u, 4097u})
+            {
+                std::vector<double> a(n), b(n), rows(2 * n);
+                for(std::size_t i=0; i<n; ++i)
+                {
+                    a[i] = 0.25 * i;
+                    b[i] = 1.0 / (i + 1);
+                    rows[2 * i] = a[i];
+                    rows[2 * i + 1] = b[i];
+                }
+                const double* columns[] = {a.data(), b.data()};
+
+                std::vector<double> serial(n), out(n), out_rows(n), sum(n), prod(n);
+                f(columns, serial.data(), n);
+
+                jitome::first_touch(pool, out.data(), n, 100);
+                jitome::parallel_evaluate(pool, f, columns, out.data(), n, 100);
+                jitome::parallel_evaluate(pool, g, rows.data(), out_rows.data(), n, 64);
+                double* outs[] = {sum.data(), prod.data()};
+                jitome::parallel_evaluate(pool, h, columns, outs, n, 33);
+
+                bool ok = true;
+                for(std::size_t i=0; i<n; ++i)
+                {
+                    ok = ok && out[i] == serial[i] && out_rows[i] == serial[i];
+                    ok = ok && sum[i] == a[i] + b[i] && prod[i] == a[i] * b[i];
+                }
+                boost::ut::expect(ok) << threads << n;
+            }
+        }
+
+        // more columns than OffsetColumns keeps on the stack
+        std::string args, body;
+        for(std::size_t k=0; k<20; ++k)
+        {
+            args += (k == 0 ? "x" : ", x") + std::to_string(k);
+            body += (k == 0 ? "x" : " + x") + std::to_string(k);
+        }
+        jitome::JitBatchCompiler wide("(" + args + ") {" + body + "}");
+        const std::size_t n = 1000;
+        std::vector<std::vector<double>> xs(20, std::vector<double>(n));
+        std::vector<const double*> columns;
+        for(std::size_t k=0; k<xs.size(); ++k)
+        {
+            for(std::size_t i=0; i<n; ++i) {xs[k][i] = 0.5 * i + k;}
+            columns.push_back(xs[k].data());
+        }
+        std::vector<double> serial(n), out(n);
+        wide(columns.data(), serial.data(), n);
+        jitome::ThreadPool pool(3);
+        jitome::parallel_evaluate(pool, wide, columns.data(), out.data(), n, 64);
+        boost::ut::expect(out == serial);
+    };
+
+    "reduce"_test = []
+    {
+        using jitome::Reduction;
+        jitome::JitReduceCompiler sum ("(x) {sin(x)}", Reduction::Sum);
+        jitome::JitReduceCompiler mean("(x) {x * 2}",  Reduction::Mean);
+        jitome::JitReduceCompiler max ("(x) {cos(x)}", Reduction::Max);
+
+        const std::size_t n = 10007;
+        std::vector<double> x(n);
+        for(std::size_t i=0; i<n; ++i)
+        {
+            x[i] = 0.001 * i;
+        }
+        const double* columns[] = {x.data()};
+
+        double ref_sum = 0.0, ref_max = -2.0;
+        for(const auto v : x)
+        {
+            ref_sum += std::sin(v);
+            ref_max = std::max(ref_max, std::cos(v));
+        }
+
+        jitome::ThreadPool one(1);
+        const double expect = jitome::parallel_reduce(one, sum, columns, n, 512);
+        boost::ut::expect(std::fabs(expect - ref_sum) <= 1e-10);
+        for(const std::size_t threads : {2u, 3u, 8u})
+        {
+            // the same for any number of threads
+            jitome::ThreadPool pool(threads);
+            boost::ut::expect(jitome::parallel_reduce(pool, sum, columns, n, 512) == expect);
+            boost::ut::expect(jitome::parallel_reduce(pool, max, columns, n, 512) == ref_max);
+            const double m = jitome::parallel_reduce(pool, mean, columns, n, 1000);
+            boost::ut::expect(std::fabs(m - 0.001 * (n - 1)) <= 1e-12);
+            boost::ut::expect(jitome::parallel_reduce(pool, mean, columns, 0, 1000) !=
+                              jitome::parallel_reduce(pool, mean, columns, 0, 1000)); // NaN
+        }
+        boost::ut::expect(boost::ut::throws([&] {jitome::parallel_reduce(one, sum, columns, n, 0);}));
+    };
+}
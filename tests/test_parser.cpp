@@ -128,4 +128,185 @@ int main()
             std::cout << jitome::dump(actual.as_val()) << std::endl;
         }
     };
+
+    "power"_test = []
+    {
+        jitome::Node expect{
+            jitome::NodeFunction{
+                std::string(""),
+                std::vector<std::string>{std::string("x")},
+                jitome::Node{
+                    jitome::NodeExpression{"-"sv,
+                        jitome::NodeExpression{"*"sv,
+                            jitome::NodeImmediate{2.0},
+                            jitome::NodeExpression{"^"sv,
+                                jitome::NodeVariable{"x"},
+                                jitome::NodeImmediate{3.0}
+                            }
+                        },
+                        jitome::NodeExpression{"^"sv,
+                            jitome::NodeExpression{"+"sv,
+                                jitome::NodeVariable{"x"},
+                                jitome::NodeImmediate{1.0}
+                            },
+                            jitome::NodeImmediate{-2.0}
+                        }
+                    }
+                }
+            }
+        };
+        auto tks = jitome::tokenize("(x){2 * x^3 - (x + 1) ^ -2}");
+        boost::ut::expect(tks.is_ok());
+        auto actual = jitome::parse(std::move(tks.as_val()));
+        boost::ut::expect(actual.is_ok());
+        if(actual.is_err())
+        {
+            std::cout << actual.as_err().msg << std::endl;
+        }
+        boost::ut::expect(expect == actual.as_val());
+
+        // the exponent should be an integer immediate
+        for(const auto code : {"x^2.5", "x^y", "x^(2)", "x^2^3", "x^1e3", "x^", "x^99999999999"})
+        {
+            auto t = jitome::tokenize(code);
+            boost::ut::expect(t.is_ok());
+            boost::ut::expect(jitome::parse(std::move(t.as_val())).is_err()) << code;
+        }
+    };
+
+    "call"_test = []
+    {
+        jitome::Node expect{
+            jitome::NodeFunction{
+                std::string(""),
+                std::vector<std::string>{std::string("x"), std::string("y")},
+                jitome::Node{
+                    jitome::NodeExpression{"max"sv,
+                        jitome::NodeExpression{"sqrt"sv,
+                            jitome::NodeExpression{"+"sv,
+                                jitome::NodeVariable{"x"},
+                                jitome::NodeImmediate{1.0}
+                            }
+                        },
+                        jitome::NodeVariable{"y"}
+                    }
+                }
+            }
+        };
+        auto tks = jitome::tokenize("(x, y){max(sqrt(x + 1), y)}");
+        boost::ut::expect(tks.is_ok());
+        auto actual = jitome::parse(std::move(tks.as_val()));
+        boost::ut::expect(actual.is_ok());
+        if(actual.is_err())
+        {
+            std::cout << actual.as_err().msg << std::endl;
+        }
+        boost::ut::expect(expect == actual.as_val());
+
+        // unknown functions and wrong number of arguments
+        for(const auto code : {"foo(x)", "sqrt()", "sqrt(x, x)", "min(x)", "exp(x", "max(x,)"})
+        {
+            auto t = jitome::tokenize(code);
+            boost::ut::expect(t.is_ok());
+            boost::ut::expect(jitome::parse(std::move(t.as_val())).is_err()) << code;
+        }
+    };
+
+    "statements"_test = []
+    {
+        jitome::NodeFunction func{
+            std::string(""),
+            std::vector<std::string>{std::string("a"), std::string("b")},
+            jitome::Node{
+                jitome::NodeExpression{"-"sv,
+                    jitome::NodeExpression{"*"sv,
+                        jitome::NodeVariable{"t"},
+                        jitome::NodeVariable{"t"}
+                    },
+                    jitome::NodeVariable{"t"}
+                }
+            }
+        };
+        func.locals.push_back(jitome::NodeLocal{"t", jitome::Node{
+            jitome::NodeExpression{"+"sv,
+                jitome::NodeExpression{"*"sv,
+                    jitome::NodeVariable{"a"},
+                    jitome::NodeVariable{"b"}
+                },
+                jitome::NodeImmediate{1.0}
+            }
+        }});
+        const jitome::Node expect{std::move(func)};
+
+        // a statement without assignment is dropped
+        for(const auto code : {"(a, b) { t = a*b + 1; return t*t - t; }",
+                               "(a, b) {a; t = a*b + 1; return t*t - t;}"})
+        {
+            auto tks = jitome::tokenize(code);
+            boost::ut::expect(tks.is_ok());
+            auto actual = jitome::parse(std::move(tks.as_val()));
+            boost::ut::expect(actual.is_ok()) << code;
+            if(actual.is_err())
+            {
+                std::cout << actual.as_err().msg << std::endl;
+                continue;
+            }
+            boost::ut::expect(expect == actual.as_val()) << jitome::dump(actual.as_val());
+        }
+
+        for(const auto code : {"(a) {t = a; t}", "(a) {t = a;}", "(a) {return a}",
+                               "(a) {t = ; return t;}", "(a) {t = a return t;}",
+                               "(a) {return a; a;}", "(a) {t = a;"})
+        {
+            auto t = jitome::tokenize(code);
+            boost::ut::expect(t.is_ok());
+            boost::ut::expect(jitome::parse(std::move(t.as_val())).is_err()) << code;
+        }
+    };
+
+    "conditions"_test = []
+    {
+        using jitome::NodeExpression;
+        using jitome::NodeImmediate;
+        using jitome::NodeVariable;
+        const auto parse_body = [](const std::string& code) {
+            auto tks = jitome::tokenize(code);
+            auto prs = jitome::parse(std::move(tks.as_val()));
+            if(prs.is_err())
+            {
+                std::cout << prs.as_err().msg << std::endl;
+            }
+            return std::get<jitome::NodeFunction>(prs.as_val().node).body.get();
+        };
+
+        // the same precedence as C
+        const jitome::Node expect{NodeExpression{"select"sv,
+            NodeExpression{"||"sv,
+                NodeExpression{"&&"sv,
+                    NodeExpression{"<"sv,
+                        NodeExpression{"+"sv, NodeVariable{"x"}, NodeImmediate{1.0}},
+                        NodeVariable{"y"}},
+                    NodeExpression{">="sv, NodeVariable{"y"}, NodeImmediate{3.0}}},
+                NodeExpression{"!="sv,
+                    NodeExpression{"<="sv, NodeVariable{"x"}, NodeVariable{"y"}},
+                    NodeImmediate{0.0}}},
+            NodeVariable{"x"},
+            NodeExpression{"*"sv, NodeVariable{"y"}, NodeImmediate{2.0}}}};
+        const auto actual = parse_body("(x, y) {x + 1 < y && y >= 3 || x <= y != 0 ? x : y * 2}");
+        boost::ut::expect(expect == actual) << jitome::dump(actual);
+        boost::ut::expect(parse_body("(x, y) {select(x + 1 < y && y >= 3 || x <= y != 0, x, y * 2)}") == expect);
+
+        // `?:` is right-associative
+        const jitome::Node nested{NodeExpression{"select"sv, NodeVariable{"x"}, NodeImmediate{1.0},
+            NodeExpression{"select"sv, NodeVariable{"y"}, NodeImmediate{2.0}, NodeImmediate{3.0}}}};
+        boost::ut::expect(parse_body("(x, y) {x ? 1 : y ? 2 : 3}") == nested);
+
+        for(const auto code : {"(x) {x ? 1}", "(x) {x < }", "(x) {x ? : 1}", "(x) {x ? 1 ; 2}",
+                               "(x) {select(x, 1)}", "(x) {clamp(x, 1)}", "(x) {x && }"})
+        {
+            auto t = jitome::tokenize(code);
+            boost::ut::expect(t.is_ok());
+            boost::ut::expect(jitome::parse(std::move(t.as_val())).is_err()) << code;
+        }
+    };
 }
@@ -0,0 +1,109 @@
+#include "jitome/persistent_cache.hpp"
+#include <boost/ut.hpp>
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main()
+{
+    using namespace boost::ut::literals;
+
+    const std::string path = "jitome_test_cache_" + std::to_string(::getpid()) + ".bin";
+    std::remove(path.c_str());
+
+    "save_and_load"_test = [&]
+    {
+        {
+            jitome::PersistentCache cache(path);
+            boost::ut::expect(cache.loaded() == 0);
+
+            auto f = cache.compile<double(double, double)>("(a, b) {a * b + 2.5}");
+            cache.compile_batch("(a, b) {a / b - 1}");
+            boost::ut::expect(f(2.0, 3.0) == 8.5);
+            boost::ut::expect(cache.misses() == 2);
+
+            cache.compile<double(double, double)>("(a, b) {a * b + 2.5}");
+            boost::ut::expect(cache.hits() == 1);
+            cache.save();
+        }
+
+        jitome::PersistentCache cache(path);
+        boost::ut::expect(cache.loaded() == 2);
+
+        auto f = cache.compile<double(double, double)>("(a, b) {a * b + 2.5}");
+        auto g = cache.compile_batch("(a, b) {a / b - 1}");
+        boost::ut::expect(cache.hits()   == 2);
+        boost::ut::expect(cache.misses() == 0);
+        boost::ut::expect(f(2.0, 3.0) == 8.5);
+
+        const std::size_t n = 11;
+        std::vector<double> a(n), b(n), out(n);
+        for(std::size_t i=0; i<n; ++i)
+        {
+            a[i] = 1.0 * i;
+            b[i] = 0.5 + i;
+        }
+        const double* columns[] = {a.data(), b.data()};
+        g(columns, out.data(), n);
+        bool ok = true;
+        for(std::size_t i=0; i<n; ++i)
+        {
+            ok = ok && out[i] == a[i] / b[i] - 1;
+        }
+        boost::ut::expect(ok);
+
+        // the same source with another signature is another function
+        auto h = cache.compile<double(double, double, double)>("(a, b) {a * b + 2.5}");
+        boost::ut::expect(cache.misses() == 1);
+        boost::ut::expect(h(2.0, 3.0, 0.0) == 8.5);
+
+        // new functions are added to the existing ones
+        jitome::Node root = jitome::parse(jitome::tokenize("(x) {x - 1}").as_val()).as_val();
+        auto k = cache.compile<double(double)>(root);
+        boost::ut::expect(k(3.0) == 2.0);
+        cache.save();
+
+        jitome::PersistentCache reloaded(path);
+        boost::ut::expect(reloaded.loaded() == 4);
+        jitome::Node renamed = jitome::parse(jitome::tokenize("(y) {y - 1}").as_val()).as_val();
+        boost::ut::expect(reloaded.compile<double(double)>(renamed)(5.0) == 4.0);
+        boost::ut::expect(reloaded.hits() == 1);
+    };
+
+    "invalid_file"_test = [&]
+    {
+        {
+            std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+            ofs << "this is not a cache file, but it is long enough for a header";
+        }
+        jitome::PersistentCache cache(path);
+        boost::ut::expect(cache.loaded() == 0);
+        boost::ut::expect(cache.compile<double(double)>("(x) {x * 2}")(4.0) == 8.0);
+        cache.save();
+
+        jitome::PersistentCache reloaded(path);
+        boost::ut::expect(reloaded.loaded() == 1);
+    };
+
+    "other_codegen"_test = [&]
+    {
+        // a file written by another code generator is not executed. The
+        // codegen_version follows magic, version, count and features.
+        {
+            std::fstream fs(path, std::ios::binary | std::ios::in | std::ios::out);
+            fs.seekg(24);
+            const char c = static_cast<char>(fs.get());
+            fs.seekp(24);
+            fs.put(static_cast<char>(~c));
+        }
+        jitome::PersistentCache cache(path);
+        boost::ut::expect(cache.loaded() == 0);
+        boost::ut::expect(cache.compile<double(double)>("(x) {x * 2}")(4.0) == 8.0);
+        boost::ut::expect(cache.misses() == 1);
+    };
+
+    std::remove(path.c_str());
+}
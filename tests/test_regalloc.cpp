@@ -0,0 +1,311 @@
+#include "jitome/eval.hpp"
+#include "jitome/ir.hpp"
+#include "jitome/parser.hpp"
+#include "jitome/regalloc.hpp"
+#include <boost/ut.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+jitome::Program lower_code(const std::string& code)
+{
+    auto tks = jitome::tokenize(code);
+    auto prs = jitome::parse(tks.as_val());
+    return jitome::lower(std::get<jitome::NodeFunction>(prs.as_val().node));
+}
+
+int main()
+{
+    using namespace boost::ut::literals;
+
+    "lower"_test = []
+    {
+        const auto prog = lower_code("(a, b) {a - b * 2}");
+
+        boost::ut::expect(prog.arity == 2);
+        boost::ut::expect(prog.code.size() == 5);
+        boost::ut::expect(prog.code.at(0).op == jitome::Opcode::Argument);
+        boost::ut::expect(prog.code.at(1).op == jitome::Opcode::Argument);
+        boost::ut::expect(prog.code.at(2).op == jitome::Opcode::Constant);
+        boost::ut::expect(prog.code.at(3).op == jitome::Opcode::Mul);
+        boost::ut::expect(prog.code.at(4).op == jitome::Opcode::Sub);
+        boost::ut::expect(prog.code.at(4).operands.at(0) == 0);
+        boost::ut::expect(prog.code.at(4).operands.at(1) == 3);
+        boost::ut::expect(prog.result == 4);
+    };
+
+    "hash_consing"_test = []
+    {
+        // a*b is computed once, and so is a*b + 1. b*a is the same as a*b.
+        const auto prog = lower_code("(a, b) {(a*b + 1) * (a*b + 1) / (b*a)}");
+
+        std::size_t muls = 0;
+        for(const auto& inst : prog.code)
+        {
+            if(inst.op == jitome::Opcode::Mul) {muls += 1;}
+        }
+        // a, b, a*b, 1, a*b+1, (a*b+1)^2, /
+        boost::ut::expect(prog.code.size() == 7) << jitome::dump(prog);
+        boost::ut::expect(muls == 2);
+        boost::ut::expect(prog.merged == 4);
+
+        // the shared value is kept in a register until its last use
+        jitome::RegisterAllocatorConfig config;
+        const auto alloc = jitome::allocate_registers(prog, config);
+        boost::ut::expect(alloc.spill_slots == 0);
+        boost::ut::expect(alloc.loads == 0);
+
+        // 0.0 and -0.0 are different values
+        using namespace std::literals::string_literals;
+        using namespace std::literals::string_view_literals;
+        const jitome::NodeFunction func{"", std::vector{"a"s},
+            jitome::Node{jitome::NodeExpression{"+"sv,
+                jitome::NodeExpression{"*"sv, jitome::NodeVariable{"a"}, jitome::NodeImmediate{ 0.0}},
+                jitome::NodeExpression{"*"sv, jitome::NodeVariable{"a"}, jitome::NodeImmediate{-0.0}}
+            }}
+        };
+        const auto zeros = jitome::lower(func);
+        boost::ut::expect(zeros.merged == 0) << jitome::dump(zeros);
+        boost::ut::expect(zeros.code.size() == 6);
+    };
+
+    "outputs"_test = []
+    {
+        // a*b is shared between the two functions and stored twice
+        std::vector<jitome::NodeFunction> funcs;
+        for(const auto code : {"(a, b) {a*b + 1}", "(a, b) {a*b - b}", "(a, b) {b*a}"})
+        {
+            auto tks = jitome::tokenize(code);
+            funcs.push_back(std::get<jitome::NodeFunction>(jitome::parse(tks.as_val()).as_val().node));
+        }
+        const auto prog = jitome::lower(funcs);
+        const auto muls = std::count_if(prog.code.begin(), prog.code.end(),
+                [](const jitome::Instruction& inst) {return inst.op == jitome::Opcode::Mul;});
+        boost::ut::expect(muls == 1) << jitome::dump(prog);
+        boost::ut::expect(prog.outputs == 3);
+        boost::ut::expect(prog.result == jitome::Program::npos);
+        boost::ut::expect(prog.code.back().op == jitome::Opcode::Output);
+        boost::ut::expect(prog.code.back().index == 2);
+
+        // outputs are not removed as dead code
+        boost::ut::expect(jitome::eliminate_dead_code(prog).code.size() == prog.code.size());
+
+        jitome::RegisterAllocatorConfig config;
+        const auto alloc = jitome::allocate_registers(prog, config);
+        boost::ut::expect(alloc.spill_slots == 0);
+        boost::ut::expect(!alloc.result.is_register());
+
+        std::vector<double> values;
+        const double args[] = {3.0, 2.0};
+        double out[3] = {};
+        jitome::evaluate(prog, args, out, values);
+        boost::ut::expect(out[0] == 7.0 && out[1] == 4.0 && out[2] == 6.0);
+
+        funcs.back().args = {"b", "a"};
+        boost::ut::expect(boost::ut::throws([&] {jitome::lower(funcs);}));
+    };
+
+    "no_spill"_test = []
+    {
+        const auto prog = lower_code("(a, b, c) {a + b * c}");
+
+        jitome::RegisterAllocatorConfig config;
+        config.three_operand = false;
+        const auto sse = jitome::allocate_registers(prog, config);
+        boost::ut::expect(sse.spill_slots == 0);
+        boost::ut::expect(sse.stores == 0);
+        boost::ut::expect(sse.moves  == 0);
+
+        // arguments are loaded from memory and used as memory operands
+        config.three_operand          = true;
+        config.arguments_in_registers = false;
+        const auto avx = jitome::allocate_registers(prog, config);
+        boost::ut::expect(avx.spill_slots == 0);
+        boost::ut::expect(avx.loads == 2);
+        boost::ut::expect(avx.moves == 0);
+    };
+
+    "result_register"_test = []
+    {
+        const auto prog = lower_code("(a, b) {b - a * b}");
+
+        jitome::RegisterAllocatorConfig config;
+        config.three_operand   = true;
+        config.result_register = 0;
+        const auto alloc = jitome::allocate_registers(prog, config);
+        boost::ut::expect(alloc.result == jitome::Location::reg(0)) << jitome::dump(prog, alloc);
+        boost::ut::expect(alloc.moves == 0);
+    };
+
+    "constant_operand"_test = []
+    {
+        const auto prog = lower_code("(a) {a * 2 + 3}");
+
+        jitome::RegisterAllocatorConfig config;
+        config.constants_in_memory = true;
+        const auto mem = jitome::allocate_registers(prog, config);
+        boost::ut::expect(mem.loads == 0);
+        boost::ut::expect(mem.ops.size() == 2);
+
+        config.constants_in_memory = false;
+        const auto reg = jitome::allocate_registers(prog, config);
+        boost::ut::expect(reg.loads == 2);
+    };
+
+    "spill"_test = []
+    {
+        // a * 1 + (a * 2 + (... + a)) keeps all the products alive
+        std::string code("(a) {");
+        std::string close;
+        for(std::size_t i=1; i<=20; ++i)
+        {
+            code  += "a * " + std::to_string(i) + " + (";
+            close += ")";
+        }
+        code += "a" + close + "}";
+        const auto prog = lower_code(code);
+
+        jitome::RegisterAllocatorConfig config;
+        config.registers = 4;
+        const auto alloc = jitome::allocate_registers(prog, config);
+        boost::ut::expect(alloc.spill_slots != 0);
+        boost::ut::expect(alloc.stores != 0);
+        boost::ut::expect(alloc.result.is_register());
+
+        // every register is at most 4
+        bool ok = true;
+        for(const auto& op : alloc.ops)
+        {
+            if(op.dst.is_register())
+            {
+                ok = ok && op.dst.index < 4;
+            }
+        }
+        boost::ut::expect(ok);
+        if(!ok)
+        {
+            std::cout << jitome::dump(prog, alloc) << std::endl;
+        }
+    };
+
+    "contract"_test = []
+    {
+        using jitome::Opcode;
+        const auto count = [](const jitome::Program& prog, const Opcode op) {
+            return std::count_if(prog.code.begin(), prog.code.end(),
+                    [op](const jitome::Instruction& inst) {return inst.op == op;});
+        };
+
+        const auto muladd = jitome::contract(lower_code("(a, b, c) {a * b + c * 2 - a / c}"));
+        // one of the products remains as the addend
+        boost::ut::expect(count(muladd, Opcode::Mul)    == 1) << jitome::dump(muladd);
+        boost::ut::expect(count(muladd, Opcode::MulAdd) == 1);
+        boost::ut::expect(count(muladd, Opcode::Sub)    == 1);
+
+        const auto sub = jitome::contract(lower_code("(a, b, c) {c - a * b}"));
+        boost::ut::expect(count(sub, Opcode::NegMulAdd) == 1) << jitome::dump(sub);
+        boost::ut::expect(sub.code.size() == 4);
+
+        const auto mulsub = jitome::contract(lower_code("(a, b, c) {a * b - c}"));
+        boost::ut::expect(count(mulsub, Opcode::MulSub) == 1) << jitome::dump(mulsub);
+
+        // the product is used twice, so it is kept
+        const auto shared = jitome::contract(lower_code("(a, b, c) {(a * b + c) / (a * b)}"));
+        boost::ut::expect(count(shared, Opcode::Mul)    == 1) << jitome::dump(shared);
+        boost::ut::expect(count(shared, Opcode::MulAdd) == 0);
+    };
+
+    "fma_spill"_test = []
+    {
+        // a * 1 + (a * 2 + (... + a)) becomes a chain of FMAs
+        std::string code("(a, b) {");
+        std::string close;
+        for(std::size_t i=1; i<=20; ++i)
+        {
+            code  += "(a - " + std::to_string(i) + ") * (b + " + std::to_string(i) + ") + (";
+            close += ")";
+        }
+        code += "a" + close + "}";
+        const auto prog = jitome::contract(lower_code(code));
+
+        for(const bool vex : {false, true})
+        {
+            jitome::RegisterAllocatorConfig config;
+            config.registers     = 4;
+            config.three_operand = vex;
+            const auto alloc = jitome::allocate_registers(prog, config);
+            boost::ut::expect(alloc.spill_slots != 0);
+
+            // FMA overwrites one of its operands
+            bool ok = true;
+            for(const auto& op : alloc.ops)
+            {
+                if(op.kind != jitome::MachineOp::Kind::Compute ||
+                   !jitome::is_fma(prog.code.at(op.inst).op))
+                {
+                    continue;
+                }
+                const auto tied = std::count(op.src.begin(), op.src.end(), op.dst);
+                const auto mem  = std::count_if(op.src.begin(), op.src.end(),
+                        [](const jitome::Location& l) {return !l.is_register();});
+                ok = ok && 1 <= tied && mem <= 1;
+                ok = ok && (op.src.at(2) == op.dst || op.src.at(0) == op.dst || op.src.at(1) == op.dst);
+                // if a factor is overwritten, only the addend can be in memory
+                if(op.src.at(2) != op.dst)
+                {
+                    ok = ok && op.src.at(0).is_register() && op.src.at(1).is_register();
+                }
+            }
+            boost::ut::expect(ok) << jitome::dump(prog, alloc);
+        }
+    };
+    "schedule"_test = []
+    {
+        // right-heavy: every sqrt is alive until the last one is computed
+        const auto prog = lower_code("(a, b, c, d, e) {sqrt(a) + (sqrt(b) + (sqrt(c) + (sqrt(d) + sqrt(e))))}");
+        const auto sched = jitome::schedule(prog);
+        boost::ut::expect(jitome::max_live(prog)  == 5u) << jitome::dump(prog);
+        boost::ut::expect(jitome::max_live(sched) == 2u) << jitome::dump(sched);
+        boost::ut::expect(sched.code.size() == prog.code.size());
+        for(std::size_t i=0; i<5; ++i)
+        {
+            boost::ut::expect(sched.code.at(i).op == jitome::Opcode::Argument && sched.code.at(i).index == i);
+        }
+
+        jitome::RegisterAllocatorConfig config;
+        config.registers              = 3;
+        config.arguments_in_registers = false;
+        boost::ut::expect(jitome::allocate_registers(prog,  config).spill_slots != 0);
+        boost::ut::expect(jitome::allocate_registers(sched, config).spill_slots == 0);
+
+        // operands keep their positions
+        std::vector<double> values;
+        const double args[] = {2.0, 3.0, 5.0};
+        for(const auto code : {"(a, b, c) {sqrt(a) - (b / (c - sqrt(b * c)))}",
+                               "(a, b, c) {a / (sqrt(b) - (c - sqrt(a * b)) * sqrt(c))}",
+                               "(a, b, c) {(a - b) / (c - (a - sqrt(b - c / a)))}"})
+        {
+            const auto p = lower_code(code);
+            const auto q = jitome::schedule(p);
+            boost::ut::expect(jitome::evaluate(p, args, values) == jitome::evaluate(q, args, values)) << code;
+            boost::ut::expect(jitome::max_live(q) <= jitome::max_live(p)) << code;
+        }
+
+        // outputs stay in order, and a value used by several outputs is computed once
+        std::vector<jitome::NodeFunction> funcs;
+        for(const auto code : {"(a, b) {a - sqrt(b)}", "(a, b) {sqrt(b) / (a * (a + b))}"})
+        {
+            auto tks = jitome::tokenize(code);
+            funcs.push_back(std::get<jitome::NodeFunction>(jitome::parse(tks.as_val()).as_val().node));
+        }
+        const auto multi = jitome::schedule(jitome::lower(funcs));
+        boost::ut::expect(multi.code.size() == jitome::lower(funcs).code.size());
+        double out[2] = {};
+        jitome::evaluate(multi, args, out, values);
+        boost::ut::expect(out[0] == 2.0 - std::sqrt(3.0));
+        boost::ut::expect(out[1] == std::sqrt(3.0) / (2.0 * (2.0 + 3.0)));
+    };
+    return 0;
+}
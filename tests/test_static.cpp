@@ -0,0 +1,141 @@
+#include "jitome/eval.hpp"
+#include "jitome/parser.hpp"
+#include "jitome/static.hpp"
+#include "jitome/tokenizer.hpp"
+#include <boost/ut.hpp>
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace
+{
+
+double reference(const std::string_view code, const double x, const double y)
+{
+    const auto root = jitome::parse(jitome::tokenize(std::string(code)).as_val()).as_val();
+    const auto& func = std::get<jitome::NodeFunction>(root.node);
+    std::map<std::string, double> env{{func.args.at(0), x}, {func.args.at(1), y}};
+    return jitome::evaluate(env, root);
+}
+
+bool same(const double a, const double b)
+{
+    return (std::isnan(a) && std::isnan(b)) || jitome::bit_cast<std::uint64_t>(a) == jitome::bit_cast<std::uint64_t>(b);
+}
+
+// the compiled function is bit-identical to evaluate() on a grid of points
+template<typename Source>
+bool matches_evaluate()
+{
+    const jitome::StaticFunction<Source> f;
+    bool ok = true;
+    for(const double x : {-2.5, -1.0, -0.0, 0.0, 0.3, 1.0, 2.0, 7.25, 1e10})
+    {
+        for(const double y : {-3.0, -0.5, 0.0, 0.1, 1.0, 2.0, 100.0})
+        {
+            const bool same_value = same(f(x, y), reference(Source::value(), x, y));
+            boost::ut::expect(same_value) << Source::value() << x << y;
+            ok = ok && same_value;
+        }
+    }
+    return ok;
+}
+
+#define JITOME_TEST_SOURCE(name, code) \
+    struct name {static constexpr std::string_view value() noexcept {return code;}}
+
+JITOME_TEST_SOURCE(Arithmetic, "(x, y) {(x + 1.5) * y - x / (y + 4) + 2.5e-3}");
+JITOME_TEST_SOURCE(Power,      "(x, y) {x^5 - y^0 + (x + y)^-3 + x^+2}");
+JITOME_TEST_SOURCE(Builtins,   "(x, y) {sqrt(abs(x)) + exp(y) * log(x * x + 1) - sin(x) * cos(y) + sign(x) + min(x, y) * max(x, y)}");
+JITOME_TEST_SOURCE(Conditions, "(x, y) {x < 0 ? 0 : x < y && y > 1 ? x * x : clamp(x, 1, y) + (x == y) - (x != 2) * (x >= y || y <= 0)}");
+JITOME_TEST_SOURCE(Locals,     "(a, b) { t = a*b + 1; /* comment */ t = t*t - t; a; u = select(a - b, t, b); return u / (t + 3); }");
+JITOME_TEST_SOURCE(Shadow,     "(a, b) { a = a + b; b = a * 2; return a - b; }");
+
+} // anonymous
+
+int main()
+{
+    using namespace boost::ut::literals;
+
+    "evaluate"_test = []
+    {
+        boost::ut::expect(matches_evaluate<Arithmetic>());
+        boost::ut::expect(matches_evaluate<Power>());
+        boost::ut::expect(matches_evaluate<Builtins>());
+        boost::ut::expect(matches_evaluate<Conditions>());
+        boost::ut::expect(matches_evaluate<Locals>());
+        boost::ut::expect(matches_evaluate<Shadow>());
+    };
+
+    "constexpr"_test = []
+    {
+        // parsed and evaluated by the compiler
+        constexpr auto f = JITOME_STATIC_FUNCTION("(a, b, c) {a + b * c}");
+        static_assert(decltype(f)::arity == 3);
+        static_assert(f(1.0, 2.0, 3.0) == 7.0);
+
+        constexpr auto g = JITOME_STATIC_FUNCTION("(x) { y = x * x; return y < 10 ? y^3 : 0 - y; }");
+        static_assert(g(2.0) == 64.0);
+        static_assert(g(4.0) == -16.0);
+        static_assert(decltype(g)::tree.num_locals == 1);
+
+        constexpr auto tree = jitome::parse_static("(x, y) {x - 2 * y}");
+        static_assert(tree.arity == 2 && tree.size == 5);
+        static_assert(tree.nodes[tree.body].op == jitome::StaticOp::Sub);
+        static_assert(tree.args[1] == "y");
+    };
+
+    "float"_test = []
+    {
+        constexpr auto f = JITOME_STATIC_FUNCTION("(a, b) {a / b + 0.1}");
+        static_assert(std::is_same_v<decltype(f(1.0f, 3.0f)), float>);
+        static_assert(std::is_same_v<decltype(f(1.0f, 3.0)),  double>);
+        boost::ut::expect(f(1.0f, 3.0f) == 1.0f / 3.0f + 0.1f);
+        boost::ut::expect(f(1.0, 3.0)   == 1.0  / 3.0  + 0.1);
+
+        // a loop over columns
+        std::vector<float> a(1000), b(1000), out(1000);
+        for(std::size_t i=0; i<a.size(); ++i)
+        {
+            a[i] = 0.5f * i;
+            b[i] = 1.0f + i;
+        }
+        for(std::size_t i=0; i<a.size(); ++i)
+        {
+            out[i] = f(a[i], b[i]);
+        }
+        boost::ut::expect(out[999] == 499.5f / 1000.0f + 0.1f);
+    };
+
+    "immediate"_test = []
+    {
+        for(const char* imm : {"0", "0.1", "2.5", "1e-3", "3.14159", "123456789012345678",
+                               "1.7976931348623157e308", "2.2250738585072014e-308", "4.9e-324",
+                               "0.30000000000000004", "1E22", "1e23", "9007199254740993",
+                               "0.000001234", "1e-400"})
+        {
+            std::istringstream iss(imm);
+            double expected = 0.0;
+            iss >> expected;
+            boost::ut::expect(jitome::static_immediate(imm) == expected) << imm;
+        }
+        boost::ut::expect(std::isinf(jitome::static_immediate("1e400")));
+    };
+
+    "error"_test = []
+    {
+        for(const char* code : {"", "x + 1", "(x) x", "(x) {x +}", "(x) {y}", "(x) {x^2.5}",
+                                "(x) {x^2^3}", "(x) {foo(x)}", "(x) {min(x)}", "(x) {(x}",
+                                "(x) {x ? x}", "(x) {t = x;}", "(x) {x} x", "(x) {1.}",
+                                "(x) {x # 1}", "(x, ) {x}"})
+        {
+            boost::ut::expect(boost::ut::throws<std::invalid_argument>([code] {
+                    jitome::parse_static(code);
+                })) << code;
+        }
+    };
+}
@@ -1,6 +1,8 @@
 #include <iostream>
 #include <jitome/tokenizer.hpp>
 #include <boost/ut.hpp>
+#include <string>
+#include <vector>
 
 int main()
 {
@@ -213,6 +215,13 @@ int main()
         auto begin4 = test4->begin();
         const auto actual4 = jitome::scan_operator(begin4, test4->end(), test4);
         boost::ut::expect(actual4.is_err());
+
+        const auto test5 = std::make_shared<std::string>("^2");
+        auto begin5 = test5->begin();
+        const auto actual5 = jitome::scan_operator(begin5, test5->end(), test5).as_val();
+        boost::ut::expect(actual5.kind == jitome::TokenKind::Operator);
+        boost::ut::expect(actual5.str == "^");
+        boost::ut::expect(actual5.len == 1);
     };
 
     "scan_token"_test = []
@@ -309,5 +318,55 @@ int main()
         }
     };
 
+    "statements"_test = []
+    {
+        const auto actual = jitome::tokenize("t = a;return(t)");
+        boost::ut::expect(actual.is_ok());
+
+        const auto actual1 = actual.as_val();
+
+        boost::ut::expect(actual1.size() == 8);
+        boost::ut::expect(actual1.at(0).kind == jitome::TokenKind::Identifier);
+        boost::ut::expect(actual1.at(1).kind == jitome::TokenKind::Operator);
+        boost::ut::expect(actual1.at(2).kind == jitome::TokenKind::Identifier);
+        boost::ut::expect(actual1.at(3).kind == jitome::TokenKind::Semicolon);
+        boost::ut::expect(actual1.at(4).kind == jitome::TokenKind::Keyword);
+        boost::ut::expect(actual1.at(5).kind == jitome::TokenKind::LeftParen);
+
+        boost::ut::expect(actual1.at(1).str == "=");
+        boost::ut::expect(actual1.at(3).str == ";");
+        boost::ut::expect(actual1.at(4).str == "return");
+
+        // an identifier that starts with `return` is not a keyword
+        const auto ident = jitome::tokenize("returns");
+        boost::ut::expect(ident.as_val().at(0).kind == jitome::TokenKind::Identifier);
+    };
+
+    "conditions"_test = []
+    {
+        const auto actual = jitome::tokenize("a<=b&&c!=d||e==f?g<h:i>=j>k");
+        boost::ut::expect(actual.is_ok());
+
+        const std::vector<std::string> ops = {"<=", "&&", "!=", "||", "==", "?", "<", ":", ">=", ">"};
+        std::vector<std::string> found;
+        for(const auto& tk : actual.as_val())
+        {
+            if(tk.kind == jitome::TokenKind::Operator)
+            {
+                found.emplace_back(tk.str);
+            }
+        }
+        boost::ut::expect(found == ops);
+        boost::ut::expect(actual.as_val().size() == 21u);
+
+        // `=` alone is still an assignment
+        boost::ut::expect(jitome::tokenize("t = a == b").as_val().at(1).str == "=");
+
+        for(const auto code : {"a ! b", "a & b", "a | b"})
+        {
+            boost::ut::expect(jitome::tokenize(code).is_err()) << code;
+        }
+    };
+
     return 0;
 }